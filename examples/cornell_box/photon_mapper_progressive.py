@@ -0,0 +1,36 @@
+#! /usr/bin/env python
+
+# Demonstration of the classic cornell box using the PhotonMapper in progressive mode.
+# Each pass shoots a fresh batch of photons with a smaller estimation radius,
+# so the render keeps improving with constant memory until the time budget runs out.
+#
+# LiAR isn't a raytracer
+# Copyright (C) 2004-2024  Bram de Greve (bramz@users.sourceforge.net)
+# http://liar.bramz.net/
+
+from liar import *
+from liar.tools import cornell_box, scripting
+
+options = scripting.renderOptions(
+    size=800, photons_per_pass=100000, radius_reduction=0.7, time_budget=300.0
+)
+
+photonMapper = tracers.PhotonMapper()
+photonMapper.photonsPerPass = options.photons_per_pass
+photonMapper.radiusReduction = options.radius_reduction
+photonMapper.isRayTracingDirect = True
+photonMapper.numFinalGatherRays = 0
+
+engine = RenderEngine()
+engine.tracer = photonMapper
+engine.sampler = samplers.Halton()
+engine.timeBudget = options.time_budget
+engine.scene = cornell_box.scene()
+engine.camera = cornell_box.camera()
+engine.target = scripting.makeRenderTarget(
+    options.size,
+    options.size,
+    "photon_mapper_progressive.hdr",
+    "Classic Cornell box with progressive PhotonMapper",
+)
+engine.render()
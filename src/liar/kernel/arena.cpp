@@ -0,0 +1,147 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "arena.h"
+
+namespace liar
+{
+namespace kernel
+{
+
+namespace
+{
+	thread_local Arena* currentArena = nullptr;
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+Arena::Arena(size_t blockSize):
+	blockSize_(std::max<size_t>(blockSize, 1024)),
+	block_(0),
+	offset_(0),
+	numHeapAllocations_(0)
+{
+}
+
+
+
+Arena::~Arena()
+{
+	LASS_ASSERT(currentArena != this);
+}
+
+
+
+/** Allocate @a size bytes, aligned to @a alignment, which must be a power of two.
+ *  Continues in the next block if the current one is full, and only goes to the heap if there isn't one.
+ */
+void* Arena::allocate(size_t size, size_t alignment)
+{
+	LASS_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	while (block_ < blocks_.size())
+	{
+		Block& block = blocks_[block_];
+		const size_t address = reinterpret_cast<size_t>(block.data.get()) + offset_;
+		const size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+		if (offset_ + padding + size <= block.size)
+		{
+			void* result = block.data.get() + offset_ + padding;
+			offset_ += padding + size;
+			return result;
+		}
+		++block_;
+		offset_ = 0;
+	}
+
+	Block block;
+	block.size = std::max(blockSize_, size + alignment);
+	block.data.reset(new char[block.size]);
+	++numHeapAllocations_;
+	blocks_.push_back(std::move(block));
+	block_ = blocks_.size() - 1;
+	offset_ = 0;
+	return allocate(size, alignment);
+}
+
+
+
+size_t Arena::numHeapAllocations() const
+{
+	return numHeapAllocations_;
+}
+
+
+
+size_t Arena::capacity() const
+{
+	size_t result = 0;
+	for (const Block& block : blocks_)
+	{
+		result += block.size;
+	}
+	return result;
+}
+
+
+
+/** The arena of the innermost Scope of the calling thread, or null if there's none.
+ */
+Arena* Arena::current()
+{
+	return currentArena;
+}
+
+
+
+// --- Scope ---------------------------------------------------------------------------------------
+
+Arena::Scope::Scope(Arena& arena):
+	arena_(arena),
+	previous_(currentArena),
+	block_(arena.block_),
+	offset_(arena.offset_)
+{
+	currentArena = &arena;
+}
+
+
+
+Arena::Scope::~Scope()
+{
+	arena_.block_ = block_;
+	arena_.offset_ = offset_;
+	currentArena = previous_;
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,102 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::Arena
+ *  @brief per thread bump allocator for short lived temporaries of the sample pipeline.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Memory is carved out of large blocks by simply bumping an offset, and is never given back
+ *  individually.  Instead, an Arena::Scope remembers the offset on construction and rewinds to it
+ *  on destruction, so that everything allocated within that scope is released at once.  Blocks
+ *  are kept for reuse, so once an arena has grown to its working size, it doesn't need the heap
+ *  anymore.  numHeapAllocations() counts how often it did.
+ *
+ *  A Scope also makes its arena the current one of the calling thread, so that code deep down the
+ *  pipeline, like Bsdf::operator new, can find it without it being passed around.
+ *
+ *  An arena is not thread safe, and isn't meant to be: each render thread owns its own.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_ARENA_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_ARENA_H
+
+#include "kernel_common.h"
+#include <lass/util/non_copyable.h>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL Arena: util::NonCopyable
+{
+public:
+
+	enum { defaultBlockSize = 64 * 1024 };
+
+	class LIAR_KERNEL_DLL Scope: util::NonCopyable
+	{
+	public:
+		explicit Scope(Arena& arena);
+		~Scope();
+	private:
+		Arena& arena_;
+		Arena* previous_;
+		size_t block_;
+		size_t offset_;
+	};
+
+	explicit Arena(size_t blockSize = defaultBlockSize);
+	~Arena();
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	size_t numHeapAllocations() const;
+	size_t capacity() const;
+
+	static Arena* current();
+
+private:
+
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	typedef std::vector<Block> TBlocks;
+
+	TBlocks blocks_;
+	size_t blockSize_;
+	size_t block_;
+	size_t offset_;
+	size_t numHeapAllocations_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
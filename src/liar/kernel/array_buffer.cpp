@@ -0,0 +1,387 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "array_buffer.h"
+#include <bit>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace liar
+{
+namespace kernel
+{
+
+// --- public --------------------------------------------------------------------------------------
+
+ArrayBuffer::ArrayBuffer(const TPyObjectPtr& object, const char* name):
+	name_(name)
+{
+	if (PyObject_GetBuffer(object.get(), &view_, PyBUF_RECORDS_RO) != 0)
+	{
+		python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+	}
+
+	// format is a single struct character, optionally preceded by a byte order.
+	const char* format = view_.format ? view_.format : "B";
+	const char order = *format;
+	if (order == '@' || order == '=' || order == '<' || order == '>' || order == '!')
+	{
+		const bool isBigEndian = order == '>' || order == '!';
+		if (isBigEndian != (std::endian::native == std::endian::big))
+		{
+			PyBuffer_Release(&view_);
+			LASS_THROW(name_ << ": arrays with non-native byte order are not supported.");
+		}
+		++format;
+	}
+	const size_t itemSize = static_cast<size_t>(view_.itemsize);
+	const bool isSupportedSize = itemSize == 1 || itemSize == 2 || itemSize == 4 || itemSize == 8;
+	if (format[0] && !format[1] && std::strchr("bhilqn", format[0]) && isSupportedSize)
+	{
+		kind_ = kSigned;
+	}
+	else if (format[0] && !format[1] && std::strchr("BHILQN", format[0]) && isSupportedSize)
+	{
+		kind_ = kUnsigned;
+	}
+	else if ((format[0] == 'f' || format[0] == 'd') && !format[1] && (itemSize == 4 || itemSize == 8))
+	{
+		kind_ = kFloat;
+	}
+	else
+	{
+		const std::string unsupported = view_.format ? view_.format : "";
+		PyBuffer_Release(&view_);
+		LASS_THROW(name_ << ": arrays of type '" << unsupported << "' are not supported.");
+	}
+}
+
+
+
+ArrayBuffer::~ArrayBuffer()
+{
+	PyBuffer_Release(&view_);
+}
+
+
+
+size_t ArrayBuffer::ndim() const
+{
+	return static_cast<size_t>(view_.ndim);
+}
+
+
+
+size_t ArrayBuffer::shape(size_t axis) const
+{
+	LASS_ASSERT(axis < ndim());
+	return static_cast<size_t>(view_.shape[axis]);
+}
+
+
+
+size_t ArrayBuffer::size() const
+{
+	return static_cast<size_t>(view_.len / view_.itemsize);
+}
+
+
+
+bool ArrayBuffer::isFloatingPoint() const
+{
+	return kind_ == kFloat;
+}
+
+
+
+/** @a shape1 must match, @a shape0 only if it isn't zero.
+ */
+void ArrayBuffer::enforceShape(size_t shape0, size_t shape1) const
+{
+	if (ndim() != 2 || (shape0 && shape(0) != shape0) || shape(1) != shape1)
+	{
+		LASS_THROW(name_ << ": expected array of shape (" << (shape0 ? std::to_string(shape0) : "n") << ", " << shape1 << ").");
+	}
+}
+
+
+
+/** @a shape1 and @a shape2 must match, @a shape0 only if it isn't zero.
+ */
+void ArrayBuffer::enforceShape(size_t shape0, size_t shape1, size_t shape2) const
+{
+	if (ndim() != 3 || (shape0 && shape(0) != shape0) || shape(1) != shape1 || shape(2) != shape2)
+	{
+		LASS_THROW(name_ << ": expected array of shape (" << (shape0 ? std::to_string(shape0) : "n") << ", " << shape1 << ", " << shape2 << ").");
+	}
+}
+
+
+
+/** copies all elements in C order, converting them to float.
+ */
+void ArrayBuffer::copyTo(float* dest) const
+{
+	copyElements(dest);
+}
+
+
+
+/** copies all elements in C order, converting them to double.
+ */
+void ArrayBuffer::copyTo(double* dest) const
+{
+	copyElements(dest);
+}
+
+
+
+/** copies all elements in C order, converting them to 64-bit integers.
+ *  Floating point elements are not accepted.
+ */
+void ArrayBuffer::copyTo(num::Tint64* dest) const
+{
+	if (kind_ == kFloat)
+	{
+		LASS_THROW(name_ << ": expected array of integers.");
+	}
+	copyElements(dest);
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+template <typename T>
+void ArrayBuffer::copyElements(T* dest) const
+{
+	switch (kind_)
+	{
+	case kSigned:
+		switch (view_.itemsize)
+		{
+		case 1: return convertElements<T, num::Tint8>(dest);
+		case 2: return convertElements<T, num::Tint16>(dest);
+		case 4: return convertElements<T, num::Tint32>(dest);
+		default: return convertElements<T, num::Tint64>(dest);
+		}
+	case kUnsigned:
+		switch (view_.itemsize)
+		{
+		case 1: return convertElements<T, num::Tuint8>(dest);
+		case 2: return convertElements<T, num::Tuint16>(dest);
+		case 4: return convertElements<T, num::Tuint32>(dest);
+		default: return convertElements<T, num::Tuint64>(dest);
+		}
+	default:
+		if (view_.itemsize == 4)
+		{
+			return convertElements<T, num::Tfloat32>(dest);
+		}
+		return convertElements<T, num::Tfloat64>(dest);
+	}
+}
+
+
+
+/** Contiguous arrays of the right type are copied in one go.  Others are walked element by
+ *  element, following the strides of each axis.
+ */
+template <typename T, typename S>
+void ArrayBuffer::convertElements(T* dest) const
+{
+	const size_t n = size();
+	if (PyBuffer_IsContiguous(&view_, 'C'))
+	{
+		if constexpr (std::is_same_v<T, S>)
+		{
+			std::memcpy(dest, view_.buf, n * sizeof(T));
+		}
+		else
+		{
+			const S* source = static_cast<const S*>(view_.buf);
+			for (size_t i = 0; i < n; ++i)
+			{
+				dest[i] = static_cast<T>(source[i]);
+			}
+		}
+		return;
+	}
+
+	const size_t dims = ndim();
+	std::vector<Py_ssize_t> index(dims, 0);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const char* p = static_cast<const char*>(view_.buf);
+		for (size_t k = 0; k < dims; ++k)
+		{
+			p += index[k] * view_.strides[k];
+		}
+		S x;
+		std::memcpy(&x, p, sizeof(S));
+		dest[i] = static_cast<T>(x);
+		for (size_t k = dims; k-- > 0; )
+		{
+			if (++index[k] < view_.shape[k])
+			{
+				break;
+			}
+			index[k] = 0;
+		}
+	}
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+namespace
+{
+
+/** python object exposing memory of an owner through the buffer protocol.
+ */
+struct ArrayView
+{
+	PyObject_HEAD
+	PyObject* owner;
+	const void* data;
+	const char* format;
+	Py_ssize_t itemSize;
+	Py_ssize_t ndim;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+	TArrayViewRelease release;
+};
+
+int arrayViewGetBuffer(PyObject* self, Py_buffer* view, int flags)
+{
+	ArrayView* array = reinterpret_cast<ArrayView*>(self);
+	if (flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "array is read-only");
+		view->obj = nullptr;
+		return -1;
+	}
+	Py_ssize_t len = array->itemSize;
+	for (Py_ssize_t k = 0; k < array->ndim; ++k)
+	{
+		len *= array->shape[k];
+	}
+	view->buf = const_cast<void*>(array->data);
+	view->obj = self;
+	Py_INCREF(self);
+	view->len = len;
+	view->readonly = 1;
+	view->itemsize = array->itemSize;
+	view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(array->format) : nullptr;
+	view->ndim = static_cast<int>(array->ndim);
+	view->shape = (flags & PyBUF_ND) ? array->shape : nullptr;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? array->strides : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
+}
+
+void arrayViewDealloc(PyObject* self)
+{
+	ArrayView* array = reinterpret_cast<ArrayView*>(self);
+	if (array->release)
+	{
+		array->release(array->owner);
+	}
+	Py_XDECREF(array->owner);
+	PyTypeObject* type = Py_TYPE(self);
+	type->tp_free(self);
+	Py_DECREF(type);
+}
+
+PyTypeObject* arrayViewType()
+{
+	static PyTypeObject* type = nullptr;
+	if (!type)
+	{
+		static PyType_Slot slots[] =
+		{
+			{ Py_bf_getbuffer, reinterpret_cast<void*>(arrayViewGetBuffer) },
+			{ Py_tp_dealloc, reinterpret_cast<void*>(arrayViewDealloc) },
+			{ Py_tp_doc, const_cast<char*>("read-only array, use numpy.asarray to access it without copying") },
+			{ 0, nullptr },
+		};
+		static PyType_Spec spec =
+		{
+			"liar.kernel.ArrayView",
+			sizeof(ArrayView),
+			0,
+			Py_TPFLAGS_DEFAULT,
+			slots,
+		};
+		type = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&spec));
+		if (!type)
+		{
+			python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+		}
+	}
+	return type;
+}
+
+}
+
+/** exposes @a data of @a owner as a read-only, C contiguous array of shape (shape0, shape1) or
+ *  (shape0, shape1, shape2).
+ *
+ *  @a owner is kept alive as long as the view is, but it must not reallocate @a data meanwhile.
+ *  Owners that can, must count their views and refuse to do so while there are any.  @a release
+ *  is called when a view goes away.
+ */
+TPyObjectPtr makeArrayView(const TPyObjectPtr& owner, const void* data,
+	const char* format, size_t itemSize, size_t shape0, size_t shape1, size_t shape2, TArrayViewRelease release)
+{
+	PyTypeObject* type = arrayViewType();
+	ArrayView* array = reinterpret_cast<ArrayView*>(type->tp_alloc(type, 0));
+	if (!array)
+	{
+		python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+	}
+	array->owner = owner.get();
+	Py_XINCREF(array->owner);
+	array->data = data;
+	array->format = format;
+	array->itemSize = static_cast<Py_ssize_t>(itemSize);
+	array->ndim = shape2 ? 3 : 2;
+	array->shape[0] = static_cast<Py_ssize_t>(shape0);
+	array->shape[1] = static_cast<Py_ssize_t>(shape1);
+	array->shape[2] = static_cast<Py_ssize_t>(shape2);
+	array->strides[2] = array->itemSize;
+	array->strides[1] = array->ndim == 3 ? array->shape[2] * array->itemSize : array->itemSize;
+	array->strides[0] = array->shape[1] * array->strides[1];
+	array->release = release;
+	return TPyObjectPtr(reinterpret_cast<PyObject*>(array));
+}
+
+}
+
+}
+
+// EOF
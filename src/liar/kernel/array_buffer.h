@@ -0,0 +1,108 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::ArrayBuffer
+ *  @brief read access to objects that support Python's buffer protocol, like numpy arrays.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  The elements are converted in C++, without going through Python objects.  If the array already
+ *  has the layout of the destination, it's copied in one go.
+ *
+ *  makeArrayView does the opposite: it exposes memory to Python as a read-only array, that numpy
+ *  can wrap without copying.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_ARRAY_BUFFER_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_ARRAY_BUFFER_H
+
+#include "kernel_common.h"
+#include <lass/util/non_copyable.h>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL ArrayBuffer: util::NonCopyable
+{
+public:
+
+	ArrayBuffer(const TPyObjectPtr& object, const char* name);
+	~ArrayBuffer();
+
+	size_t ndim() const;
+	size_t shape(size_t axis) const;
+	size_t size() const;
+	bool isFloatingPoint() const;
+
+	void enforceShape(size_t shape0, size_t shape1) const;
+	void enforceShape(size_t shape0, size_t shape1, size_t shape2) const;
+
+	void copyTo(float* dest) const;
+	void copyTo(double* dest) const;
+	void copyTo(num::Tint64* dest) const;
+
+private:
+
+	enum Kind
+	{
+		kSigned,
+		kUnsigned,
+		kFloat,
+	};
+
+	template <typename T> void copyElements(T* dest) const;
+	template <typename T, typename S> void convertElements(T* dest) const;
+
+	Py_buffer view_;
+	std::string name_;
+	Kind kind_;
+};
+
+/** called when the last view on the memory of @a owner is released. */
+typedef void (*TArrayViewRelease)(PyObject* owner);
+
+template <typename T> struct ArrayFormat;
+template <> struct ArrayFormat<float> { static const char* format() { return "f"; } };
+template <> struct ArrayFormat<double> { static const char* format() { return "d"; } };
+template <> struct ArrayFormat<num::Tint64> { static const char* format() { return "q"; } };
+
+LIAR_KERNEL_DLL TPyObjectPtr makeArrayView(const TPyObjectPtr& owner, const void* data,
+	const char* format, size_t itemSize, size_t shape0, size_t shape1, size_t shape2 = 0, TArrayViewRelease release = 0);
+
+/** exposes @a count rows of @a columns values of type T, owned by @a owner.
+ *  @a owner is kept alive as long as the view is.
+ */
+template <typename T>
+TPyObjectPtr makeArrayView(const TPyObjectPtr& owner, const T* data, size_t count, size_t columns, TArrayViewRelease release = 0)
+{
+	return makeArrayView(owner, data, ArrayFormat<T>::format(), sizeof(T), count, columns, 0, release);
+}
+
+}
+
+}
+
+#endif
+
+// EOF
@@ -23,6 +23,7 @@
 
 #include "kernel_common.h"
 #include "bsdf.h"
+#include "arena.h"
 #include "intersection_context.h"
 #include "shader.h"
 
@@ -31,8 +32,60 @@ namespace liar
 namespace kernel
 {
 
+namespace
+{
+	TBsdfAllocator& bsdfAllocator()
+	{
+		static TBsdfAllocator allocator;
+		return allocator;
+	}
+
+	/** Each Bsdf is preceded by a header that records where it was allocated.  Asking the current arena whether
+	 *  it owns a pointer isn't good enough: a Bsdf can be deleted while another arena's scope is active.
+	 */
+	enum class BsdfOrigin: unsigned char
+	{
+		allocator,
+		arena,
+	};
+
+	constexpr size_t bsdfHeaderSize = alignof(std::max_align_t);
+}
+
 // --- public --------------------------------------------------------------------------------------
 
+void* Bsdf::operator new(std::size_t size)
+{
+	char* block;
+	BsdfOrigin origin;
+	if (Arena* arena = Arena::current())
+	{
+		block = static_cast<char*>(arena->allocate(bsdfHeaderSize + size, 64));
+		origin = BsdfOrigin::arena;
+	}
+	else
+	{
+		block = static_cast<char*>(bsdfAllocator().allocate(bsdfHeaderSize + size));
+		origin = BsdfOrigin::allocator;
+	}
+	*reinterpret_cast<BsdfOrigin*>(block) = origin;
+	return block + bsdfHeaderSize;
+}
+
+
+
+void Bsdf::operator delete(void* p, std::size_t size)
+{
+	char* block = static_cast<char*>(p) - bsdfHeaderSize;
+	if (*reinterpret_cast<const BsdfOrigin*>(block) == BsdfOrigin::arena)
+	{
+		return; // released when the arena's scope ends.
+	}
+	bsdfAllocator().deallocate(block, bsdfHeaderSize + size);
+}
+
+
+
 Bsdf::Bsdf(const Sample& sample, const IntersectionContext& context, BsdfCaps caps):
 	omegaGeometricNormal_(context.localToBsdf().normalTransform(context.geometricNormal())),
 	sample_(sample),
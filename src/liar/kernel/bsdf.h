@@ -146,10 +146,15 @@ inline constexpr bool compatibleCaps(BsdfCaps capsUnderTest, BsdfCaps allowedCap
 
 
 
-class LIAR_KERNEL_DLL Bsdf: public util::AllocatorClassAdaptor<TBsdfAllocator>
+/** Bsdfs live in the Arena of the calling thread, if it has one.  Otherwise, they fall back to TBsdfAllocator.
+ */
+class LIAR_KERNEL_DLL Bsdf
 {
 public:
 
+	static void* operator new(std::size_t size);
+	static void operator delete(void* p, std::size_t size);
+
 	Bsdf(const Sample& sample, const IntersectionContext& context, BsdfCaps caps);
 	virtual ~Bsdf();
 
@@ -0,0 +1,332 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "bvh_tree.h"
+#include <lass/util/thread.h>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+namespace liar
+{
+namespace kernel
+{
+
+namespace
+{
+
+	std::atomic<size_t> buildThreads { 0 };
+	std::atomic<std::ptrdiff_t> sharedIdleThreads { 0 };
+	std::atomic<size_t> numSharedBudgets { 0 };
+	std::atomic<double> refitCostGrowth { 1.5 };
+	std::mutex statisticsMutex;
+	BvhTreeBase::Statistics totalStatistics;
+	std::mutex cacheMutex;
+	std::filesystem::path cacheRoot;
+
+	const char cacheMagic[8] = { 'L', 'I', 'A', 'R', 'B', 'V', 'H', 0 };
+
+	std::filesystem::path cachePath(const std::filesystem::path& directory, const std::uint64_t key[2])
+	{
+		std::ostringstream name;
+		name << "bvh-" << std::hex << std::setfill('0') << std::setw(16) << key[0] << std::setw(16) << key[1] << ".bin";
+		return directory / name.str();
+	}
+
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+BvhTreeBase::Statistics& BvhTreeBase::Statistics::operator+=(const Statistics& other)
+{
+	numBuilds += other.numBuilds;
+	numCacheHits += other.numCacheHits;
+	numRefits += other.numRefits;
+	numObjects += other.numObjects;
+	numNodes += other.numNodes;
+	numLeaves += other.numLeaves;
+	maxDepth = std::max(maxDepth, other.maxDepth);
+	buildTime += other.buildTime;
+	refitTime += other.refitTime;
+	return *this;
+}
+
+
+
+/** Adds @a numberOfThreads to the budget.  Budgets that are alive at the same time are pooled.
+ */
+BvhTreeBase::SharedBuildThreads::SharedBuildThreads(size_t numberOfThreads):
+	numberOfThreads_(static_cast<std::ptrdiff_t>(std::max<size_t>(numberOfThreads, 1)))
+{
+	sharedIdleThreads.fetch_add(numberOfThreads_);
+	++numSharedBudgets;
+}
+
+
+
+/** Takes the threads out of the budget again.  By then, all of them must have been lent back.
+ */
+BvhTreeBase::SharedBuildThreads::~SharedBuildThreads()
+{
+	--numSharedBudgets;
+	sharedIdleThreads.fetch_sub(numberOfThreads_);
+}
+
+
+
+/** Gives the calling thread back to the budget, so that builds can use it while it's idle.
+ */
+void BvhTreeBase::SharedBuildThreads::lend()
+{
+	sharedIdleThreads.fetch_add(1);
+}
+
+
+
+/** Takes the calling thread from the budget before it runs builds of its own.
+ */
+void BvhTreeBase::SharedBuildThreads::reclaim()
+{
+	sharedIdleThreads.fetch_sub(1);
+}
+
+
+
+/** Number of threads a build may use.  Unless set otherwise, that's all available processors.
+ */
+size_t BvhTreeBase::numberOfBuildThreads()
+{
+	const size_t number = buildThreads.load();
+	return number > 0 ? number : std::max<size_t>(util::numberOfAvailableProcessors(), 1);
+}
+
+
+
+/** Sets the number of threads a build may use, or 0 to use all available processors.
+ */
+void BvhTreeBase::setNumberOfBuildThreads(size_t number)
+{
+	buildThreads = number;
+}
+
+
+
+BvhTreeBase::Statistics BvhTreeBase::accumulatedStatistics()
+{
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	return totalStatistics;
+}
+
+
+
+void BvhTreeBase::resetAccumulatedStatistics()
+{
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	totalStatistics = Statistics();
+}
+
+
+
+std::filesystem::path BvhTreeBase::cacheDirectory()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return cacheRoot;
+}
+
+
+
+/** Sets the directory where built trees are cached, or an empty path to disable caching.
+ *  The directory is created when the first tree is stored.
+ */
+void BvhTreeBase::setCacheDirectory(const std::filesystem::path& directory)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	cacheRoot = directory;
+}
+
+
+
+/** How much refit() may increase the SAH cost of a tree, relative to when it was built, before it's
+ *  rebuilt instead.
+ */
+double BvhTreeBase::maxRefitCostGrowth()
+{
+	return refitCostGrowth.load();
+}
+
+
+
+void BvhTreeBase::setMaxRefitCostGrowth(double factor)
+{
+	LASS_ENFORCE(factor >= 1);
+	refitCostGrowth = factor;
+}
+
+
+
+// --- protected -----------------------------------------------------------------------------------
+
+BvhTreeBase::CacheHeader::CacheHeader(size_t valueSize, size_t dimension, size_t nodeSize, size_t numObjects):
+	version(cacheVersion),
+	valueSize(static_cast<std::uint32_t>(valueSize)),
+	dimension(static_cast<std::uint32_t>(dimension)),
+	nodeSize(static_cast<std::uint32_t>(nodeSize)),
+	numObjects(numObjects),
+	numNodes(0),
+	numLeaves(0),
+	maxDepth(0)
+{
+	static_assert(sizeof(CacheHeader) <= cacheHeaderSize, "CacheHeader doesn't fit");
+	std::memcpy(magic, cacheMagic, sizeof(magic));
+	key[0] = key[1] = 0;
+}
+
+
+
+
+void BvhTreeBase::accumulate(const Statistics& statistics)
+{
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	totalStatistics += statistics;
+}
+
+
+
+/** The idle threads of the SharedBuildThreads budgets, or nullptr if there are none.
+ */
+std::atomic<std::ptrdiff_t>* BvhTreeBase::sharedIdleBuildThreads()
+{
+	return numSharedBudgets.load() > 0 ? &sharedIdleThreads : nullptr;
+}
+
+
+
+/** Mixes @a value into @a seed, using the finalizer of MurmurHash3.
+ */
+std::uint64_t BvhTreeBase::hash(std::uint64_t seed, std::uint64_t value)
+{
+	std::uint64_t h = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+
+/** Maps the cached tree with the same key in memory, if there is one and if it matches @a expected.
+ *  Returns null otherwise.  Failing to read the cache is never an error, the tree is just built again.
+ */
+BvhTreeBase::TMappedFilePtr BvhTreeBase::loadCache(const std::filesystem::path& directory, const CacheHeader& expected)
+{
+	const std::filesystem::path path = cachePath(directory, expected.key);
+	std::error_code error;
+	if (!std::filesystem::is_regular_file(path, error))
+	{
+		return TMappedFilePtr();
+	}
+	TMappedFilePtr file;
+	try
+	{
+		file.reset(new MappedFile(path));
+	}
+	catch (const std::exception& e)
+	{
+		LASS_CERR << "warning: failed to read BVH cache: " << e.what() << std::endl;
+		return TMappedFilePtr();
+	}
+	if (file->size() < cacheHeaderSize)
+	{
+		return TMappedFilePtr();
+	}
+	const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(file->data());
+	const bool isMatch = std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+		header.version == expected.version &&
+		header.valueSize == expected.valueSize &&
+		header.dimension == expected.dimension &&
+		header.nodeSize == expected.nodeSize &&
+		header.key[0] == expected.key[0] &&
+		header.key[1] == expected.key[1] &&
+		header.numObjects == expected.numObjects;
+	if (!isMatch || header.numNodes == 0 || header.numNodes > file->size() / header.nodeSize)
+	{
+		return TMappedFilePtr();
+	}
+	const std::uint64_t size = cacheHeaderSize + header.numNodes * header.nodeSize + header.numObjects * sizeof(std::uint32_t);
+	if (size != file->size())
+	{
+		return TMappedFilePtr();
+	}
+	return file;
+}
+
+
+
+/** Stores a tree in the cache.  It's written to a temporary file first, which is then renamed, so
+ *  that other processes never see a half written one.  Failures are reported, but not thrown.
+ */
+void BvhTreeBase::saveCache(const std::filesystem::path& directory, const CacheHeader& header,
+		const void* nodes, size_t nodesSize, const void* indices, size_t indicesSize)
+{
+	const std::filesystem::path path = cachePath(directory, header.key);
+	std::ostringstream suffix;
+	suffix << ".tmp" << std::hex << std::random_device()();
+	std::filesystem::path temp = path;
+	temp += suffix.str();
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	{
+		char buffer[cacheHeaderSize] = { 0 };
+		std::memcpy(buffer, &header, sizeof(CacheHeader));
+		std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+		file.write(buffer, cacheHeaderSize);
+		file.write(static_cast<const char*>(nodes), static_cast<std::streamsize>(nodesSize));
+		file.write(static_cast<const char*>(indices), static_cast<std::streamsize>(indicesSize));
+		if (!file.good())
+		{
+			LASS_CERR << "warning: failed to write BVH cache " << temp.string() << std::endl;
+			file.close();
+			std::filesystem::remove(temp, error);
+			return;
+		}
+	}
+	std::filesystem::rename(temp, path, error);
+	if (error)
+	{
+		// most likely, another process has just stored the same tree.
+		std::filesystem::remove(temp, error);
+	}
+}
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,379 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::BvhTree
+ *  @brief a four-wide bounding volume hierarchy, built with binned SAH on all cores.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  BvhTree has the same template arguments and interface as lass::spat::QbvhTree, so that it can be
+ *  plugged in prim::TriangleMesh3D and ObjectTree in its place.  The SplitHeuristics argument is
+ *  only there for that compatibility: splits are always found by binning the object centroids in
+ *  numBins bins per axis, and evaluating the surface area heuristic at the bin boundaries.
+ *
+ *  The build is parallel on three levels.  The bounds of the objects are computed in parallel
+ *  chunks.  Ranges with many objects are binned and partitioned in parallel chunks too.  And once a
+ *  range is split, both halves are built as separate tasks.  This yields a binary tree, which is
+ *  then collapsed into a four-wide one by pulling up grandchildren.
+ *
+ *  Each build is added to accumulatedStatistics(), so that the render engine can report on them.
+ *
+ *  Several trees can be built at once, each by its own thread.  To keep them from each taking all
+ *  processors, those threads can share a budget with SharedBuildThreads: the builds then only get
+ *  extra threads for as long as the budget has idle ones.
+ *
+ *  If a cache directory is set, built trees are stored there, in a file named after a hash of the
+ *  bounds of the objects.  That's all a tree depends on, so next time the same objects are
+ *  given, the file is simply mapped in memory instead of building the tree again.  The nodes are
+ *  used straight from the mapping, only the reordered object iterators are rebuilt.
+ *
+ *  Up to packetSize coherent rays can traverse the tree together with intersectPacketLeaves.  Each
+ *  node is then visited once for all of them, and its children are tested against all rays at
+ *  once.  A child is only entered with the rays that hit it.  intersectsPacketLeaves does the same
+ *  for shadow rays, and drops each ray from the packet as soon as it's blocked.
+ *
+ *  Objects that move without changing otherwise, like the triangles of a deforming mesh, can be
+ *  refitted: the structure is kept and only the bounds are updated.  As that degrades the tree,
+ *  it's rebuilt anyway once its cost() grows too much, see maxRefitCostGrowth().
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_BVH_TREE_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_BVH_TREE_H
+
+#include "kernel_common.h"
+#include "mapped_file.h"
+#include <lass/util/non_copyable.h>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL BvhTreeBase
+{
+public:
+
+	struct Statistics
+	{
+		size_t numBuilds = 0;
+		size_t numCacheHits = 0;
+		size_t numRefits = 0;
+		size_t numObjects = 0;
+		size_t numNodes = 0;
+		size_t numLeaves = 0;
+		size_t maxDepth = 0;
+		TTimeDelta buildTime = 0;
+		TTimeDelta refitTime = 0;
+
+		Statistics& operator+=(const Statistics& other);
+	};
+
+	/** Threads shared by builds that run at the same time, for as long as this is alive.
+	 *
+	 *  Each thread that runs builds takes one of the budget with reclaim, and gives it back with
+	 *  lend while it's idle or done.  The builds only spawn extra threads while others are lent.
+	 */
+	class LIAR_KERNEL_DLL SharedBuildThreads: util::NonCopyable
+	{
+	public:
+		explicit SharedBuildThreads(size_t numberOfThreads);
+		~SharedBuildThreads();
+		void lend();
+		void reclaim();
+	private:
+		std::ptrdiff_t numberOfThreads_;
+	};
+
+	static size_t numberOfBuildThreads();
+	static void setNumberOfBuildThreads(size_t number);
+
+	static Statistics accumulatedStatistics();
+	static void resetAccumulatedStatistics();
+
+	static std::filesystem::path cacheDirectory();
+	static void setCacheDirectory(const std::filesystem::path& directory);
+
+	static double maxRefitCostGrowth();
+	static void setMaxRefitCostGrowth(double factor);
+
+protected:
+
+	typedef std::shared_ptr<const MappedFile> TMappedFilePtr;
+
+	enum
+	{
+		cacheVersion = 2,
+		cacheHeaderSize = 128,
+	};
+
+	struct CacheHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t valueSize;
+		std::uint32_t dimension;
+		std::uint32_t nodeSize;
+		std::uint64_t key[2];
+		std::uint64_t numObjects;
+		std::uint64_t numNodes;
+		std::uint64_t numLeaves;
+		std::uint64_t maxDepth;
+
+		CacheHeader(size_t valueSize, size_t dimension, size_t nodeSize, size_t numObjects);
+	};
+
+	static void accumulate(const Statistics& statistics);
+	static std::atomic<std::ptrdiff_t>* sharedIdleBuildThreads();
+
+	static std::uint64_t hash(std::uint64_t seed, std::uint64_t value);
+	static TMappedFilePtr loadCache(const std::filesystem::path& directory, const CacheHeader& expected);
+	static void saveCache(const std::filesystem::path& directory, const CacheHeader& header,
+		const void* nodes, size_t nodesSize, const void* indices, size_t indicesSize);
+};
+
+
+
+template <typename ObjectType, typename ObjectTraits, typename SplitHeuristics>
+class BvhTree: public BvhTreeBase
+{
+public:
+
+	typedef BvhTree<ObjectType, ObjectTraits, SplitHeuristics> TSelf;
+	typedef ObjectType TObjectType;
+	typedef ObjectTraits TObjectTraits;
+	typedef SplitHeuristics TSplitHeuristics;
+
+	typedef typename TObjectTraits::TObjectIterator TObjectIterator;
+	typedef typename TObjectTraits::TObjectReference TObjectReference;
+	typedef typename TObjectTraits::TAabb TAabb;
+	typedef typename TObjectTraits::TRay TRay;
+	typedef typename TObjectTraits::TPoint TPoint;
+	typedef typename TObjectTraits::TVector TVector;
+	typedef typename TObjectTraits::TValue TValue;
+	typedef typename TObjectTraits::TParam TParam;
+	typedef typename TObjectTraits::TReference TReference;
+	typedef typename TObjectTraits::TConstReference TConstReference;
+	typedef typename TObjectTraits::TInfo TInfo;
+
+	enum
+	{
+		dimension = TObjectTraits::dimension,
+		numBins = 16,
+		defaultMaxObjectsPerLeaf = 4,
+		maxObjectsPerForcedLeaf = 32,
+		maxDepth = 64,
+		packetSize = 8,
+	};
+
+	typedef unsigned TMask;
+
+	BvhTree();
+	BvhTree(TObjectIterator first, TObjectIterator last);
+
+	void reset();
+	void reset(TObjectIterator first, TObjectIterator last);
+
+	const TAabb& aabb() const;
+	bool contains(const TPoint& point, const TInfo* info = 0) const;
+	template <typename OutputIterator> OutputIterator find(const TPoint& point, OutputIterator result, const TInfo* info = 0) const;
+	TObjectIterator intersect(const TRay& ray, TReference t, TParam tMin = 0, const TInfo* info = 0) const;
+	bool intersects(const TRay& ray, TParam tMin = 0, TParam tMax = std::numeric_limits<TValue>::infinity(), const TInfo* info = 0) const;
+
+	template <typename LeafIntersector> bool intersectLeaves(const TRay& ray, TParam tMin, TReference tNearest, LeafIntersector leaf) const;
+	template <typename LeafIntersector> bool intersectsLeaves(const TRay& ray, TParam tMin, TParam tMax, LeafIntersector leaf) const;
+	template <typename LeafIntersector> TMask intersectPacketLeaves(const TRay* rays, size_t count, const TValue* tMin, TValue* tNearest, LeafIntersector leaf) const;
+	template <typename LeafIntersector> TMask intersectsPacketLeaves(const TRay* rays, size_t count, const TValue* tMin, const TValue* tMax, LeafIntersector leaf) const;
+	bool refit(TObjectIterator first, TObjectIterator last);
+	TValue cost() const;
+
+	template <typename Function> void forEachLeaf(Function function) const;
+	TObjectIterator object(size_t position) const;
+	size_t size() const;
+
+	size_t maxObjectsPerLeaf() const;
+	void setMaxObjectsPerLeaf(size_t maxObjectsPerLeaf);
+
+	const Statistics& statistics() const;
+
+	void swap(TSelf& other);
+	bool isEmpty() const;
+	const TObjectIterator end() const;
+	void clear();
+
+private:
+
+	typedef std::uint32_t TIndex;
+
+	enum
+	{
+		invalidIndex = TIndex(-1),
+		maxMedianDepth = 32,
+		stackSize = 3 * (maxDepth + maxMedianDepth) + 4,
+	};
+
+	struct Bounds
+	{
+		TValue min[dimension];
+		TValue max[dimension];
+
+		Bounds();
+		void grow(const Bounds& other);
+		void grow(const TValue* point);
+		TValue centroid(size_t axis) const;
+		TValue halfArea() const;
+		bool isEmpty() const;
+	};
+
+	struct Primitive
+	{
+		Bounds bounds;
+		TIndex index;
+	};
+
+	struct Bin
+	{
+		Bounds bounds;
+		Bounds centroids;
+		size_t count;
+
+		Bin(): count(0) {}
+	};
+
+	struct Bins
+	{
+		Bin bins[dimension][numBins];
+		void merge(const Bins& other);
+	};
+
+	struct Split
+	{
+		size_t axis;
+		size_t bin;
+		TValue offset;
+		TValue scale;
+	};
+
+	struct BuildNode
+	{
+		Bounds bounds;
+		std::unique_ptr<BuildNode> children[2];
+		size_t first;
+		size_t last;
+
+		bool isLeaf() const { return !children[0]; }
+	};
+
+	/** four children, of which the bounds are quantized to 8 bits relative to the node's own
+	 *  bounds: origin + q * 2^exponent, rounded outwards.  Together with the single precision
+	 *  origin, that keeps a node in one cache line, whatever TValue is.  Traversal is therefore
+	 *  slightly conservative, but the objects are still intersected in full precision.
+	 *
+	 *  A child is either another node (count == 0), a leaf with count objects starting at index,
+	 *  or empty (count == 0 and index == invalidIndex).
+	 */
+	struct alignas(64) Node
+	{
+		float origin[dimension];
+		std::int8_t exponent[dimension];
+		std::uint8_t count[4];
+		std::uint8_t min[dimension][4];
+		std::uint8_t max[dimension][4];
+		TIndex index[4];
+	};
+
+	struct SlabRay
+	{
+		TValue support[dimension];
+		TValue invDirection[dimension];
+		size_t isNegative[dimension];
+
+		explicit SlabRay(const TRay& ray);
+	};
+
+	/** up to packetSize rays like SlabRay, one lane per ray.  Only the first size lanes are used.
+	 */
+	struct SlabPacket
+	{
+		TValue support[dimension][packetSize];
+		TValue invDirection[dimension][packetSize];
+		bool isNegative[dimension][packetSize];
+		size_t size;
+
+		SlabPacket(const TRay* rays, size_t numRays);
+	};
+
+	struct StackEntry
+	{
+		TIndex node;
+		TValue tNear;
+	};
+
+	struct PacketStackEntry
+	{
+		TIndex node;
+		TMask mask;
+	};
+
+	typedef std::vector<Primitive> TPrimitives;
+	typedef std::vector<TObjectIterator> TObjectIterators;
+	typedef std::vector<Node> TNodes;
+
+	class Builder;
+
+	TIndex flatten(const BuildNode& node, size_t depth, TNodes& nodes);
+	static void encodeFrame(Node& node, const Bounds& bounds);
+	static void encodeChild(Node& node, size_t k, const Bounds& bounds);
+	static float scale(std::int8_t exponent);
+	static float decode(const Node& node, size_t axis, std::uint8_t q);
+	bool loadCache(const std::filesystem::path& directory, const CacheHeader& expected, const TObjectIterators& objects);
+	void saveCache(const std::filesystem::path& directory, CacheHeader header, const TPrimitives& primitives) const;
+	size_t intersectChildren(const Node& node, const SlabRay& ray, TValue tMin, TValue tMax, TValue* tNear, size_t* order) const;
+	size_t intersectChildren(const Node& node, const SlabPacket& packet, TMask active, const TValue* tMin, const TValue* tMax, TMask* masks, size_t* order) const;
+	bool contains(const Node& node, size_t k, const TPoint& point) const;
+
+	const Node* nodes_;
+	size_t numNodes_;
+	std::shared_ptr<const void> storage_; // either TNodes or MappedFile
+	size_t maxObjectsPerLeaf_;
+	TObjectIterators objects_;
+	std::vector<TIndex> indices_; // position of each of objects_ in the range given to reset.
+	TValue buildCost_;
+	TAabb aabb_;
+	TObjectIterator end_;
+	Statistics statistics_;
+};
+
+}
+
+}
+
+#include "bvh_tree.inl"
+
+#endif
+
+// EOF
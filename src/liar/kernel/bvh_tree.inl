@@ -0,0 +1,1766 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <vector>
+
+namespace liar
+{
+namespace kernel
+{
+
+// --- Builder -------------------------------------------------------------------------------------
+
+template <typename O, typename OT, typename SH>
+class BvhTree<O, OT, SH>::Builder
+{
+public:
+
+	enum
+	{
+		minObjectsPerChunk = 16 * 1024,
+		minObjectsPerTask = 1024,
+	};
+
+	Builder(TPrimitives& primitives, size_t maxObjectsPerLeaf, size_t numThreads):
+		primitives_(primitives),
+		maxObjectsPerLeaf_(maxObjectsPerLeaf),
+		numThreads_(std::max<size_t>(numThreads, 1)),
+		numIdleThreads_(static_cast<std::ptrdiff_t>(numThreads_) - 1),
+		sharedIdleThreads_(sharedIdleBuildThreads())
+	{
+	}
+
+	void computeBounds(const TObjectIterators& objects, Bounds& bounds, Bounds& centroids)
+	{
+		const size_t size = objects.size();
+		primitives_.resize(size);
+		const size_t n = numChunks(size);
+		std::vector<Bounds> chunkBounds(n);
+		std::vector<Bounds> chunkCentroids(n);
+		std::vector<size_t> chunkSizes(n);
+		forChunks(0, size, n, [&](size_t chunk, size_t begin, size_t end)
+		{
+			Bounds& b = chunkBounds[chunk];
+			Bounds& c = chunkCentroids[chunk];
+			size_t& k = chunkSizes[chunk];
+			k = begin;
+			for (size_t i = begin; i < end; ++i)
+			{
+				Primitive p;
+				p.bounds = objectBounds(objects[i]);
+				if (p.bounds.isEmpty())
+				{
+					continue; // they can't be hit or contain anything anyway.
+				}
+				p.index = static_cast<TIndex>(i);
+				b.grow(p.bounds);
+				TValue centroid[dimension];
+				for (size_t a = 0; a < dimension; ++a)
+				{
+					centroid[a] = p.bounds.centroid(a);
+				}
+				c.grow(centroid);
+				primitives_[k++] = p;
+			}
+		});
+
+		// compact the chunks, as empty objects may have left some holes.
+		size_t size2 = 0;
+		for (size_t chunk = 0; chunk < n; ++chunk)
+		{
+			const size_t begin = chunkBegin(0, size, n, chunk);
+			const size_t end = chunkSizes[chunk];
+			if (begin != size2)
+			{
+				std::copy(primitives_.begin() + static_cast<std::ptrdiff_t>(begin), primitives_.begin() + static_cast<std::ptrdiff_t>(end),
+					primitives_.begin() + static_cast<std::ptrdiff_t>(size2));
+			}
+			size2 += end - begin;
+			bounds.grow(chunkBounds[chunk]);
+			centroids.grow(chunkCentroids[chunk]);
+		}
+		primitives_.resize(size2);
+		temp_.resize(size2);
+	}
+
+	/** Recomputes the bounds of all @a nodes bottom-up, for @a objects in the order of the leaves.
+	 *  Children always come after their parent, so a first pass over the nodes finds their depth.
+	 *  Then the levels are refitted from the deepest up, each one in parallel chunks.
+	 *  Returns the exact bounds of the root.
+	 */
+	Bounds refit(const TObjectIterators& objects, TNodes& nodes)
+	{
+		const size_t numObjects = objects.size();
+		std::vector<Bounds> bounds(numObjects);
+		forChunks(0, numObjects, numChunks(numObjects), [&](size_t, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				bounds[i] = objectBounds(objects[i]);
+			}
+		});
+
+		const size_t numNodes = nodes.size();
+		std::vector<size_t> depths(numNodes, 0);
+		std::vector< std::vector<TIndex> > levels;
+		for (size_t i = 0; i < numNodes; ++i)
+		{
+			const size_t depth = depths[i];
+			if (levels.size() <= depth)
+			{
+				levels.resize(depth + 1);
+			}
+			levels[depth].push_back(static_cast<TIndex>(i));
+			for (size_t k = 0; k < 4; ++k)
+			{
+				if (nodes[i].count[k] == 0 && nodes[i].index[k] != invalidIndex)
+				{
+					depths[nodes[i].index[k]] = depth + 1;
+				}
+			}
+		}
+
+		std::vector<Bounds> nodeBounds(numNodes);
+		for (size_t level = levels.size(); level-- > 0; )
+		{
+			const std::vector<TIndex>& indices = levels[level];
+			forChunks(0, indices.size(), numChunks(indices.size()), [&](size_t, size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					Node& node = nodes[indices[i]];
+					Bounds children[4];
+					for (size_t k = 0; k < 4; ++k)
+					{
+						if (node.count[k] > 0)
+						{
+							for (size_t j = node.index[k], last = j + node.count[k]; j < last; ++j)
+							{
+								children[k].grow(bounds[j]);
+							}
+						}
+						else if (node.index[k] != invalidIndex)
+						{
+							children[k] = nodeBounds[node.index[k]];
+						}
+						nodeBounds[indices[i]].grow(children[k]);
+					}
+					encodeFrame(node, nodeBounds[indices[i]]);
+					for (size_t k = 0; k < 4; ++k)
+					{
+						if (node.count[k] > 0 || node.index[k] != invalidIndex)
+						{
+							encodeChild(node, k, children[k]);
+						}
+					}
+				}
+			});
+		}
+		return numNodes > 0 ? nodeBounds[0] : Bounds();
+	}
+
+	/** Hashes the bounds of all objects, in chunks of a fixed size so that the result doesn't
+	 *  depend on the number of threads.  Each chunk is hashed twice with a different seed, to get
+	 *  a key of 128 bits.
+	 */
+	void hash(std::uint64_t key[2])
+	{
+		const size_t size = primitives_.size();
+		const size_t numHashChunks = (size + minObjectsPerChunk - 1) / minObjectsPerChunk;
+		std::vector<std::uint64_t> chunkKeys(2 * numHashChunks);
+		forChunks(0, numHashChunks, numChunks(size), [&](size_t, size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; ++chunk)
+			{
+				std::uint64_t a = 0x243f6a8885a308d3ULL;
+				std::uint64_t b = 0x13198a2e03707344ULL;
+				const size_t last = std::min(size, (chunk + 1) * minObjectsPerChunk);
+				for (size_t i = chunk * minObjectsPerChunk; i < last; ++i)
+				{
+					const Primitive& p = primitives_[i];
+					for (size_t k = 0; k < dimension; ++k)
+					{
+						a = BvhTreeBase::hash(BvhTreeBase::hash(a, bits(p.bounds.min[k])), bits(p.bounds.max[k]));
+						b = BvhTreeBase::hash(BvhTreeBase::hash(b, bits(p.bounds.min[k])), bits(p.bounds.max[k]));
+					}
+					a = BvhTreeBase::hash(a, p.index);
+					b = BvhTreeBase::hash(b, p.index);
+				}
+				chunkKeys[2 * chunk] = a;
+				chunkKeys[2 * chunk + 1] = b;
+			}
+		});
+		key[0] = BvhTreeBase::hash(0x452821e638d01377ULL, size);
+		key[1] = BvhTreeBase::hash(0xbe5466cf34e90c6cULL, size);
+		for (size_t chunk = 0; chunk < numHashChunks; ++chunk)
+		{
+			key[0] = BvhTreeBase::hash(key[0], chunkKeys[2 * chunk]);
+			key[1] = BvhTreeBase::hash(key[1], chunkKeys[2 * chunk + 1]);
+		}
+	}
+
+	std::unique_ptr<BuildNode> build(size_t first, size_t last, const Bounds& bounds, const Bounds& centroids, size_t depth)
+	{
+		std::unique_ptr<BuildNode> node(new BuildNode);
+		node->bounds = bounds;
+		node->first = first;
+		node->last = last;
+
+		const size_t count = last - first;
+		if (count <= maxObjectsPerLeaf_)
+		{
+			return node;
+		}
+
+		Bounds leftBounds, leftCentroids, rightBounds, rightCentroids;
+		size_t middle;
+		Split split;
+		TValue cost;
+		if (depth < maxDepth && findSplit(first, last, centroids, split, cost, leftBounds, leftCentroids, rightBounds, rightCentroids))
+		{
+			const TValue traversalCost = 1;
+			if (cost + traversalCost * bounds.halfArea() >= static_cast<TValue>(count) * bounds.halfArea() && count <= maxObjectsPerForcedLeaf)
+			{
+				return node;
+			}
+			middle = partition(first, last, split);
+		}
+		else
+		{
+			// All centroids coincide, or the tree is too deep already.  Split in two halves along
+			// the largest axis, so that leaves stay small enough and the depth remains bounded.
+			if (count <= maxObjectsPerForcedLeaf)
+			{
+				return node;
+			}
+			size_t axis = 0;
+			for (size_t a = 1; a < dimension; ++a)
+			{
+				if (centroids.max[a] - centroids.min[a] > centroids.max[axis] - centroids.min[axis])
+				{
+					axis = a;
+				}
+			}
+			middle = first + count / 2;
+			std::nth_element(primitives_.begin() + static_cast<std::ptrdiff_t>(first), primitives_.begin() + static_cast<std::ptrdiff_t>(middle),
+				primitives_.begin() + static_cast<std::ptrdiff_t>(last),
+				[axis](const Primitive& a, const Primitive& b) { return a.bounds.centroid(axis) < b.bounds.centroid(axis); });
+			for (size_t i = first; i < last; ++i)
+			{
+				const Primitive& p = primitives_[i];
+				TValue centroid[dimension];
+				for (size_t a = 0; a < dimension; ++a)
+				{
+					centroid[a] = p.bounds.centroid(a);
+				}
+				(i < middle ? leftBounds : rightBounds).grow(p.bounds);
+				(i < middle ? leftCentroids : rightCentroids).grow(centroid);
+			}
+		}
+		LASS_ASSERT(middle > first && middle < last);
+
+		if (count >= minObjectsPerTask && acquireThread())
+		{
+			std::future< std::unique_ptr<BuildNode> > left = std::async(std::launch::async, [&]()
+			{
+				std::unique_ptr<BuildNode> result = build(first, middle, leftBounds, leftCentroids, depth + 1);
+				releaseThread();
+				return result;
+			});
+			node->children[1] = build(middle, last, rightBounds, rightCentroids, depth + 1);
+			node->children[0] = left.get();
+		}
+		else
+		{
+			node->children[0] = build(first, middle, leftBounds, leftCentroids, depth + 1);
+			node->children[1] = build(middle, last, rightBounds, rightCentroids, depth + 1);
+		}
+		return node;
+	}
+
+private:
+
+	bool findSplit(size_t first, size_t last, const Bounds& centroids, Split& best, TValue& bestCost,
+			Bounds& leftBounds, Bounds& leftCentroids, Bounds& rightBounds, Bounds& rightCentroids)
+	{
+		Split splits[dimension];
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			const TValue extent = centroids.max[a] - centroids.min[a];
+			splits[a].axis = a;
+			splits[a].offset = centroids.min[a];
+			splits[a].scale = extent > 0 ? static_cast<TValue>(numBins) / extent : 0;
+		}
+
+		const size_t n = numChunks(last - first);
+		std::vector<Bins> chunkBins(n);
+		forChunks(first, last, n, [&](size_t chunk, size_t begin, size_t end)
+		{
+			Bins& bins = chunkBins[chunk];
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Primitive& p = primitives_[i];
+				TValue centroid[dimension];
+				for (size_t a = 0; a < dimension; ++a)
+				{
+					centroid[a] = p.bounds.centroid(a);
+				}
+				for (size_t a = 0; a < dimension; ++a)
+				{
+					Bin& bin = bins.bins[a][binIndex(splits[a], centroid[a])];
+					bin.bounds.grow(p.bounds);
+					bin.centroids.grow(centroid);
+					++bin.count;
+				}
+			}
+		});
+		for (size_t chunk = 1; chunk < n; ++chunk)
+		{
+			chunkBins[0].merge(chunkBins[chunk]);
+		}
+		const Bins& bins = chunkBins[0];
+
+		bool found = false;
+		bestCost = std::numeric_limits<TValue>::infinity();
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			if (splits[a].scale == 0)
+			{
+				continue;
+			}
+			TValue rightCosts[numBins];
+			Bounds right;
+			size_t rightCount = 0;
+			for (size_t i = numBins; i-- > 1; )
+			{
+				right.grow(bins.bins[a][i].bounds);
+				rightCount += bins.bins[a][i].count;
+				rightCosts[i] = rightCount ? static_cast<TValue>(rightCount) * right.halfArea() : 0;
+			}
+			Bounds left;
+			size_t leftCount = 0;
+			for (size_t i = 1; i < numBins; ++i)
+			{
+				left.grow(bins.bins[a][i - 1].bounds);
+				leftCount += bins.bins[a][i - 1].count;
+				if (leftCount == 0 || leftCount == last - first)
+				{
+					continue;
+				}
+				const TValue cost = static_cast<TValue>(leftCount) * left.halfArea() + rightCosts[i];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					best = splits[a];
+					best.bin = i;
+					found = true;
+				}
+			}
+		}
+		if (!found)
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < numBins; ++i)
+		{
+			const Bin& bin = bins.bins[best.axis][i];
+			if (i < best.bin)
+			{
+				leftBounds.grow(bin.bounds);
+				leftCentroids.grow(bin.centroids);
+			}
+			else
+			{
+				rightBounds.grow(bin.bounds);
+				rightCentroids.grow(bin.centroids);
+			}
+		}
+		return true;
+	}
+
+	size_t partition(size_t first, size_t last, const Split& split)
+	{
+		const auto isLeft = [&split](const Primitive& p)
+		{
+			return binIndex(split, p.bounds.centroid(split.axis)) < split.bin;
+		};
+
+		const size_t n = numChunks(last - first);
+		if (n <= 1)
+		{
+			return static_cast<size_t>(std::partition(primitives_.begin() + static_cast<std::ptrdiff_t>(first),
+				primitives_.begin() + static_cast<std::ptrdiff_t>(last), isLeft) - primitives_.begin());
+		}
+
+		std::vector<size_t> leftCounts(n);
+		forChunks(first, last, n, [&](size_t chunk, size_t begin, size_t end)
+		{
+			leftCounts[chunk] = static_cast<size_t>(std::count_if(primitives_.begin() + static_cast<std::ptrdiff_t>(begin),
+				primitives_.begin() + static_cast<std::ptrdiff_t>(end), isLeft));
+		});
+
+		std::vector<size_t> leftOffsets(n);
+		std::vector<size_t> rightOffsets(n);
+		size_t numLeft = 0;
+		for (size_t chunk = 0; chunk < n; ++chunk)
+		{
+			leftOffsets[chunk] = first + numLeft;
+			numLeft += leftCounts[chunk];
+		}
+		size_t numRight = 0;
+		for (size_t chunk = 0; chunk < n; ++chunk)
+		{
+			rightOffsets[chunk] = first + numLeft + numRight;
+			numRight += (chunkBegin(first, last, n, chunk + 1) - chunkBegin(first, last, n, chunk)) - leftCounts[chunk];
+		}
+
+		forChunks(first, last, n, [&](size_t chunk, size_t begin, size_t end)
+		{
+			size_t left = leftOffsets[chunk];
+			size_t right = rightOffsets[chunk];
+			for (size_t i = begin; i < end; ++i)
+			{
+				temp_[isLeft(primitives_[i]) ? left++ : right++] = primitives_[i];
+			}
+		});
+		forChunks(first, last, n, [&](size_t, size_t begin, size_t end)
+		{
+			std::copy(temp_.begin() + static_cast<std::ptrdiff_t>(begin), temp_.begin() + static_cast<std::ptrdiff_t>(end),
+				primitives_.begin() + static_cast<std::ptrdiff_t>(begin));
+		});
+		return first + numLeft;
+	}
+
+	static Bounds objectBounds(TObjectIterator object)
+	{
+		const TAabb aabb = TObjectTraits::objectAabb(object);
+		const TPoint min = TObjectTraits::aabbMin(aabb);
+		const TPoint max = TObjectTraits::aabbMax(aabb);
+		Bounds result;
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			result.min[a] = TObjectTraits::coord(min, a);
+			result.max[a] = TObjectTraits::coord(max, a);
+		}
+		return result;
+	}
+
+	static std::uint64_t bits(TValue x)
+	{
+		static_assert(sizeof(TValue) <= sizeof(std::uint64_t), "TValue is too large to hash");
+		std::uint64_t result = 0;
+		std::memcpy(&result, &x, sizeof(TValue));
+		return result;
+	}
+
+	static size_t binIndex(const Split& split, TValue x)
+	{
+		const TValue i = (x - split.offset) * split.scale;
+		return i > 0 ? std::min(static_cast<size_t>(i), static_cast<size_t>(numBins - 1)) : 0;
+	}
+
+	size_t numChunks(size_t count) const
+	{
+		return std::max<size_t>(std::min(numThreads_, count / minObjectsPerChunk), 1);
+	}
+
+	static size_t chunkBegin(size_t first, size_t last, size_t numChunks, size_t chunk)
+	{
+		return first + (last - first) * chunk / numChunks;
+	}
+
+	/** calls function(chunk, begin, end) for numChunks consecutive chunks of [first, last).
+	 *
+	 *  A chunk only gets a thread of its own if one can be acquired from the same budget as the
+	 *  build tasks, the others are done by the calling thread.  So also when this is called from
+	 *  within parallel build tasks, never more than numThreads threads are running at once.  If
+	 *  builds share a SharedBuildThreads budget, a thread must be idle in that one as well.
+	 */
+	template <typename Function>
+	void forChunks(size_t first, size_t last, size_t numChunks, Function function)
+	{
+		std::vector< std::future<void> > futures;
+		futures.reserve(numChunks);
+		std::vector<size_t> ownChunks(1, 0);
+		for (size_t chunk = 1; chunk < numChunks; ++chunk)
+		{
+			if (!acquireThread())
+			{
+				ownChunks.push_back(chunk);
+				continue;
+			}
+			const size_t begin = chunkBegin(first, last, numChunks, chunk);
+			const size_t end = chunkBegin(first, last, numChunks, chunk + 1);
+			futures.push_back(std::async(std::launch::async, [this, &function, chunk, begin, end]()
+			{
+				function(chunk, begin, end);
+				releaseThread();
+			}));
+		}
+		for (size_t chunk : ownChunks)
+		{
+			function(chunk, chunkBegin(first, last, numChunks, chunk), chunkBegin(first, last, numChunks, chunk + 1));
+		}
+		for (auto& future : futures)
+		{
+			future.get();
+		}
+	}
+
+	bool acquireThread()
+	{
+		if (!acquire(numIdleThreads_))
+		{
+			return false;
+		}
+		if (sharedIdleThreads_ && !acquire(*sharedIdleThreads_))
+		{
+			numIdleThreads_.fetch_add(1);
+			return false;
+		}
+		return true;
+	}
+
+	void releaseThread()
+	{
+		if (sharedIdleThreads_)
+		{
+			sharedIdleThreads_->fetch_add(1);
+		}
+		numIdleThreads_.fetch_add(1);
+	}
+
+	static bool acquire(std::atomic<std::ptrdiff_t>& idleThreads)
+	{
+		if (idleThreads.fetch_sub(1) > 0)
+		{
+			return true;
+		}
+		idleThreads.fetch_add(1);
+		return false;
+	}
+
+	TPrimitives& primitives_;
+	size_t maxObjectsPerLeaf_;
+	TPrimitives temp_;
+	size_t numThreads_;
+	std::atomic<std::ptrdiff_t> numIdleThreads_;
+	std::atomic<std::ptrdiff_t>* sharedIdleThreads_; // if the build shares a budget with others, it needs a thread of both.
+};
+
+
+
+// --- public --------------------------------------------------------------------------------------
+
+template <typename O, typename OT, typename SH>
+BvhTree<O, OT, SH>::BvhTree():
+	nodes_(0),
+	numNodes_(0),
+	maxObjectsPerLeaf_(defaultMaxObjectsPerLeaf),
+	buildCost_(0),
+	aabb_(TObjectTraits::aabbEmpty()),
+	end_()
+{
+}
+
+
+
+template <typename O, typename OT, typename SH>
+BvhTree<O, OT, SH>::BvhTree(TObjectIterator first, TObjectIterator last):
+	nodes_(0),
+	numNodes_(0),
+	maxObjectsPerLeaf_(defaultMaxObjectsPerLeaf),
+	buildCost_(0),
+	aabb_(TObjectTraits::aabbEmpty()),
+	end_(last)
+{
+	reset(first, last);
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::reset()
+{
+	TSelf temp;
+	temp.maxObjectsPerLeaf_ = maxObjectsPerLeaf_;
+	swap(temp);
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::reset(TObjectIterator first, TObjectIterator last)
+{
+	typedef std::chrono::steady_clock TClock;
+	const TClock::time_point start = TClock::now();
+
+	TObjectIterators objects;
+	for (TObjectIterator i = first; i != last; ++i)
+	{
+		objects.push_back(i);
+	}
+
+	TSelf result;
+	result.end_ = last;
+	result.maxObjectsPerLeaf_ = maxObjectsPerLeaf_;
+	result.statistics_.numBuilds = 1;
+
+	TPrimitives primitives;
+	Builder builder(primitives, maxObjectsPerLeaf_, numberOfBuildThreads());
+	Bounds bounds;
+	Bounds centroids;
+	builder.computeBounds(objects, bounds, centroids);
+	if (!primitives.empty())
+	{
+		TPoint min;
+		TPoint max;
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			TObjectTraits::coord(min, a, bounds.min[a]);
+			TObjectTraits::coord(max, a, bounds.max[a]);
+		}
+		result.aabb_ = TObjectTraits::aabbMake(min, max);
+
+		const std::filesystem::path directory = cacheDirectory();
+		CacheHeader header(sizeof(TValue), dimension, sizeof(Node), primitives.size());
+		if (!directory.empty())
+		{
+			builder.hash(header.key);
+			header.key[0] = BvhTreeBase::hash(header.key[0], maxObjectsPerLeaf_);
+		}
+		if (directory.empty() || !result.loadCache(directory, header, objects))
+		{
+			const std::unique_ptr<BuildNode> root = builder.build(0, primitives.size(), bounds, centroids, 0);
+			std::shared_ptr<TNodes> nodes = std::make_shared<TNodes>();
+			result.flatten(*root, 1, *nodes);
+			result.nodes_ = nodes->data();
+			result.numNodes_ = nodes->size();
+			result.storage_ = nodes;
+
+			result.objects_.reserve(primitives.size());
+			result.indices_.reserve(primitives.size());
+			for (const Primitive& p : primitives)
+			{
+				result.objects_.push_back(objects[p.index]);
+				result.indices_.push_back(p.index);
+			}
+
+			if (!directory.empty())
+			{
+				result.saveCache(directory, header, primitives);
+			}
+		}
+	}
+
+	result.buildCost_ = result.cost();
+	result.statistics_.numObjects = result.objects_.size();
+	result.statistics_.numNodes = result.numNodes_;
+	result.statistics_.buildTime = std::chrono::duration<TTimeDelta>(TClock::now() - start).count();
+	accumulate(result.statistics_);
+
+	swap(result);
+}
+
+
+
+template <typename O, typename OT, typename SH>
+const typename BvhTree<O, OT, SH>::TAabb& BvhTree<O, OT, SH>::aabb() const
+{
+	return aabb_;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::contains(const TPoint& point, const TInfo* info) const
+{
+	if (numNodes_ == 0)
+	{
+		return false;
+	}
+	TIndex stack[stackSize];
+	size_t top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes_[stack[--top]];
+		for (size_t k = 0; k < 4; ++k)
+		{
+			if (!contains(node, k, point))
+			{
+				continue;
+			}
+			if (node.count[k] == 0)
+			{
+				stack[top++] = node.index[k];
+				continue;
+			}
+			for (TIndex i = node.index[k], last = i + node.count[k]; i < last; ++i)
+			{
+				if (TObjectTraits::objectContains(objects_[i], point, info))
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+template <typename OutputIterator>
+OutputIterator BvhTree<O, OT, SH>::find(const TPoint& point, OutputIterator result, const TInfo* info) const
+{
+	if (numNodes_ == 0)
+	{
+		return result;
+	}
+	TIndex stack[stackSize];
+	size_t top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes_[stack[--top]];
+		for (size_t k = 0; k < 4; ++k)
+		{
+			if (!contains(node, k, point))
+			{
+				continue;
+			}
+			if (node.count[k] == 0)
+			{
+				stack[top++] = node.index[k];
+				continue;
+			}
+			for (TIndex i = node.index[k], last = i + node.count[k]; i < last; ++i)
+			{
+				if (TObjectTraits::objectContains(objects_[i], point, info))
+				{
+					*result++ = objects_[i];
+				}
+			}
+		}
+	}
+	return result;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TObjectIterator
+BvhTree<O, OT, SH>::intersect(const TRay& ray, TReference t, TParam tMin, const TInfo* info) const
+{
+	TObjectIterator best = end_;
+	TValue tBest = std::numeric_limits<TValue>::infinity();
+	intersectLeaves(ray, tMin, tBest, [this, &ray, tMin, info, &best](size_t first, size_t count, TValue& tNearest)
+	{
+		bool hit = false;
+		for (size_t j = first, last = first + count; j < last; ++j)
+		{
+			TValue tCandidate;
+			if (TObjectTraits::objectIntersect(objects_[j], ray, tCandidate, tMin, info) && tCandidate < tNearest)
+			{
+				tNearest = tCandidate;
+				best = objects_[j];
+				hit = true;
+			}
+		}
+		return hit;
+	});
+	if (best != end_)
+	{
+		t = tBest;
+	}
+	return best;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::intersects(const TRay& ray, TParam tMin, TParam tMax, const TInfo* info) const
+{
+	return intersectsLeaves(ray, tMin, tMax, [this, &ray, tMin, tMax, info](size_t first, size_t count)
+	{
+		for (size_t j = first, last = first + count; j < last; ++j)
+		{
+			if (TObjectTraits::objectIntersects(objects_[j], ray, tMin, tMax, info))
+			{
+				return true;
+			}
+		}
+		return false;
+	});
+}
+
+
+
+/** Finds the nearest hit beyond @a tMin, leaving the intersection of the objects to @a leaf.
+ *
+ *  leaf(first, count, tNearest) must intersect the objects at positions [first, first + count),
+ *  see object(), and lower tNearest and return true if it finds a nearer hit.  This allows to
+ *  store the objects of the leaves in another layout that can be tested all at once.
+ *
+ *  Children are visited front to back, and leaves are tested as soon as they are found, so that
+ *  the nearest hit so far can cull as much of the remaining children as possible.
+ *
+ *  @param tNearest [in,out] starts as the far limit, and is the distance of the nearest hit after.
+ *  @return true if a hit nearer than the initial tNearest is found.
+ */
+template <typename O, typename OT, typename SH>
+template <typename LeafIntersector>
+bool BvhTree<O, OT, SH>::intersectLeaves(const TRay& ray, TParam tMin, TReference tNearest, LeafIntersector leaf) const
+{
+	if (numNodes_ == 0)
+	{
+		return false;
+	}
+	const SlabRay r(ray);
+	bool hit = false;
+
+	StackEntry stack[stackSize];
+	size_t top = 0;
+	stack[top++] = StackEntry { 0, tMin };
+	while (top > 0)
+	{
+		const StackEntry entry = stack[--top];
+		if (entry.tNear > tNearest)
+		{
+			continue;
+		}
+		const Node& node = nodes_[entry.node];
+		TValue tNear[4];
+		size_t order[4];
+		const size_t n = intersectChildren(node, r, tMin, tNearest, tNear, order);
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t k = order[i];
+			if (node.count[k] > 0 && tNear[k] <= tNearest)
+			{
+				hit |= leaf(static_cast<size_t>(node.index[k]), static_cast<size_t>(node.count[k]), tNearest);
+			}
+		}
+		for (size_t i = n; i-- > 0; )
+		{
+			const size_t k = order[i];
+			if (node.count[k] == 0)
+			{
+				stack[top++] = StackEntry { node.index[k], tNear[k] };
+			}
+		}
+	}
+	return hit;
+}
+
+
+
+/** Finds if there's any hit in [@a tMin, @a tMax], leaving the intersection of the objects to @a leaf.
+ *  leaf(first, count) must return true if any of the objects at positions [first, first + count) is hit.
+ */
+template <typename O, typename OT, typename SH>
+template <typename LeafIntersector>
+bool BvhTree<O, OT, SH>::intersectsLeaves(const TRay& ray, TParam tMin, TParam tMax, LeafIntersector leaf) const
+{
+	if (numNodes_ == 0)
+	{
+		return false;
+	}
+	const SlabRay r(ray);
+	TIndex stack[stackSize];
+	size_t top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes_[stack[--top]];
+		TValue tNear[4];
+		size_t order[4];
+		const size_t n = intersectChildren(node, r, tMin, tMax, tNear, order);
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t k = order[i];
+			if (node.count[k] == 0)
+			{
+				stack[top++] = node.index[k];
+			}
+			else if (leaf(static_cast<size_t>(node.index[k]), static_cast<size_t>(node.count[k])))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+
+/** Finds the nearest hit of each of up to packetSize rays, leaving the intersection of the objects
+ *  to @a leaf.
+ *
+ *  The rays share the traversal: each node is visited once for the whole packet, and a child is
+ *  only entered with the mask of the rays that hit it.  That pays off if the rays are coherent,
+ *  like the primary rays of neighbouring pixels.  The children are visited front to back, for
+ *  the nearest entry of any of their rays.
+ *
+ *  leaf(first, count, mask, tNearest) must intersect the objects at positions [first, first + count)
+ *  with each ray k that has bit k set in @a mask.  It must lower tNearest[k] if it finds a nearer hit,
+ *  and return the mask of the rays for which it did.
+ *
+ *  @param tMin [in] the near limits of the @a count rays.
+ *  @param tNearest [in,out] start as the far limits, and are the distances of the nearest hits after.
+ *  @return the mask of the rays that found a hit nearer than their initial tNearest.
+ */
+template <typename O, typename OT, typename SH>
+template <typename LeafIntersector>
+typename BvhTree<O, OT, SH>::TMask
+BvhTree<O, OT, SH>::intersectPacketLeaves(const TRay* rays, size_t count, const TValue* tMin, TValue* tNearest, LeafIntersector leaf) const
+{
+	LASS_ASSERT(count <= packetSize);
+	if (numNodes_ == 0 || count == 0)
+	{
+		return 0;
+	}
+	const SlabPacket packet(rays, count);
+	TMask hit = 0;
+
+	PacketStackEntry stack[stackSize];
+	size_t top = 0;
+	stack[top++] = PacketStackEntry { 0, (TMask(1) << count) - 1 };
+	while (top > 0)
+	{
+		const PacketStackEntry entry = stack[--top];
+		const Node& node = nodes_[entry.node];
+		TMask masks[4];
+		size_t order[4];
+		const size_t n = intersectChildren(node, packet, entry.mask, tMin, tNearest, masks, order);
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t k = order[i];
+			if (node.count[k] > 0)
+			{
+				hit |= leaf(static_cast<size_t>(node.index[k]), static_cast<size_t>(node.count[k]), masks[k], tNearest);
+			}
+		}
+		for (size_t i = n; i-- > 0; )
+		{
+			const size_t k = order[i];
+			if (node.count[k] == 0)
+			{
+				stack[top++] = PacketStackEntry { node.index[k], masks[k] };
+			}
+		}
+	}
+	return hit;
+}
+
+
+
+/** Finds which of up to packetSize rays hit anything, leaving the intersection of the objects to @a leaf.
+ *
+ *  Like intersectPacketLeaves, but for shadow rays: any hit will do, so a ray is dropped from the
+ *  packet as soon as @a leaf reports a hit for it, and the traversal stops once all rays are
+ *  blocked.  The limits of the rays are never lowered.
+ *
+ *  leaf(first, count, mask) must test the objects at positions [first, first + count) against
+ *  each ray k that has bit k set in @a mask, and return the mask of the rays that hit any of them.
+ *
+ *  @return the mask of the rays that hit something within their limits.
+ */
+template <typename O, typename OT, typename SH>
+template <typename LeafIntersector>
+typename BvhTree<O, OT, SH>::TMask
+BvhTree<O, OT, SH>::intersectsPacketLeaves(const TRay* rays, size_t count, const TValue* tMin, const TValue* tMax, LeafIntersector leaf) const
+{
+	LASS_ASSERT(count <= packetSize);
+	if (numNodes_ == 0 || count == 0)
+	{
+		return 0;
+	}
+	const SlabPacket packet(rays, count);
+	const TMask all = (TMask(1) << count) - 1;
+	TMask hit = 0;
+
+	PacketStackEntry stack[stackSize];
+	size_t top = 0;
+	stack[top++] = PacketStackEntry { 0, all };
+	while (top > 0 && hit != all)
+	{
+		const PacketStackEntry entry = stack[--top];
+		const TMask active = entry.mask & ~hit;
+		if (!active)
+		{
+			continue;
+		}
+		const Node& node = nodes_[entry.node];
+		TMask masks[4];
+		size_t order[4];
+		const size_t n = intersectChildren(node, packet, active, tMin, tMax, masks, order);
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t k = order[i];
+			const TMask mask = masks[k] & ~hit;
+			if (node.count[k] > 0 && mask)
+			{
+				hit |= leaf(static_cast<size_t>(node.index[k]), static_cast<size_t>(node.count[k]), mask) & mask;
+			}
+		}
+		for (size_t i = n; i-- > 0; )
+		{
+			const size_t k = order[i];
+			if (node.count[k] == 0)
+			{
+				stack[top++] = PacketStackEntry { node.index[k], masks[k] };
+			}
+		}
+	}
+	return hit;
+}
+
+
+
+/** Updates the bounds of the tree after its objects have moved, keeping its structure.
+ *
+ *  [@a first, @a last) must be the same objects as given to the last reset, in the same order.
+ *  The bounds of the nodes are recomputed bottom-up, each level of the tree in parallel.  If that
+ *  raised the cost() by more than maxRefitCostGrowth() compared to the last build, the tree is
+ *  rebuilt instead.
+ *
+ *  @return true if the tree is refitted, false if it had to be rebuilt.
+ */
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::refit(TObjectIterator first, TObjectIterator last)
+{
+	typedef std::chrono::steady_clock TClock;
+	const TClock::time_point start = TClock::now();
+
+	if (indices_.empty())
+	{
+		reset(first, last);
+		return false;
+	}
+
+	TObjectIterators objects;
+	for (TObjectIterator i = first; i != last; ++i)
+	{
+		objects.push_back(i);
+	}
+	TObjectIterators reordered;
+	reordered.reserve(indices_.size());
+	for (const TIndex index : indices_)
+	{
+		LASS_ENFORCE(index < objects.size());
+		reordered.push_back(objects[index]);
+	}
+
+	std::shared_ptr<TNodes> nodes = std::make_shared<TNodes>(nodes_, nodes_ + numNodes_);
+	TPrimitives primitives;
+	Builder builder(primitives, maxObjectsPerLeaf_, numberOfBuildThreads());
+	const Bounds bounds = builder.refit(reordered, *nodes);
+
+	nodes_ = nodes->data();
+	storage_ = nodes;
+	objects_.swap(reordered);
+	end_ = last;
+
+	if (cost() > maxRefitCostGrowth() * buildCost_)
+	{
+		reset(first, last);
+		return false;
+	}
+
+	TPoint min;
+	TPoint max;
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		TObjectTraits::coord(min, a, bounds.min[a]);
+		TObjectTraits::coord(max, a, bounds.max[a]);
+	}
+	aabb_ = TObjectTraits::aabbMake(min, max);
+
+	Statistics statistics;
+	statistics.numRefits = 1;
+	statistics.refitTime = std::chrono::duration<TTimeDelta>(TClock::now() - start).count();
+	statistics_.numRefits += statistics.numRefits;
+	statistics_.refitTime += statistics.refitTime;
+	accumulate(statistics);
+	return true;
+}
+
+
+
+/** Returns the surface area heuristic cost of the tree: the expected number of nodes visited plus
+ *  objects tested by a ray through the root, if nothing is hit.  It's evaluated on the quantized
+ *  bounds, as they are traversed.
+ */
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TValue BvhTree<O, OT, SH>::cost() const
+{
+	if (numNodes_ == 0)
+	{
+		return 0;
+	}
+	Bounds root;
+	TValue total = 0;
+	for (size_t i = 0; i < numNodes_; ++i)
+	{
+		const Node& node = nodes_[i];
+		for (size_t k = 0; k < 4; ++k)
+		{
+			if (node.count[k] == 0 && node.index[k] == invalidIndex)
+			{
+				continue;
+			}
+			Bounds bounds;
+			for (size_t a = 0; a < dimension; ++a)
+			{
+				bounds.min[a] = decode(node, a, node.min[a][k]);
+				bounds.max[a] = decode(node, a, node.max[a][k]);
+			}
+			if (i == 0)
+			{
+				root.grow(bounds);
+			}
+			total += bounds.halfArea() * (node.count[k] > 0 ? node.count[k] : 1);
+		}
+	}
+	const TValue area = root.halfArea();
+	return area > 0 ? 1 + total / area : 1;
+}
+
+
+
+/** Calls function(first, count) for each leaf, with the positions [first, first + count) of its objects.
+ */
+template <typename O, typename OT, typename SH>
+template <typename Function>
+void BvhTree<O, OT, SH>::forEachLeaf(Function function) const
+{
+	for (size_t i = 0; i < numNodes_; ++i)
+	{
+		const Node& node = nodes_[i];
+		for (size_t k = 0; k < 4; ++k)
+		{
+			if (node.count[k] > 0)
+			{
+				function(static_cast<size_t>(node.index[k]), static_cast<size_t>(node.count[k]));
+			}
+		}
+	}
+}
+
+
+
+/** Returns the object at @a position in the order of the leaves.
+ */
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TObjectIterator BvhTree<O, OT, SH>::object(size_t position) const
+{
+	LASS_ASSERT(position < objects_.size());
+	return objects_[position];
+}
+
+
+
+template <typename O, typename OT, typename SH>
+size_t BvhTree<O, OT, SH>::size() const
+{
+	return objects_.size();
+}
+
+
+
+template <typename O, typename OT, typename SH>
+size_t BvhTree<O, OT, SH>::maxObjectsPerLeaf() const
+{
+	return maxObjectsPerLeaf_;
+}
+
+
+
+/** Sets the number of objects below which a range isn't split any further.
+ *  Useful when leaves are intersected in groups.  Only affects the next reset.
+ */
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::setMaxObjectsPerLeaf(size_t maxObjectsPerLeaf)
+{
+	maxObjectsPerLeaf_ = std::max<size_t>(std::min<size_t>(maxObjectsPerLeaf, maxObjectsPerForcedLeaf), 1);
+}
+
+
+
+template <typename O, typename OT, typename SH>
+const BvhTreeBase::Statistics& BvhTree<O, OT, SH>::statistics() const
+{
+	return statistics_;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::swap(TSelf& other)
+{
+	std::swap(nodes_, other.nodes_);
+	std::swap(numNodes_, other.numNodes_);
+	storage_.swap(other.storage_);
+	std::swap(maxObjectsPerLeaf_, other.maxObjectsPerLeaf_);
+	objects_.swap(other.objects_);
+	indices_.swap(other.indices_);
+	std::swap(buildCost_, other.buildCost_);
+	std::swap(aabb_, other.aabb_);
+	std::swap(end_, other.end_);
+	std::swap(statistics_, other.statistics_);
+}
+
+
+
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::isEmpty() const
+{
+	return objects_.empty();
+}
+
+
+
+template <typename O, typename OT, typename SH>
+const typename BvhTree<O, OT, SH>::TObjectIterator BvhTree<O, OT, SH>::end() const
+{
+	return end_;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::clear()
+{
+	TSelf temp;
+	temp.end_ = end_;
+	temp.maxObjectsPerLeaf_ = maxObjectsPerLeaf_;
+	swap(temp);
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+/** collapses the binary tree below @a node into four-wide nodes, by repeatedly replacing the
+ *  internal child with the largest surface by its own two children.
+ */
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TIndex BvhTree<O, OT, SH>::flatten(const BuildNode& node, size_t depth, TNodes& nodes)
+{
+	const BuildNode* children[4] = { &node, 0, 0, 0 };
+	size_t n = 1;
+	if (!node.isLeaf())
+	{
+		children[0] = node.children[0].get();
+		children[1] = node.children[1].get();
+		n = 2;
+		while (n < 4)
+		{
+			size_t largest = n;
+			TValue largestArea = -1;
+			for (size_t k = 0; k < n; ++k)
+			{
+				const TValue area = children[k]->bounds.halfArea();
+				if (!children[k]->isLeaf() && area > largestArea)
+				{
+					largest = k;
+					largestArea = area;
+				}
+			}
+			if (largest == n)
+			{
+				break;
+			}
+			const BuildNode* parent = children[largest];
+			children[largest] = parent->children[0].get();
+			children[n++] = parent->children[1].get();
+		}
+	}
+
+	const TIndex index = static_cast<TIndex>(nodes.size());
+	nodes.push_back(Node());
+	statistics_.maxDepth = std::max(statistics_.maxDepth, depth);
+	TIndex indices[4];
+	std::uint8_t counts[4];
+	for (size_t k = 0; k < n; ++k)
+	{
+		const BuildNode& child = *children[k];
+		if (child.isLeaf())
+		{
+			LASS_ASSERT(child.last - child.first <= 255);
+			indices[k] = static_cast<TIndex>(child.first);
+			counts[k] = static_cast<std::uint8_t>(child.last - child.first);
+			++statistics_.numLeaves;
+		}
+		else
+		{
+			indices[k] = flatten(child, depth + 1, nodes);
+			counts[k] = 0;
+		}
+	}
+
+	Node& result = nodes[index]; // flatten may have reallocated nodes.
+	encodeFrame(result, node.bounds);
+	for (size_t k = 0; k < 4; ++k)
+	{
+		if (k < n)
+		{
+			encodeChild(result, k, children[k]->bounds);
+			result.index[k] = indices[k];
+			result.count[k] = counts[k];
+		}
+		else
+		{
+			for (size_t a = 0; a < dimension; ++a)
+			{
+				result.min[a][k] = 255;
+				result.max[a][k] = 0;
+			}
+			result.index[k] = invalidIndex;
+			result.count[k] = 0;
+		}
+	}
+	return index;
+}
+
+
+
+/** Picks origin and exponents of @a node so that the bounds of all children can be quantized
+ *  relative to @a bounds.  The origin is rounded down to single precision, and the exponent is the
+ *  smallest one for which 255 steps cover the whole of @a bounds.
+ */
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::encodeFrame(Node& node, const Bounds& bounds)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		float origin = static_cast<float>(bounds.min[a]);
+		if (origin > bounds.min[a])
+		{
+			origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+		}
+		node.origin[a] = origin;
+		const TValue extent = bounds.max[a] - origin;
+		int exponent = extent > 0 ? std::max(std::ilogb(extent / 255) - 1, -126) : -126;
+		node.exponent[a] = static_cast<std::int8_t>(exponent);
+		while (exponent < 127 && decode(node, a, 255) < bounds.max[a])
+		{
+			node.exponent[a] = static_cast<std::int8_t>(++exponent);
+		}
+	}
+}
+
+
+
+/** Quantizes the bounds of child @a k, rounding outwards, so that the decoded bounds always
+ *  contain the original ones.
+ */
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::encodeChild(Node& node, size_t k, const Bounds& bounds)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		const TValue s = scale(node.exponent[a]);
+		const TValue lo = std::floor((bounds.min[a] - node.origin[a]) / s);
+		const TValue hi = std::ceil((bounds.max[a] - node.origin[a]) / s);
+		int qMin = static_cast<int>(std::min<TValue>(std::max<TValue>(lo, 0), 255));
+		int qMax = static_cast<int>(std::min<TValue>(std::max<TValue>(hi, 0), 255));
+		while (qMin > 0 && decode(node, a, static_cast<std::uint8_t>(qMin)) > bounds.min[a])
+		{
+			--qMin;
+		}
+		while (qMax < 255 && decode(node, a, static_cast<std::uint8_t>(qMax)) < bounds.max[a])
+		{
+			++qMax;
+		}
+		node.min[a][k] = static_cast<std::uint8_t>(qMin);
+		node.max[a][k] = static_cast<std::uint8_t>(qMax);
+	}
+}
+
+
+
+/** returns 2^exponent, for exponents in [-126, 127].
+ */
+template <typename O, typename OT, typename SH>
+float BvhTree<O, OT, SH>::scale(std::int8_t exponent)
+{
+	const std::uint32_t bits = static_cast<std::uint32_t>(exponent + 127) << 23;
+	float result;
+	std::memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+
+
+/** q * 2^exponent is exact, so the only rounding is in adding the origin.  That's the same
+ *  whether it's fused or not, so encoding and traversal always agree on the decoded bounds.
+ */
+template <typename O, typename OT, typename SH>
+float BvhTree<O, OT, SH>::decode(const Node& node, size_t axis, std::uint8_t q)
+{
+	return node.origin[axis] + static_cast<float>(q) * scale(node.exponent[axis]);
+}
+
+
+
+/** Uses the nodes of a cached tree with the same header, straight from the mapped file.  The file
+ *  is checked to be consistent, so that a corrupt one can't cause out of bounds accesses.
+ */
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::loadCache(const std::filesystem::path& directory, const CacheHeader& expected, const TObjectIterators& objects)
+{
+	const TMappedFilePtr file = BvhTreeBase::loadCache(directory, expected);
+	if (!file)
+	{
+		return false;
+	}
+	const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(file->data());
+	const size_t numNodes = static_cast<size_t>(header.numNodes);
+	const size_t numObjects = static_cast<size_t>(header.numObjects);
+	const Node* nodes = reinterpret_cast<const Node*>(file->data() + cacheHeaderSize);
+	const TIndex* indices = reinterpret_cast<const TIndex*>(nodes + numNodes);
+
+	for (size_t i = 0; i < numNodes; ++i)
+	{
+		for (size_t k = 0; k < 4; ++k)
+		{
+			const size_t index = nodes[i].index[k];
+			const size_t count = nodes[i].count[k];
+			const bool isValid = count > 0 ? index + count <= numObjects : (index == invalidIndex || (index > i && index < numNodes));
+			if (!isValid)
+			{
+				return false;
+			}
+		}
+	}
+	TObjectIterators reordered;
+	reordered.reserve(numObjects);
+	for (size_t i = 0; i < numObjects; ++i)
+	{
+		if (indices[i] >= objects.size())
+		{
+			return false;
+		}
+		reordered.push_back(objects[indices[i]]);
+	}
+	indices_.assign(indices, indices + numObjects);
+
+	nodes_ = nodes;
+	numNodes_ = numNodes;
+	storage_ = file;
+	objects_.swap(reordered);
+	statistics_.numCacheHits = 1;
+	statistics_.numLeaves = static_cast<size_t>(header.numLeaves);
+	statistics_.maxDepth = static_cast<size_t>(header.maxDepth);
+	return true;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::saveCache(const std::filesystem::path& directory, CacheHeader header, const TPrimitives& primitives) const
+{
+	LASS_ASSERT(indices_.size() == primitives.size());
+	header.numNodes = numNodes_;
+	header.numLeaves = statistics_.numLeaves;
+	header.maxDepth = statistics_.maxDepth;
+	BvhTreeBase::saveCache(directory, header, nodes_, numNodes_ * sizeof(Node), indices_.data(), indices_.size() * sizeof(TIndex));
+}
+
+
+
+/** Finds the children of @a node that are hit by @a ray within [tMin, tMax], and returns how many.
+ *  Their indices are stored in @a order from front to back, and their entry distance in @a tNear.
+ *
+ *  The far distance is slightly enlarged to make the test conservative for rounding errors.
+ */
+template <typename O, typename OT, typename SH>
+size_t BvhTree<O, OT, SH>::intersectChildren(const Node& node, const SlabRay& ray, TValue tMin, TValue tMax, TValue* tNear, size_t* order) const
+{
+	const TValue robustness = 1 + 4 * std::numeric_limits<TValue>::epsilon();
+	float scales[dimension];
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		scales[a] = scale(node.exponent[a]);
+	}
+	size_t n = 0;
+	for (size_t k = 0; k < 4; ++k)
+	{
+		if (node.count[k] == 0 && node.index[k] == invalidIndex)
+		{
+			continue;
+		}
+		TValue t0 = tMin;
+		TValue t1 = tMax;
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			const std::uint8_t* nearPlane = ray.isNegative[a] ? node.max[a] : node.min[a];
+			const std::uint8_t* farPlane = ray.isNegative[a] ? node.min[a] : node.max[a];
+			const TValue nearValue = node.origin[a] + static_cast<float>(nearPlane[k]) * scales[a];
+			const TValue farValue = node.origin[a] + static_cast<float>(farPlane[k]) * scales[a];
+			const TValue tn = (nearValue - ray.support[a]) * ray.invDirection[a];
+			const TValue tf = (farValue - ray.support[a]) * ray.invDirection[a] * robustness;
+			t0 = tn > t0 ? tn : t0;
+			t1 = tf < t1 ? tf : t1;
+		}
+		if (t0 > t1)
+		{
+			continue;
+		}
+		size_t i = n++;
+		for (; i > 0 && tNear[order[i - 1]] > t0; --i)
+		{
+			order[i] = order[i - 1];
+		}
+		order[i] = k;
+		tNear[k] = t0;
+	}
+	return n;
+}
+
+
+
+/** Like intersectChildren for a single ray, but for the rays of @a packet set in @a active.  The
+ *  child bounds are decoded once, and then tested against all rays.  The rays that hit child k are
+ *  stored in masks[k], and the children that are hit by any are stored in @a order, sorted by
+ *  their nearest entry distance.
+ */
+template <typename O, typename OT, typename SH>
+size_t BvhTree<O, OT, SH>::intersectChildren(const Node& node, const SlabPacket& packet, TMask active, const TValue* tMin, const TValue* tMax, TMask* masks, size_t* order) const
+{
+	const TValue robustness = 1 + 4 * std::numeric_limits<TValue>::epsilon();
+	TValue tFirst[4];
+	size_t n = 0;
+	for (size_t k = 0; k < 4; ++k)
+	{
+		if (node.count[k] == 0 && node.index[k] == invalidIndex)
+		{
+			continue;
+		}
+		TValue minValue[dimension];
+		TValue maxValue[dimension];
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			minValue[a] = decode(node, a, node.min[a][k]);
+			maxValue[a] = decode(node, a, node.max[a][k]);
+		}
+		TMask mask = 0;
+		TValue tEntry = std::numeric_limits<TValue>::infinity();
+		for (size_t lane = 0; lane < packet.size; ++lane)
+		{
+			TValue t0 = tMin[lane];
+			TValue t1 = tMax[lane];
+			for (size_t a = 0; a < dimension; ++a)
+			{
+				const bool isNegative = packet.isNegative[a][lane];
+				const TValue tn = ((isNegative ? maxValue[a] : minValue[a]) - packet.support[a][lane]) * packet.invDirection[a][lane];
+				const TValue tf = ((isNegative ? minValue[a] : maxValue[a]) - packet.support[a][lane]) * packet.invDirection[a][lane] * robustness;
+				t0 = tn > t0 ? tn : t0;
+				t1 = tf < t1 ? tf : t1;
+			}
+			const bool isHit = t0 <= t1 && ((active >> lane) & 1);
+			mask |= static_cast<TMask>(isHit) << lane;
+			tEntry = isHit && t0 < tEntry ? t0 : tEntry;
+		}
+		if (!mask)
+		{
+			continue;
+		}
+		masks[k] = mask;
+		size_t i = n++;
+		for (; i > 0 && tFirst[order[i - 1]] > tEntry; --i)
+		{
+			order[i] = order[i - 1];
+		}
+		order[i] = k;
+		tFirst[k] = tEntry;
+	}
+	return n;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::contains(const Node& node, size_t k, const TPoint& point) const
+{
+	if (node.count[k] == 0 && node.index[k] == invalidIndex)
+	{
+		return false;
+	}
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		const TValue x = TObjectTraits::coord(point, a);
+		if (!(x >= decode(node, a, node.min[a][k]) && x <= decode(node, a, node.max[a][k])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+// --- Bounds --------------------------------------------------------------------------------------
+
+template <typename O, typename OT, typename SH>
+BvhTree<O, OT, SH>::Bounds::Bounds()
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		min[a] = std::numeric_limits<TValue>::infinity();
+		max[a] = -std::numeric_limits<TValue>::infinity();
+	}
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::Bounds::grow(const Bounds& other)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		min[a] = std::min(min[a], other.min[a]);
+		max[a] = std::max(max[a], other.max[a]);
+	}
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::Bounds::grow(const TValue* point)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		min[a] = std::min(min[a], point[a]);
+		max[a] = std::max(max[a], point[a]);
+	}
+}
+
+
+
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TValue BvhTree<O, OT, SH>::Bounds::centroid(size_t axis) const
+{
+	return (min[axis] + max[axis]) / 2;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+typename BvhTree<O, OT, SH>::TValue BvhTree<O, OT, SH>::Bounds::halfArea() const
+{
+	if (isEmpty())
+	{
+		return 0;
+	}
+	TValue result = 0;
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		for (size_t b = a + 1; b < dimension; ++b)
+		{
+			result += (max[a] - min[a]) * (max[b] - min[b]);
+		}
+	}
+	return result;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+bool BvhTree<O, OT, SH>::Bounds::isEmpty() const
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		if (!(min[a] <= max[a]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+template <typename O, typename OT, typename SH>
+void BvhTree<O, OT, SH>::Bins::merge(const Bins& other)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		for (size_t i = 0; i < numBins; ++i)
+		{
+			Bin& bin = bins[a][i];
+			const Bin& otherBin = other.bins[a][i];
+			bin.bounds.grow(otherBin.bounds);
+			bin.centroids.grow(otherBin.centroids);
+			bin.count += otherBin.count;
+		}
+	}
+}
+
+
+
+template <typename O, typename OT, typename SH>
+BvhTree<O, OT, SH>::SlabRay::SlabRay(const TRay& ray)
+{
+	const TPoint s = TObjectTraits::raySupport(ray);
+	const TVector invDir = TObjectTraits::vectorReciprocal(TObjectTraits::rayDirection(ray));
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		support[a] = TObjectTraits::coord(s, a);
+		invDirection[a] = TObjectTraits::coord(invDir, a);
+		isNegative[a] = invDirection[a] < 0;
+	}
+}
+
+
+
+template <typename O, typename OT, typename SH>
+BvhTree<O, OT, SH>::SlabPacket::SlabPacket(const TRay* rays, size_t numRays):
+	size(numRays)
+{
+	for (size_t lane = 0; lane < numRays; ++lane)
+	{
+		const SlabRay ray(rays[lane]);
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			support[a][lane] = ray.support[a];
+			invDirection[a][lane] = ray.invDirection[a];
+			isNegative[a][lane] = ray.isNegative[a] != 0;
+		}
+	}
+}
+
+}
+
+}
+
+// EOF
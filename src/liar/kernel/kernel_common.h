@@ -245,6 +245,23 @@ void latinHypercube2D(RandomAccessRange& range, Generator& generator)
 	latinHypercube2D(range.begin(), range.end(), generator);
 }
 
+/** interleave the bits of i and j, to lay out 2D cells in Morton order.
+ */
+inline num::Tuint64 mortonCode(size_t i, size_t j)
+{
+	auto spread = [](num::Tuint64 x)
+	{
+		x &= 0xffffffff;
+		x = (x | (x << 16)) & 0x0000ffff0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+		x = (x | (x << 2)) & 0x3333333333333333;
+		x = (x | (x << 1)) & 0x5555555555555555;
+		return x;
+	};
+	return spread(static_cast<num::Tuint64>(i)) | (spread(static_cast<num::Tuint64>(j)) << 1);
+}
+
 inline TScalar sphericalPhi(const TVector3D& v)
 {
 	if (v.x == 0 && v.y == 0)
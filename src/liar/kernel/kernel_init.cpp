@@ -26,6 +26,7 @@
 // keep in alphabetical order please! [Bramz]
 //
 #include "attenuation.h"
+#include "bvh_tree.h"
 #include "camera.h"
 #include "image_codec.h"
 #include "medium.h"
@@ -40,6 +41,7 @@
 #include "render_target.h"
 #include "rgb_space.h"
 #include "sampler.h"
+#include "sampler_adaptive.h"
 #include "sampler_progressive.h"
 #include "sampler_tiled.h"
 #include "scene_light.h"
@@ -75,6 +77,26 @@ void setTolerance(liar::TScalar tolerance)
 	liar::tolerance = tolerance;
 }
 
+std::filesystem::path bvhCacheDirectory()
+{
+	return liar::kernel::BvhTreeBase::cacheDirectory();
+}
+
+void setBvhCacheDirectory(const std::filesystem::path& directory)
+{
+	liar::kernel::BvhTreeBase::setCacheDirectory(directory);
+}
+
+double bvhMaxRefitCostGrowth()
+{
+	return liar::kernel::BvhTreeBase::maxRefitCostGrowth();
+}
+
+void setBvhMaxRefitCostGrowth(double factor)
+{
+	liar::kernel::BvhTreeBase::setMaxRefitCostGrowth(factor);
+}
+
 PY_DECLARE_MODULE_DOC(kernel, "LiAR isn't a raytracer")
 
 // keep in alphabetical order please! [Bramz]
@@ -95,6 +117,7 @@ PY_MODULE_CLASS(kernel, liar::kernel::RayTracer)
 PY_MODULE_CLASS(kernel, liar::kernel::RenderEngine)
 PY_MODULE_CLASS(kernel, liar::kernel::RenderTarget)
 PY_MODULE_CLASS(kernel, liar::kernel::Sampler)
+	PY_MODULE_CLASS(kernel, liar::kernel::SamplerAdaptive)
 	PY_MODULE_CLASS(kernel, liar::kernel::SamplerProgressive)
 	PY_MODULE_CLASS(kernel, liar::kernel::SamplerTiled)
 PY_MODULE_CLASS(kernel, liar::kernel::ScalarSpline)
@@ -112,6 +135,19 @@ PY_MODULE_CLASS(kernel, liar::kernel::PyTransformation3D)
 PY_MODULE_FUNCTION(kernel, license)
 PY_MODULE_FUNCTION(kernel, tolerance)
 PY_MODULE_FUNCTION(kernel, setTolerance)
+PY_MODULE_FUNCTION_DOC(kernel, bvhCacheDirectory,
+	"bvhCacheDirectory() -> path\n"
+	"directory where built BVHs are cached, or an empty path if they aren't.\n")
+PY_MODULE_FUNCTION_DOC(kernel, setBvhCacheDirectory,
+	"setBvhCacheDirectory(path) -> None\n"
+	"cache built BVHs in directory, so that they're loaded instead of rebuilt next time the same geometry is used.\n"
+	"An empty path disables the cache.\n")
+PY_MODULE_FUNCTION_DOC(kernel, bvhMaxRefitCostGrowth,
+	"bvhMaxRefitCostGrowth() -> float\n"
+	"factor by which refitting a BVH to moved geometry may increase its SAH cost, before it's rebuilt instead.\n")
+PY_MODULE_FUNCTION_DOC(kernel, setBvhMaxRefitCostGrowth,
+	"setBvhMaxRefitCostGrowth(factor) -> None\n"
+	"set the factor by which refitting a BVH may increase its SAH cost, before it's rebuilt instead.  Default is 1.5.\n")
 
 using lass::util::setProcessPriority;
 PY_MODULE_FUNCTION_QUALIFIED_DOC_1(kernel, setProcessPriority, void, const std::string&,
@@ -0,0 +1,156 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace liar
+{
+namespace kernel
+{
+
+// --- public --------------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::filesystem::path& path):
+	data_(0),
+	size_(0),
+	file_(INVALID_HANDLE_VALUE),
+	mapping_(0)
+{
+	file_ = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file_ == INVALID_HANDLE_VALUE)
+	{
+		LASS_THROW("failed to open " << path.string() << ".");
+	}
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file_, &size))
+	{
+		::CloseHandle(file_);
+		LASS_THROW("failed to get size of " << path.string() << ".");
+	}
+	size_ = static_cast<size_t>(size.QuadPart);
+	if (size_ == 0)
+	{
+		return;
+	}
+	mapping_ = ::CreateFileMappingW(file_, 0, PAGE_READONLY, 0, 0, 0);
+	data_ = mapping_ ? static_cast<const char*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : 0;
+	if (!data_)
+	{
+		if (mapping_)
+		{
+			::CloseHandle(mapping_);
+		}
+		::CloseHandle(file_);
+		LASS_THROW("failed to map " << path.string() << " in memory.");
+	}
+}
+
+
+
+MappedFile::~MappedFile()
+{
+	if (data_)
+	{
+		::UnmapViewOfFile(data_);
+		::CloseHandle(mapping_);
+	}
+	::CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path):
+	data_(0),
+	size_(0)
+{
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		LASS_THROW("failed to open " << path.string() << ".");
+	}
+	struct stat status;
+	if (::fstat(fd, &status) != 0)
+	{
+		::close(fd);
+		LASS_THROW("failed to get size of " << path.string() << ".");
+	}
+	size_ = static_cast<size_t>(status.st_size);
+	if (size_ == 0)
+	{
+		::close(fd);
+		return;
+	}
+	void* data = ::mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd); // the mapping keeps its own reference to the file.
+	if (data == MAP_FAILED)
+	{
+		LASS_THROW("failed to map " << path.string() << " in memory.");
+	}
+	data_ = static_cast<const char*>(data);
+}
+
+
+
+MappedFile::~MappedFile()
+{
+	if (data_)
+	{
+		::munmap(const_cast<char*>(data_), size_);
+	}
+}
+
+#endif
+
+
+
+const char* MappedFile::data() const
+{
+	return data_;
+}
+
+
+
+size_t MappedFile::size() const
+{
+	return size_;
+}
+
+}
+
+}
+
+// EOF
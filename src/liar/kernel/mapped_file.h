@@ -0,0 +1,70 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::MappedFile
+ *  @brief maps a whole file read-only in memory.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Pages are only read from disk when they're touched, and are shared with other processes that map
+ *  the same file.  The mapping lives as long as the MappedFile does.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_MAPPED_FILE_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_MAPPED_FILE_H
+
+#include "kernel_common.h"
+#include <lass/util/non_copyable.h>
+#include <filesystem>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL MappedFile: util::NonCopyable
+{
+public:
+
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+
+	const char* data() const;
+	size_t size() const;
+
+private:
+
+	const char* data_;
+	size_t size_;
+#if defined(_WIN32)
+	void* file_;
+	void* mapping_;
+#endif
+};
+
+}
+
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,310 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "preprocess_graph.h"
+#include "bvh_tree.h"
+#include <lass/util/clock.h>
+#include <lass/util/thread_fun.h>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <typeinfo>
+
+namespace liar
+{
+namespace kernel
+{
+
+namespace
+{
+	/** adds a task per unique object, and makes it depend on the tasks of its children.
+	 */
+	class GraphBuilder: public util::VisitorBase, public util::Visitor<SceneObject>
+	{
+	public:
+		GraphBuilder(PreProcessGraph& graph, const TimePeriod& period):
+			graph_(graph),
+			period_(period),
+			pass_(SceneObject::newPreProcessPass())
+		{
+		}
+		PreProcessGraph::TTaskId root() const
+		{
+			return root_;
+		}
+	private:
+		void doPreVisit(SceneObject& object)
+		{
+			PreProcessGraph::TTaskId task;
+			const TTasks::const_iterator i = tasks_.find(&object);
+			if (i == tasks_.end())
+			{
+				const TimePeriod period = period_;
+				const size_t pass = pass_;
+				SceneObject* obj = &object;
+				task = graph_.add(nameOf(object), [obj, period, pass]() { obj->preProcess(period, pass); });
+				tasks_[&object] = task;
+			}
+			else
+			{
+				task = i->second;
+			}
+			if (path_.empty())
+			{
+				root_ = task;
+			}
+			else if (edges_.insert(std::make_pair(path_.back(), task)).second)
+			{
+				graph_.addDependency(path_.back(), task);
+			}
+			path_.push_back(task);
+		}
+		void doPostVisit(SceneObject&)
+		{
+			path_.pop_back();
+		}
+		static std::string nameOf(SceneObject& object)
+		{
+			const PyTypeObject* type = Py_TYPE(static_cast<PyObject*>(&object));
+			return type && type->tp_name ? type->tp_name : typeid(object).name();
+		}
+
+		typedef std::map<const SceneObject*, PreProcessGraph::TTaskId> TTasks;
+		typedef std::set< std::pair<PreProcessGraph::TTaskId, PreProcessGraph::TTaskId> > TEdges;
+
+		PreProcessGraph& graph_;
+		TimePeriod period_;
+		size_t pass_;
+		TTasks tasks_;
+		TEdges edges_;
+		std::vector<PreProcessGraph::TTaskId> path_;
+		PreProcessGraph::TTaskId root_ = 0;
+	};
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+PreProcessGraph::PreProcessGraph():
+	numberOfThreads_(0),
+	wallTime_(0)
+{
+}
+
+
+
+PreProcessGraph::TTaskId PreProcessGraph::add(const std::string& name, const TFunction& function)
+{
+	Task task;
+	task.name = name;
+	task.function = function;
+	task.numDependencies = 0;
+	task.duration = 0;
+	tasks_.push_back(task);
+	return tasks_.size() - 1;
+}
+
+
+
+/** @a task will only run after @a dependency is done.
+ */
+void PreProcessGraph::addDependency(TTaskId task, TTaskId dependency)
+{
+	LASS_ENFORCE(task < tasks_.size() && dependency < tasks_.size() && task != dependency);
+	tasks_[dependency].dependents.push_back(task);
+	++tasks_[task].numDependencies;
+}
+
+
+
+/** Adds the preprocessing of all objects in @a scene, and returns the task of the root.
+ */
+PreProcessGraph::TTaskId PreProcessGraph::addScene(const TSceneObjectPtr& scene, const TimePeriod& period)
+{
+	GraphBuilder builder(*this, period);
+	scene->accept(builder);
+	return builder.root();
+}
+
+
+
+/** Runs all tasks on @a numberOfThreads threads, including the calling one.
+ *  If a task throws, no new tasks are started and the exception is rethrown once all threads are done.
+ */
+void PreProcessGraph::run(size_t numberOfThreads)
+{
+	const size_t n = tasks_.size();
+	numberOfThreads_ = std::max<size_t>(std::min(numberOfThreads, n), 1);
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<TTaskId> ready;
+	std::vector<size_t> numDependencies(n);
+	for (TTaskId k = 0; k < n; ++k)
+	{
+		numDependencies[k] = tasks_[k].numDependencies;
+		if (numDependencies[k] == 0)
+		{
+			ready.push_back(k);
+		}
+	}
+	size_t numDone = 0;
+	std::exception_ptr error;
+	util::Clock clock;
+	const util::Clock::TTime start = clock.time();
+
+	// the tasks share the threads with the BVH builds they run: a worker that waits for a task
+	// lends its thread, so that a big build can still use all of them once others are done.
+	// A worker that wakes up while its thread is lent takes it back anyway, so the budget can be
+	// exceeded until the build gives the thread back, which it does after one chunk or subtree.
+	BvhTreeBase::SharedBuildThreads buildThreads(numberOfThreads);
+
+	auto work = [&]()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		buildThreads.reclaim();
+		while (true)
+		{
+			if (ready.empty() && numDone < n && !error)
+			{
+				buildThreads.lend();
+				condition.wait(lock, [&]() { return !ready.empty() || numDone == n || error; });
+				buildThreads.reclaim();
+			}
+			if (numDone == n || error)
+			{
+				break;
+			}
+			const TTaskId k = ready.front();
+			ready.pop_front();
+			lock.unlock();
+
+			const util::Clock::TTime begin = clock.time();
+			try
+			{
+				tasks_[k].function();
+			}
+			catch (...)
+			{
+				lock.lock();
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				condition.notify_all();
+				break;
+			}
+			const TTimeDelta duration = clock.time() - begin;
+
+			lock.lock();
+			tasks_[k].duration = duration;
+			++numDone;
+			for (TTaskId dependent : tasks_[k].dependents)
+			{
+				if (--numDependencies[dependent] == 0)
+				{
+					ready.push_back(dependent);
+				}
+			}
+			condition.notify_all();
+		}
+		buildThreads.lend();
+	};
+
+	// the calling thread is a worker too, so we only need to spawn the others.
+	std::vector<std::unique_ptr<util::Thread>> threads;
+	for (size_t k = 1; k < numberOfThreads_; ++k)
+	{
+		threads.emplace_back(util::threadFun(work, util::threadJoinable));
+		threads.back()->run();
+	}
+	work();
+	for (auto& thread : threads)
+	{
+		thread->join();
+	}
+	wallTime_ = clock.time() - start;
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+	LASS_ENFORCE(numDone == n); // otherwise, there's a cycle.
+}
+
+
+
+size_t PreProcessGraph::size() const
+{
+	return tasks_.size();
+}
+
+
+
+/** Returns name and duration of every task, the slowest first.
+ */
+PreProcessGraph::TTimings PreProcessGraph::timings() const
+{
+	TTimings result;
+	result.reserve(tasks_.size());
+	for (const Task& task : tasks_)
+	{
+		result.push_back(TTiming(task.name, task.duration));
+	}
+	std::stable_sort(result.begin(), result.end(), [](const TTiming& a, const TTiming& b) { return a.second > b.second; });
+	return result;
+}
+
+
+
+TTimeDelta PreProcessGraph::wallTime() const
+{
+	return wallTime_;
+}
+
+
+
+void PreProcessGraph::report(size_t maxTasks) const
+{
+	const TTimings times = timings();
+	TTimeDelta busyTime = 0;
+	for (const TTiming& t : times)
+	{
+		busyTime += t.second;
+	}
+	LASS_COUT << "  preprocessed " << times.size() << " tasks in " << std::setprecision(3) << wallTime_ << "s on "
+		<< numberOfThreads_ << " threads (" << busyTime << "s busy)" << std::endl;
+	for (size_t k = 0; k < std::min(maxTasks, times.size()); ++k)
+	{
+		LASS_COUT << "    " << std::setprecision(3) << times[k].second << "s " << times[k].first << std::endl;
+	}
+}
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,101 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::PreProcessGraph
+ *  @brief runs preprocessing tasks on a number of threads, each one as soon as its dependencies are done.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  addScene adds a task for each unique object of a scene, as found by visiting it.  Each task
+ *  depends on the tasks of the object's children, so that those are preprocessed first.  Then,
+ *  the preProcess calls in the parent's doPreProcess simply return.  Objects shared by several
+ *  parents are added only once, so they're still preprocessed only once.  Other independent work
+ *  can be added with add, as long as it doesn't touch Python objects: tasks run on worker threads.
+ *
+ *  The tasks share the threads of run with the BVH builds they do, see BvhTreeBase::SharedBuildThreads.
+ *  So a build only gets extra threads while workers are waiting for tasks, instead of each build
+ *  taking all processors while the other workers build too.
+ *
+ *  Every task is timed, so that report can show what dominates startup.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_PREPROCESS_GRAPH_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_PREPROCESS_GRAPH_H
+
+#include "kernel_common.h"
+#include "scene_object.h"
+#include <lass/util/non_copyable.h>
+
+#include <functional>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL PreProcessGraph: util::NonCopyable
+{
+public:
+
+	typedef size_t TTaskId;
+	typedef std::function<void()> TFunction;
+	typedef std::pair<std::string, TTimeDelta> TTiming;
+	typedef std::vector<TTiming> TTimings;
+
+	PreProcessGraph();
+
+	TTaskId add(const std::string& name, const TFunction& function);
+	void addDependency(TTaskId task, TTaskId dependency);
+	TTaskId addScene(const TSceneObjectPtr& scene, const TimePeriod& period);
+
+	void run(size_t numberOfThreads);
+
+	size_t size() const;
+	TTimings timings() const;
+	TTimeDelta wallTime() const;
+	void report(size_t maxTasks = 10) const;
+
+private:
+
+	struct Task
+	{
+		std::string name;
+		TFunction function;
+		std::vector<TTaskId> dependents;
+		size_t numDependencies;
+		TTimeDelta duration;
+	};
+
+	typedef std::vector<Task> TTasks;
+
+	TTasks tasks_;
+	size_t numberOfThreads_;
+	TTimeDelta wallTime_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
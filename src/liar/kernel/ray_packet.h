@@ -0,0 +1,162 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::RayPacket
+ *  @brief a small batch of rays in SoA layout, to test them against a bounding box all at once.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Rays are stored as single precision lanes, regardless of TScalar, so that a whole packet fits
+ *  in a single AVX register per component.  Because of that, hitMask is conservative: the box is
+ *  slightly enlarged so that rounding can only cause false hits, never false misses.  Lanes that do
+ *  hit still need an exact test in full precision.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_RAY_PACKET_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_RAY_PACKET_H
+
+#include "kernel_common.h"
+#include "bounded_ray.h"
+
+#if LIAR_HAVE_AVX
+#	include <immintrin.h>
+#endif
+
+namespace liar
+{
+namespace kernel
+{
+
+class RayPacket
+{
+public:
+
+	enum { capacity = 8 };
+
+	typedef unsigned TMask;
+
+	RayPacket(const BoundedRay* rays, size_t size):
+		size_(std::min<size_t>(size, capacity))
+	{
+		for (size_t k = 0; k < capacity; ++k)
+		{
+			// unused lanes get an empty range, so they never hit.
+			const bool isUsed = k < size_;
+			const BoundedRay& ray = rays[isUsed ? k : 0];
+			const TPoint3D& support = ray.support();
+			const TVector3D& direction = ray.direction();
+			x_[k] = static_cast<float>(support.x);
+			y_[k] = static_cast<float>(support.y);
+			z_[k] = static_cast<float>(support.z);
+			invX_[k] = 1.f / static_cast<float>(direction.x);
+			invY_[k] = 1.f / static_cast<float>(direction.y);
+			invZ_[k] = 1.f / static_cast<float>(direction.z);
+			near_[k] = isUsed ? static_cast<float>(ray.nearLimit()) : 1.f;
+			far_[k] = isUsed ? static_cast<float>(ray.farLimit()) : 0.f;
+		}
+	}
+
+	size_t size() const { return size_; }
+
+	/** Returns a mask with bit k set if ray k may hit @a box within its near and far limits.
+	 */
+	TMask hitMask(const TAabb3D& box) const
+	{
+		if (box.isEmpty())
+		{
+			return 0;
+		}
+		const TVector3D margin = box.size() * TScalar(1e-4) + TVector3D(1e-6f, 1e-6f, 1e-6f);
+		const TPoint3D min = box.min() - margin;
+		const TPoint3D max = box.max() + margin;
+
+#if LIAR_HAVE_AVX
+		__m256 tNear = _mm256_load_ps(near_);
+		__m256 tFar = _mm256_load_ps(far_);
+		slab(tNear, tFar, x_, invX_, min.x, max.x);
+		slab(tNear, tFar, y_, invY_, min.y, max.y);
+		slab(tNear, tFar, z_, invZ_, min.z, max.z);
+		const TMask mask = static_cast<TMask>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+		TMask mask = 0;
+		for (size_t k = 0; k < capacity; ++k)
+		{
+			float tNear = near_[k];
+			float tFar = far_[k];
+			slab(tNear, tFar, x_[k], invX_[k], min.x, max.x);
+			slab(tNear, tFar, y_[k], invY_[k], min.y, max.y);
+			slab(tNear, tFar, z_[k], invZ_[k], min.z, max.z);
+			if (tNear <= tFar)
+			{
+				mask |= TMask(1) << k;
+			}
+		}
+#endif
+		return mask & ((TMask(1) << size_) - 1);
+	}
+
+private:
+
+#if LIAR_HAVE_AVX
+	// a ray in the plane of a slab gives 0 * inf = NaN.  min_ps and max_ps don't drop a single NaN
+	// operand, they return the second one, so such lanes are masked out to leave their range as is.
+	static void slab(__m256& tNear, __m256& tFar, const float* support, const float* invDirection, TScalar min, TScalar max)
+	{
+		const __m256 s = _mm256_load_ps(support);
+		const __m256 inv = _mm256_load_ps(invDirection);
+		const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(min)), s), inv);
+		const __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(max)), s), inv);
+		const __m256 isOrdered = _mm256_cmp_ps(t1, t2, _CMP_ORD_Q);
+		tNear = _mm256_blendv_ps(tNear, _mm256_max_ps(_mm256_min_ps(t1, t2), tNear), isOrdered);
+		tFar = _mm256_blendv_ps(tFar, _mm256_min_ps(_mm256_max_ps(t1, t2), tFar), isOrdered);
+	}
+#else
+	static void slab(float& tNear, float& tFar, float support, float invDirection, TScalar min, TScalar max)
+	{
+		const float t1 = (static_cast<float>(min) - support) * invDirection;
+		const float t2 = (static_cast<float>(max) - support) * invDirection;
+		if (!num::isNaN(t1) && !num::isNaN(t2))
+		{
+			tNear = std::max(std::min(t1, t2), tNear);
+			tFar = std::min(std::max(t1, t2), tFar);
+		}
+	}
+#endif
+
+	alignas(32) float x_[capacity];
+	alignas(32) float y_[capacity];
+	alignas(32) float z_[capacity];
+	alignas(32) float invX_[capacity];
+	alignas(32) float invY_[capacity];
+	alignas(32) float invZ_[capacity];
+	alignas(32) float near_[capacity];
+	alignas(32) float far_[capacity];
+	size_t size_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
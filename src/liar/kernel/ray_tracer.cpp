@@ -23,6 +23,7 @@
 
 #include "kernel_common.h"
 #include "ray_tracer.h"
+#include "ray_packet.h"
 
 namespace liar
 {
@@ -125,6 +126,59 @@ void RayTracer::preProcess(const TSamplerPtr& sampler, const TimePeriod& period,
 
 
 
+/** prepare for a render pass, before any ray of that pass is cast.
+ *  Called on the ray tracer attached to the render engine, not on the clones of the render threads,
+ *  so anything that changes per pass must be shared with those clones.
+ *  @param pass [in] index of the pass within the render, starting at zero.
+ */
+void RayTracer::beginPass(const TSamplerPtr& sampler, const TimePeriod& period, size_t pass, size_t numberOfThreads)
+{
+	doBeginPass(sampler, period, pass, numberOfThreads);
+}
+
+
+
+/** true if the ray tracer refines its estimates from pass to pass, and wants the render to be split in passes.
+ */
+bool RayTracer::hasPasses() const
+{
+	return doHasPasses();
+}
+
+
+
+/** cast a number of coherent primary rays at once.
+ *  Equivalent to calling castRay for each of them, but allows tracers to intersect them as a packet.
+ *  @warning castRays is NOT THREAD SAFE!
+ */
+void RayTracer::castRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, bool highQuality) const
+{
+	RayGenerationIncrementor incrementor(*this);
+	if (static_cast<size_t>(rayGeneration_) > maxRayGeneration_)
+	{
+		for (size_t k = 0; k < count; ++k)
+		{
+			radiances[k] = Spectral();
+			tIntersections[k] = TNumTraits::infinity;
+			alphas[k] = 0;
+		}
+		return;
+	}
+	doCastRays(samples, primaryRays, radiances, tIntersections, alphas, count, static_cast<size_t>(rayGeneration_), highQuality);
+}
+
+
+
+/** number of primary rays the render engine should pass to castRays at once.
+ */
+size_t RayTracer::batchSize() const
+{
+	return doBatchSize();
+}
+
+
+
 const TRayTracerPtr RayTracer::clone() const
 {
 	const TRayTracerPtr result = doClone();
@@ -189,6 +243,37 @@ const Spectral RayTracer::estimateLightContribution(
 		const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
 		const Sample::TSubSequence2D& lightSamples, const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
 		const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn) const
+{
+	LASS_ASSERT(shadowRays_.empty());
+	gatherLightContribution(sample, bsdf, light, lightSamples, bsdfSamples, componentSamples, target, targetNormal, omegaIn);
+	return resolveLightContributions(sample);
+}
+
+
+
+/** Like estimateLightContribution, but instead of testing the shadow rays right away, they are
+ *  queued with their unoccluded contribution (multiplied by @a scale), so that all shadow rays of
+ *  a shading point can be tested in one go by resolveLightContributions.
+ */
+void RayTracer::gatherLightContribution(
+		const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
+		const Sample::TSubSequence2D& lightSamples, const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
+		const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn, TScalar scale) const
+{
+	gatherLightContribution(sample, bsdf, light, lightSamples, bsdfSamples, componentSamples, target, targetNormal, omegaIn,
+		shadowRays_, shadowContributions_, scale);
+}
+
+
+
+/** Like above, but the shadow rays are queued in @a shadowRays and @a shadowContributions instead,
+ *  for tracers that want to test them at their own pace.
+ */
+void RayTracer::gatherLightContribution(
+		const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
+		const Sample::TSubSequence2D& lightSamples, const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
+		const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn,
+		TShadowRays& shadowRays, TShadowContributions& shadowContributions, TScalar scale) const
 {
 	LASS_ASSERT(bsdfSamples.size() == componentSamples.size());
 
@@ -206,7 +291,6 @@ const Spectral RayTracer::estimateLightContribution(
 	}
 	// what about indirect estimator caps???
 
-	Spectral result;
 	const TPoint3D start = target + 10 * liar::tolerance * targetNormal;
 
 	if (nl > 0)
@@ -222,14 +306,15 @@ const Spectral RayTracer::estimateLightContribution(
 			}
 			const TVector3D omegaOut = bsdf->worldToBsdf(shadowRay.direction());
 			const BsdfOut out = bsdf->evaluate(omegaIn, omegaOut, caps);
-			if (!out || scene()->isIntersecting(sample, shadowRay) != isShadowOnly)
+			if (!out)
 			{
 				continue;
 			}
-			const Spectral trans = mediumStack().transmittance(sample, shadowRay);
 			const TScalar weight = temp::squaredHeuristic(nl * lightPdf, nb * out.pdf);
 			const TScalar cosTheta = omegaOut.z;
-			result += out.value * trans * radiance * static_cast<Spectral::TValue>(sign * weight * num::abs(cosTheta) / (nl * lightPdf));
+			shadowRays.push_back(shadowRay);
+			shadowContributions.push_back(ShadowContribution{
+				out.value * radiance * static_cast<Spectral::TValue>(scale * sign * weight * num::abs(cosTheta) / (nl * lightPdf)), isShadowOnly });
 		}
 	}
 
@@ -251,23 +336,52 @@ const Spectral RayTracer::estimateLightContribution(
 			{
 				continue;
 			}
-			if (scene()->isIntersecting(sample, shadowRay) != isShadowOnly)
-			{
-				continue;
-			}
-			const Spectral trans = mediumStack().transmittance(sample, shadowRay);
 			const TScalar weight = !hasCaps(out.usedCaps, BsdfCaps::specular)
 				? temp::squaredHeuristic(nb * out.pdf, nl * lightPdf)
 				: 1;
 			const TScalar cosTheta = out.omegaOut.z;
-			result += out.value * trans * radiance * static_cast<Spectral::TValue>(sign * weight * num::abs(cosTheta) / (nb * out.pdf));
+			shadowRays.push_back(shadowRay);
+			shadowContributions.push_back(ShadowContribution{
+				out.value * radiance * static_cast<Spectral::TValue>(scale * sign * weight * num::abs(cosTheta) / (nb * out.pdf)), isShadowOnly });
+		}
+	}
+}
+
+
+
+/** Tests all shadow rays queued by gatherLightContribution for occlusion in one pass over the scene,
+ *  and returns the sum of the contributions that reach the shading point.
+ */
+const Spectral RayTracer::resolveLightContributions(const Sample& sample) const
+{
+	LASS_ASSERT(shadowRays_.size() == shadowContributions_.size());
+	const size_t batchSize = 64;
+	bool isOccluded[batchSize];
+
+	Spectral result;
+	const size_t n = shadowRays_.size();
+	for (size_t i = 0; i < n; i += batchSize)
+	{
+		const size_t m = std::min(n - i, batchSize);
+		scene()->areIntersecting(sample, &shadowRays_[i], isOccluded, m);
+		for (size_t k = 0; k < m; ++k)
+		{
+			const ShadowContribution& contribution = shadowContributions_[i + k];
+			if (isOccluded[k] != contribution.isShadowOnly)
+			{
+				continue;
+			}
+			result += contribution.value * mediumStack().transmittance(sample, shadowRays_[i + k]);
 		}
 	}
 
+	shadowRays_.clear();
+	shadowContributions_.clear();
 	return result;
 }
 
 
+
 /** Helper function for some RayTracer implementations to request
  *  samples for lights and shaders. This is mostly for the DirectLighting one.
  */
@@ -280,6 +394,40 @@ void RayTracer::requestLightAndSceneSamples(const TSamplerPtr& sampler)
 
 // --- private -------------------------------------------------------------------------------------
 
+/** By default, rays are cast one by one.
+ */
+void RayTracer::doCastRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, size_t generation, bool highQuality) const
+{
+	for (size_t k = 0; k < count; ++k)
+	{
+		radiances[k] = doCastRay(samples[k], primaryRays[k], tIntersections[k], alphas[k], generation, highQuality);
+	}
+}
+
+
+
+size_t RayTracer::doBatchSize() const
+{
+	return RayPacket::capacity;
+}
+
+
+
+/** By default, all passes are rendered alike.
+ */
+void RayTracer::doBeginPass(const TSamplerPtr&, const TimePeriod&, size_t, size_t)
+{
+}
+
+
+
+bool RayTracer::doHasPasses() const
+{
+	return false;
+}
+
+
 
 
 // --- free ----------------------------------------------------------------------------------------
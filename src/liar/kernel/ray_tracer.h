@@ -66,6 +66,8 @@ public:
 
 	void requestSamples(const TSamplerPtr& sampler);
 	void preProcess(const TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads = 0);
+	void beginPass(const TSamplerPtr& sampler, const TimePeriod& period, size_t pass, size_t numberOfThreads = 0);
+	bool hasPasses() const;
 
 	/** @warning castRay is NOT THREAD SAFE!
 	 */
@@ -80,6 +82,9 @@ public:
 		}
 		return doCastRay(sample, primaryRay, tIntersection, alpha, static_cast<size_t>(rayGeneration_), highQuality);
 	}
+	void castRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, bool highQuality = true) const;
+	size_t batchSize() const;
 
 	const TRayTracerPtr clone() const;
 	void seed(TSeed seed);
@@ -90,6 +95,14 @@ public:
 
 protected:
 
+	struct ShadowContribution
+	{
+		Spectral value;
+		bool isShadowOnly;
+	};
+	typedef std::vector<BoundedRay> TShadowRays;
+	typedef std::vector<ShadowContribution> TShadowContributions;
+
 	RayTracer();
 
 	const LightContexts& lights() const { return lights_; }
@@ -99,6 +112,16 @@ protected:
 			const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
 			const Sample::TSubSequence2D& lightSamples,  const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
 			const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn) const;
+	void gatherLightContribution(
+			const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
+			const Sample::TSubSequence2D& lightSamples,  const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
+			const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn, TScalar scale = 1) const;
+	void gatherLightContribution(
+			const Sample& sample, const TBsdfPtr& bsdf, const LightContext& light,
+			const Sample::TSubSequence2D& lightSamples,  const Sample::TSubSequence2D& bsdfSamples, const Sample::TSubSequence1D& componentSamples,
+			const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn,
+			TShadowRays& shadowRays, TShadowContributions& shadowContributions, TScalar scale = 1) const;
+	const Spectral resolveLightContributions(const Sample& sample) const;
 
 	void requestLightAndSceneSamples(const TSamplerPtr& sampler);
 
@@ -106,7 +129,12 @@ private:
 
 	virtual void doRequestSamples(const TSamplerPtr& sampler) = 0;
 	virtual void doPreProcess(const TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads) = 0;
+	virtual void doBeginPass(const TSamplerPtr& sampler, const TimePeriod& period, size_t pass, size_t numberOfThreads);
+	virtual bool doHasPasses() const;
 	virtual const Spectral doCastRay(const Sample& sample, const DifferentialRay& primaryRay, TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const = 0;
+	virtual void doCastRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, size_t generation, bool highQuality) const;
+	virtual size_t doBatchSize() const;
 	virtual const TRayTracerPtr doClone() const = 0;
 	virtual void doSeed(num::Tuint32 seed) = 0;
 
@@ -138,6 +166,8 @@ private:
 	size_t maxRayGeneration_;
 	mutable int rayGeneration_;
 	mutable MediumStack mediumStack_;
+	mutable TShadowRays shadowRays_;
+	mutable TShadowContributions shadowContributions_;
 };
 
 }
@@ -23,9 +23,19 @@
 
 #include "kernel_common.h"
 #include "render_engine.h"
+#include "bvh_tree.h"
+#include "sampler_adaptive.h"
+#include "sampler_progressive.h"
 #include "sampler_tiled.h"
+#include <lass/io/binary_o_file.h>
 #include <lass/io/keyboard.h>
+#include <lass/python/export_traits_filesystem.h>
+#include <lass/util/clock.h>
 #include <lass/util/progress_indicator.h>
+#include <lass/util/thread_fun.h>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
 
 namespace liar
 {
@@ -40,6 +50,22 @@ PY_CLASS_MEMBER_RW(RenderEngine, target, setTarget)
 PY_CLASS_MEMBER_RW(RenderEngine, sampler, setSampler)
 PY_CLASS_MEMBER_RW(RenderEngine, scene, setScene)
 PY_CLASS_MEMBER_RW(RenderEngine, numberOfThreads, setNumberOfThreads)
+PY_CLASS_MEMBER_R_DOC(RenderEngine, threadUtilization, "fraction of the last render each thread spent busy on tasks")
+PY_CLASS_MEMBER_R_DOC(RenderEngine, numHeapAllocations,
+	"number of blocks the per thread arenas of the last render allocated on the heap.\n"
+	"Once they're warmed up, this no longer grows with the number of samples. "
+	"Only the arenas are counted: memory the tracers or shaders allocate by other means is not included.")
+PY_CLASS_MEMBER_R_DOC(RenderEngine, preProcessTimings,
+	"[(name, seconds)] of every task of the last scene preprocessing, the slowest first.")
+PY_CLASS_MEMBER_RW_DOC(RenderEngine, timeBudget, setTimeBudget,
+	"wall clock time in seconds a render may take, or zero for no limit.\n"
+	"Progressive and adaptive samplers render in passes until the next pass would exceed the budget.")
+PY_CLASS_MEMBER_RW_DOC(RenderEngine, checkpointPath, setCheckpointPath,
+	"file to periodically save the render state to, or empty for none.\n"
+	"If it exists when a render starts, the render resumes from it. It is removed once the render completes.\n"
+	"Checkpoints are taken between passes, so only progressive and adaptive samplers benefit.")
+PY_CLASS_MEMBER_RW_DOC(RenderEngine, checkpointInterval, setCheckpointInterval,
+	"minimum time in seconds between two checkpoints")
 PY_CLASS_METHOD_QUALIFIED_0(RenderEngine, render, void)
 PY_CLASS_METHOD_QUALIFIED_1(RenderEngine, render, void, TTime)
 PY_CLASS_METHOD_QUALIFIED_1(RenderEngine, render, void, const RenderEngine::TBucket&)
@@ -48,6 +74,66 @@ PY_CLASS_STATIC_CONST(RenderEngine, "AUTO_NUMBER_OF_THREADS", int(RenderEngine::
 PY_CLASS_METHOD_DOC(RenderEngine, seed, "seed the samplers and tracers with a 32 bit unsigned integer")
 
 
+namespace
+{
+	const size_t outputSize = 1024;
+
+	const char checkpointMagic[8] = { 'L', 'I', 'A', 'R', 'C', 'K', 'P', 'T' };
+	const num::Tuint32 checkpointVersion = 1;
+
+	void writeBytes(io::BinaryOStream& stream, const std::string& bytes)
+	{
+		stream << static_cast<num::Tuint64>(bytes.size());
+		stream.write(bytes.data(), bytes.size());
+	}
+
+	std::string readBytes(io::BinaryIStream& stream)
+	{
+		num::Tuint64 size = 0;
+		stream >> size;
+		std::string bytes(static_cast<size_t>(size), '\0');
+		stream.read(&bytes[0], bytes.size());
+		if (!stream.good())
+		{
+			LASS_THROW("Failed to read checkpoint: unexpected end of file.");
+		}
+		return bytes;
+	}
+
+	TPyObjectPtr callPickle(const char* method, PyObject* arg)
+	{
+		const TPyObjectPtr pickle(PyImport_ImportModule("pickle"));
+		if (!pickle)
+		{
+			python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+		}
+		const TPyObjectPtr result(PyObject_CallMethod(pickle.get(), method, "O", arg));
+		if (!result)
+		{
+			python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+		}
+		return result;
+	}
+
+	std::string pickle(const TPyObjectPtr& state)
+	{
+		const TPyObjectPtr bytes = callPickle("dumps", state.get());
+		char* data = nullptr;
+		Py_ssize_t size = 0;
+		if (PyBytes_AsStringAndSize(bytes.get(), &data, &size) != 0)
+		{
+			python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+		}
+		return std::string(data, static_cast<size_t>(size));
+	}
+
+	TPyObjectPtr unpickle(const std::string& bytes)
+	{
+		const TPyObjectPtr data(PyBytes_FromStringAndSize(bytes.data(), static_cast<Py_ssize_t>(bytes.size())));
+		return callPickle("loads", data.get());
+	}
+}
+
 const RenderEngine::TBucket RenderEngine::bucketBound_(
 	RenderEngine::TBucket::TPoint(TNumTraits::zero, TNumTraits::zero),
 	RenderEngine::TBucket::TPoint(TNumTraits::one, TNumTraits::one));
@@ -56,6 +142,9 @@ const RenderEngine::TBucket RenderEngine::bucketBound_(
 
 RenderEngine::RenderEngine():
 	numberOfThreads_(autoNumberOfThreads),
+	numHeapAllocations_(0),
+	timeBudget_(0),
+	checkpointInterval_(600),
 	isDirty_(false)
 {
 	seed(0);
@@ -121,6 +210,48 @@ size_t RenderEngine::numberOfThreads() const
 
 
 
+const std::vector<TScalar>& RenderEngine::threadUtilization() const
+{
+	return threadUtilization_;
+}
+
+
+
+TTimeDelta RenderEngine::timeBudget() const
+{
+	return timeBudget_;
+}
+
+
+
+const std::filesystem::path& RenderEngine::checkpointPath() const
+{
+	return checkpointPath_;
+}
+
+
+
+TTimeDelta RenderEngine::checkpointInterval() const
+{
+	return checkpointInterval_;
+}
+
+
+
+size_t RenderEngine::numHeapAllocations() const
+{
+	return numHeapAllocations_;
+}
+
+
+
+const PreProcessGraph::TTimings& RenderEngine::preProcessTimings() const
+{
+	return preProcessTimings_;
+}
+
+
+
 void RenderEngine::setCamera(const TCameraPtr& camera)
 {
 	camera_ = camera;
@@ -167,6 +298,27 @@ void RenderEngine::setNumberOfThreads(size_t number)
 
 
 
+void RenderEngine::setTimeBudget(TTimeDelta seconds)
+{
+	timeBudget_ = std::max<TTimeDelta>(seconds, 0);
+}
+
+
+
+void RenderEngine::setCheckpointPath(const std::filesystem::path& path)
+{
+	checkpointPath_ = path;
+}
+
+
+
+void RenderEngine::setCheckpointInterval(TTimeDelta seconds)
+{
+	checkpointInterval_ = std::max<TTimeDelta>(seconds, 0);
+}
+
+
+
 void RenderEngine::render(TTime iFrameTime, const TBucket& bucket)
 {
 	if (!camera_)
@@ -197,9 +349,24 @@ void RenderEngine::render(TTime iFrameTime, const TBucket& bucket)
 
 	const TimePeriod timePeriod = iFrameTime + camera_->shutterDelta();
 
+	const bool hasCheckpoints = !checkpointPath_.empty();
+	size_t numberOfPasses = 0;
+	std::unique_ptr<io::BinaryIFile> checkpoint;
+	if (hasCheckpoints && std::filesystem::exists(checkpointPath_))
+	{
+		checkpoint = loadCheckpoint(numberOfPasses);
+	}
+
 	if (isDirty_)
 	{
-		scene_->preProcess(timePeriod);
+		// objects are preprocessed in parallel, children before their parents.  The light contexts
+		// are only gathered once that's done, on this thread, since that touches Python objects.
+		PreProcessGraph graph;
+		graph.addScene(scene_, timePeriod);
+		graph.run(effectiveNumberOfThreads());
+		graph.report();
+		preProcessTimings_ = graph.timings();
+		reportBvhStatistics();
 		rayTracer_->setScene(scene_);
 		rayTracer_->requestSamples(sampler_);
 		rayTracer_->preProcess(sampler_, timePeriod, numberOfThreads_);
@@ -209,41 +376,133 @@ void RenderEngine::render(TTime iFrameTime, const TBucket& bucket)
 	// we need an unbounded progress indicator ...
 	size_t numberOfSamples = num::NumTraits<size_t>::max;
 	TVector2D sampleSize = TVector2D(renderTarget_->resolution()).reciprocal();
+	SamplerAdaptive* adaptive = dynamic_cast<SamplerAdaptive*>(sampler_.get());
+	SamplerProgressive* progressive = dynamic_cast<SamplerProgressive*>(sampler_.get());
+	const bool hasTimeBudget = timeBudget_ > 0;
+	const bool isMultiPass = adaptive || (progressive && (hasTimeBudget || hasCheckpoints || rayTracer_->hasPasses()));
+	size_t tasksPerPass = num::NumTraits<size_t>::max;
 	if (SamplerTiled* sampler = dynamic_cast<SamplerTiled*>(sampler_.get()))
 	{
 		numberOfSamples = sampler->resolution().x * sampler->resolution().y * sampler->samplesPerPixel();
 		sampleSize /= num::sqrt(TScalar(sampler->samplesPerPixel()));
 	}
+	else if (adaptive)
+	{
+		// we don't know how many passes it will take, so assume the worst.
+		numberOfSamples = adaptive->resolution().x * adaptive->resolution().y * adaptive->samplesPerPass() * adaptive->maxPasses();
+		sampleSize /= num::sqrt(TScalar(adaptive->samplesPerPass()));
+	}
 	else
 	{
 		// sampler is unbounded, we don't know how many samples we'll take per pixel. So just take a guess.
 		sampleSize /= 10;
 	}
-	Progress progress("rendering bucket " + util::stringCast<std::string>(bucket), numberOfSamples);
+	if (progressive && isMultiPass)
+	{
+		// a pass of a progressive sampler draws about one sample per pixel.
+		const TVector2D bucketPixels = TVector2D(renderTarget_->resolution()) * bucket.size();
+		const TScalar numberOfPixels = std::max(bucketPixels.x * bucketPixels.y, TNumTraits::one);
+		const TScalar samplesPerTask = static_cast<TScalar>(std::max<size_t>(progressive->samplesPerTask(), 1));
+		tasksPerPass = static_cast<size_t>(num::ceil(numberOfPixels / samplesPerTask));
+	}
+	const std::string caption = "rendering bucket " + util::stringCast<std::string>(bucket);
+	std::unique_ptr<Progress> progress = hasTimeBudget
+		? std::make_unique<Progress>(caption, timeBudget_)
+		: std::make_unique<Progress>(caption, numberOfSamples);
 
 	sampler_->setBucket(bucket); // bit unorthodox, since we modify sampler here.
-	Consumer consumer(*this, rayTracer_, sampler_, progress, sampleSize, timePeriod);
+	if (adaptive)
+	{
+		// before the consumers clone it.
+		if (checkpoint)
+		{
+			adaptive->resumePasses();
+		}
+		else
+		{
+			adaptive->beginPasses();
+		}
+	}
+	const Consumer consumer(*this, rayTracer_, sampler_, *progress, sampleSize, timePeriod);
 
-	typedef Sampler::TTaskPtr TTaskPtr;
-	typedef util::ThreadPool<TTaskPtr, Consumer> TThreadPool;
+	const size_t numberOfThreads = effectiveNumberOfThreads();
+	std::vector<Consumer> consumers(numberOfThreads, consumer); // clones and seeds tracer and sampler for each thread.
+	TWorkerStatistics statistics(numberOfThreads);
 
-	TThreadPool pool(numberOfThreads_, std::max<size_t>(2 * numberOfThreads_, 16), consumer);
+	util::Clock clock;
+	const util::Clock::TTime start = clock.time();
 
 	renderTarget_->beginRender();
-	TTaskPtr task = sampler_->getTask();
-	while (task)
+	if (checkpoint)
 	{
-		pool.addTask(task);
-		task = sampler_->getTask();
-
+		renderTarget_->loadCheckpoint(*checkpoint);
+		checkpoint.reset();
+	}
+	const size_t firstPass = numberOfPasses;
+	util::Clock::TTime lastCheckpoint = clock.time();
+	while (isMultiPass || numberOfPasses == firstPass)
+	{
+		const util::Clock::TTime passStart = clock.time();
+		rayTracer_->beginPass(sampler_, timePeriod, numberOfPasses, numberOfThreads);
+		renderTasks(consumers, statistics, tasksPerPass);
+		++numberOfPasses;
 		if (isCanceling())
 		{
-			pool.clearQueue();
-			return;
+			break;
 		}
+		if (hasTimeBudget)
+		{
+			// stop if another pass like the last one would not fit in the budget.
+			const util::Clock::TTime now = clock.time();
+			if ((now - start) + (now - passStart) > timeBudget_)
+			{
+				break;
+			}
+		}
+		if (adaptive)
+		{
+			RenderTarget::TValueBuffer mean;
+			RenderTarget::TValueBuffer varianceOfMean;
+			if (!renderTarget_->estimateVariance(mean, varianceOfMean))
+			{
+				mean.clear();
+				varianceOfMean.clear();
+			}
+			if (!adaptive->nextPass(renderTarget_->resolution(), mean, varianceOfMean))
+			{
+				break;
+			}
+			LASS_COUT << "  adaptive pass " << adaptive->pass() << ": " << adaptive->numActivePixels() << " pixels" << std::endl;
+		}
+		if (hasCheckpoints && clock.time() - lastCheckpoint >= checkpointInterval_)
+		{
+			saveCheckpoint(numberOfPasses);
+			lastCheckpoint = clock.time();
+		}
+	}
+
+	if (hasCheckpoints && !isCanceling())
+	{
+		std::error_code error;
+		std::filesystem::remove(checkpointPath_, error);
+	}
+
+	const TTimeDelta duration = clock.time() - start;
+	if (hasTimeBudget)
+	{
+		LASS_COUT << "  " << (numberOfPasses - firstPass) << " passes in " << std::setprecision(3) << duration << "s of a "
+			<< timeBudget_ << "s budget" << std::endl;
 	}
+	reportUtilization(statistics, duration);
 
-	// ~TThreadPool will wait for completion ...
+	numHeapAllocations_ = 0;
+	size_t arenaCapacity = 0;
+	for (const Consumer& c : consumers)
+	{
+		numHeapAllocations_ += c.arena().numHeapAllocations();
+		arenaCapacity = std::max(arenaCapacity, c.arena().capacity());
+	}
+	LASS_COUT << "  arenas: " << numHeapAllocations_ << " heap allocations, max " << (arenaCapacity / 1024) << " KiB per thread" << std::endl;
 }
 
 
@@ -282,6 +541,198 @@ void RenderEngine::seed(num::Tuint32 seed)
 
 // --- private -------------------------------------------------------------------------------------
 
+/** Process all tasks of the sampler, or at most @a maxTasks of them, using one worker per consumer.
+ *  Tasks are distributed with work stealing, see TaskScheduler.
+ */
+void RenderEngine::renderTasks(std::vector<Consumer>& consumers, TWorkerStatistics& statistics, size_t maxTasks)
+{
+	const size_t numberOfThreads = consumers.size();
+	LASS_ASSERT(statistics.size() == numberOfThreads);
+	TaskScheduler scheduler(*sampler_, numberOfThreads);
+	scheduler.setMaxTasks(maxTasks);
+
+	std::mutex errorMutex;
+	std::exception_ptr error;
+	util::Clock clock;
+
+	auto work = [&](size_t k)
+	{
+		try
+		{
+			TaskScheduler::WorkerStatistics& stats = scheduler.statistics(k);
+			while (!isCanceling())
+			{
+				const Sampler::TTaskPtr task = scheduler.pop(k);
+				if (!task)
+				{
+					break;
+				}
+				const util::Clock::TTime begin = clock.time();
+				consumers[k](task);
+				stats.busyTime += clock.time() - begin;
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+			scheduler.cancel();
+		}
+	};
+
+	// the calling thread is worker 0, so we only need to spawn the others.
+	std::vector<std::unique_ptr<util::Thread>> threads;
+	for (size_t k = 1; k < numberOfThreads; ++k)
+	{
+		threads.emplace_back(util::threadFun([&work, k]() { work(k); }, util::threadJoinable));
+		threads.back()->run();
+	}
+	work(0);
+	for (auto& thread : threads)
+	{
+		thread->join();
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+
+	for (size_t k = 0; k < numberOfThreads; ++k)
+	{
+		const TaskScheduler::WorkerStatistics& stats = scheduler.statistics(k);
+		statistics[k].numTasks += stats.numTasks;
+		statistics[k].numStolen += stats.numStolen;
+		statistics[k].busyTime += stats.busyTime;
+	}
+}
+
+
+
+void RenderEngine::reportUtilization(const TWorkerStatistics& statistics, TTimeDelta duration)
+{
+	const size_t numberOfThreads = statistics.size();
+	threadUtilization_.assign(numberOfThreads, 0);
+	size_t numStolen = 0;
+	for (size_t k = 0; k < numberOfThreads; ++k)
+	{
+		threadUtilization_[k] = duration > 0 ? static_cast<TScalar>(statistics[k].busyTime / duration) : TNumTraits::one;
+		numStolen += statistics[k].numStolen;
+	}
+	if (!numberOfThreads)
+	{
+		return;
+	}
+	const auto minmax = std::minmax_element(threadUtilization_.begin(), threadUtilization_.end());
+	const TScalar average = std::accumulate(threadUtilization_.begin(), threadUtilization_.end(), TNumTraits::zero) / static_cast<TScalar>(numberOfThreads);
+	LASS_COUT << "  " << numberOfThreads << " render threads busy: min=" << std::setprecision(3) << 100 * *minmax.first
+		<< "%, avg=" << 100 * average << "%, max=" << 100 * *minmax.second << "%, " << numStolen << " tasks stolen" << std::endl;
+}
+
+
+
+/** Write pass index, random seed, sampler and tracer state, and the render target's buffers to checkpointPath().
+ *
+ *  The file is first written next to it, and only then renamed, so that a render that gets killed
+ *  while writing doesn't leave a corrupted checkpoint behind.
+ */
+void RenderEngine::saveCheckpoint(size_t numberOfPasses)
+{
+	const std::filesystem::path tempPath = checkpointPath_.string() + ".tmp";
+	{
+		io::BinaryOFile file(tempPath);
+		if (!file.good())
+		{
+			LASS_THROW("Failed to open checkpoint file '" << tempPath.string() << "' for writing.");
+		}
+		std::ostringstream seedState;
+		seedState << seedGenerator_;
+
+		file.write(checkpointMagic, sizeof(checkpointMagic));
+		file << checkpointVersion << static_cast<num::Tuint64>(numberOfPasses);
+		writeBytes(file, seedState.str());
+		writeBytes(file, pickle(sampler_->getState()));
+		writeBytes(file, pickle(rayTracer_->getState()));
+		if (!renderTarget_->saveCheckpoint(file))
+		{
+			LASS_COUT << "  warning: render target does not support checkpoints, only the sampler state is saved." << std::endl;
+		}
+		file.flush();
+		if (!file.good())
+		{
+			LASS_THROW("Failed to write checkpoint file '" << tempPath.string() << "'.");
+		}
+	}
+	std::filesystem::rename(tempPath, checkpointPath_);
+	LASS_COUT << "  checkpoint after " << numberOfPasses << " passes saved to " << checkpointPath_.string() << std::endl;
+}
+
+
+
+/** Restore pass index, random seed, sampler and tracer state from checkpointPath().
+ *  Returns the file, positioned at the render target's buffers, which can only be restored after beginRender.
+ */
+std::unique_ptr<io::BinaryIFile> RenderEngine::loadCheckpoint(size_t& numberOfPasses)
+{
+	std::unique_ptr<io::BinaryIFile> file = std::make_unique<io::BinaryIFile>(checkpointPath_);
+	char magic[sizeof(checkpointMagic)] = { 0 };
+	num::Tuint32 version = 0;
+	num::Tuint64 passes = 0;
+	file->read(magic, sizeof(magic));
+	*file >> version >> passes;
+	if (!file->good() || !std::equal(magic, magic + sizeof(magic), checkpointMagic) || version != checkpointVersion)
+	{
+		LASS_THROW("'" << checkpointPath_.string() << "' is not a valid checkpoint file.");
+	}
+
+	std::istringstream seedState(readBytes(*file));
+	seedState >> seedGenerator_;
+	sampler_->setState(unpickle(readBytes(*file)));
+	rayTracer_->setState(unpickle(readBytes(*file)));
+	isDirty_ = true;
+
+	numberOfPasses = static_cast<size_t>(passes);
+	LASS_COUT << "  resuming from " << checkpointPath_.string() << " after " << numberOfPasses << " passes" << std::endl;
+	return file;
+}
+
+
+
+/** Reports on the BVHs that are built since the last render, both while the scene was created and
+ *  preprocessed.
+ */
+void RenderEngine::reportBvhStatistics() const
+{
+	const BvhTreeBase::Statistics statistics = BvhTreeBase::accumulatedStatistics();
+	BvhTreeBase::resetAccumulatedStatistics();
+	if (statistics.numBuilds > 0)
+	{
+		LASS_COUT << "  " << statistics.numBuilds << " BVHs built over " << statistics.numObjects << " objects in "
+			<< std::setprecision(3) << statistics.buildTime << "s (" << statistics.numCacheHits << " from cache): "
+			<< statistics.numNodes << " nodes, " << statistics.numLeaves << " leaves, max depth " << statistics.maxDepth << std::endl;
+	}
+	if (statistics.numRefits > 0)
+	{
+		LASS_COUT << "  " << statistics.numRefits << " BVHs refitted in " << std::setprecision(3) << statistics.refitTime << "s" << std::endl;
+	}
+}
+
+
+
+size_t RenderEngine::effectiveNumberOfThreads() const
+{
+	if (numberOfThreads_ == static_cast<size_t>(autoNumberOfThreads))
+	{
+		return std::max<size_t>(util::numberOfAvailableProcessors(), 1);
+	}
+	return numberOfThreads_;
+}
+
+
+
 void RenderEngine::writeRender(const OutputSample* first, const OutputSample* last,
 		Progress& ioProgress)
 {
@@ -308,7 +759,13 @@ RenderEngine::Consumer::Consumer(
 	sampler_(LASS_ENFORCE_POINTER(sampler)),
 	progress_(&progress),
 	sampleSize_(sampleSize),
-	timePeriod_(timePeriod)
+	timePeriod_(timePeriod),
+	samples_(rayTracer_->batchSize()),
+	primaryRays_(samples_.size()),
+	radiances_(samples_.size()),
+	tIntersections_(samples_.size()),
+	alphas_(samples_.size()),
+	outputSamples_(std::max(outputSize, samples_.size()))
 {
 }
 
@@ -320,7 +777,13 @@ RenderEngine::Consumer::Consumer(const Consumer& other):
 	sampler_(other.sampler_->clone()),
 	progress_(other.progress_),
 	sampleSize_(other.sampleSize_),
-	timePeriod_(other.timePeriod_)
+	timePeriod_(other.timePeriod_),
+	samples_(rayTracer_->batchSize()),
+	primaryRays_(samples_.size()),
+	radiances_(samples_.size()),
+	tIntersections_(samples_.size()),
+	alphas_(samples_.size()),
+	outputSamples_(std::max(outputSize, samples_.size()))
 {
 	rayTracer_->seed(static_cast<RayTracer::TSeed>(engine_->seedGenerator_()));
 	sampler_->seed(static_cast<Sampler::TSeed>(engine_->seedGenerator_()));
@@ -331,34 +794,55 @@ RenderEngine::Consumer::Consumer(const Consumer& other):
 void RenderEngine::Consumer::operator()(const Sampler::TTaskPtr& task)
 {
 	typedef OutputSample::TValue TValue;
+	const size_t batchSize = samples_.size();
 
-	const size_t outputSize = 1024;
-	TOutputSamples outputSamples(outputSize);
+	// samples_ and outputSamples_ are reused from task to task, and everything else that's
+	// allocated while tracing a sample comes from the arena, so that we don't need the heap.
+	// Samples are drawn in batches of coherent primary rays, so that the tracer can intersect
+	// them with the scene in one go.
+	TOutputSamples& outputSamples = outputSamples_;
 	size_t outputIndex = 0;
 
-	Sample sample;
-	while (task->drawSample(*sampler_, timePeriod_, sample))
+	while (true)
 	{
-		if (engine_->isCanceling())
+		size_t n = 0;
+		while (n < batchSize && task->drawSample(*sampler_, timePeriod_, samples_[n]))
 		{
-			return;
+			++n;
 		}
+		if (n == 0 || engine_->isCanceling())
+		{
+			break;
+		}
+		const Arena::Scope scope(arena_);
 
-		const DifferentialRay primaryRay = engine_->camera_->primaryRay(sample, sampleSize_);
-		sample.setWeight(engine_->camera_->weight(primaryRay));
-		TScalar alpha;
-		TScalar tIntersection;
-		const Spectral radiance = rayTracer_->castRay(sample, primaryRay, tIntersection, alpha);
-		const TScalar depth = engine_->camera_->asDepth(primaryRay, tIntersection);
+		for (size_t k = 0; k < n; ++k)
+		{
+			primaryRays_[k] = engine_->camera_->primaryRay(samples_[k], sampleSize_);
+			samples_[k].setWeight(engine_->camera_->weight(primaryRays_[k]));
+		}
+		rayTracer_->castRays(&samples_[0], &primaryRays_[0], &radiances_[0], &tIntersections_[0], &alphas_[0], n);
 
-		outputSamples[outputIndex++] = OutputSample(sample, radiance, static_cast<TValue>(depth), static_cast<TValue>(alpha));
-		if (outputIndex == outputSize)
+		if (outputIndex + n > outputSamples.size())
 		{
-			engine_->writeRender(&outputSamples[0], &outputSamples[0] + outputSize, *progress_);
+			engine_->writeRender(&outputSamples[0], &outputSamples[outputIndex], *progress_);
 			outputIndex = 0;
 		}
+		for (size_t k = 0; k < n; ++k)
+		{
+			const TScalar depth = engine_->camera_->asDepth(primaryRays_[k], tIntersections_[k]);
+			outputSamples[outputIndex++] = OutputSample(samples_[k], radiances_[k], static_cast<TValue>(depth), static_cast<TValue>(alphas_[k]));
+		}
+		if (n < batchSize)
+		{
+			break;
+		}
 	}
 
+	if (engine_->isCanceling())
+	{
+		return;
+	}
 	engine_->writeRender(&outputSamples[0], &outputSamples[outputIndex], *progress_);
 }
 
@@ -368,8 +852,24 @@ void RenderEngine::Consumer::operator()(const Sampler::TTaskPtr& task)
 
 RenderEngine::Progress::Progress(const std::string& caption, size_t totalNumberOfSamples):
 	indicator_(caption),
+	start_(clock_.time()),
 	numSamplesWritten_(0),
-	totalNumSamples_(totalNumberOfSamples)
+	totalNumSamples_(totalNumberOfSamples),
+	timeBudget_(0)
+{
+}
+
+
+
+/** Progress is reported as the fraction of @a timeBudget that has elapsed,
+ *  so that the indicator's estimate of the remaining time is the remaining budget.
+ */
+RenderEngine::Progress::Progress(const std::string& caption, TTimeDelta timeBudget):
+	indicator_(caption + " (time budget " + util::stringCast<std::string>(timeBudget) + "s)"),
+	start_(clock_.time()),
+	numSamplesWritten_(0),
+	totalNumSamples_(0),
+	timeBudget_(timeBudget)
 {
 }
 
@@ -386,7 +886,14 @@ RenderEngine::Progress& RenderEngine::Progress::operator+=(size_t numNewSamplesW
 {
 	std::lock_guard<std::mutex> lock(mutex_);
 	numSamplesWritten_ += numNewSamplesWritten;
-	indicator_(static_cast<double>(numSamplesWritten_) / static_cast<double>(totalNumSamples_));
+	if (timeBudget_ > 0)
+	{
+		indicator_(std::min(static_cast<double>((clock_.time() - start_) / timeBudget_), 1.));
+	}
+	else
+	{
+		indicator_(static_cast<double>(numSamplesWritten_) / static_cast<double>(totalNumSamples_));
+	}
 	return *this;
 }
 
@@ -30,15 +30,21 @@
 #define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_RENDER_ENGINE_H
 
 #include "kernel_common.h"
+#include "arena.h"
 #include "camera.h"
 #include "object.h"
+#include "preprocess_graph.h"
 #include "render_target.h"
 #include "sampler.h"
 #include "ray_tracer.h"
+#include "task_scheduler.h"
 
+#include <lass/io/binary_i_file.h>
 #include <lass/prim/aabb_2d.h>
+#include <lass/util/clock.h>
 #include <lass/util/progress_indicator.h>
 #include <lass/util/thread_pool.h>
+#include <filesystem>
 
 namespace liar
 {
@@ -63,6 +69,12 @@ public:
 	const TRenderTargetPtr& target() const;
 	const TRayTracerPtr& tracer() const;
 	size_t numberOfThreads() const;
+	const std::vector<TScalar>& threadUtilization() const;
+	size_t numHeapAllocations() const;
+	const PreProcessGraph::TTimings& preProcessTimings() const;
+	TTimeDelta timeBudget() const;
+	const std::filesystem::path& checkpointPath() const;
+	TTimeDelta checkpointInterval() const;
 
 	void setCamera(const TCameraPtr& camera);
 	void setSampler(const TSamplerPtr& sampler);
@@ -70,6 +82,9 @@ public:
 	void setTarget(const TRenderTargetPtr& renderTarget);
 	void setTracer(const TRayTracerPtr& iRayTracer);
 	void setNumberOfThreads(size_t number);
+	void setTimeBudget(TTimeDelta seconds);
+	void setCheckpointPath(const std::filesystem::path& path);
+	void setCheckpointInterval(TTimeDelta seconds);
 
 	void render(TTime time, const TBucket& bucket);
 	void render(TTime time);
@@ -84,13 +99,17 @@ private:
 	{
 	public:
 		Progress(const std::string& caption, size_t totalNumberOfSamples);
+		Progress(const std::string& caption, TTimeDelta timeBudget);
 		~Progress();
 		Progress& operator+=(size_t numNewSamplesWritten);
 	private:
 		util::ProgressIndicator indicator_;
 		std::mutex mutex_;
+		util::Clock clock_;
+		util::Clock::TTime start_;
 		size_t numSamplesWritten_;
 		size_t totalNumSamples_;
+		TTimeDelta timeBudget_;
 	};
 
 	class Consumer
@@ -101,6 +120,7 @@ private:
 		Consumer(const Consumer& other);
 		Consumer& operator=(const Consumer& other) = delete;
 		void operator()(const Sampler::TTaskPtr& task);
+		const Arena& arena() const { return arena_; }
 	private:
 		RenderEngine* engine_;
 		TRayTracerPtr rayTracer_;
@@ -109,10 +129,25 @@ private:
 		TVector2D pixelSize_;
 		TVector2D sampleSize_;
 		TimePeriod timePeriod_;
+		Arena arena_;
+		std::vector<Sample> samples_;
+		std::vector<DifferentialRay> primaryRays_;
+		std::vector<Spectral> radiances_;
+		std::vector<TScalar> tIntersections_;
+		std::vector<TScalar> alphas_;
+		TOutputSamples outputSamples_;
 	};
 
 	friend class Consumer;
 
+	typedef std::vector<TaskScheduler::WorkerStatistics> TWorkerStatistics;
+
+	void renderTasks(std::vector<Consumer>& consumers, TWorkerStatistics& statistics, size_t maxTasks);
+	void reportUtilization(const TWorkerStatistics& statistics, TTimeDelta duration);
+	void reportBvhStatistics() const;
+	size_t effectiveNumberOfThreads() const;
+	void saveCheckpoint(size_t numberOfPasses);
+	std::unique_ptr<io::BinaryIFile> loadCheckpoint(size_t& numberOfPasses);
 	void writeRender(const OutputSample* first, const OutputSample* last, Progress& ioProgress);
 	bool isCanceling() const;
 
@@ -122,6 +157,12 @@ private:
 	TSamplerPtr sampler_;
 	TSceneObjectPtr scene_;
 	size_t numberOfThreads_;
+	std::vector<TScalar> threadUtilization_;
+	size_t numHeapAllocations_;
+	PreProcessGraph::TTimings preProcessTimings_;
+	TTimeDelta timeBudget_;
+	std::filesystem::path checkpointPath_;
+	TTimeDelta checkpointInterval_;
 	bool isDirty_;
 	std::minstd_rand seedGenerator_;
 
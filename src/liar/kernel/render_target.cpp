@@ -99,6 +99,39 @@ bool RenderTarget::isRendering() const
 
 
 
+/** Estimate per pixel mean luminance and the variance of that mean, as accumulated so far.
+ *
+ *  Both buffers are resized to resolution().x * resolution().y, in scanline order.
+ *  Returns false if the render target doesn't keep track of that kind of information.
+ */
+bool RenderTarget::estimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean)
+{
+	return doEstimateVariance(mean, varianceOfMean);
+}
+
+
+
+/** Write everything accumulated so far to @a stream, so that a later render can continue from there.
+ *  Returns false if the render target can't do that, in which case nothing is written.
+ */
+bool RenderTarget::saveCheckpoint(io::BinaryOStream& stream)
+{
+	return doSaveCheckpoint(stream);
+}
+
+
+
+/** Restore what was written by saveCheckpoint.  Must be called after beginRender.
+ *  Returns false if the render target can't do that, in which case nothing is read.
+ */
+bool RenderTarget::loadCheckpoint(io::BinaryIStream& stream)
+{
+	LASS_ENFORCE(isRendering_);
+	return doLoadCheckpoint(stream);
+}
+
+
+
 // --- private -------------------------------------------------------------------------------------
 
 bool RenderTarget::doIsCanceling() const
@@ -108,6 +141,27 @@ bool RenderTarget::doIsCanceling() const
 
 
 
+bool RenderTarget::doEstimateVariance(TValueBuffer&, TValueBuffer&)
+{
+	return false;
+}
+
+
+
+bool RenderTarget::doSaveCheckpoint(io::BinaryOStream&)
+{
+	return false;
+}
+
+
+
+bool RenderTarget::doLoadCheckpoint(io::BinaryIStream&)
+{
+	return false;
+}
+
+
+
 // --- free ----------------------------------------------------------------------------------------
 
 
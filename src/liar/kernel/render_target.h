@@ -34,6 +34,8 @@
 #include "output_sample.h"
 #include "sample.h"
 #include "xyz.h"
+#include <lass/io/binary_i_stream.h>
+#include <lass/io/binary_o_stream.h>
 #include <lass/prim/vector_2d.h>
 #include <shared_mutex>
 
@@ -47,6 +49,8 @@ class LIAR_KERNEL_DLL RenderTarget: public python::PyObjectPlus
 	PY_HEADER(python::PyObjectPlus)
 public:
 
+	typedef std::vector<OutputSample::TValue> TValueBuffer;
+
 	virtual ~RenderTarget();
 
 	const TResolution2D resolution() const;
@@ -58,6 +62,11 @@ public:
 
 	bool isCanceling() const { return doIsCanceling(); }
 
+	bool estimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean);
+
+	bool saveCheckpoint(io::BinaryOStream& stream);
+	bool loadCheckpoint(io::BinaryIStream& stream);
+
 protected:
 
 	RenderTarget();
@@ -70,6 +79,9 @@ private:
 	virtual void doWriteRender(const OutputSample* first, const OutputSample* last) = 0;
 	virtual void doEndRender() = 0;
 	virtual bool doIsCanceling() const;
+	virtual bool doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean);
+	virtual bool doSaveCheckpoint(io::BinaryOStream& stream);
+	virtual bool doLoadCheckpoint(io::BinaryIStream& stream);
 
 	bool isRendering_;
 };
@@ -106,6 +106,7 @@ private:
 
 	friend class Sample;
 	friend class SamplerTiled; // until we cleared up the mess.
+	friend class SamplerAdaptive;
 
 	typedef std::vector<size_t> TSubSequenceSizes;
 
@@ -0,0 +1,442 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "sampler_adaptive.h"
+#include "sample.h"
+
+namespace liar
+{
+namespace kernel
+{
+
+PY_DECLARE_CLASS_DOC(SamplerAdaptive,
+	"SamplerAdaptive(child: SamplerTiled [, maxPasses: int, maxRelativeError: float])\n"
+	"Renders in passes of child.samplesPerPixel samples per pixel, and only revisits pixels that are still too noisy.")
+PY_CLASS_CONSTRUCTOR_1(SamplerAdaptive, const TSamplerTiledRef&)
+PY_CLASS_CONSTRUCTOR_3(SamplerAdaptive, const TSamplerTiledRef&, size_t, TScalar)
+PY_CLASS_MEMBER_RW(SamplerAdaptive, child, setChild)
+PY_CLASS_MEMBER_RW(SamplerAdaptive, maxPasses, setMaxPasses)
+PY_CLASS_MEMBER_RW(SamplerAdaptive, maxRelativeError, setMaxRelativeError)
+PY_CLASS_MEMBER_R(SamplerAdaptive, resolution)
+PY_CLASS_MEMBER_R(SamplerAdaptive, samplesPerPass)
+PY_CLASS_MEMBER_R(SamplerAdaptive, pass)
+PY_CLASS_MEMBER_R(SamplerAdaptive, numActivePixels)
+
+namespace
+{
+
+const size_t tileSize = 16;
+
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+SamplerAdaptive::SamplerAdaptive(const TSamplerTiledRef& child):
+	child_(child),
+	nextTile_(0),
+	pass_(0),
+	maxPasses_(16),
+	maxRelativeError_(0.02f)
+{
+}
+
+
+
+SamplerAdaptive::SamplerAdaptive(const TSamplerTiledRef& child, size_t maxPasses, TScalar maxRelativeError):
+	child_(child),
+	nextTile_(0),
+	pass_(0),
+	maxPasses_(std::max<size_t>(maxPasses, 1)),
+	maxRelativeError_(std::max(maxRelativeError, TNumTraits::zero))
+{
+}
+
+
+
+const TSamplerTiledRef& SamplerAdaptive::child() const
+{
+	return child_;
+}
+
+
+
+void SamplerAdaptive::setChild(const TSamplerTiledRef& child)
+{
+	child_ = child;
+	syncChildSubSequences();
+}
+
+
+
+size_t SamplerAdaptive::maxPasses() const
+{
+	return maxPasses_;
+}
+
+
+
+void SamplerAdaptive::setMaxPasses(size_t maxPasses)
+{
+	maxPasses_ = std::max<size_t>(maxPasses, 1);
+}
+
+
+
+TScalar SamplerAdaptive::maxRelativeError() const
+{
+	return maxRelativeError_;
+}
+
+
+
+void SamplerAdaptive::setMaxRelativeError(TScalar maxRelativeError)
+{
+	maxRelativeError_ = std::max(maxRelativeError, TNumTraits::zero);
+}
+
+
+
+const TResolution2D& SamplerAdaptive::resolution() const
+{
+	return child_->resolution();
+}
+
+
+
+size_t SamplerAdaptive::samplesPerPass() const
+{
+	return child_->samplesPerPixel();
+}
+
+
+
+size_t SamplerAdaptive::pass() const
+{
+	return pass_;
+}
+
+
+
+size_t SamplerAdaptive::numActivePixels() const
+{
+	return activePixels_.size();
+}
+
+
+
+/** Start over with a first pass that covers all pixels of the bucket.
+ */
+void SamplerAdaptive::beginPasses()
+{
+	syncChildSubSequences();
+
+	const TResolution2D res = resolution();
+	const TScalar r_x = static_cast<TScalar>(res.x);
+	const TScalar r_y = static_cast<TScalar>(res.y);
+	const TResolution2D begin(num::floor(bucket().min().x * r_x), num::floor(bucket().min().y * r_y));
+	const TResolution2D end(num::floor(bucket().max().x * r_x), num::floor(bucket().max().y * r_y));
+
+	activePixels_.clear();
+	activePixels_.reserve((end.x - begin.x) * (end.y - begin.y));
+	for (size_t j = begin.y; j < end.y; ++j)
+	{
+		for (size_t i = begin.x; i < end.x; ++i)
+		{
+			activePixels_.push_back(j * res.x + i);
+		}
+	}
+
+	pass_ = 0;
+	buildTiles();
+}
+
+
+
+/** Continue with the active pixels of a restored state, instead of starting over with all of them.
+ */
+void SamplerAdaptive::resumePasses()
+{
+	syncChildSubSequences();
+	buildTiles();
+}
+
+
+
+/** Select the pixels for the next pass, using the variance estimated by the render target.
+ *
+ *  @param targetResolution [in] resolution of @a mean and @a varianceOfMean, which may differ from the sampler's.
+ *  @param mean [in] per pixel mean luminance. If empty, all pixels stay active.
+ *  @param varianceOfMean [in] per pixel variance of @a mean.
+ *  @return false if there's nothing left to do.
+ */
+bool SamplerAdaptive::nextPass(const TResolution2D& targetResolution, const TValueBuffer& mean, const TValueBuffer& varianceOfMean)
+{
+	++pass_;
+	if (pass_ >= maxPasses_)
+	{
+		activePixels_.clear();
+		tiles_.clear();
+		return false;
+	}
+
+	if (mean.empty())
+	{
+		// render target can't tell us, so we'll keep rendering all pixels of previous pass.
+		buildTiles();
+		return !activePixels_.empty();
+	}
+
+	const TResolution2D& res = resolution();
+	LASS_ENFORCE(mean.size() == targetResolution.x * targetResolution.y);
+	LASS_ENFORCE(varianceOfMean.size() == mean.size());
+
+	TScalar totalMean = 0;
+	size_t numCovered = 0;
+	for (const auto m : mean)
+	{
+		if (m > 0)
+		{
+			totalMean += m;
+			++numCovered;
+		}
+	}
+	const TScalar epsilon = numCovered ? totalMean / static_cast<TScalar>(100 * numCovered) : TNumTraits::minStrictPositive;
+	const TScalar maxRelativeVariance = num::sqr(maxRelativeError_);
+
+	auto isNoisy = [&](size_t k)
+	{
+		const size_t i = k % res.x;
+		const size_t j = k / res.x;
+		const size_t ti = std::min((2 * i + 1) * targetResolution.x / (2 * res.x), targetResolution.x - 1);
+		const size_t tj = std::min((2 * j + 1) * targetResolution.y / (2 * res.y), targetResolution.y - 1);
+		const size_t tk = tj * targetResolution.x + ti;
+		const TScalar var = varianceOfMean[tk];
+		if (!isPositiveAndFinite(var))
+		{
+			return true;
+		}
+		return var > maxRelativeVariance * num::sqr(mean[tk] + epsilon);
+	};
+
+	// mark noisy pixels and their neighbours, but only within the set of previously active pixels
+	// (a pixel that has converged once stays converged).
+	std::vector<bool> isActive(res.x * res.y, false);
+	std::vector<bool> isSelected(res.x * res.y, false);
+	for (const size_t k : activePixels_)
+	{
+		isActive[k] = true;
+	}
+	for (const size_t k : activePixels_)
+	{
+		if (!isNoisy(k))
+		{
+			continue;
+		}
+		const size_t i = k % res.x;
+		const size_t j = k / res.x;
+		for (size_t jj = (j > 0 ? j - 1 : 0), jEnd = std::min(j + 2, res.y); jj < jEnd; ++jj)
+		{
+			for (size_t ii = (i > 0 ? i - 1 : 0), iEnd = std::min(i + 2, res.x); ii < iEnd; ++ii)
+			{
+				const size_t kk = jj * res.x + ii;
+				isSelected[kk] = isActive[kk];
+			}
+		}
+	}
+
+	TActivePixels activePixels;
+	for (const size_t k : activePixels_)
+	{
+		if (isSelected[k])
+		{
+			activePixels.push_back(k);
+		}
+	}
+	activePixels_.swap(activePixels);
+
+	buildTiles();
+	return !activePixels_.empty();
+}
+
+
+
+// --- protected -----------------------------------------------------------------------------------
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+SamplerAdaptive::TTaskPtr SamplerAdaptive::doGetTask()
+{
+	if (nextTile_ >= tiles_.size())
+	{
+		return TTaskPtr(0);
+	}
+	const size_t id = nextTile_++;
+	return TTaskPtr(new TaskAdaptive(pass_ * tiles_.size() + id, std::move(tiles_[id]), samplesPerPass()));
+}
+
+
+
+void SamplerAdaptive::doSeed(TSeed randomSeed)
+{
+	child_->seed(randomSeed);
+}
+
+
+
+size_t SamplerAdaptive::doRoundSize2D(size_t requestedSize) const
+{
+	const Sampler& child = *child_;
+	return child.doRoundSize2D(requestedSize);
+}
+
+
+
+const TSamplerPtr SamplerAdaptive::doClone() const
+{
+	SamplerAdaptive* clone = new SamplerAdaptive(*this);
+	clone->child_ = TSamplerTiledRef(child_->clone().dynamicCast<SamplerTiled>());
+	// clones only draw samples of tasks they're given, the per pixel state stays with the original.
+	TActivePixels().swap(clone->activePixels_);
+	std::vector<TPixels>().swap(clone->tiles_);
+	clone->nextTile_ = 0;
+	return TSamplerPtr(clone);
+}
+
+
+
+const TPyObjectPtr SamplerAdaptive::doGetState() const
+{
+	return python::makeTuple(child_, maxPasses_, maxRelativeError_, pass_, activePixels_);
+}
+
+
+
+void SamplerAdaptive::doSetState(const TPyObjectPtr& state)
+{
+	python::decodeTuple(state, child_, maxPasses_, maxRelativeError_, pass_, activePixels_);
+	syncChildSubSequences();
+	buildTiles();
+}
+
+
+
+/** Make sure the child sampler lays out the subsequences exactly like we do,
+ *  as it's going to fill in the samples that we hand out.
+ */
+void SamplerAdaptive::syncChildSubSequences()
+{
+	Sampler& child = *child_;
+	child.clearSubSequenceRequests();
+	for (const size_t size : subSequenceSize1D_)
+	{
+		child.requestSubSequence1D(size);
+	}
+	for (const size_t size : subSequenceSize2D_)
+	{
+		child.requestSubSequence2D(size);
+	}
+	LASS_ASSERT(child.totalSubSequenceSize1D_ == totalSubSequenceSize1D_);
+	LASS_ASSERT(child.totalSubSequenceSize2D_ == totalSubSequenceSize2D_);
+}
+
+
+
+/** Group the active pixels per tile, and order the tiles along a Morton curve.
+ */
+void SamplerAdaptive::buildTiles()
+{
+	const TResolution2D& res = resolution();
+
+	std::vector<std::pair<num::Tuint64, size_t>> keyed;
+	keyed.reserve(activePixels_.size());
+	for (const size_t k : activePixels_)
+	{
+		const size_t i = k % res.x;
+		const size_t j = k / res.x;
+		keyed.emplace_back(mortonCode(i / tileSize, j / tileSize), k);
+	}
+	std::sort(keyed.begin(), keyed.end());
+
+	tiles_.clear();
+	for (size_t first = 0, n = keyed.size(); first < n; )
+	{
+		size_t last = first;
+		TPixels pixels;
+		while (last < n && keyed[last].first == keyed[first].first)
+		{
+			const size_t k = keyed[last].second;
+			pixels.emplace_back(k % res.x, k / res.x);
+			++last;
+		}
+		tiles_.push_back(std::move(pixels));
+		first = last;
+	}
+	nextTile_ = 0;
+}
+
+
+
+// --- TaskAdaptive --------------------------------------------------------------------------------
+
+SamplerAdaptive::TaskAdaptive::TaskAdaptive(size_t id, TPixels&& pixels, size_t samplesPerPixel):
+	Task(id),
+	pixels_(std::move(pixels)),
+	pixel_(0),
+	samplesPerPixel_(samplesPerPixel),
+	subPixel_(0)
+{
+}
+
+
+
+bool SamplerAdaptive::TaskAdaptive::doDrawSample(Sampler& sampler, const TimePeriod& period, Sample& sample)
+{
+	if (subPixel_ == samplesPerPixel_)
+	{
+		subPixel_ = 0;
+		++pixel_;
+	}
+	if (pixel_ >= pixels_.size())
+	{
+		return false;
+	}
+	SamplerTiled& child = *static_cast<SamplerAdaptive&>(sampler).child_;
+	child.sample(pixels_[pixel_], subPixel_, period, sample);
+	++subPixel_;
+	return true;
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,128 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::SamplerAdaptive
+ *  @brief renders in passes, only revisiting pixels that are still too noisy.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  The actual samples are drawn from a child SamplerTiled, which provides samplesPerPixel
+ *  samples per pixel in each pass.  The first pass covers all pixels.  After each pass,
+ *  RenderEngine feeds back the per pixel variance tracked by the render target, and only pixels
+ *  of which the relative standard error of the mean still exceeds maxRelativeError, and their
+ *  direct neighbours, are rendered again in the next pass.  This goes on until all pixels have
+ *  converged, or maxPasses is reached.
+ *
+ *  The relative error is computed as @f$ \sigma_\mu / (\mu + \epsilon) @f$, where @f$ \epsilon @f$
+ *  is a hundredth of the average luminance of the frame, so that dark pixels aren't sampled forever.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_SAMPLER_ADAPTIVE_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_SAMPLER_ADAPTIVE_H
+
+#include "kernel_common.h"
+#include "sampler_tiled.h"
+#include "output_sample.h"
+
+namespace liar
+{
+namespace kernel
+{
+
+class SamplerAdaptive;
+
+typedef python::PyObjectPtr<SamplerAdaptive>::Type TSamplerAdaptivePtr;
+
+class LIAR_KERNEL_DLL SamplerAdaptive: public Sampler
+{
+	PY_HEADER(Sampler)
+public:
+
+	typedef std::vector<OutputSample::TValue> TValueBuffer;
+
+	SamplerAdaptive(const TSamplerTiledRef& child);
+	SamplerAdaptive(const TSamplerTiledRef& child, size_t maxPasses, TScalar maxRelativeError);
+
+	const TSamplerTiledRef& child() const;
+	void setChild(const TSamplerTiledRef& child);
+
+	size_t maxPasses() const;
+	void setMaxPasses(size_t maxPasses);
+
+	TScalar maxRelativeError() const;
+	void setMaxRelativeError(TScalar maxRelativeError);
+
+	const TResolution2D& resolution() const;
+	size_t samplesPerPass() const;
+
+	size_t pass() const;
+	size_t numActivePixels() const;
+
+	void beginPasses();
+	void resumePasses();
+	bool nextPass(const TResolution2D& targetResolution, const TValueBuffer& mean, const TValueBuffer& varianceOfMean);
+
+private:
+
+	typedef std::vector<TResolution2D> TPixels;
+	typedef std::vector<size_t> TActivePixels;
+
+	class TaskAdaptive: public Task
+	{
+	public:
+		TaskAdaptive(size_t id, TPixels&& pixels, size_t samplesPerPixel);
+	private:
+		bool doDrawSample(Sampler& sampler, const TimePeriod& period, Sample& sample) override;
+		TPixels pixels_;
+		size_t pixel_;
+		size_t samplesPerPixel_;
+		size_t subPixel_;
+	};
+
+	TTaskPtr doGetTask() override;
+	void doSeed(TSeed randomSeed) override;
+	size_t doRoundSize2D(size_t requestedSize) const override;
+
+	const TSamplerPtr doClone() const override;
+
+	const TPyObjectPtr doGetState() const override;
+	void doSetState(const TPyObjectPtr& state) override;
+
+	void syncChildSubSequences();
+	void buildTiles();
+
+	TSamplerTiledRef child_;
+	TActivePixels activePixels_;
+	std::vector<TPixels> tiles_;
+	size_t nextTile_;
+	size_t pass_;
+	size_t maxPasses_;
+	TScalar maxRelativeError_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
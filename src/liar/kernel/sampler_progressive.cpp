@@ -30,6 +30,7 @@ namespace kernel
 {
 
 PY_DECLARE_CLASS_DOC(SamplerProgressive, "Abstract base class of samplers that return an unbounded number of samples over all pixels")
+PY_CLASS_MEMBER_R_DOC(SamplerProgressive, samplesPerTask, "number of samples drawn by each task")
 
 TSamplerProgressivePtr SamplerProgressive::defaultProgressiveSampler_;
 
@@ -43,6 +44,15 @@ TSamplerProgressivePtr& SamplerProgressive::defaultProgressiveSampler()
 
 
 
+/** Number of samples each task draws, so that RenderEngine knows how many tasks make up a pass.
+ */
+size_t SamplerProgressive::samplesPerTask() const
+{
+	return doSamplesPerTask();
+}
+
+
+
 // --- protected -----------------------------------------------------------------------------------
 
 SamplerProgressive::SamplerProgressive():
@@ -53,10 +53,14 @@ class LIAR_KERNEL_DLL SamplerProgressive : public Sampler
 public:
 	static TSamplerProgressivePtr& defaultProgressiveSampler();
 
+	size_t samplesPerTask() const;
+
 protected:
 	SamplerProgressive();
 
 private:
+	virtual size_t doSamplesPerTask() const = 0;
+
 	static TSamplerProgressivePtr defaultProgressiveSampler_;
 };
 
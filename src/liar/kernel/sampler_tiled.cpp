@@ -30,6 +30,13 @@ namespace liar
 namespace kernel
 {
 
+namespace
+{
+
+const size_t tileSize = 16;
+
+}
+
 PY_DECLARE_CLASS_DOC(SamplerTiled, "Abstract base class of samplers that render a number of samples per pixel")
 	PY_CLASS_MEMBER_RW(SamplerTiled, resolution, setResolution)
 	PY_CLASS_MEMBER_RW(SamplerTiled, samplesPerPixel, setSamplesPerPixel)
@@ -60,26 +67,58 @@ SamplerTiled::TTaskPtr SamplerTiled::doGetTask()
 
 	const TResolution2D begin(num::floor(bucket().min().x * r_x), num::floor(bucket().min().y * r_y));
 	const TResolution2D end(num::floor(bucket().max().x * r_x), num::floor(bucket().max().y * r_y));
-
-	const size_t tileSize = 16;
-	const size_t n_x = (end.x - begin.x + tileSize - 1) / tileSize;
-	const size_t n_y = (end.y - begin.y + tileSize - 1) / tileSize;
+	updateTiles(begin, end);
 
 	const size_t id = nextId_++;
-	if (id >= n_x * n_y)
+	if (id >= tiles_.size())
 	{
 		return TTaskPtr(0);
 	}
-	const size_t i = id % n_x;
-	const size_t j = id / n_x;
 
-	const TResolution2D first(begin.x + i * tileSize, begin.y + j * tileSize);
+	const TResolution2D& first = tiles_[id];
 	const TResolution2D last(std::min(first.x + tileSize, end.x), std::min(first.y + tileSize, end.y));
 	return TTaskPtr(new TaskTiled(id, first, last, this->samplesPerPixel()));
 }
 
 
 
+/** Lay out the tiles covering [begin, end) in Morton order.
+ */
+void SamplerTiled::updateTiles(const TResolution2D& begin, const TResolution2D& end)
+{
+	if (!tiles_.empty() && begin == tilesBegin_ && end == tilesEnd_)
+	{
+		return;
+	}
+
+	const size_t n_x = (end.x - begin.x + tileSize - 1) / tileSize;
+	const size_t n_y = (end.y - begin.y + tileSize - 1) / tileSize;
+
+	std::vector<std::pair<num::Tuint64, TResolution2D>> codes;
+	codes.reserve(n_x * n_y);
+	for (size_t j = 0; j < n_y; ++j)
+	{
+		for (size_t i = 0; i < n_x; ++i)
+		{
+			codes.emplace_back(mortonCode(i, j), TResolution2D(begin.x + i * tileSize, begin.y + j * tileSize));
+		}
+	}
+	std::sort(codes.begin(), codes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	TTiles tiles;
+	tiles.reserve(codes.size());
+	for (const auto& code : codes)
+	{
+		tiles.push_back(code.second);
+	}
+
+	tiles_.swap(tiles);
+	tilesBegin_ = begin;
+	tilesEnd_ = end;
+}
+
+
+
 void SamplerTiled::sample(const TResolution2D& pixel, size_t subPixel, const TimePeriod& period, Sample& sample)
 {
 	doSampleScreen(pixel, subPixel, sample.screenSample_);
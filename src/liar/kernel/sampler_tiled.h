@@ -24,6 +24,9 @@
 /** @class liar::SamplerTiled
  *  @brief generates samples per pixel and groups tiles of pixels in tasks
  *  @author Bram de Greve [Bramz]
+ *
+ *  Tiles are handed out in Morton order, so that consecutive tasks cover neighbouring parts of
+ *  the image.  That keeps a worker that takes a batch of them working in the same region.
  */
 
 #ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_SAMPLER_TILED_H
@@ -37,6 +40,11 @@ namespace liar
 namespace kernel
 {
 
+class SamplerTiled;
+
+typedef python::PyObjectPtr<SamplerTiled>::Type TSamplerTiledPtr;
+typedef PyObjectRef<SamplerTiled> TSamplerTiledRef;
+
 class LIAR_KERNEL_DLL SamplerTiled: public Sampler
 {
 	PY_HEADER(Sampler)
@@ -53,6 +61,9 @@ protected:
 	SamplerTiled();
 
 private:
+
+	friend class SamplerAdaptive;
+
 	class TaskTiled : public Task
 	{
 	public:
@@ -66,7 +77,10 @@ private:
 		size_t subPixel_;
 	};
 
+	typedef std::vector<TResolution2D> TTiles;
+
 	TTaskPtr doGetTask() override;
+	void updateTiles(const TResolution2D& begin, const TResolution2D& end);
 
 	void sample(const TResolution2D& pixel, size_t subPixel, const TimePeriod& period, Sample& sample);
 
@@ -82,6 +96,9 @@ private:
 	virtual void doSampleSubSequence1D(const TResolution2D& pixel, size_t subPixel, TSubSequenceId id, TSample1D* first, TSample1D* last) = 0;
 	virtual void doSampleSubSequence2D(const TResolution2D& pixel, size_t subPixel, TSubSequenceId id, TSample2D* first, TSample2D* last) = 0;
 
+	TTiles tiles_;
+	TResolution2D tilesBegin_;
+	TResolution2D tilesEnd_;
 	size_t nextId_;
 };
 
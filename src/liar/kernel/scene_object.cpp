@@ -25,6 +25,7 @@
 #include "scene_object.h"
 #include "intersection.h"
 #include "intersection_context.h"
+#include <atomic>
 
 namespace liar
 {
@@ -43,6 +44,20 @@ PY_CLASS_METHOD_NAME(SceneObject, setState, "__setstate__")
 
 TShaderPtr SceneObject::defaultShader_(0);
 
+namespace
+{
+	std::atomic<size_t> numPreProcessPasses(0);
+	thread_local size_t preProcessPass = 0;
+	thread_local size_t preProcessDepth = 0;
+
+	class PreProcessDepth
+	{
+	public:
+		PreProcessDepth() { ++preProcessDepth; }
+		~PreProcessDepth() { --preProcessDepth; }
+	};
+}
+
 // --- public --------------------------------------------------------------------------------------
 
 SceneObject::~SceneObject()
@@ -51,6 +66,61 @@ SceneObject::~SceneObject()
 
 
 
+/** do some preprocessing before rendering.
+ *
+ *  @param period [in]
+ *		timespan covered by render.
+ *
+ *  Objects that are shared by several parents (like the child of many Instances) are only
+ *  preprocessed once per pass.  A pass starts when preProcess is called on the root of a scene.
+ */
+void SceneObject::preProcess(const TimePeriod& period)
+{
+	preProcess(period, preProcessDepth == 0 ? newPreProcessPass() : preProcessPass);
+}
+
+
+
+/** do some preprocessing before rendering, as part of an explicit pass.
+ *
+ *  This allows to preprocess the objects of a scene one by one, possibly on different threads,
+ *  as PreProcessGraph does.  Children that are already preprocessed in the same pass, are skipped
+ *  when the parent calls preProcess on them.
+ */
+void SceneObject::preProcess(const TimePeriod& period, size_t pass)
+{
+	if (preProcessPass_ == pass)
+	{
+		return;
+	}
+	preProcessPass_ = pass;
+
+	const size_t outerPass = preProcessPass;
+	preProcessPass = pass;
+	const PreProcessDepth depth;
+	try
+	{
+		doPreProcess(period);
+	}
+	catch (...)
+	{
+		preProcessPass = outerPass;
+		throw;
+	}
+	preProcessPass = outerPass;
+}
+
+
+
+/** Start a new preprocessing pass, see preProcess(period, pass).
+ */
+size_t SceneObject::newPreProcessPass()
+{
+	return ++numPreProcessPasses;
+}
+
+
+
 const TShaderPtr& SceneObject::shader() const
 {
 	return shader_;
@@ -157,7 +227,8 @@ void SceneObject::setState(const TPyObjectPtr& state)
 SceneObject::SceneObject():
 	shader_(defaultShader_),
 	isOverridingShader_(false),
-	isOverridingInterior_(false)
+	isOverridingInterior_(false),
+	preProcessPass_(0)
 {
 }
 
@@ -172,6 +243,30 @@ void SceneObject::doPreProcess(const TimePeriod&)
 
 
 
+/** By default, a packet is intersected ray by ray.
+ */
+void SceneObject::doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const
+{
+	for (size_t k = 0; k < count; ++k)
+	{
+		doIntersect(samples[k], rays[k], results[k]);
+	}
+}
+
+
+
+/** By default, rays are tested one by one.
+ */
+void SceneObject::doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const
+{
+	for (size_t k = 0; k < count; ++k)
+	{
+		results[k] = doIsIntersecting(sample, rays[k]);
+	}
+}
+
+
+
 /** By default, objects don't support surface sampling.
  *  If however, an object can, it must implement doSampleSurface to sample the surface
  *  and override this function to return true
@@ -276,6 +371,15 @@ const TSphere3D SceneObject::doBoundingSphere() const
 
 
 
+/** By default, the bounding box covers the whole period anyway.
+ */
+const TAabb3D SceneObject::doMotionBoundingBox(const TimePeriod&) const
+{
+	return doBoundingBox();
+}
+
+
+
 void SceneObject::doLocalSpace(TTime, TTransformation3D&) const
 {
 	// most objects don't have a local space matrix.
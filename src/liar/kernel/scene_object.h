@@ -106,11 +106,15 @@ public:
 	virtual ~SceneObject();
 
 	void preProcess(const TimePeriod& period);
+	void preProcess(const TimePeriod& period, size_t pass);
+	static size_t newPreProcessPass();
 
 	void intersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const;
 	void intersect(const Sample& sample, const DifferentialRay& ray, Intersection& result) const;
 	bool isIntersecting(const Sample& sample, const BoundedRay& ray) const;
 	bool isIntersecting(const Sample& sample, const DifferentialRay& ray) const;
+	void intersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const;
+	void areIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const;
 	void localContext(const Sample& sample, const BoundedRay& ray, const Intersection& intersection, IntersectionContext& result) const;
 	bool contains(const Sample& sample, const TPoint3D& point) const;
 	void localSpace(TTime time, TTransformation3D& localToWorld) const;
@@ -123,6 +127,7 @@ public:
 	TScalar angularPdf(const Sample& sample, const TRay3D& ray, BoundedRay& shadowRay, TVector3D& normal) const;
 
 	const TAabb3D boundingBox() const;
+	const TAabb3D motionBoundingBox(const TimePeriod& period) const;
 	const TSphere3D boundingSphere() const;
 	bool hasMotion() const;
 
@@ -159,6 +164,8 @@ private:
 	virtual void doPreProcess(const TimePeriod& period);
 	virtual void doIntersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const = 0;
 	virtual bool doIsIntersecting(const Sample& sample, const BoundedRay& ray) const = 0;
+	virtual void doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const;
+	virtual void doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const;
 	virtual void doLocalContext(const Sample& sample, const BoundedRay& ray, const Intersection& intersection, IntersectionContext& result) const = 0;
 	virtual bool doContains(const Sample& sample, const TPoint3D& point) const = 0;
 
@@ -170,6 +177,7 @@ private:
 	virtual TScalar doAngularPdf(const Sample& sample, const TRay3D& ray, BoundedRay& shadowRay, TVector3D& normal) const;
 
 	virtual const TAabb3D doBoundingBox() const = 0;
+	virtual const TAabb3D doMotionBoundingBox(const TimePeriod& period) const;
 	virtual const TSphere3D doBoundingSphere() const;
 	virtual TScalar doArea() const = 0;
 	virtual TScalar doArea(const TVector3D& viewDirection) const = 0;
@@ -184,6 +192,7 @@ private:
 	TMediumPtr interior_;
 	bool isOverridingShader_;
 	bool isOverridingInterior_;
+	size_t preProcessPass_;
 
 	static TShaderPtr defaultShader_;
 };
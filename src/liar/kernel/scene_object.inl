@@ -26,18 +26,6 @@ namespace liar
 namespace kernel
 {
 
-/** do some preprocessing before rendering.
- *
- *  @param period [in]
- *		timespan covered by render.
- */
-inline void SceneObject::preProcess(const TimePeriod& period)
-{
-	doPreProcess(period);
-}
-
-
-
 /** intersect object with normal BoundedRay.
  *
  *  @param sample [in]
@@ -121,6 +109,54 @@ inline bool SceneObject::isIntersecting(const Sample& sample, const Differential
 
 
 
+/** intersect object with a number of coherent rays at once.
+ *
+ *  @param samples [in]
+ *		sample information, one per ray
+ *	@param rays [in]
+ *		rays to intersect with
+ *  @param results [out]
+ *		information on intersection, one per ray
+ *  @param count [in]
+ *		number of rays
+ *
+ *  Equivalent to intersecting each ray separately, but objects can use the coherence of the rays,
+ *  for example to reject a whole packet against their bounds at once.
+ */
+inline void SceneObject::intersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const
+{
+	doIntersectPacket(samples, rays, results, count);
+#ifndef NDEBUG
+	for (size_t k = 0; k < count; ++k)
+	{
+		LASS_ASSERT(!results[k] || results[k].object() == this);
+	}
+#endif
+}
+
+
+
+/** check for a number of rays at once if they intersect the object.
+ *
+ *  @param sample [in]
+ *		sample information, shared by all rays
+ *	@param rays [in]
+ *		rays to intersect with
+ *  @param results [out]
+ *		true if ray intersects object, false otherwise, one per ray
+ *  @param count [in]
+ *		number of rays
+ *
+ *  Equivalent to calling isIntersecting for each ray, but meant for occlusion tests of many shadow
+ *  rays from the same shading point, so that objects can cull them together.
+ */
+inline void SceneObject::areIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const
+{
+	doAreIntersecting(sample, rays, results, count);
+}
+
+
+
 /** get geometrical information on intersection with BoundedRay
  *
  *  @param sample [in]
@@ -308,6 +344,20 @@ inline const TAabb3D SceneObject::boundingBox() const
 
 
 
+/** get AABB of object during part of the period it was preprocessed for.
+ *
+ *  Objects that move over time can give tighter bounds for shorter periods.
+ *
+ *  @return
+ *		AABB of object during @a period, or boundingBox() if it doesn't move.
+ */
+inline const TAabb3D SceneObject::motionBoundingBox(const TimePeriod& period) const
+{
+	return doMotionBoundingBox(period);
+}
+
+
+
 /** get bounding sphere of object
  *
  *  @return
@@ -0,0 +1,265 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "kernel_common.h"
+#include "task_scheduler.h"
+
+namespace liar
+{
+namespace kernel
+{
+
+// --- public --------------------------------------------------------------------------------------
+
+TaskScheduler::TaskScheduler(Sampler& sampler, size_t numberOfWorkers, size_t batchSize):
+	sampler_(sampler),
+	batchSize_(std::max<size_t>(batchSize, 1)),
+	maxTasks_(num::NumTraits<size_t>::max),
+	numTasksDrawn_(0),
+	isExhausted_(false),
+	isCanceled_(false)
+{
+	numberOfWorkers = std::max<size_t>(numberOfWorkers, 1);
+	workers_.reserve(numberOfWorkers);
+	for (size_t k = 0; k < numberOfWorkers; ++k)
+	{
+		workers_.push_back(std::make_unique<Worker>());
+	}
+}
+
+
+
+TaskScheduler::~TaskScheduler()
+{
+}
+
+
+
+size_t TaskScheduler::numberOfWorkers() const
+{
+	return workers_.size();
+}
+
+
+
+size_t TaskScheduler::batchSize() const
+{
+	return batchSize_;
+}
+
+
+
+size_t TaskScheduler::maxTasks() const
+{
+	return maxTasks_;
+}
+
+
+
+/** Stop drawing tasks from the sampler after @a maxTasks of them, even if it's not exhausted yet.
+ */
+void TaskScheduler::setMaxTasks(size_t maxTasks)
+{
+	std::lock_guard<std::mutex> lock(samplerMutex_);
+	maxTasks_ = maxTasks;
+}
+
+
+
+/** Get next task for @a worker, or null if there's no more work to be done.
+ *
+ *  The worker's own deque is consumed front to back, so that tasks are processed in the order
+ *  the sampler made them.  If that's empty, a new batch is drawn from the sampler.  And if that
+ *  is exhausted, a task is stolen from the back of another worker's deque.
+ */
+TaskScheduler::TTaskPtr TaskScheduler::pop(size_t worker)
+{
+	LASS_ASSERT(worker < workers_.size());
+	if (isCanceled_)
+	{
+		return TTaskPtr();
+	}
+
+	Worker& self = *workers_[worker];
+	{
+		std::lock_guard<std::mutex> lock(self.mutex);
+		if (!self.tasks.empty())
+		{
+			TTaskPtr task = self.tasks.front();
+			self.tasks.pop_front();
+			--self.size;
+			++self.statistics.numTasks;
+			return task;
+		}
+	}
+
+	if (TTaskPtr task = refill(worker))
+	{
+		++self.statistics.numTasks;
+		return task;
+	}
+
+	if (TTaskPtr task = steal(worker))
+	{
+		++self.statistics.numTasks;
+		++self.statistics.numStolen;
+		return task;
+	}
+
+	return TTaskPtr();
+}
+
+
+
+/** Drop all pending tasks, and make pop return null from now on.
+ */
+void TaskScheduler::cancel()
+{
+	isCanceled_ = true;
+	for (auto& w : workers_)
+	{
+		std::lock_guard<std::mutex> lock(w->mutex);
+		w->tasks.clear();
+		w->size = 0;
+	}
+}
+
+
+
+bool TaskScheduler::isCanceled() const
+{
+	return isCanceled_;
+}
+
+
+
+TaskScheduler::WorkerStatistics& TaskScheduler::statistics(size_t worker)
+{
+	LASS_ASSERT(worker < workers_.size());
+	return workers_[worker]->statistics;
+}
+
+
+
+const TaskScheduler::WorkerStatistics& TaskScheduler::statistics(size_t worker) const
+{
+	LASS_ASSERT(worker < workers_.size());
+	return workers_[worker]->statistics;
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+/** Draw a batch of tasks from the sampler.  Return the first, and queue the others in @a worker's deque.
+ */
+TaskScheduler::TTaskPtr TaskScheduler::refill(size_t worker)
+{
+	if (isExhausted_)
+	{
+		return TTaskPtr();
+	}
+
+	std::vector<TTaskPtr> batch;
+	batch.reserve(batchSize_);
+	{
+		std::lock_guard<std::mutex> lock(samplerMutex_);
+		while (batch.size() < batchSize_ && !isExhausted_)
+		{
+			TTaskPtr task = numTasksDrawn_ < maxTasks_ ? sampler_.getTask() : TTaskPtr();
+			if (!task)
+			{
+				isExhausted_ = true;
+				break;
+			}
+			batch.push_back(task);
+			++numTasksDrawn_;
+		}
+	}
+	if (batch.empty())
+	{
+		return TTaskPtr();
+	}
+
+	Worker& self = *workers_[worker];
+	{
+		std::lock_guard<std::mutex> lock(self.mutex);
+		self.tasks.insert(self.tasks.end(), batch.begin() + 1, batch.end());
+		self.size += batch.size() - 1;
+	}
+	return batch.front();
+}
+
+
+
+/** Steal a task from the back of the fullest deque of another worker.
+ *
+ *  The sizes are only peeked at without locking, so by the time we get to the victim,
+ *  it may already be empty.  In that case, we simply try again.
+ */
+TaskScheduler::TTaskPtr TaskScheduler::steal(size_t thief)
+{
+	const size_t n = workers_.size();
+	while (!isCanceled_)
+	{
+		size_t victim = n;
+		size_t maxSize = 0;
+		for (size_t k = 1; k < n; ++k)
+		{
+			const size_t candidate = (thief + k) % n;
+			const size_t size = workers_[candidate]->size;
+			if (size > maxSize)
+			{
+				victim = candidate;
+				maxSize = size;
+			}
+		}
+		if (victim == n)
+		{
+			return TTaskPtr();
+		}
+
+		Worker& other = *workers_[victim];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.tasks.empty())
+		{
+			TTaskPtr task = other.tasks.back();
+			other.tasks.pop_back();
+			--other.size;
+			return task;
+		}
+	}
+	return TTaskPtr();
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+
+
+}
+
+}
+
+// EOF
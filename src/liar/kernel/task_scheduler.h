@@ -0,0 +1,115 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::kernel::TaskScheduler
+ *  @brief distributes the tasks of a sampler over a number of workers, using work stealing.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Each worker owns a deque of tasks.  When it runs dry, it first refills it with a batch of
+ *  consecutive tasks from the sampler, so that it keeps working on neighbouring tiles.  Only once
+ *  the sampler is exhausted, workers steal from the back of the fullest deque of their peers.
+ *  There's no dedicated producer thread, so workers never have to wait for one to catch up.
+ *
+ *  The number of tasks drawn from the sampler can be limited with setMaxTasks, so that progressive
+ *  samplers, which never run out of tasks, can be rendered in passes.
+ *
+ *  Sampler::getTask is not thread safe, so access to the sampler is serialized.  Since a whole
+ *  batch of tasks is drawn at once, that lock is hardly contended.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_KERNEL_TASK_SCHEDULER_H
+#define LIAR_GUARDIAN_OF_INCLUSION_KERNEL_TASK_SCHEDULER_H
+
+#include "kernel_common.h"
+#include "sampler.h"
+#include <lass/util/non_copyable.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace liar
+{
+namespace kernel
+{
+
+class LIAR_KERNEL_DLL TaskScheduler: public util::NonCopyable
+{
+public:
+
+	typedef Sampler::TTaskPtr TTaskPtr;
+
+	struct WorkerStatistics
+	{
+		size_t numTasks = 0;
+		size_t numStolen = 0;
+		TTimeDelta busyTime = 0;
+	};
+
+	TaskScheduler(Sampler& sampler, size_t numberOfWorkers, size_t batchSize = 8);
+	~TaskScheduler();
+
+	size_t numberOfWorkers() const;
+	size_t batchSize() const;
+	size_t maxTasks() const;
+	void setMaxTasks(size_t maxTasks);
+
+	TTaskPtr pop(size_t worker);
+	void cancel();
+	bool isCanceled() const;
+
+	WorkerStatistics& statistics(size_t worker);
+	const WorkerStatistics& statistics(size_t worker) const;
+
+private:
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<TTaskPtr> tasks;
+		std::atomic<size_t> size { 0 };
+		WorkerStatistics statistics;
+	};
+
+	typedef std::vector<std::unique_ptr<Worker>> TWorkers;
+
+	TTaskPtr refill(size_t worker);
+	TTaskPtr steal(size_t thief);
+
+	TWorkers workers_;
+	Sampler& sampler_;
+	std::mutex samplerMutex_;
+	size_t batchSize_;
+	size_t maxTasks_;
+	size_t numTasksDrawn_;
+	std::atomic<bool> isExhausted_;
+	std::atomic<bool> isCanceled_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
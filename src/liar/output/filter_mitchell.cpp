@@ -161,6 +161,27 @@ bool FilterMitchell::doIsCanceling() const
 
 
 
+bool FilterMitchell::doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean)
+{
+	return target_->estimateVariance(mean, varianceOfMean);
+}
+
+
+
+bool FilterMitchell::doSaveCheckpoint(io::BinaryOStream& stream)
+{
+	return target_->saveCheckpoint(stream);
+}
+
+
+
+bool FilterMitchell::doLoadCheckpoint(io::BinaryIStream& stream)
+{
+	return target_->loadCheckpoint(stream);
+}
+
+
+
 inline TScalar FilterMitchell::filterKernel(TScalar x) const
 {
 	const TScalar B = b_;
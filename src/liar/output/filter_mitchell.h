@@ -69,6 +69,9 @@ private:
 	void doWriteRender(const OutputSample* first, const OutputSample* last) override;
 	void doEndRender() override;
 	bool doIsCanceling() const override;
+	bool doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean) override;
+	bool doSaveCheckpoint(io::BinaryOStream& stream) override;
+	bool doLoadCheckpoint(io::BinaryIStream& stream) override;
 
 	TScalar filterKernel(TScalar x) const;
 	const TVector2D filterKernel(const TVector2D& p) const;
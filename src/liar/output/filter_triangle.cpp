@@ -164,6 +164,27 @@ bool FilterTriangle::doIsCanceling() const
 
 
 
+bool FilterTriangle::doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean)
+{
+	return target_->estimateVariance(mean, varianceOfMean);
+}
+
+
+
+bool FilterTriangle::doSaveCheckpoint(io::BinaryOStream& stream)
+{
+	return target_->saveCheckpoint(stream);
+}
+
+
+
+bool FilterTriangle::doLoadCheckpoint(io::BinaryIStream& stream)
+{
+	return target_->loadCheckpoint(stream);
+}
+
+
+
 inline FilterTriangle::TValue FilterTriangle::filterKernel(TValue x) const
 {
 	return std::max(num::NumTraits<TValue>::zero, width_ - num::abs(x));
@@ -23,6 +23,7 @@
 
 #include "output_common.h"
 #include "raster.h"
+#include <atomic>
 
 #define TONEMAP_SAMPLES
 
@@ -53,6 +54,11 @@ PY_CLASS_MEMBER_RW(Raster, exposureCorrectionStops, setExposureCorrectionStops)
 PY_CLASS_MEMBER_RW(Raster, autoExposure, setAutoExposure)
 PY_CLASS_MEMBER_RW(Raster, middleGrey, setMiddleGrey)
 PY_CLASS_MEMBER_RW(Raster, maxSampleLuminance, setMaxSampleLuminance)
+PY_CLASS_MEMBER_RW_DOC(Raster, threadLocalAccumulation, setThreadLocalAccumulation,
+    "If true, each render thread accumulates samples in its own buffer, merged only when tonemapping or ending the render")
+PY_CLASS_METHOD_DOC(Raster, variance,
+    "variance() -> list\n"
+    "per pixel variance of the mean luminance, in scanline order. Pixels without samples have infinite variance.")
 PY_CLASS_ENUM(Raster, Raster::ToneMapping)
 
 namespace
@@ -77,11 +83,35 @@ namespace
         const TValue x = (-b - num::sqrt(D)) / (2 * a);
         return x + 0.004f;
     }
+
+    std::atomic<num::Tuint64> nextAccumulatorGeneration(1);
+
+    template <typename T>
+    void writeBuffer(io::BinaryOStream& stream, const std::vector<T>& buffer)
+    {
+        stream.write(buffer.data(), buffer.size() * sizeof(T));
+    }
+
+    template <typename T>
+    void readBuffer(io::BinaryIStream& stream, std::vector<T>& buffer)
+    {
+        stream.read(buffer.data(), buffer.size() * sizeof(T));
+        if (!stream.good())
+        {
+            LASS_THROW("Failed to read raster checkpoint: unexpected end of stream.");
+        }
+    }
 }
 
 
 // --- public --------------------------------------------------------------------------------------
 
+Raster::~Raster()
+{
+}
+
+
+
 const TRgbSpaceRef& Raster::rgbSpace() const
 {
     return rgbSpace_;
@@ -179,6 +209,13 @@ Raster::TValue Raster::maxSampleLuminance() const
 
 
 
+bool Raster::threadLocalAccumulation() const
+{
+    return threadLocalAccumulation_;
+}
+
+
+
 void Raster::setRgbSpace(const TRgbSpaceRef& rgbSpace)
 {
     std::lock_guard<std::recursive_mutex> lock(renderLock_);
@@ -262,6 +299,18 @@ void Raster::setMaxSampleLuminance(TValue level)
 
 
 
+void Raster::setThreadLocalAccumulation(bool enable)
+{
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    if (!enable)
+    {
+        mergeAccumulators();
+    }
+    threadLocalAccumulation_ = enable;
+}
+
+
+
 void Raster::nextToneMapping()
 {
     std::lock_guard<std::recursive_mutex> lock(renderLock_);
@@ -272,6 +321,18 @@ void Raster::nextToneMapping()
 
 
 
+/** Per pixel variance of the mean luminance, in scanline order.
+ */
+Raster::TValueBuffer Raster::variance()
+{
+    TValueBuffer mean;
+    TValueBuffer varianceOfMean;
+    doEstimateVariance(mean, varianceOfMean);
+    return varianceOfMean;
+}
+
+
+
 // --- protected -----------------------------------------------------------------------------------
 
 Raster::Raster(const TResolution2D& resolution):
@@ -283,7 +344,9 @@ Raster::Raster(const TResolution2D& resolution):
     middleGrey_(.184f),
     maxSampleLuminance_(num::NumTraits<TValue>::infinity),
     maxSceneLuminance_(0),
+    accumulatorGeneration_(0),
     autoExposure_(true),
+    threadLocalAccumulation_(false),
     isDirtyAutoExposure_(false)
 {
 }
@@ -298,6 +361,10 @@ void Raster::beginRaster()
     tonemapBuffer_.assign(n, prim::ColorRGBA(0,0,0,0));
     totalWeight_.assign(n, 0);
     alphaBuffer_.assign(n, 0);
+    squaredLuminanceBuffer_.assign(n, 0);
+    squaredWeight_.assign(n, 0);
+    accumulators_.clear();
+    accumulatorGeneration_ = nextAccumulatorGeneration++;
     renderDirtyBox_.clear();
     allTimeDirtyBox_.clear();
     maxSceneLuminance_ = 0;
@@ -313,6 +380,8 @@ Raster::TDirtyBox Raster::tonemap(const TRgbSpaceRef& destSpace)
 
     std::lock_guard<std::recursive_mutex> lock(renderLock_);
 
+    mergeAccumulators();
+
     const TValue gain = sceneGain(); // get gain first, as it can change the dirtybox
 
     const TDirtyBox::TPoint min = renderDirtyBox_.min();
@@ -509,8 +578,10 @@ const Raster::TValueBuffer& Raster::totalWeight() const
 
 
 
-const Raster::TDirtyBox& Raster::dirtyBox() const
+const Raster::TDirtyBox& Raster::dirtyBox()
 {
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    mergeAccumulators();
     return renderDirtyBox_;
 }
 
@@ -523,6 +594,26 @@ void Raster::clearDirtyBox()
 
 
 
+/** Merge the thread local accumulators into the render buffer, and reset them.
+ */
+void Raster::mergeAccumulators()
+{
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    TDirtyBox dirtyBox;
+    for (const auto& accumulator : accumulators_)
+    {
+        dirtyBox += accumulator->merge(*this);
+    }
+    if (!dirtyBox.isEmpty())
+    {
+        renderDirtyBox_ += dirtyBox;
+        allTimeDirtyBox_ += dirtyBox;
+        isDirtyAutoExposure_ = true;
+    }
+}
+
+
+
 // --- private -------------------------------------------------------------------------------------
 
 const TResolution2D Raster::doResolution() const
@@ -540,10 +631,152 @@ struct Splat
     XYZ xyz;
     TValue weight;
     TValue alpha;
+    TValue squaredLuminance; // weight * y * y, for the variance estimate
 };
 
 }
 
+/** @internal
+ *  Per thread accumulation buffer, allocated in blocks of blockSize x blockSize pixels on first touch.
+ *  Its mutex is only contended when the render buffer is being merged, which happens rarely.
+ */
+class Raster::Accumulator
+{
+public:
+    Accumulator(const TResolution2D& resolution):
+        resolution_(resolution),
+        numBlocksX_((resolution.x + blockSize - 1) / blockSize)
+    {
+        const size_t numBlocksY = (resolution.y + blockSize - 1) / blockSize;
+        blocks_.resize(numBlocksX_ * numBlocksY);
+    }
+
+    void add(const Splat* first, const Splat* last, const TDirtyBox& dirtyBox)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (; first != last; ++first)
+        {
+            const size_t i = first->index % resolution_.x;
+            const size_t j = first->index / resolution_.x;
+            auto& block = blocks_[(j / blockSize) * numBlocksX_ + (i / blockSize)];
+            if (!block)
+            {
+                block = std::make_unique<Block>();
+            }
+            const size_t k = (j % blockSize) * blockSize + (i % blockSize);
+            block->xyz[k] += first->xyz;
+            block->weight[k] += first->weight;
+            block->alpha[k] += first->alpha;
+            block->squaredLuminance[k] += first->squaredLuminance;
+            block->squaredWeight[k] += first->weight * first->weight;
+            block->isDirty = true;
+        }
+        dirtyBox_ += dirtyBox;
+    }
+
+    TDirtyBox merge(Raster& raster)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t b = 0, n = blocks_.size(); b < n; ++b)
+        {
+            Block* block = blocks_[b].get();
+            if (!block || !block->isDirty)
+            {
+                continue;
+            }
+            const size_t iBegin = (b % numBlocksX_) * blockSize;
+            const size_t jBegin = (b / numBlocksX_) * blockSize;
+            const size_t iEnd = std::min(iBegin + blockSize, resolution_.x);
+            const size_t jEnd = std::min(jBegin + blockSize, resolution_.y);
+            for (size_t j = jBegin; j < jEnd; ++j)
+            {
+                for (size_t i = iBegin; i < iEnd; ++i)
+                {
+                    const size_t k = (j % blockSize) * blockSize + (i % blockSize);
+                    if (block->weight[k] == 0)
+                    {
+                        continue;
+                    }
+                    const size_t index = j * resolution_.x + i;
+                    TValue& w = raster.totalWeight_[index];
+                    w += block->weight[k];
+                    raster.alphaBuffer_[index] += block->alpha[k];
+                    raster.squaredLuminanceBuffer_[index] += block->squaredLuminance[k];
+                    raster.squaredWeight_[index] += block->squaredWeight[k];
+                    XYZ& xyz = raster.renderBuffer_[index];
+                    xyz += block->xyz[k];
+                    if (w > 0 && xyz.y > 0)
+                    {
+                        raster.maxSceneLuminance_ = std::max(xyz.y / w, raster.maxSceneLuminance_);
+                    }
+                }
+            }
+            *block = Block();
+        }
+        const TDirtyBox dirtyBox = dirtyBox_;
+        dirtyBox_.clear();
+        return dirtyBox;
+    }
+
+private:
+    enum { blockSize = 32 };
+
+    struct Block
+    {
+        XYZ xyz[blockSize * blockSize];
+        TValue weight[blockSize * blockSize] = {};
+        TValue alpha[blockSize * blockSize] = {};
+        TValue squaredLuminance[blockSize * blockSize] = {};
+        TValue squaredWeight[blockSize * blockSize] = {};
+        bool isDirty = false;
+    };
+
+    std::vector<std::unique_ptr<Block>> blocks_;
+    std::mutex mutex_;
+    TDirtyBox dirtyBox_;
+    TResolution2D resolution_;
+    size_t numBlocksX_;
+};
+
+
+
+/** @internal
+ *  Find the accumulator of the calling thread, or make a new one.
+ *  Lookups go through a small thread local cache, keyed on the generation of the accumulators,
+ *  so that rasters and renders never mix up accumulators.
+ */
+Raster::Accumulator& Raster::threadAccumulator()
+{
+    typedef std::pair<num::Tuint64, Accumulator*> TCacheEntry;
+    static thread_local std::vector<TCacheEntry> cache;
+
+    const num::Tuint64 generation = accumulatorGeneration_;
+    for (const TCacheEntry& entry : cache)
+    {
+        if (entry.first == generation)
+        {
+            return *entry.second;
+        }
+    }
+
+    Accumulator* accumulator = nullptr;
+    {
+        std::lock_guard<std::recursive_mutex> lock(renderLock_);
+        accumulators_.push_back(std::make_unique<Accumulator>(resolution_));
+        accumulator = accumulators_.back().get();
+    }
+
+    const size_t maxCacheSize = 8;
+    if (cache.size() >= maxCacheSize)
+    {
+        cache.erase(cache.begin());
+    }
+    cache.emplace_back(generation, accumulator);
+    return *accumulator;
+}
+
+
+
 void Raster::doWriteRender(const OutputSample* first, const OutputSample* last)
 {
     static thread_local std::vector<Splat> buffer;
@@ -577,6 +810,8 @@ void Raster::doWriteRender(const OutputSample* first, const OutputSample* last)
                 splat->weight = first->weight();
                 splat->alpha = splat->weight * first->alpha();
                 splat->xyz = splat->alpha * xyz;
+                const TValue y = first->alpha() * xyz.y;
+                splat->squaredLuminance = splat->weight * y * y;
                 dirtyBox += TDirtyBox::TPoint(i, j);
             }
         }
@@ -584,6 +819,12 @@ void Raster::doWriteRender(const OutputSample* first, const OutputSample* last)
         ++splat;
     }
 
+    if (threadLocalAccumulation_)
+    {
+        threadAccumulator().add(&*buffer.begin(), &*buffer.begin() + (splat - buffer.begin()), dirtyBox);
+        return;
+    }
+
     {
         std::lock_guard<std::recursive_mutex> lock(renderLock_);
         for (auto s = buffer.begin(); s != splat; ++s)
@@ -592,6 +833,8 @@ void Raster::doWriteRender(const OutputSample* first, const OutputSample* last)
             TValue& w = totalWeight_[k];
             w += s->weight;
             alphaBuffer_[k] += s->alpha;
+            squaredLuminanceBuffer_[k] += s->squaredLuminance;
+            squaredWeight_[k] += s->weight * s->weight;
             XYZ& xyz = renderBuffer_[k];
             xyz += s->xyz;
             if (w > 0 && xyz.y > 0)
@@ -607,6 +850,91 @@ void Raster::doWriteRender(const OutputSample* first, const OutputSample* last)
 
 
 
+/** Weighted sample variance of the luminance, divided by the effective number of samples
+ *  W^2 / sum(w^2), which gives the variance of the mean for non-uniform filter weights.
+ */
+bool Raster::doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean)
+{
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    mergeAccumulators();
+    const size_t n = resolution_.x * resolution_.y;
+    mean.assign(n, 0);
+    varianceOfMean.assign(n, num::NumTraits<TValue>::infinity);
+    if (renderBuffer_.size() != n)
+    {
+        return true; // we haven't started rendering yet.
+    }
+    for (size_t k = 0; k < n; ++k)
+    {
+        const TValue w = totalWeight_[k];
+        if (w <= 0)
+        {
+            continue;
+        }
+        const TValue mu = renderBuffer_[k].y / w;
+        const TValue sigma2 = std::max(squaredLuminanceBuffer_[k] / w - mu * mu, TValue(0));
+        const TValue numEffective = w * w / squaredWeight_[k];
+        mean[k] = mu;
+        varianceOfMean[k] = sigma2 / numEffective;
+    }
+    return true;
+}
+
+
+
+/** Buffers are written in native byte order, as checkpoints are only meant to be resumed on the same machine.
+ */
+bool Raster::doSaveCheckpoint(io::BinaryOStream& stream)
+{
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    mergeAccumulators();
+    const num::Tuint32 width = num::numCast<num::Tuint32>(resolution_.x);
+    const num::Tuint32 height = num::numCast<num::Tuint32>(resolution_.y);
+    const num::Tuint32 valueSize = sizeof(TValue);
+    stream << width << height << valueSize << maxSceneLuminance_;
+    writeBuffer(stream, renderBuffer_);
+    writeBuffer(stream, totalWeight_);
+    writeBuffer(stream, alphaBuffer_);
+    writeBuffer(stream, squaredLuminanceBuffer_);
+    writeBuffer(stream, squaredWeight_);
+    return true;
+}
+
+
+
+bool Raster::doLoadCheckpoint(io::BinaryIStream& stream)
+{
+    std::lock_guard<std::recursive_mutex> lock(renderLock_);
+    num::Tuint32 width = 0;
+    num::Tuint32 height = 0;
+    num::Tuint32 valueSize = 0;
+    TValue maxSceneLuminance = 0;
+    stream >> width >> height >> valueSize >> maxSceneLuminance;
+    if (!stream.good())
+    {
+        LASS_THROW("Failed to read raster checkpoint: unexpected end of stream.");
+    }
+    if (TResolution2D(width, height) != resolution_ || valueSize != sizeof(TValue))
+    {
+        LASS_THROW("Raster checkpoint of " << width << "x" << height << " doesn't match raster of " << resolution_ << ".");
+    }
+    mergeAccumulators();
+    readBuffer(stream, renderBuffer_);
+    readBuffer(stream, totalWeight_);
+    readBuffer(stream, alphaBuffer_);
+    readBuffer(stream, squaredLuminanceBuffer_);
+    readBuffer(stream, squaredWeight_);
+    maxSceneLuminance_ = maxSceneLuminance;
+
+    const TDirtyBox all(TDirtyBox::TPoint(0, 0), TDirtyBox::TPoint(resolution_.x - 1, resolution_.y - 1));
+    renderDirtyBox_ += all;
+    allTimeDirtyBox_ += all;
+    isDirtyAutoExposure_ = true;
+    return true;
+}
+
+
+
 Raster::TValue Raster::sceneGain() const
 {
     const TValue stops = exposureStops() + exposureCorrectionStops();
@@ -24,6 +24,12 @@
 /** @class liar::output::Raster
  *  @brief common base for raster based render targets like Image and Display.
  *  @author Bram de Greve [Bramz]
+ *
+ *  With threadLocalAccumulation enabled, each render thread splats its samples in a private
+ *  accumulator, instead of directly into the shared render buffer under renderLock_.  The
+ *  accumulators are only merged into the render buffer when tonemapping or ending the render.
+ *  Accumulators are allocated per block of pixels as they get touched, so tiled renders don't
+ *  need a full frame per thread.
  */
 
 #ifndef LIAR_GUARDIAN_OF_INCLUSION_OUTPUT_RASTER_H
@@ -45,6 +51,8 @@ class LIAR_OUTPUT_DLL Raster: public RenderTarget
 public:
     typedef OutputSample::TValue TValue;
 
+    ~Raster();
+
     enum class ToneMapping
     {
         Linear = 0,
@@ -66,6 +74,7 @@ public:
     bool autoExposure() const;
     TValue middleGrey() const;
     TValue maxSampleLuminance() const;
+    bool threadLocalAccumulation() const;
 
     void setRgbSpace(const TRgbSpaceRef& rgbSpace);
     void setToneMapping(ToneMapping mode);
@@ -74,15 +83,17 @@ public:
     void setAutoExposure(bool enable = true);
     void setMiddleGrey(TValue grey);
     void setMaxSampleLuminance(TValue luminance);
+    void setThreadLocalAccumulation(bool enable = true);
 
     void nextToneMapping();
 
+    TValueBuffer variance();
+
 protected:
 
     Raster(const TResolution2D& resolution);
 
     typedef std::vector<XYZ> TRenderBuffer;
-    typedef std::vector<OutputSample::TValue> TValueBuffer;
     typedef std::vector<prim::ColorRGBA> TTonemapBuffer;
     typedef prim::Aabb2D<size_t> TDirtyBox;
 
@@ -91,25 +102,37 @@ protected:
 
     const TTonemapBuffer& tonemapBuffer() const;
     const TValueBuffer& totalWeight() const;
-    const TDirtyBox& dirtyBox() const;
+    const TDirtyBox& dirtyBox();
     void clearDirtyBox();
+    void mergeAccumulators();
 
 private:
 
+    class Accumulator;
+    typedef std::vector<std::unique_ptr<Accumulator>> TAccumulators;
+
     const TResolution2D doResolution() const override;
 
     void doWriteRender(const OutputSample* first, const OutputSample* last) override;
+    bool doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean) override;
+    bool doSaveCheckpoint(io::BinaryOStream& stream) override;
+    bool doLoadCheckpoint(io::BinaryIStream& stream) override;
 
     TValue sceneGain() const;
     TValue averageSceneLuminance() const;
     XYZA weighted(size_t index, TValue gain = 1) const;
+    Accumulator& threadAccumulator();
 
     TRenderBuffer renderBuffer_;
     TTonemapBuffer tonemapBuffer_;
     TValueBuffer totalWeight_;
     TValueBuffer alphaBuffer_;
+    TValueBuffer squaredLuminanceBuffer_;
+    TValueBuffer squaredWeight_;
     mutable TDirtyBox renderDirtyBox_;
     TDirtyBox allTimeDirtyBox_;
+    TAccumulators accumulators_;
+    num::Tuint64 accumulatorGeneration_;
     mutable std::recursive_mutex   renderLock_;
     TResolution2D resolution_;
     TRgbSpaceRef rgbSpace_;
@@ -120,6 +143,7 @@ private:
     TValue maxSampleLuminance_;
     TValue maxSceneLuminance_;
     bool autoExposure_;
+    bool threadLocalAccumulation_;
     mutable bool isDirtyAutoExposure_;
 };
 
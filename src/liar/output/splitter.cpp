@@ -138,6 +138,46 @@ bool Splitter::doIsCanceling() const
 
 
 
+bool Splitter::doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean)
+{
+	for (TChildren::const_iterator i = children_.begin(); i != children_.end(); ++i)
+	{
+		if ((*i)->estimateVariance(mean, varianceOfMean))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+/** All children get to write their checkpoint, in order, so they can be restored in the same order.
+ */
+bool Splitter::doSaveCheckpoint(io::BinaryOStream& stream)
+{
+	bool result = false;
+	for (TChildren::const_iterator i = children_.begin(); i != children_.end(); ++i)
+	{
+		result |= (*i)->saveCheckpoint(stream);
+	}
+	return result;
+}
+
+
+
+bool Splitter::doLoadCheckpoint(io::BinaryIStream& stream)
+{
+	bool result = false;
+	for (TChildren::const_iterator i = children_.begin(); i != children_.end(); ++i)
+	{
+		result |= (*i)->loadCheckpoint(stream);
+	}
+	return result;
+}
+
+
+
 // --- free ----------------------------------------------------------------------------------------
 
 
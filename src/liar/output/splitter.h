@@ -59,6 +59,9 @@ private:
 	void doWriteRender(const OutputSample* first, const OutputSample* last) override;
 	void doEndRender() override;
 	bool doIsCanceling() const override;
+	bool doEstimateVariance(TValueBuffer& mean, TValueBuffer& varianceOfMean) override;
+	bool doSaveCheckpoint(io::BinaryOStream& stream) override;
+	bool doLoadCheckpoint(io::BinaryIStream& stream) override;
 
 	TChildren children_;
 };
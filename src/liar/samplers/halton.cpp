@@ -43,12 +43,6 @@ Halton::Halton():
 }
 
 
-size_t Halton::samplesPerTask() const
-{
-	return samplesPerTask_;
-}
-
-
 void Halton::setSamplesPerTask(size_t samplesPerTask)
 {
 	samplesPerTask_ = std::max<size_t>(samplesPerTask, 1);
@@ -69,6 +63,12 @@ Halton::TTaskPtr Halton::doGetTask()
 }
 
 
+size_t Halton::doSamplesPerTask() const
+{
+	return samplesPerTask_;
+}
+
+
 void Halton::doSeed(TSeed /*randomSeed*/)
 {
 	// As a global deterministic sampler, we don't need to seed anything.
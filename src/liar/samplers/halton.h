@@ -77,7 +77,6 @@ public:
 
 	Halton();
 
-	size_t samplesPerTask() const;
 	void setSamplesPerTask(size_t samplesPerTask);
 
 private:
@@ -108,6 +107,7 @@ private:
 	};
 
 	TTaskPtr doGetTask() override;
+	size_t doSamplesPerTask() const override;
 
 	void doSeed(TSeed randomSeed) override;
 	const TSamplerPtr doClone() const  override;
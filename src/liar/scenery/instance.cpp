@@ -0,0 +1,172 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "scenery_common.h"
+#include "instance.h"
+#include "../kernel/ray_packet.h"
+
+namespace liar
+{
+namespace scenery
+{
+
+PY_DECLARE_CLASS_DOC(Instance,
+	"Instance(child, localToWorld)\n"
+	"placement of a shared child object, which is only stored and preprocessed once.\n"
+	"Put many instances in a QbvhTree to get a two-level hierarchy.")
+PY_CLASS_CONSTRUCTOR_2(Instance, const TSceneObjectRef&, const TTransformation3D&)
+PY_CLASS_CONSTRUCTOR_2(Instance, const TSceneObjectRef&, const TPyTransformation3DRef&)
+PY_CLASS_MEMBER_RW(Instance, child, setChild)
+PY_CLASS_MEMBER_RW(Instance, localToWorld, setLocalToWorld)
+
+
+// --- public --------------------------------------------------------------------------------------
+
+Instance::Instance(const TSceneObjectRef& child, const TTransformation3D& localToWorld):
+	Transformation(child, localToWorld)
+{
+}
+
+
+
+Instance::Instance(const TSceneObjectRef& child, const TPyTransformation3DRef& localToWorld):
+	Transformation(child, localToWorld)
+{
+}
+
+
+
+void Instance::setChild(const TSceneObjectRef& child)
+{
+	Transformation::setChild(child);
+	bounds_ = TAabb3D();
+}
+
+
+
+void Instance::setLocalToWorld(const TTransformation3D& localToWorld)
+{
+	Transformation::setLocalToWorld(localToWorld);
+	bounds_ = TAabb3D();
+}
+
+
+
+// --- protected -----------------------------------------------------------------------------------
+
+// --- private -------------------------------------------------------------------------------------
+
+void Instance::doAccept(util::VisitorBase& visitor)
+{
+	preAccept(visitor, *this);
+	child()->accept(visitor);
+	postAccept(visitor, *this);
+}
+
+
+
+/** The child is shared by many instances, but SceneObject::preProcess makes sure it's only
+ *  done once.  The world bounds are cached, as the top level tree queries them a lot.
+ */
+void Instance::doPreProcess(const TimePeriod& period)
+{
+	Transformation::doPreProcess(period);
+	bounds_ = Transformation::doBoundingBox();
+}
+
+
+
+/** Transforms the packet as a whole, so that the child can still use its coherence.
+ */
+void Instance::doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const
+{
+	const size_t packetSize = RayPacket::capacity;
+	BoundedRay localRays[packetSize];
+	TScalar tScalers[packetSize];
+	for (size_t i = 0; i < count; i += packetSize)
+	{
+		const size_t n = std::min(count - i, packetSize);
+		for (size_t k = 0; k < n; ++k)
+		{
+			tScalers[k] = TNumTraits::one;
+			localRays[k] = transform(rays[i + k], worldToLocalMatrix(), tScalers[k]);
+		}
+		child()->intersectPacket(samples + i, localRays, results + i, n);
+		for (size_t k = 0; k < n; ++k)
+		{
+			Intersection& result = results[i + k];
+			if (result)
+			{
+				result.push(this, result.t() / tScalers[k]);
+			}
+		}
+	}
+}
+
+
+
+void Instance::doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const
+{
+	const size_t packetSize = RayPacket::capacity;
+	BoundedRay localRays[packetSize];
+	for (size_t i = 0; i < count; i += packetSize)
+	{
+		const size_t n = std::min(count - i, packetSize);
+		for (size_t k = 0; k < n; ++k)
+		{
+			localRays[k] = transform(rays[i + k], worldToLocalMatrix());
+		}
+		child()->areIntersecting(sample, localRays, results + i, n);
+	}
+}
+
+
+
+const TAabb3D Instance::doBoundingBox() const
+{
+	if (!bounds_.isEmpty())
+	{
+		return bounds_;
+	}
+	return Transformation::doBoundingBox();
+}
+
+
+
+void Instance::doSetState(const TPyObjectPtr& state)
+{
+	Transformation::doSetState(state);
+	bounds_ = TAabb3D();
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,80 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::scenery::Instance
+ *  @brief placement of a shared, prebuilt child object with a transformation.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Many instances can refer to the same child (a mesh, a tree or a composite), so that memory
+ *  scales with the unique geometry rather than with the number of instances.  Put the instances
+ *  in an object tree like QbvhTree to get a two-level hierarchy: the top level is built over the
+ *  world bounds of the instances, and rays are only transformed to the child's space once they
+ *  reach an instance.  The shared child is preprocessed only once per render.
+ *
+ *  It's a Transformation that caches its world bounds and passes packets of rays on to the child
+ *  as a whole.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_SCENERY_INSTANCE_H
+#define LIAR_GUARDIAN_OF_INCLUSION_SCENERY_INSTANCE_H
+
+#include "scenery_common.h"
+#include "transformation.h"
+
+namespace liar
+{
+namespace scenery
+{
+
+class LIAR_SCENERY_DLL Instance: public Transformation
+{
+	PY_HEADER(Transformation)
+public:
+
+	Instance(const TSceneObjectRef& child, const TTransformation3D& localToWorld);
+	Instance(const TSceneObjectRef& child, const TPyTransformation3DRef& localToWorld);
+
+	void setChild(const TSceneObjectRef& child);
+	void setLocalToWorld(const TTransformation3D& localToWorld);
+
+private:
+
+	void doAccept(lass::util::VisitorBase& visitor) override;
+
+	void doPreProcess(const TimePeriod& period) override;
+	void doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const override;
+	void doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const override;
+	const TAabb3D doBoundingBox() const override;
+
+	void doSetState(const TPyObjectPtr& state) override;
+
+	TAabb3D bounds_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
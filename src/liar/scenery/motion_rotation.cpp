@@ -122,30 +122,8 @@ void MotionRotation::doAccept(util::VisitorBase& visitor)
 void MotionRotation::doPreProcess(const TimePeriod& period)
 {
 	child_->preProcess(period);
-
-	const TAabb3D localBox = child_->boundingBox();
-	if (localBox.isEmpty())
-	{
-		aabb_ = localBox;
-		return;
-	}
-	aabb_ = prim::transform(localBox, worldToLocal(period.begin()).inverse());
-	if (period.end() == period.begin())
-	{
-		return;
-	}
-	aabb_ += prim::transform(localBox, worldToLocal(period.end()).inverse());
-
-	const TScalar theta1 = angle(period.begin());
-	const TScalar theta2 = angle(period.end());
-	const TScalar quadrant = TNumTraits::pi / 2;
-	const int k1 = static_cast<int>(num::ceil(theta1 / quadrant));
-	const int k2 = static_cast<int>(num::floor(theta2 / quadrant));
-	for (int k = k1; k <= k2; ++k)
-	{
-		TTransformation3D localToWorld = TTransformation3D::rotation(axis_, k * quadrant);
-		aabb_ += prim::transform(localBox, localToWorld);
-	}
+	localAabb_ = child_->boundingBox();
+	aabb_ = doMotionBoundingBox(period);
 }
 
 
@@ -204,6 +182,37 @@ const TAabb3D MotionRotation::doBoundingBox() const
 
 
 
+/** Besides the orientations at the begin and end of @a period, the box also covers the ones at
+ *  each multiple of 90 degrees in between, where the rotated corners reach their extremes.
+ */
+const TAabb3D MotionRotation::doMotionBoundingBox(const TimePeriod& period) const
+{
+	if (localAabb_.isEmpty())
+	{
+		return localAabb_;
+	}
+	TAabb3D result = prim::transform(localAabb_, worldToLocal(period.begin()).inverse());
+	if (period.end() == period.begin())
+	{
+		return result;
+	}
+	result += prim::transform(localAabb_, worldToLocal(period.end()).inverse());
+
+	const TScalar theta1 = angle(period.begin());
+	const TScalar theta2 = angle(period.end());
+	const TScalar quadrant = TNumTraits::pi / 2;
+	const int k1 = static_cast<int>(num::ceil(std::min(theta1, theta2) / quadrant));
+	const int k2 = static_cast<int>(num::floor(std::max(theta1, theta2) / quadrant));
+	for (int k = k1; k <= k2; ++k)
+	{
+		TTransformation3D localToWorld = TTransformation3D::rotation(axis_, k * quadrant);
+		result += prim::transform(localAabb_, localToWorld);
+	}
+	return result;
+}
+
+
+
 TScalar MotionRotation::doArea() const
 {
 	return child_->area();
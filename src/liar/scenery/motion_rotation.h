@@ -67,6 +67,7 @@ private:
 	void doLocalSpace(TTime time, TTransformation3D& localToWorld) const override;
 	bool doContains(const Sample& sample, const TPoint3D& point) const override;
 	const TAabb3D doBoundingBox() const override;
+	const TAabb3D doMotionBoundingBox(const TimePeriod& period) const override;
 	TScalar doArea() const override;
 	TScalar doArea(const TVector3D& normal) const override;
 	bool doHasMotion() const override { return true; }
@@ -85,6 +86,7 @@ private:
 	const TTransformation3D& worldToLocal(TTime time) const;
 
 	TSceneObjectRef child_;
+	TAabb3D localAabb_;
 	TAabb3D aabb_;
 	TVector3D axis_;
 	TScalar start_;
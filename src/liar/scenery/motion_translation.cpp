@@ -77,20 +77,8 @@ void MotionTranslation::doAccept(util::VisitorBase& visitor)
 void MotionTranslation::doPreProcess(const TimePeriod& period)
 {
 	child_->preProcess(period);
-
-	const TAabb3D localBox = child_->boundingBox();
-	if (localBox.isEmpty())
-	{
-	    aabb_ = localBox;
-
-	}
-	else
-	{
-        const TVector3D offsetBegin = localToWorldOffset(period.begin());
-        const TVector3D offsetEnd = localToWorldOffset(period.end());
-        aabb_ = TAabb3D(localBox.min() + offsetBegin, localBox.max() + offsetBegin);
-        aabb_ += TAabb3D(localBox.min() + offsetEnd, localBox.max() + offsetEnd);
-	}
+	localAabb_ = child_->boundingBox();
+	aabb_ = doMotionBoundingBox(period);
 }
 
 
@@ -151,6 +139,23 @@ const TAabb3D MotionTranslation::doBoundingBox() const
 
 
 
+/** The motion is linear, so the box is swept from the begin to the end of @a period.
+ */
+const TAabb3D MotionTranslation::doMotionBoundingBox(const TimePeriod& period) const
+{
+	if (localAabb_.isEmpty())
+	{
+		return localAabb_;
+	}
+	const TVector3D offsetBegin = localToWorldOffset(period.begin());
+	const TVector3D offsetEnd = localToWorldOffset(period.end());
+	TAabb3D result(localAabb_.min() + offsetBegin, localAabb_.max() + offsetBegin);
+	result += TAabb3D(localAabb_.min() + offsetEnd, localAabb_.max() + offsetEnd);
+	return result;
+}
+
+
+
 TScalar MotionTranslation::doArea() const
 {
 	return child_->area();
@@ -58,6 +58,7 @@ private:
 	void doLocalSpace(TTime time, TTransformation3D& localToWorld) const override;
 	bool doContains(const Sample& sample, const TPoint3D& point) const override;
 	const TAabb3D doBoundingBox() const override;
+	const TAabb3D doMotionBoundingBox(const TimePeriod& period) const override;
 	TScalar doArea() const override;
 	TScalar doArea(const TVector3D& normal) const override;
 	bool doHasMotion() const override { return true; }
@@ -68,6 +69,7 @@ private:
 	const TVector3D localToWorldOffset(TTime time) const;
 
 	TSceneObjectRef child_;
+	TAabb3D localAabb_;
 	TAabb3D aabb_;
 	TVector3D localToWorldStart_;
 	TVector3D speedInWorld_;
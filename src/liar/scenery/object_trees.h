@@ -24,6 +24,11 @@
 /** @class liar::scenery::AabbTree
  *  @brief compound of some child scenery in an AABB tree.
  *  @author Bram de Greve [Bramz]
+ *
+ *  Children that move are kept out of the main tree. Instead, the shutter period is split in
+ *  a number of time segments, and each segment gets its own tree bounding the moving children
+ *  over that segment only. A ray only traverses the tree of the segment its time falls in,
+ *  so fast moving objects don't get boxes spanning their whole path.
  */
 
 #ifndef LIAR_GUARDIAN_OF_INCLUSION_SCENERY_OBJECT_TREE_H
@@ -31,11 +36,13 @@
 
 #include "scenery_common.h"
 #include "list.h"
+#include "../kernel/bvh_tree.h"
 #include "../kernel/scene_object.h"
 #include <lass/spat/aabb_tree.h>
 #include <lass/spat/aabp_tree.h>
 #include <lass/spat/quad_tree.h>
 #include <lass/spat/qbvh_tree.h>
+#include <bit>
 
 namespace liar
 {
@@ -78,8 +85,8 @@ public:
 
 protected:
 
-	ObjectTree() {}
-	ObjectTree(const TChildren& children)
+	ObjectTree(): period_(0, 0) {}
+	ObjectTree(const TChildren& children): period_(0, 0)
 	{
 		this->add(children);
 	}
@@ -104,7 +111,37 @@ private:
 		{
 			(*i)->preProcess(period);
 		}
-		tree_.reset(smallChildren_.begin(), smallChildren_.end());
+
+		// this may run on a worker thread, so the trees only keep raw pointers to the children, which
+		// are owned by smallChildren_.  Copying the references would touch Python reference counts.
+		stillChildren_.clear();
+		TObjects movingChildren;
+		for (TChildren::const_iterator i = smallChildren_.begin(); i != smallChildren_.end(); ++i)
+		{
+			const SceneObject* child = i->get();
+			(child->hasMotion() ? movingChildren : stillChildren_).push_back(child);
+		}
+		tree_.reset(stillChildren_.begin(), stillChildren_.end());
+
+		period_ = period;
+		const size_t numSegments = movingChildren.empty() ? 0 : (period.duration() > 0 ? numTimeSegments : 1);
+		segmentChildren_.assign(numSegments, TMovingChildren());
+		segmentTrees_.assign(numSegments, TMotionTree());
+		motionAabb_ = TAabb3D();
+		for (size_t k = 0; k < numSegments; ++k)
+		{
+			const TimePeriod segment(
+				period.interpolate(static_cast<TScalar>(k) / numSegments),
+				period.interpolate(static_cast<TScalar>(k + 1) / numSegments));
+			TMovingChildren& children = segmentChildren_[k];
+			children.reserve(movingChildren.size());
+			for (TObjects::const_iterator i = movingChildren.begin(); i != movingChildren.end(); ++i)
+			{
+				children.push_back(MovingChild(*i, (*i)->motionBoundingBox(segment)));
+			}
+			segmentTrees_[k].reset(children.begin(), children.end());
+			motionAabb_ += segmentTrees_[k].aabb();
+		}
 	}
 
 	void doIntersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const
@@ -114,15 +151,92 @@ private:
 		info.sample = &sample;
 		info.intersectionResult = &treeResult;
 		TScalar t = TNumTraits::infinity;
-		if (tree_.intersect(ray, t, ray.nearLimit(), &info) != smallChildren_.end() && t < ray.farLimit())
+		if (tree_.intersect(ray, t, ray.nearLimit(), &info) != stillChildren_.end() && t < ray.farLimit())
 		{
 			LASS_ASSERT(treeResult);
-			treeResult.push(this);
 		}
 		else
 		{
 			LASS_ASSERT(!treeResult);
 		}
+		intersectOthers(sample, ray, treeResult, result);
+	}
+
+	/** If the tree supports it, the rays traverse it together, TTree::packetSize at a time.  The
+	 *  moving and big children are still intersected ray by ray.
+	 */
+	void doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const
+	{
+		if constexpr (requires { TTree::packetSize; })
+		{
+			typedef typename TTree::TMask TMask;
+			const size_t packetSize = TTree::packetSize;
+			Intersection treeResults[packetSize];
+			Info infos[packetSize];
+			TScalar tMin[packetSize];
+			TScalar tNearest[packetSize];
+			for (size_t i = 0; i < count; i += packetSize)
+			{
+				const size_t n = std::min(count - i, packetSize);
+				const BoundedRay* packet = rays + i;
+				for (size_t k = 0; k < n; ++k)
+				{
+					treeResults[k] = Intersection::empty();
+					infos[k].sample = &samples[i + k];
+					infos[k].intersectionResult = &treeResults[k];
+					tMin[k] = packet[k].nearLimit();
+					tNearest[k] = packet[k].farLimit();
+				}
+				tree_.intersectPacketLeaves(packet, n, tMin, tNearest, [this, packet, &infos](size_t first, size_t numObjects, TMask mask, TScalar* tNear)
+				{
+					TMask hit = 0;
+					for (; mask; mask &= mask - 1)
+					{
+						const int k = std::countr_zero(mask);
+						for (size_t j = first, last = first + numObjects; j < last; ++j)
+						{
+							TScalar t;
+							if (ObjectTraits::objectIntersect(tree_.object(j), packet[k], t, packet[k].nearLimit(), &infos[k]) && t < tNear[k])
+							{
+								tNear[k] = t;
+								hit |= TMask(1) << k;
+							}
+						}
+					}
+					return hit;
+				});
+				for (size_t k = 0; k < n; ++k)
+				{
+					intersectOthers(samples[i + k], packet[k], treeResults[k], results[i + k]);
+				}
+			}
+		}
+		else
+		{
+			for (size_t k = 0; k < count; ++k)
+			{
+				doIntersect(samples[k], rays[k], results[k]);
+			}
+		}
+	}
+
+	/** Completes @a treeResult, the nearest hit of the still children, with the moving and big children.
+	 */
+	void intersectOthers(const Sample& sample, const BoundedRay& ray, Intersection& treeResult, Intersection& result) const
+	{
+		Info info;
+		info.sample = &sample;
+		info.intersectionResult = &treeResult;
+		if (const TMotionTree* motionTree = segmentTree(sample))
+		{
+			const BoundedRay bounded = treeResult ? bound(ray, ray.nearLimit(), treeResult.t()) : ray;
+			TScalar tMotion = TNumTraits::infinity;
+			motionTree->intersect(bounded, tMotion, bounded.nearLimit(), &info);
+		}
+		if (treeResult)
+		{
+			treeResult.push(this);
+		}
 
 		Intersection bigResult;
 		bigChildren_.intersect(sample, ray, bigResult);
@@ -139,7 +253,64 @@ private:
 		Info info;
 		info.sample = &sample;
 		info.intersectionResult = 0;
-		return bigChildren_.isIntersecting(sample, ray) || tree_.intersects(ray, ray.nearLimit(), ray.farLimit(), &info);
+		return bigChildren_.isIntersecting(sample, ray) || tree_.intersects(ray, ray.nearLimit(), ray.farLimit(), &info) ||
+			isIntersectingMotion(sample, ray, info);
+	}
+
+	/** If the tree supports it, the shadow rays traverse it together, packetSize at a time.  Each ray
+	 *  is dropped from the packet as soon as it's blocked.
+	 */
+	void doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const
+	{
+		Info info;
+		info.sample = &sample;
+		info.intersectionResult = 0;
+		if constexpr (requires { TTree::packetSize; })
+		{
+			typedef typename TTree::TMask TMask;
+			const size_t packetSize = TTree::packetSize;
+			TScalar tMin[packetSize];
+			TScalar tMax[packetSize];
+			for (size_t i = 0; i < count; i += packetSize)
+			{
+				const size_t n = std::min(count - i, packetSize);
+				const BoundedRay* packet = rays + i;
+				for (size_t k = 0; k < n; ++k)
+				{
+					tMin[k] = packet[k].nearLimit();
+					tMax[k] = packet[k].farLimit();
+				}
+				const TMask hit = tree_.intersectsPacketLeaves(packet, n, tMin, tMax, [this, packet, &info](size_t first, size_t numObjects, TMask mask)
+				{
+					TMask found = 0;
+					for (; mask; mask &= mask - 1)
+					{
+						const int k = std::countr_zero(mask);
+						for (size_t j = first, last = first + numObjects; j < last; ++j)
+						{
+							if (ObjectTraits::objectIntersects(tree_.object(j), packet[k], packet[k].nearLimit(), packet[k].farLimit(), &info))
+							{
+								found |= TMask(1) << k;
+								break;
+							}
+						}
+					}
+					return found;
+				});
+				for (size_t k = 0; k < n; ++k)
+				{
+					results[i + k] = ((hit >> k) & 1) || bigChildren_.isIntersecting(sample, packet[k]) ||
+						isIntersectingMotion(sample, packet[k], info);
+				}
+			}
+		}
+		else
+		{
+			for (size_t k = 0; k < count; ++k)
+			{
+				results[k] = doIsIntersecting(sample, rays[k]);
+			}
+		}
 	}
 
 	void doLocalContext(
@@ -155,12 +326,46 @@ private:
 		Info info;
 		info.sample = &sample;
 		info.intersectionResult = 0;
-		return tree_.contains(point, &info) || bigChildren_.contains(sample, point);
+		if (tree_.contains(point, &info) || bigChildren_.contains(sample, point))
+		{
+			return true;
+		}
+		const TMotionTree* motionTree = segmentTree(sample);
+		return motionTree && motionTree->contains(point, &info);
 	}
 
 	const TAabb3D doBoundingBox() const
 	{
-		return tree_.aabb() + bigChildren_.boundingBox();
+		return tree_.aabb() + motionAabb_ + bigChildren_.boundingBox();
+	}
+
+	const TAabb3D doMotionBoundingBox(const TimePeriod& period) const
+	{
+		TAabb3D result = tree_.aabb() + bigChildren_.boundingBox();
+		const size_t n = segmentTrees_.size();
+		if (n == 0)
+		{
+			return result;
+		}
+		const size_t first = segmentIndex(period.begin());
+		const size_t last = segmentIndex(period.end());
+		for (size_t k = first; k <= last && k < n; ++k)
+		{
+			result += segmentTrees_[k].aabb();
+		}
+		return result;
+	}
+
+	bool doHasMotion() const
+	{
+		for (TChildren::const_iterator i = allChildren_.begin(); i != allChildren_.end(); ++i)
+		{
+			if ((*i)->hasMotion())
+			{
+				return true;
+			}
+		}
+		return false;
 	}
 
 	TScalar doArea() const
@@ -193,20 +398,32 @@ private:
 		LASS_ENFORCE(python::decodeTuple(state, allChildren_));
 	}
 
+	enum { numTimeSegments = 8 };
+
 	struct Info
 	{
 		const Sample* sample;
 		Intersection* intersectionResult;
 	};
 
+	typedef std::vector<const SceneObject*> TObjects;
+
+	struct MovingChild
+	{
+		const SceneObject* object;
+		TAabb3D bounds; /**< bounds of object during one time segment */
+		MovingChild(const SceneObject* object, const TAabb3D& bounds): object(object), bounds(bounds) {}
+	};
+	typedef std::vector<MovingChild> TMovingChildren;
+
 	struct ObjectTraits
 	{
-		typedef TSceneObjectRef TObject;
+		typedef const SceneObject* TObject;
 		typedef TAabb3D TAabb;
 		typedef BoundedRay TRay;
 
-		typedef TChildren::const_iterator TObjectIterator;
-		typedef TChildren::const_reference TObjectReference;
+		typedef TObjects::const_iterator TObjectIterator;
+		typedef TObjects::const_reference TObjectReference;
 
 		typedef TPoint3D TPoint;
 		typedef TVector3D TVector;
@@ -225,17 +442,37 @@ private:
 		}
 
 		static bool objectContains(TObjectIterator object, const TPoint& point, const TInfo* info)
+		{
+			return childContains(*object, point, info);
+		}
+
+		static bool objectIntersect(TObjectIterator object, const TRay& ray, TReference t, TParam minT, const TInfo* info)
+		{
+			return childIntersect(*object, ray, t, minT, info);
+		}
+
+		static bool objectIntersects(TObjectIterator object, const TRay& ray, TParam minT, TParam maxT, const TInfo* info)
+		{
+			return childIntersects(*object, ray, minT, maxT, info);
+		}
+
+		static bool objectIntersects(TObjectIterator it, const TAabb& aabb, const TInfo*)
+		{
+			return objectAabb(it).intersects(aabb);
+		}
+
+		static bool childContains(const SceneObject* child, const TPoint& point, const TInfo* info)
 		{
 			LASS_ASSERT(info && info->sample);
-			return (*object)->contains(*info->sample, point);
+			return child->contains(*info->sample, point);
 		}
 
-		static bool objectIntersect(TObjectIterator object, const TRay& ray, TReference t, TParam LASS_UNUSED(minT), const TInfo* info)
+		static bool childIntersect(const SceneObject* child, const TRay& ray, TReference t, TParam LASS_UNUSED(minT), const TInfo* info)
 		{
 			LASS_ASSERT(info && info->sample && info->intersectionResult);
 			LASS_ASSERT(ray.nearLimit() == minT);
 			Intersection temp;
-			(*object)->intersect(*info->sample, ray, temp);
+			child->intersect(*info->sample, ray, temp);
 			if (temp)
 			{
 				LASS_ASSERT(temp.t() > minT);
@@ -250,16 +487,11 @@ private:
 			return false;
 		}
 
-		static bool objectIntersects(TObjectIterator object, const TRay& ray, TParam LASS_UNUSED(minT), TParam LASS_UNUSED(maxT), const TInfo* info)
+		static bool childIntersects(const SceneObject* child, const TRay& ray, TParam LASS_UNUSED(minT), TParam LASS_UNUSED(maxT), const TInfo* info)
 		{
 			LASS_ASSERT(info && info->sample);
 			LASS_ASSERT(ray.nearLimit() == minT && ray.farLimit() == maxT);
-			return (*object)->isIntersecting(*info->sample, ray);
-		}
-
-		static bool objectIntersects(TObjectIterator it, const TAabb& aabb, const TInfo*)
-		{
-			return objectAabb(it).intersects(aabb);
+			return child->isIntersecting(*info->sample, ray);
 		}
 
 		static TAabb aabbEmpty()
@@ -324,12 +556,85 @@ private:
 		static const TVector vectorReciprocal(const TVector& vector) { return vector.reciprocal();	}
 	};
 
-	typedef TreeType<TSceneObjectRef, ObjectTraits> TTree;
+	/** Like ObjectTraits, but uses the bounds of one time segment instead of the whole period.
+	 */
+	struct MotionTraits: ObjectTraits
+	{
+		typedef MovingChild TObject;
+		typedef typename TMovingChildren::const_iterator TObjectIterator;
+		typedef typename TMovingChildren::const_reference TObjectReference;
+		typedef typename ObjectTraits::TAabb TAabb;
+		typedef typename ObjectTraits::TRay TRay;
+		typedef typename ObjectTraits::TPoint TPoint;
+		typedef typename ObjectTraits::TParam TParam;
+		typedef typename ObjectTraits::TReference TReference;
+		typedef typename ObjectTraits::TInfo TInfo;
+
+		static const TAabb objectAabb(TObjectIterator object)
+		{
+			return object->bounds;
+		}
+
+		static bool objectContains(TObjectIterator object, const TPoint& point, const TInfo* info)
+		{
+			return ObjectTraits::childContains(object->object, point, info);
+		}
+
+		static bool objectIntersect(TObjectIterator object, const TRay& ray, TReference t, TParam minT, const TInfo* info)
+		{
+			return ObjectTraits::childIntersect(object->object, ray, t, minT, info);
+		}
+
+		static bool objectIntersects(TObjectIterator object, const TRay& ray, TParam minT, TParam maxT, const TInfo* info)
+		{
+			return ObjectTraits::childIntersects(object->object, ray, minT, maxT, info);
+		}
+
+		static bool objectIntersects(TObjectIterator it, const TAabb& aabb, const TInfo*)
+		{
+			return objectAabb(it).intersects(aabb);
+		}
+	};
+
+	typedef TreeType<const SceneObject*, ObjectTraits> TTree;
+	typedef kernel::BvhTree<MovingChild, MotionTraits, spat::SAHSplitHeuristics> TMotionTree;
+
+	size_t segmentIndex(TTime time) const
+	{
+		const size_t n = segmentTrees_.size();
+		const TTime duration = period_.duration();
+		if (n <= 1 || !(duration > 0))
+		{
+			return 0;
+		}
+		const TTime x = (time - period_.begin()) / duration;
+		if (!(x > 0))
+		{
+			return 0;
+		}
+		return std::min(static_cast<size_t>(x * static_cast<TTime>(n)), n - 1);
+	}
+
+	const TMotionTree* segmentTree(const Sample& sample) const
+	{
+		return segmentTrees_.empty() ? 0 : &segmentTrees_[segmentIndex(sample.time())];
+	}
+
+	bool isIntersectingMotion(const Sample& sample, const BoundedRay& ray, const Info& info) const
+	{
+		const TMotionTree* motionTree = segmentTree(sample);
+		return motionTree && motionTree->intersects(ray, ray.nearLimit(), ray.farLimit(), &info);
+	}
 
 	TChildren allChildren_;
 	TChildren smallChildren_;
+	TObjects stillChildren_; // still children of smallChildren_, which owns them.
 	List bigChildren_;
 	TTree tree_;
+	std::vector<TMovingChildren> segmentChildren_;
+	std::vector<TMotionTree> segmentTrees_;
+	TAabb3D motionAabb_;
+	TimePeriod period_;
 };
 
 namespace impl
@@ -338,7 +643,7 @@ namespace impl
 template <typename O, typename OT> using AabbTree = ::lass::spat::AabbTree<O, OT, ::lass::spat::SAHSplitHeuristics>;
 template <typename O, typename OT> using AabpTree = ::lass::spat::AabpTree<O, OT, ::lass::spat::SAHSplitHeuristics>;
 template <typename O, typename OT> using OctTree = ::lass::spat::QuadTree<O, OT>;
-template <typename O, typename OT> using QbvhTree = ::lass::spat::QbvhTree<O, OT, ::lass::spat::SAHSplitHeuristics>;
+template <typename O, typename OT> using QbvhTree = ::liar::kernel::BvhTree<O, OT, ::lass::spat::SAHSplitHeuristics>;
 
 }
 
@@ -31,6 +31,7 @@
 #include "csg.h"
 #include "disk.h"
 #include "goursat.h"
+#include "instance.h"
 #include "light_area.h"
 #include "light_directional.h"
 #include "light_point.h"
@@ -82,6 +83,7 @@ PY_MODULE_CLASS(scenery, QbvhTree)
 PY_MODULE_CLASS(scenery, Sphere)
 PY_MODULE_CLASS(scenery, Sky)
 PY_MODULE_CLASS(scenery, Transformation)
+	PY_MODULE_CLASS(scenery, Instance)
 PY_MODULE_CLASS(scenery, Translation)
 PY_MODULE_CLASS(scenery, Triangle)
 PY_MODULE_CLASS(scenery, TriangleMesh)
@@ -95,7 +95,12 @@ const TTransformation3D Transformation::worldToLocal() const
 
 // --- protected -----------------------------------------------------------------------------------
 
-// --- private -------------------------------------------------------------------------------------
+const Transformation::TMatrix& Transformation::worldToLocalMatrix() const
+{
+	return worldToLocal_;
+}
+
+
 
 void Transformation::doPreProcess(const TimePeriod& period)
 {
@@ -104,6 +109,23 @@ void Transformation::doPreProcess(const TimePeriod& period)
 
 
 
+const TAabb3D Transformation::doBoundingBox() const
+{
+	return transform(child_->boundingBox(), localToWorld_);
+}
+
+
+
+void Transformation::doSetState(const TPyObjectPtr& state)
+{
+	LASS_ENFORCE(python::decodeTuple(state, child_, localToWorld_));
+	worldToLocal_ = localToWorld_.inverseMatrix();
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
 void Transformation::doAccept(util::VisitorBase& visitor)
 {
 	preAccept(visitor, *this);
@@ -163,9 +185,9 @@ bool Transformation::doContains(const Sample& sample, const TPoint3D& point) con
 
 
 
-const TAabb3D Transformation::doBoundingBox() const
+const TAabb3D Transformation::doMotionBoundingBox(const TimePeriod& period) const
 {
-	return transform(child_->boundingBox(), localToWorld_);
+	return transform(child_->motionBoundingBox(period), localToWorld_);
 }
 
 
@@ -184,17 +206,16 @@ TScalar Transformation::doArea(const TVector3D& normal) const
 
 
 
-const TPyObjectPtr Transformation::doGetState() const
+bool Transformation::doHasMotion() const
 {
-	return python::makeTuple(child_, localToWorld_);
+	return child_->hasMotion();
 }
 
 
 
-void Transformation::doSetState(const TPyObjectPtr& state)
+const TPyObjectPtr Transformation::doGetState() const
 {
-	LASS_ENFORCE(python::decodeTuple(state, child_, localToWorld_));
-	worldToLocal_ = localToWorld_.inverseMatrix();
+	return python::makeTuple(child_, localToWorld_);
 }
 
 
@@ -55,24 +55,31 @@ public:
 
 	const TTransformation3D worldToLocal() const;
 
-private:
+protected:
 
 	typedef Matrix4x4<TScalar> TMatrix;
 
-	void doAccept(lass::util::VisitorBase& visitor) override;
+	const TMatrix& worldToLocalMatrix() const;
 
 	void doPreProcess(const TimePeriod& period) override;
+	const TAabb3D doBoundingBox() const override;
+	void doSetState(const TPyObjectPtr& state) override;
+
+private:
+
+	void doAccept(lass::util::VisitorBase& visitor) override;
+
 	void doIntersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const override;
 	bool doIsIntersecting(const Sample& sample, const BoundedRay& ray) const override;
 	void doLocalSpace(TTime time, TTransformation3D& localToWorld) const override;
 	void doLocalContext(const Sample& sample, const BoundedRay& ray, const Intersection& intersection, IntersectionContext& result) const override;
 	bool doContains(const Sample& sample, const TPoint3D& point) const override;
-	const TAabb3D doBoundingBox() const override;
+	const TAabb3D doMotionBoundingBox(const TimePeriod& period) const override;
 	TScalar doArea() const override;
 	TScalar doArea(const TVector3D& normal) const override;
+	bool doHasMotion() const override;
 
 	const TPyObjectPtr doGetState() const override;
-	void doSetState(const TPyObjectPtr& state) override;
 
 	TSceneObjectRef child_;
 	TTransformation3D localToWorld_;
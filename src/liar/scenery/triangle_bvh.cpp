@@ -0,0 +1,581 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "scenery_common.h"
+#include "triangle_bvh.h"
+
+#include <algorithm>
+#include <bit>
+
+#if LIAR_HAVE_AVX
+#	include <immintrin.h>
+#endif
+
+namespace liar
+{
+namespace scenery
+{
+
+namespace
+{
+
+/** relative tolerance of the single precision test.  Large enough to cover the rounding errors
+ *  of its products.
+ */
+constexpr float tolerance = 1e-5f;
+
+/** bound on the absolute error of the sheared vertex coordinates, relative to the largest
+ *  coordinate of vertices and ray support.  Converting both to single precision, subtracting
+ *  them and shearing the result each add an error of up to 2^-23 times that coordinate.
+ */
+constexpr float absoluteTolerance = 4.f / (1 << 23);
+
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+TriangleBvh::TriangleBvh():
+	triangles_(),
+	vertexScale_(0)
+{
+}
+
+
+
+void TriangleBvh::reset(const TMesh& mesh)
+{
+	const auto& triangles = mesh.triangles();
+	LASS_ENFORCE(triangles.size() < std::numeric_limits<TIndex>::max());
+
+	TTree tree;
+	tree.setMaxObjectsPerLeaf(groupSize);
+	tree.reset(triangles.begin(), triangles.end());
+	tree_.swap(tree);
+	pack(mesh);
+}
+
+
+
+/** Updates the BVH to @a mesh, of which the vertices have moved since the last reset.  It must
+ *  otherwise have the same triangles, in the same order.  Unless the tree degraded too much, it's
+ *  only refitted instead of being rebuilt.
+ */
+void TriangleBvh::refit(const TMesh& mesh)
+{
+	const auto& triangles = mesh.triangles();
+	tree_.refit(triangles.begin(), triangles.end());
+	pack(mesh);
+}
+
+
+
+void TriangleBvh::clear()
+{
+	TriangleBvh temp;
+	swap(temp);
+}
+
+
+
+const TAabb3D& TriangleBvh::aabb() const
+{
+	return tree_.aabb();
+}
+
+
+
+bool TriangleBvh::isEmpty() const
+{
+	return tree_.isEmpty();
+}
+
+
+
+/** Finds the nearest triangle hit beyond @a tMin that passes the filter, if any.
+ */
+prim::Result TriangleBvh::intersect(const TRay3D& ray, TTriangleIterator& triangle, TScalar& t, TScalar tMin, const TFilter& filter) const
+{
+	const WatertightRay r(ray, vertexScale_);
+	TScalar tBest = TNumTraits::infinity;
+	TTriangleIterator best;
+	const bool hit = tree_.intersectLeaves(ray, tMin, tBest, [&](size_t first, size_t count, TScalar& tNearest)
+	{
+		return intersectLeaf(first, count, ray, r, tMin, tNearest, best, filter);
+	});
+
+	if (!hit)
+	{
+		return prim::rNone;
+	}
+	triangle = best;
+	t = tBest;
+	return prim::rOne;
+}
+
+
+
+bool TriangleBvh::intersects(const TRay3D& ray, TScalar tMin, TScalar tMax, const TFilter& filter) const
+{
+	const WatertightRay r(ray, vertexScale_);
+	return tree_.intersectsLeaves(ray, tMin, tMax, [&](size_t first, size_t count)
+	{
+		return intersectsLeaf(first, count, ray, r, tMin, tMax, filter);
+	});
+}
+
+
+
+/** Finds the nearest triangle hit of each of @a count rays, at most packetSize, like intersect.
+ *
+ *  The rays traverse the tree together, so that coherent rays share the node tests.  The leaves
+ *  are still tested ray by ray, with only the rays that reached them.  @a filters is either null,
+ *  or has a filter per ray.
+ *
+ *  @return the mask of the rays that hit a triangle.  Only for those, @a triangles and @a t are set.
+ */
+TriangleBvh::TMask TriangleBvh::intersectPacket(const TRay3D* rays, size_t count, const TScalar* tMin, TTriangleIterator* triangles, TScalar* t,
+	const TFilter* filters) const
+{
+	static_assert(static_cast<size_t>(packetSize) == static_cast<size_t>(TTree::packetSize), "packet size of tree");
+	LASS_ASSERT(count <= packetSize);
+	WatertightRay r[packetSize];
+	TScalar tNearest[packetSize];
+	for (size_t k = 0; k < count; ++k)
+	{
+		r[k] = WatertightRay(rays[k], vertexScale_);
+		tNearest[k] = TNumTraits::infinity;
+	}
+	const TFilter noFilter;
+	const TMask hit = tree_.intersectPacketLeaves(rays, count, tMin, tNearest, [&](size_t first, size_t n, TMask mask, TScalar* tNear)
+	{
+		TMask found = 0;
+		for (; mask; mask &= mask - 1)
+		{
+			const int k = std::countr_zero(mask);
+			if (intersectLeaf(first, n, rays[k], r[k], tMin[k], tNear[k], triangles[k], filters ? filters[k] : noFilter))
+			{
+				found |= TMask(1) << k;
+			}
+		}
+		return found;
+	});
+
+	for (TMask mask = hit; mask; mask &= mask - 1)
+	{
+		const int k = std::countr_zero(mask);
+		t[k] = tNearest[k];
+	}
+	return hit;
+}
+
+
+
+/** Finds which of @a count rays, at most packetSize, hit a triangle within their limits, like intersects.
+ *
+ *  The rays traverse the tree together, and each one is dropped as soon as it hits a triangle.
+ *  @a filters is either null, or has a filter per ray.
+ */
+TriangleBvh::TMask TriangleBvh::intersectsPacket(const TRay3D* rays, size_t count, const TScalar* tMin, const TScalar* tMax,
+	const TFilter* filters) const
+{
+	LASS_ASSERT(count <= packetSize);
+	WatertightRay r[packetSize];
+	for (size_t k = 0; k < count; ++k)
+	{
+		r[k] = WatertightRay(rays[k], vertexScale_);
+	}
+	const TFilter noFilter;
+	return tree_.intersectsPacketLeaves(rays, count, tMin, tMax, [&](size_t first, size_t n, TMask mask)
+	{
+		TMask found = 0;
+		for (; mask; mask &= mask - 1)
+		{
+			const int k = std::countr_zero(mask);
+			if (intersectsLeaf(first, n, rays[k], r[k], tMin[k], tMax[k], filters ? filters[k] : noFilter))
+			{
+				found |= TMask(1) << k;
+			}
+		}
+		return found;
+	});
+}
+
+
+
+void TriangleBvh::swap(TriangleBvh& other)
+{
+	tree_.swap(other.tree_);
+	groups_.swap(other.groups_);
+	leafGroups_.swap(other.leafGroups_);
+	std::swap(triangles_, other.triangles_);
+	std::swap(vertexScale_, other.vertexScale_);
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+/** Copies the vertices of the triangles of each leaf in groups.
+ */
+void TriangleBvh::pack(const TMesh& mesh)
+{
+	const auto& triangles = mesh.triangles();
+	size_t numGroups = 0;
+	tree_.forEachLeaf([&numGroups](size_t, size_t count)
+	{
+		numGroups += (count + groupSize - 1) / groupSize;
+	});
+	TGroups groups;
+	groups.reserve(numGroups); // they're the bulk of the memory, so don't let the vector grow by doubling.
+	std::vector<TIndex> leafGroups(tree_.size(), std::numeric_limits<TIndex>::max());
+	tree_.forEachLeaf([&](size_t first, size_t count)
+	{
+		leafGroups[first] = static_cast<TIndex>(groups.size());
+		for (size_t i = 0; i < count; i += groupSize)
+		{
+			Group group = Group();
+			for (size_t lane = 0; lane < groupSize && i + lane < count; ++lane)
+			{
+				const TTriangleIterator triangle = tree_.object(first + i + lane);
+				for (size_t k = 0; k < 3; ++k)
+				{
+					const TPoint3D& vertex = *triangle->vertices[k];
+					for (size_t a = 0; a < 3; ++a)
+					{
+						group.v[k][a][lane] = static_cast<float>(vertex[a]);
+					}
+				}
+				group.triangle[lane] = static_cast<TIndex>(std::distance(triangles.begin(), triangle));
+			}
+			groups.push_back(group);
+		}
+	});
+
+	const TAabb3D& aabb = tree_.aabb();
+	vertexScale_ = 0;
+	if (!aabb.isEmpty())
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			vertexScale_ = std::max(vertexScale_, static_cast<float>(std::max(num::abs(aabb.min()[k]), num::abs(aabb.max()[k]))));
+		}
+	}
+
+	groups_.swap(groups);
+	leafGroups_.swap(leafGroups);
+	triangles_ = triangles.begin();
+}
+
+
+
+
+/** Intersects the triangles of the leaf at positions [first, first + count) with @a ray, and
+ *  returns true if it finds one nearer than @a tNearest that passes the filter.
+ *
+ *  The candidates are confirmed nearest first, and as soon as one passes the filter, the ones that
+ *  are certainly further away aren't looked at anymore.
+ */
+bool TriangleBvh::intersectLeaf(size_t first, size_t count, const TRay3D& ray, const WatertightRay& r, TScalar tMin, TScalar& tNearest,
+	TTriangleIterator& best, const TFilter& filter) const
+{
+	Candidate candidates[maxCandidates];
+	const size_t n = findCandidates(first, count, r, r.lower(tMin), r.upper(tNearest), candidates);
+	std::sort(candidates, candidates + n, [](const Candidate& a, const Candidate& b) { return a.t < b.t; });
+
+	bool found = false;
+	for (size_t i = 0; i < n && candidates[i].t <= r.upper(tNearest); ++i)
+	{
+		const TTriangleIterator candidate = triangles_ + candidates[i].triangle;
+		TScalar tCandidate;
+		if (candidate->intersect(ray, tCandidate, tMin, nullptr) == prim::rOne && tCandidate < tNearest &&
+			(!filter || filter(candidate, tCandidate)))
+		{
+			tNearest = tCandidate;
+			best = candidate;
+			found = true;
+		}
+	}
+	return found;
+}
+
+
+
+/** Whether any triangle of the leaf at [@a first, @a first + @a count) is hit within (@a tMin, @a tMax)
+ *  and passes the filter.
+ */
+bool TriangleBvh::intersectsLeaf(size_t first, size_t count, const TRay3D& ray, const WatertightRay& r, TScalar tMin, TScalar tMax,
+	const TFilter& filter) const
+{
+	Candidate candidates[maxCandidates];
+	const size_t n = findCandidates(first, count, r, r.lower(tMin), r.upper(tMax), candidates);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const TTriangleIterator candidate = triangles_ + candidates[i].triangle;
+		TScalar tCandidate;
+		if (candidate->intersect(ray, tCandidate, tMin, nullptr) == prim::rOne && tCandidate < tMax &&
+			(!filter || filter(candidate, tCandidate)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+/** Returns the candidates of the leaf at positions [first, first + count), unsorted.
+ */
+size_t TriangleBvh::findCandidates(size_t first, size_t count, const WatertightRay& ray, float tMin, float tMax, Candidate* result) const
+{
+	LASS_ASSERT(count <= maxCandidates && leafGroups_[first] != std::numeric_limits<TIndex>::max());
+	const Group* group = &groups_[leafGroups_[first]];
+	size_t n = 0;
+	for (size_t i = 0; i < count; i += groupSize, ++group)
+	{
+		float t[groupSize];
+		for (unsigned mask = intersectGroup(*group, ray, tMin, tMax, t); mask; mask &= mask - 1)
+		{
+			const int lane = std::countr_zero(mask);
+			result[n++] = Candidate { t[lane], group->triangle[lane] };
+		}
+	}
+	return n;
+}
+
+
+
+#if LIAR_HAVE_AVX
+
+/** Intersects all lanes of the group at once, and returns a bit mask of the ones that may be hit in
+ *  [tMin, tMax].  Their distances are stored in @a t.
+ */
+unsigned TriangleBvh::intersectGroup(const Group& group, const WatertightRay& ray, float tMin, float tMax, float* t) const
+{
+	static_assert(groupSize == 8, "AVX lanes");
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+	const __m256 eps = _mm256_set1_ps(tolerance);
+
+	__m256 x[3];
+	__m256 y[3];
+	__m256 z[3];
+	for (size_t k = 0; k < 3; ++k)
+	{
+		const __m256 px = _mm256_sub_ps(_mm256_load_ps(group.v[k][ray.kx]), _mm256_set1_ps(ray.support[ray.kx]));
+		const __m256 py = _mm256_sub_ps(_mm256_load_ps(group.v[k][ray.ky]), _mm256_set1_ps(ray.support[ray.ky]));
+		const __m256 pz = _mm256_sub_ps(_mm256_load_ps(group.v[k][ray.kz]), _mm256_set1_ps(ray.support[ray.kz]));
+		x[k] = _mm256_sub_ps(px, _mm256_mul_ps(_mm256_set1_ps(ray.shear[0]), pz));
+		y[k] = _mm256_sub_ps(py, _mm256_mul_ps(_mm256_set1_ps(ray.shear[1]), pz));
+		z[k] = _mm256_mul_ps(_mm256_set1_ps(ray.shear[2]), pz);
+	}
+
+	// edge functions, each with the bound on its error: the rounding of the products, and the error
+	// delta of x and y, which contributes delta * (|x_i| + |y_i| + |x_j| + |y_j| + 2 * delta).
+	const __m256 delta = _mm256_set1_ps(ray.delta);
+	__m256 m[3];
+	for (size_t k = 0; k < 3; ++k)
+	{
+		m[k] = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(signMask, x[k]), _mm256_andnot_ps(signMask, y[k])), delta);
+	}
+	__m256 e[3];
+	__m256 err[3];
+	for (size_t k = 0; k < 3; ++k)
+	{
+		const size_t i = (k + 1) % 3;
+		const size_t j = (k + 2) % 3;
+		const __m256 a = _mm256_mul_ps(x[j], y[i]);
+		const __m256 b = _mm256_mul_ps(y[j], x[i]);
+		e[k] = _mm256_sub_ps(a, b);
+		err[k] = _mm256_add_ps(
+			_mm256_mul_ps(eps, _mm256_add_ps(_mm256_andnot_ps(signMask, a), _mm256_andnot_ps(signMask, b))),
+			_mm256_mul_ps(delta, _mm256_add_ps(m[i], m[j])));
+	}
+	const __m256 allPositive = _mm256_and_ps(
+		_mm256_and_ps(
+			_mm256_cmp_ps(e[0], _mm256_sub_ps(_mm256_setzero_ps(), err[0]), _CMP_GE_OQ),
+			_mm256_cmp_ps(e[1], _mm256_sub_ps(_mm256_setzero_ps(), err[1]), _CMP_GE_OQ)),
+		_mm256_cmp_ps(e[2], _mm256_sub_ps(_mm256_setzero_ps(), err[2]), _CMP_GE_OQ));
+	const __m256 allNegative = _mm256_and_ps(
+		_mm256_and_ps(
+			_mm256_cmp_ps(e[0], err[0], _CMP_LE_OQ),
+			_mm256_cmp_ps(e[1], err[1], _CMP_LE_OQ)),
+		_mm256_cmp_ps(e[2], err[2], _CMP_LE_OQ));
+
+	const __m256 det = _mm256_add_ps(_mm256_add_ps(e[0], e[1]), e[2]);
+	const __m256 tScaled = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e[0], z[0]), _mm256_mul_ps(e[1], z[1])), _mm256_mul_ps(e[2], z[2]));
+	const __m256 tHit = _mm256_div_ps(tScaled, det);
+	_mm256_storeu_ps(t, tHit);
+
+	__m256 mask = _mm256_or_ps(allPositive, allNegative);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(det, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(tHit, _mm256_set1_ps(tMin), _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(tHit, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+	return static_cast<unsigned>(_mm256_movemask_ps(mask));
+}
+
+#else
+
+/** Intersects all lanes of the group, and returns a bit mask of the ones that may be hit in
+ *  [tMin, tMax].  Their distances are stored in @a t.  Written lane by lane, so that the compiler
+ *  is free to vectorize it.
+ */
+unsigned TriangleBvh::intersectGroup(const Group& group, const WatertightRay& ray, float tMin, float tMax, float* t) const
+{
+	unsigned mask = 0;
+	for (size_t lane = 0; lane < groupSize; ++lane)
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const float px = group.v[k][ray.kx][lane] - ray.support[ray.kx];
+			const float py = group.v[k][ray.ky][lane] - ray.support[ray.ky];
+			const float pz = group.v[k][ray.kz][lane] - ray.support[ray.kz];
+			x[k] = px - ray.shear[0] * pz;
+			y[k] = py - ray.shear[1] * pz;
+			z[k] = ray.shear[2] * pz;
+		}
+
+		// edge functions, each with the bound on its error: the rounding of the products, and the error
+		// delta of x and y, which contributes delta * (|x_i| + |y_i| + |x_j| + |y_j| + 2 * delta).
+		float m[3];
+		for (size_t k = 0; k < 3; ++k)
+		{
+			m[k] = num::abs(x[k]) + num::abs(y[k]) + ray.delta;
+		}
+		float e[3];
+		float err[3];
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const size_t i = (k + 1) % 3;
+			const size_t j = (k + 2) % 3;
+			const float a = x[j] * y[i];
+			const float b = y[j] * x[i];
+			e[k] = a - b;
+			err[k] = tolerance * (num::abs(a) + num::abs(b)) + ray.delta * (m[i] + m[j]);
+		}
+		const bool allPositive = e[0] >= -err[0] && e[1] >= -err[1] && e[2] >= -err[2];
+		const bool allNegative = e[0] <= err[0] && e[1] <= err[1] && e[2] <= err[2];
+		const float det = e[0] + e[1] + e[2];
+		if (!(allPositive || allNegative) || det == 0)
+		{
+			continue;
+		}
+		t[lane] = (e[0] * z[0] + e[1] * z[1] + e[2] * z[2]) / det;
+		if (t[lane] >= tMin && t[lane] <= tMax)
+		{
+			mask |= 1u << lane;
+		}
+	}
+	return mask;
+}
+
+#endif
+
+
+
+/** Shears and scales space so that the ray runs along the positive z axis from the origin, with
+ *  its dominant direction component as z.  x and y are swapped if needed to preserve the winding.
+ *
+ *  @a vertexScale is the largest absolute coordinate of the vertices.  Together with the ray support,
+ *  that bounds the errors of converting both to single precision, see delta.
+ */
+TriangleBvh::WatertightRay::WatertightRay(const TRay3D& ray, float vertexScale)
+{
+	const TVector3D& d = ray.direction();
+	kz = d.majorAxis();
+	kx = (kz + 1) % 3;
+	ky = (kx + 1) % 3;
+	if (d[kz] < 0)
+	{
+		std::swap(kx, ky);
+	}
+	shear[0] = static_cast<float>(d[kx] / d[kz]);
+	shear[1] = static_cast<float>(d[ky] / d[kz]);
+	shear[2] = static_cast<float>(TNumTraits::one / d[kz]);
+
+	const TPoint3D& s = ray.support();
+	float supportScale = 0;
+	for (size_t k = 0; k < 3; ++k)
+	{
+		support[k] = static_cast<float>(s[k]);
+		supportScale = std::max(supportScale, static_cast<float>(num::abs(s[k])));
+	}
+	scale = std::max(supportScale + vertexScale, 1.f);
+	delta = absoluteTolerance * (supportScale + vertexScale);
+}
+
+
+
+float TriangleBvh::WatertightRay::lower(TScalar tMin) const
+{
+	const float t = static_cast<float>(tMin);
+	return t - tolerance * (scale + num::abs(t));
+}
+
+
+
+float TriangleBvh::WatertightRay::upper(TScalar tMax) const
+{
+	const float t = static_cast<float>(tMax);
+	return t + tolerance * (scale + num::abs(t));
+}
+
+
+
+const TAabb3D TriangleBvh::TriangleTraits::objectAabb(TObjectIterator triangle)
+{
+	TAabb3D result;
+	for (size_t k = 0; k < 3; ++k)
+	{
+		result += *triangle->vertices[k];
+	}
+	return result;
+}
+
+
+
+bool TriangleBvh::TriangleTraits::objectIntersect(TObjectIterator triangle, const TRay& ray, TReference t, TParam tMin, const TInfo*)
+{
+	return triangle->intersect(ray, t, tMin, nullptr) == prim::rOne;
+}
+
+
+
+bool TriangleBvh::TriangleTraits::objectIntersects(TObjectIterator triangle, const TRay& ray, TParam tMin, TParam tMax, const TInfo*)
+{
+	TValue t;
+	return triangle->intersect(ray, t, tMin, nullptr) == prim::rOne && t < tMax;
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+
+
+}
+
+}
+
+// EOF
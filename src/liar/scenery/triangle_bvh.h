@@ -0,0 +1,340 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::scenery::TriangleBvh
+ *  @brief a BvhTree over the triangles of a mesh, with leaves that are intersected all at once.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  The vertices of the triangles of each leaf are repacked in groups of groupSize triangles, one
+ *  coordinate at a time (structure of arrays), in single precision.  That way, a whole group is
+ *  intersected by one pass of the watertight ray-triangle test of Woop et al. [1], on eight lanes
+ *  at once if AVX is available, and on four otherwise.  Unused lanes are degenerate triangles
+ *  that are never hit.
+ *
+ *  The test is made slightly conservative, so that it finds a superset of the hits.  Its error
+ *  bounds cover its own rounding, and the conversion of vertices and ray to single precision,
+ *  which grows with the largest coordinate of both.  Only hits that the full precision test
+ *  finds by its own rounding, on the very edge of a triangle, may be missed.  These
+ *  candidates are sorted by distance, and then confirmed with the full precision test of the
+ *  triangle itself.  The filter, typically an alpha mask lookup, is only called for confirmed
+ *  hits, nearest first, so that it isn't evaluated for triangles behind the nearest opaque one.
+ *
+ *  The groups don't replace the vertices of the mesh, they're a copy of 40 bytes per triangle on
+ *  top of them, and on top of the nodes and object references of the tree.  With the index of the
+ *  first group of each leaf, that's 67 bytes per triangle for the tree and groups together, where
+ *  the tree alone takes 23.  So this trades memory for speed.  Only the nodes of the tree are stored compactly, see BvhTree.  The vertices, normals
+ *  and uvs of the mesh itself are kept in TScalar precision by prim::TriangleMesh3D.
+ *
+ *  [1] Sven Woop, Carsten Benthin, Ingo Wald, "Watertight Ray/Triangle Intersection",
+ *      Journal of Computer Graphics Techniques, Vol. 2, No. 1, 2013.
+ *
+ *  @class liar::scenery::impl::BoundsOnlyTree
+ *  @brief stand-in tree for prim::TriangleMesh3D that only keeps the bounding box.
+ *
+ *  TriangleBvh builds its own tree over the mesh, so the one of TriangleMesh3D itself only needs
+ *  to provide the bounding box.  Should anything query it anyway, it simply tests all objects.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_SCENERY_TRIANGLE_BVH_H
+#define LIAR_GUARDIAN_OF_INCLUSION_SCENERY_TRIANGLE_BVH_H
+
+#include "scenery_common.h"
+#include "../kernel/bvh_tree.h"
+
+#include <lass/prim/triangle_mesh_3d.h>
+#include <lass/spat/default_object_traits.h>
+#include <lass/spat/split_heuristics.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace liar
+{
+namespace scenery
+{
+
+namespace impl
+{
+
+template <typename ObjectType, typename ObjectTraits, typename SplitHeuristics>
+class BoundsOnlyTree
+{
+public:
+
+	typedef BoundsOnlyTree<ObjectType, ObjectTraits, SplitHeuristics> TSelf;
+	typedef ObjectType TObjectType;
+	typedef ObjectTraits TObjectTraits;
+	typedef SplitHeuristics TSplitHeuristics;
+
+	typedef typename TObjectTraits::TObjectIterator TObjectIterator;
+	typedef typename TObjectTraits::TObjectReference TObjectReference;
+	typedef typename TObjectTraits::TAabb TAabb;
+	typedef typename TObjectTraits::TRay TRay;
+	typedef typename TObjectTraits::TPoint TPoint;
+	typedef typename TObjectTraits::TVector TVector;
+	typedef typename TObjectTraits::TValue TValue;
+	typedef typename TObjectTraits::TParam TParam;
+	typedef typename TObjectTraits::TReference TReference;
+	typedef typename TObjectTraits::TConstReference TConstReference;
+	typedef typename TObjectTraits::TInfo TInfo;
+
+	BoundsOnlyTree():
+		aabb_(TObjectTraits::aabbEmpty()),
+		begin_(),
+		end_()
+	{
+	}
+
+	BoundsOnlyTree(TObjectIterator first, TObjectIterator last):
+		aabb_(TObjectTraits::aabbEmpty()),
+		begin_(first),
+		end_(last)
+	{
+		reset(first, last);
+	}
+
+	void reset()
+	{
+		TSelf temp;
+		swap(temp);
+	}
+
+	void reset(TObjectIterator first, TObjectIterator last)
+	{
+		TAabb aabb = TObjectTraits::aabbEmpty();
+		for (TObjectIterator i = first; i != last; ++i)
+		{
+			aabb = TObjectTraits::aabbJoin(aabb, TObjectTraits::objectAabb(i));
+		}
+		aabb_ = aabb;
+		begin_ = first;
+		end_ = last;
+	}
+
+	const TAabb& aabb() const
+	{
+		return aabb_;
+	}
+
+	bool contains(const TPoint& point, const TInfo* info = 0) const
+	{
+		for (TObjectIterator i = begin_; i != end_; ++i)
+		{
+			if (TObjectTraits::objectContains(i, point, info))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename OutputIterator>
+	OutputIterator find(const TPoint& point, OutputIterator result, const TInfo* info = 0) const
+	{
+		for (TObjectIterator i = begin_; i != end_; ++i)
+		{
+			if (TObjectTraits::objectContains(i, point, info))
+			{
+				*result++ = i;
+			}
+		}
+		return result;
+	}
+
+	TObjectIterator intersect(const TRay& ray, TReference t, TParam tMin = 0, const TInfo* info = 0) const
+	{
+		TObjectIterator best = end_;
+		TValue tBest = std::numeric_limits<TValue>::infinity();
+		for (TObjectIterator i = begin_; i != end_; ++i)
+		{
+			TValue tCandidate;
+			if (TObjectTraits::objectIntersect(i, ray, tCandidate, tMin, info) && tCandidate < tBest)
+			{
+				tBest = tCandidate;
+				best = i;
+			}
+		}
+		if (best != end_)
+		{
+			t = tBest;
+		}
+		return best;
+	}
+
+	bool intersects(const TRay& ray, TParam tMin = 0, TParam tMax = std::numeric_limits<TValue>::infinity(), const TInfo* info = 0) const
+	{
+		for (TObjectIterator i = begin_; i != end_; ++i)
+		{
+			if (TObjectTraits::objectIntersects(i, ray, tMin, tMax, info))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void swap(TSelf& other)
+	{
+		std::swap(aabb_, other.aabb_);
+		std::swap(begin_, other.begin_);
+		std::swap(end_, other.end_);
+	}
+
+	bool isEmpty() const
+	{
+		return begin_ == end_;
+	}
+
+	const TObjectIterator end() const
+	{
+		return end_;
+	}
+
+	void clear()
+	{
+		TSelf temp;
+		temp.begin_ = end_;
+		temp.end_ = end_;
+		swap(temp);
+	}
+
+private:
+
+	TAabb aabb_;
+	TObjectIterator begin_;
+	TObjectIterator end_;
+};
+
+}
+
+typedef prim::TriangleMesh3D<TScalar, impl::BoundsOnlyTree, spat::SAHSplitHeuristics> TTriangleMesh3D;
+
+
+
+class LIAR_SCENERY_DLL TriangleBvh
+{
+public:
+
+	typedef TTriangleMesh3D TMesh;
+	typedef TMesh::TTriangle TTriangle;
+	typedef TMesh::TTriangleIterator TTriangleIterator;
+	typedef TMesh::TFilter TFilter;
+
+#if LIAR_HAVE_AVX
+	enum { groupSize = 8 };
+#else
+	enum { groupSize = 4 };
+#endif
+	enum { packetSize = 8 };
+
+	typedef unsigned TMask;
+
+	TriangleBvh();
+
+	void reset(const TMesh& mesh);
+	void refit(const TMesh& mesh);
+	void clear();
+
+	const TAabb3D& aabb() const;
+	bool isEmpty() const;
+
+	prim::Result intersect(const TRay3D& ray, TTriangleIterator& triangle, TScalar& t, TScalar tMin, const TFilter& filter) const;
+	bool intersects(const TRay3D& ray, TScalar tMin, TScalar tMax, const TFilter& filter) const;
+	TMask intersectPacket(const TRay3D* rays, size_t count, const TScalar* tMin, TTriangleIterator* triangles, TScalar* t, const TFilter* filters) const;
+	TMask intersectsPacket(const TRay3D* rays, size_t count, const TScalar* tMin, const TScalar* tMax, const TFilter* filters) const;
+
+	void swap(TriangleBvh& other);
+
+private:
+
+	typedef std::uint32_t TIndex;
+
+	struct TriangleTraits: spat::DefaultObjectTraits<TTriangle, TAabb3D, TRay3D, TTriangleIterator>
+	{
+		static const TAabb objectAabb(TObjectIterator triangle);
+		static bool objectIntersect(TObjectIterator triangle, const TRay& ray, TReference t, TParam tMin, const TInfo* info);
+		static bool objectIntersects(TObjectIterator triangle, const TRay& ray, TParam tMin, TParam tMax, const TInfo* info);
+	};
+
+	typedef kernel::BvhTree<TTriangle, TriangleTraits, spat::SAHSplitHeuristics> TTree;
+
+	/** vertex coordinates as v[vertex][axis][lane], and the index of the triangle of each lane.
+	 */
+	struct alignas(32) Group
+	{
+		float v[3][3][groupSize];
+		TIndex triangle[groupSize];
+	};
+
+	typedef std::vector<Group> TGroups;
+
+	struct WatertightRay
+	{
+		float support[3];
+		float shear[3];
+		size_t kx;
+		size_t ky;
+		size_t kz;
+		float scale;
+		float delta; // bound on the error of sheared coordinates.
+
+		WatertightRay() = default;
+		WatertightRay(const TRay3D& ray, float vertexScale);
+		float lower(TScalar tMin) const;
+		float upper(TScalar tMax) const;
+	};
+
+	struct Candidate
+	{
+		float t;
+		TIndex triangle;
+	};
+
+	enum
+	{
+		maxCandidates = TTree::maxObjectsPerForcedLeaf,
+	};
+
+	void pack(const TMesh& mesh);
+	unsigned intersectGroup(const Group& group, const WatertightRay& ray, float tMin, float tMax, float* t) const;
+	bool intersectLeaf(size_t first, size_t count, const TRay3D& ray, const WatertightRay& r, TScalar tMin, TScalar& tNearest,
+		TTriangleIterator& best, const TFilter& filter) const;
+	bool intersectsLeaf(size_t first, size_t count, const TRay3D& ray, const WatertightRay& r, TScalar tMin, TScalar tMax,
+		const TFilter& filter) const;
+	size_t findCandidates(size_t first, size_t count, const WatertightRay& ray, float tMin, float tMax, Candidate* result) const;
+
+	TTree tree_;
+	TGroups groups_;
+	std::vector<TIndex> leafGroups_; // first group of the leaf starting at each position, if any.
+	TTriangleIterator triangles_;
+	float vertexScale_; // largest absolute coordinate of the vertices.
+};
+
+}
+
+}
+
+#endif
+
+// EOF
@@ -23,6 +23,8 @@
 
 #include "scenery_common.h"
 #include "triangle_mesh.h"
+#include "wavefront_obj.h"
+#include "../kernel/array_buffer.h"
 #include <lass/num/inverse_transform_sampling.h>
 #include <lass/python/export_traits_filesystem.h>
 
@@ -47,15 +49,43 @@ PY_CLASS_METHOD_DOC(TriangleMesh, smoothNormals,
 	"allowed between the smooth vertex normal and face normal of the triangle.  If the angle "
 	"between both normals is less than this maximum, the vertex normal is used to create the "
 	"illusion of a smooth edge.  If not, the face normal is preserved to keep hard edges.")
+PY_CLASS_STATIC_METHOD_DOC(TriangleMesh, fromArrays,
+	"fromArrays(vertices, normals, uvs, triangles) -> TriangleMesh\n"
+	"build a mesh from numpy arrays, or anything else that supports the buffer protocol.  "
+	"vertices and normals have shape (n, 3), uvs has shape (n, 2).  normals and uvs may be None.  "
+	"triangles is an integer array of shape (m, 3) with vertex indices, that are also used for the "
+	"normals and uvs if any.  Or it has shape (m, 3, 3), with (vertex, normal, uv) indices for each "
+	"corner, where -1 means none.  The arrays are read in C++, without converting elements to Python "
+	"objects, and arrays of the right type and layout are copied in one go.")
 PY_CLASS_METHOD(TriangleMesh, flatFaces)
 PY_CLASS_METHOD(TriangleMesh, loopSubdivision)
 PY_CLASS_METHOD(TriangleMesh, autoSew)
 PY_CLASS_METHOD(TriangleMesh, autoCrease)
+PY_CLASS_METHOD_DOC(TriangleMesh, updateVertices,
+	"updateVertices(vertices)\n"
+	"move the vertices of the mesh, keeping its triangles, normals and uvs.  Meant for animating "
+	"deforming meshes: instead of being rebuilt, the BVH is refitted to the new vertices, unless that "
+	"degrades it too much (see kernel.setBvhMaxRefitCostGrowth).  The number of vertices must stay "
+	"the same.")
 
 PY_CLASS_METHOD(TriangleMesh, vertices)
 PY_CLASS_METHOD(TriangleMesh, normals)
 PY_CLASS_METHOD(TriangleMesh, uvs)
 PY_CLASS_METHOD(TriangleMesh, triangles)
+PY_CLASS_METHOD_DOC(TriangleMesh, vertexArray,
+	"vertexArray() -> array of shape (n, 3)\n"
+	"read-only view on the vertices, for numpy.asarray.  It refers to the memory of the mesh without "
+	"copying, so the mesh can't be changed as long as views on it exist.")
+PY_CLASS_METHOD_DOC(TriangleMesh, normalArray,
+	"normalArray() -> array of shape (n, 3)\n"
+	"read-only view on the normals, see vertexArray.")
+PY_CLASS_METHOD_DOC(TriangleMesh, uvArray,
+	"uvArray() -> array of shape (n, 2)\n"
+	"read-only view on the uvs, see vertexArray.")
+PY_CLASS_METHOD_DOC(TriangleMesh, triangleArray,
+	"triangleArray() -> array of shape (m, 3, 3)\n"
+	"(vertex, normal, uv) indices of each corner of each triangle, -1 for none.  As the mesh doesn't "
+	"store indices, this is a copy.")
 
 PY_CLASS_MEMBER_RW(TriangleMesh, alphaMask, setAlphaMask)
 PY_CLASS_MEMBER_RW(TriangleMesh, alphaThreshold, setAlphaThreshold)
@@ -63,6 +93,11 @@ PY_CLASS_MEMBER_RW(TriangleMesh, alphaThreshold, setAlphaThreshold)
 #if LIAR_HAVE_HAPPLY
 PY_CLASS_STATIC_METHOD(TriangleMesh, loadPly)
 #endif
+PY_CLASS_STATIC_METHOD_DOC(TriangleMesh, loadObj,
+	"loadObj(path) -> [(material, mesh), ...], [mtllib, ...]\n"
+	"load the geometry of a Wavefront OBJ file, parsed in parallel.  Returns a mesh for each group, "
+	"with the name of the material it uses (empty for none), and the material libraries the file "
+	"refers to.  Use liar.tools.wavefront_obj.load to also get the materials.")
 
 // --- public --------------------------------------------------------------------------------------
 
@@ -70,24 +105,111 @@ TriangleMesh::TriangleMesh(TVertices vertices, TNormals normals, TUvs uvs, const
 	mesh_(std::move(vertices), std::move(normals), std::move(uvs), triangles),
 	alphaMask_(nullptr),
 	area_(TNumTraits::zero),
-	alphaThreshold_(0.5f)
+	alphaThreshold_(0.5f),
+	numArrayViews_(0),
+	isBvhDirty_(true)
 {
-	std::vector<TScalar> cdf;
-	cdf_.reserve(mesh_.triangles().size());
-	for (const auto& triangle : mesh_.triangles())
+	updateCdf();
+}
+
+
+
+namespace
+{
+
+bool isNone(const TPyObjectPtr& object)
+{
+	return !object || object.get() == Py_None;
+}
+
+template <typename T, size_t dimension>
+void readArray(const TPyObjectPtr& object, const char* name, std::vector<T>& result)
+{
+	static_assert(sizeof(T) == dimension * sizeof(TScalar), "T must be a tuple of TScalar");
+	result.clear();
+	if (isNone(object))
 	{
-		cdf_.push_back(triangle.area());
+		return;
 	}
-	std::partial_sum(cdf_.begin(), cdf_.end(), cdf_.begin());
-	area_ = cdf_.back();
-	std::transform(cdf_.begin(), cdf_.end(), cdf_.begin(), [area=area_](TScalar x) { return x / area;  });
-	cdf_.back() = TNumTraits::one;
+	ArrayBuffer buffer(object, name);
+	buffer.enforceShape(0, dimension);
+	result.resize(buffer.shape(0));
+	buffer.copyTo(reinterpret_cast<TScalar*>(result.data()));
+}
+
+size_t checkIndex(num::Tint64 index, size_t count, bool isOptional, const char* name)
+{
+	if (index < 0 && isOptional)
+	{
+		return TriangleMesh::TMesh::TIndexTriangle::null();
+	}
+	if (index < 0 || static_cast<num::Tuint64>(index) >= count)
+	{
+		LASS_THROW("triangles: " << name << " index " << index << " out of range [0, " << count << ").");
+	}
+	return static_cast<size_t>(index);
+}
+
+}
+
+
+
+/** Only the indices are converted one by one, as TMesh wants size_t indices and nulls for none.
+ */
+TTriangleMeshPtr TriangleMesh::fromArrays(const TPyObjectPtr& vertices, const TPyObjectPtr& normals,
+	const TPyObjectPtr& uvs, const TPyObjectPtr& triangles)
+{
+	TVertices vs;
+	TNormals ns;
+	TUvs us;
+	readArray<TMesh::TPoint, 3>(vertices, "vertices", vs);
+	readArray<TMesh::TVector, 3>(normals, "normals", ns);
+	readArray<TMesh::TUv, 2>(uvs, "uvs", us);
+
+	ArrayBuffer buffer(triangles, "triangles");
+	const bool isPerCorner = buffer.ndim() == 3;
+	if (isPerCorner)
+	{
+		buffer.enforceShape(0, 3, 3);
+	}
+	else
+	{
+		buffer.enforceShape(0, 3);
+	}
+	std::vector<num::Tint64> indices(buffer.size());
+	buffer.copyTo(indices.data());
+
+	const size_t n = buffer.shape(0);
+	TIndexTriangles ts(n);
+	for (size_t k = 0; k < n; ++k)
+	{
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if (isPerCorner)
+			{
+				const num::Tint64* corner = &indices[9 * k + 3 * i];
+				ts[k].vertices[i] = checkIndex(corner[0], vs.size(), false, "vertex");
+				ts[k].normals[i] = checkIndex(corner[1], ns.size(), true, "normal");
+				ts[k].uvs[i] = checkIndex(corner[2], us.size(), true, "uv");
+			}
+			else
+			{
+				const num::Tint64 index = indices[3 * k + i];
+				ts[k].vertices[i] = checkIndex(index, vs.size(), false, "vertex");
+				ts[k].normals[i] = ns.empty() ? TMesh::TIndexTriangle::null() : checkIndex(index, ns.size(), false, "normal");
+				ts[k].uvs[i] = us.empty() ? TMesh::TIndexTriangle::null() : checkIndex(index, us.size(), false, "uv");
+			}
+		}
+	}
+
+	return TTriangleMeshPtr(new TriangleMesh(std::move(vs), std::move(ns), std::move(us), ts));
 }
 
 
 
 void TriangleMesh::smoothNormals()
 {
+	enforceNoArrayViews("smoothNormals");
 	mesh_.smoothNormals();
 }
 
@@ -95,6 +217,7 @@ void TriangleMesh::smoothNormals()
 
 void TriangleMesh::flatFaces()
 {
+	enforceNoArrayViews("flatFaces");
 	mesh_.flatFaces();
 }
 
@@ -102,25 +225,52 @@ void TriangleMesh::flatFaces()
 
 void TriangleMesh::loopSubdivision(unsigned level)
 {
+	enforceNoArrayViews("loopSubdivision");
 	mesh_.loopSubdivision(level);
+	updateCdf();
+	isBvhDirty_ = true;
 }
 
 
 
 void TriangleMesh::autoSew()
 {
+	enforceNoArrayViews("autoSew");
 	mesh_.autoSew();
+	isBvhDirty_ = true;
 }
 
 
 
 void TriangleMesh::autoCrease(unsigned level, TScalar maxAngleInRadians)
 {
+	enforceNoArrayViews("autoCrease");
 	mesh_.autoCrease(level, maxAngleInRadians);
 }
 
 
 
+/** The BVH is refitted right away, so that the mesh can still be intersected.  But anything that
+ *  contains this mesh only picks up its new bounds when the scene is preprocessed again.
+ */
+void TriangleMesh::updateVertices(const TVertices& vertices)
+{
+	enforceNoArrayViews("updateVertices");
+	if (vertices.size() != mesh_.vertices().size())
+	{
+		LASS_THROW("updateVertices: expected " << mesh_.vertices().size() << " vertices, got " << vertices.size() << ".");
+	}
+	TMesh mesh(vertices, mesh_.normals(), mesh_.uvs(), triangles());
+	mesh_.swap(mesh);
+	updateCdf();
+	if (!isBvhDirty_)
+	{
+		bvh_.refit(mesh_);
+	}
+}
+
+
+
 const TriangleMesh::TVertices& TriangleMesh::vertices() const
 {
 	return mesh_.vertices();
@@ -151,6 +301,56 @@ const TriangleMesh::TIndexTriangles TriangleMesh::triangles() const
 
 
 
+const TPyObjectPtr TriangleMesh::vertexArray() const
+{
+	const TVertices& vertices = mesh_.vertices();
+	return arrayView(reinterpret_cast<const TScalar*>(vertices.data()), vertices.size(), 3);
+}
+
+
+
+const TPyObjectPtr TriangleMesh::normalArray() const
+{
+	const TNormals& normals = mesh_.normals();
+	return arrayView(reinterpret_cast<const TScalar*>(normals.data()), normals.size(), 3);
+}
+
+
+
+const TPyObjectPtr TriangleMesh::uvArray() const
+{
+	const TUvs& uvs = mesh_.uvs();
+	return arrayView(reinterpret_cast<const TScalar*>(uvs.data()), uvs.size(), 2);
+}
+
+
+
+const TPyObjectPtr TriangleMesh::triangleArray() const
+{
+	const TIndexTriangles triangles = this->triangles();
+	const size_t n = triangles.size();
+	const TPyObjectPtr bytes(PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(9 * n * sizeof(num::Tint64))));
+	if (!bytes)
+	{
+		python::impl::fetchAndThrowPythonException(LASS_PRETTY_FUNCTION);
+	}
+	num::Tint64* data = reinterpret_cast<num::Tint64*>(PyBytes_AS_STRING(bytes.get()));
+	auto index = [](size_t i) { return i == TMesh::TIndexTriangle::null() ? -1 : static_cast<num::Tint64>(i); };
+	for (size_t k = 0; k < n; ++k)
+	{
+		for (size_t i = 0; i < 3; ++i)
+		{
+			num::Tint64* corner = data + 9 * k + 3 * i;
+			corner[0] = index(triangles[k].vertices[i]);
+			corner[1] = index(triangles[k].normals[i]);
+			corner[2] = index(triangles[k].uvs[i]);
+		}
+	}
+	return makeArrayView(bytes, data, ArrayFormat<num::Tint64>::format(), sizeof(num::Tint64), n, 3, 3);
+}
+
+
+
 const TTexturePtr& TriangleMesh::alphaMask() const
 {
 	return alphaMask_;
@@ -249,7 +449,7 @@ TTriangleMeshPtr TriangleMesh::loadPly(std::filesystem::path path)
 	for (const auto& indices : faceIndices)
 	{
 		const size_t n = indices.size();
-		if (n < 2)
+		if (n < 3)
 		{
 			throw std::runtime_error("TriangleMesh: faces must have at least 3 vertices");
 		}
@@ -273,8 +473,8 @@ TTriangleMeshPtr TriangleMesh::loadPly(std::filesystem::path path)
 				triangle.uvs[1] = i1;
 				triangle.uvs[2] = i2;
 			}
+			triangles.push_back(triangle);
 		}
-		triangles.push_back(triangle);
 	}
 
 	return TTriangleMeshPtr(new TriangleMesh(std::move(vertices), std::move(normals), std::move(uvs), std::move(triangles)));
@@ -282,12 +482,40 @@ TTriangleMeshPtr TriangleMesh::loadPly(std::filesystem::path path)
 #endif
 
 
+
+TriangleMesh::TObjContents TriangleMesh::loadObj(std::filesystem::path path)
+{
+	impl::wavefront_obj::TGroups groups;
+	TObjContents result;
+	impl::wavefront_obj::read(path, groups, result.second);
+	result.first.reserve(groups.size());
+	for (auto& group : groups)
+	{
+		TTriangleMeshPtr mesh(new TriangleMesh(std::move(group.vertices), std::move(group.normals), std::move(group.uvs), group.triangles));
+		result.first.emplace_back(std::move(group.material), std::move(mesh));
+		TIndexTriangles().swap(group.triangles);
+	}
+	return result;
+}
+
+
 // --- protected -----------------------------------------------------------------------------------
 
 
 
 // --- private -------------------------------------------------------------------------------------
 
+void TriangleMesh::doPreProcess(const TimePeriod&)
+{
+	if (isBvhDirty_)
+	{
+		bvh_.reset(mesh_);
+		isBvhDirty_ = false;
+	}
+}
+
+
+
 void TriangleMesh::doIntersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const
 {
 	// also modify TriangleMeshComposite::doIntersect, if you change this
@@ -298,7 +526,7 @@ void TriangleMesh::doIntersect(const Sample& sample, const BoundedRay& ray, Inte
 
 	TScalar t;
 	TMesh::TTriangleIterator triangle;
-	const prim::Result hit = mesh_.intersectFilter(ray.unboundedRay(), triangle, t, ray.nearLimit(), filter);
+	const prim::Result hit = bvh_.intersect(ray.unboundedRay(), triangle, t, ray.nearLimit(), filter);
 	if (hit == prim::rOne && ray.inRange(t))
 	{
 		const TScalar d = dot(ray.direction(), triangle->geometricNormal());
@@ -326,7 +554,91 @@ bool TriangleMesh::doIsIntersecting(const Sample& sample, const BoundedRay& ray)
 		? [this, &sample, &ray](TMesh::TTriangleIterator triangle, TScalar t) { return this->triangleFilter(triangle, t, sample, ray); }
 		: TMesh::TFilter();
 
-	return mesh_.intersectsFilter(ray.unboundedRay(), ray.nearLimit(), ray.farLimit(), filter);
+	return bvh_.intersects(ray.unboundedRay(), ray.nearLimit(), ray.farLimit(), filter);
+}
+
+
+
+/** The rays traverse the BVH of the mesh together, packetSize at a time.
+ */
+void TriangleMesh::doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const
+{
+	const size_t packetSize = TriangleBvh::packetSize;
+	TRay3D unboundedRays[packetSize];
+	TScalar tMin[packetSize];
+	TMesh::TFilter filters[packetSize];
+	TMesh::TTriangleIterator triangles[packetSize];
+	TScalar t[packetSize];
+	for (size_t i = 0; i < count; i += packetSize)
+	{
+		const size_t n = std::min(count - i, packetSize);
+		for (size_t k = 0; k < n; ++k)
+		{
+			const Sample& sample = samples[i + k];
+			const BoundedRay& ray = rays[i + k];
+			unboundedRays[k] = ray.unboundedRay();
+			tMin[k] = ray.nearLimit();
+			if (alphaMask_)
+			{
+				filters[k] = [this, &sample, &ray](TMesh::TTriangleIterator triangle, TScalar tTriangle) { return this->triangleFilter(triangle, tTriangle, sample, ray); };
+			}
+		}
+
+		const TriangleBvh::TMask hit = bvh_.intersectPacket(unboundedRays, n, tMin, triangles, t, alphaMask_ ? filters : nullptr);
+		for (size_t k = 0; k < n; ++k)
+		{
+			const BoundedRay& ray = rays[i + k];
+			if (((hit >> k) & 1) && ray.inRange(t[k]))
+			{
+				const TScalar d = dot(ray.direction(), triangles[k]->geometricNormal());
+				const SolidEvent se = (d < TNumTraits::zero)
+					? seEntering
+					: (d > TNumTraits::zero)
+					? seLeaving
+					: seNoEvent;
+				const size_t index = static_cast<size_t>(std::distance(mesh_.triangles().begin(), triangles[k]));
+				results[i + k] = Intersection(this, t[k], se, index);
+			}
+			else
+			{
+				results[i + k] = Intersection::empty();
+			}
+		}
+	}
+}
+
+
+
+/** The shadow rays traverse the BVH of the mesh together, packetSize at a time.
+ */
+void TriangleMesh::doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const
+{
+	const size_t packetSize = TriangleBvh::packetSize;
+	TRay3D unboundedRays[packetSize];
+	TScalar tMin[packetSize];
+	TScalar tMax[packetSize];
+	TMesh::TFilter filters[packetSize];
+	for (size_t i = 0; i < count; i += packetSize)
+	{
+		const size_t n = std::min(count - i, packetSize);
+		for (size_t k = 0; k < n; ++k)
+		{
+			const BoundedRay& ray = rays[i + k];
+			unboundedRays[k] = ray.unboundedRay();
+			tMin[k] = ray.nearLimit();
+			tMax[k] = ray.farLimit();
+			if (alphaMask_)
+			{
+				filters[k] = [this, &sample, &ray](TMesh::TTriangleIterator triangle, TScalar t) { return this->triangleFilter(triangle, t, sample, ray); };
+			}
+		}
+
+		const TriangleBvh::TMask hit = bvh_.intersectsPacket(unboundedRays, n, tMin, tMax, alphaMask_ ? filters : nullptr);
+		for (size_t k = 0; k < n; ++k)
+		{
+			results[i + k] = (hit >> k) & 1;
+		}
+	}
 }
 
 
@@ -447,12 +759,15 @@ const TPoint3D TriangleMesh::doSampleSurface(const TPoint2D& sample, TVector3D&
 
 void TriangleMesh::doSetState(const TPyObjectPtr& state)
 {
+	enforceNoArrayViews("__setstate__");
 	TMesh::TVertices vertices;
 	TMesh::TNormals normals;
 	TMesh::TUvs uvs;
 	TIndexTriangles triangles;
 	LASS_ENFORCE(python::decodeTuple(state, vertices, normals, uvs, triangles));
 	mesh_ = TMesh(vertices, normals, uvs, triangles);
+	updateCdf();
+	isBvhDirty_ = true;
 }
 
 
@@ -479,6 +794,54 @@ bool TriangleMesh::triangleFilter(TMesh::TTriangleIterator triangle, TScalar t,
 }
 
 
+
+void TriangleMesh::updateCdf()
+{
+	cdf_.clear();
+	cdf_.reserve(mesh_.triangles().size());
+	for (const auto& triangle : mesh_.triangles())
+	{
+		cdf_.push_back(triangle.area());
+	}
+	std::partial_sum(cdf_.begin(), cdf_.end(), cdf_.begin());
+	area_ = cdf_.back();
+	std::transform(cdf_.begin(), cdf_.end(), cdf_.begin(), [area=area_](TScalar x) { return x / area;  });
+	cdf_.back() = TNumTraits::one;
+}
+
+
+
+/** The view keeps the mesh alive, and is counted so that the mesh refuses to reallocate its
+ *  buffers as long as there are any.
+ */
+const TPyObjectPtr TriangleMesh::arrayView(const TScalar* data, size_t count, size_t columns) const
+{
+	const TPyObjectPtr self = python::fromNakedToSharedPtrCast<PyObject>(const_cast<TriangleMesh*>(this));
+	TPyObjectPtr result = makeArrayView(self, data, count, columns, &TriangleMesh::releaseArrayView);
+	++numArrayViews_;
+	return result;
+}
+
+
+
+void TriangleMesh::enforceNoArrayViews(const char* method) const
+{
+	if (numArrayViews_ > 0)
+	{
+		LASS_THROW(method << ": can't change mesh while " << numArrayViews_ << " array views on it exist.");
+	}
+}
+
+
+
+void TriangleMesh::releaseArrayView(PyObject* self)
+{
+	TriangleMesh* mesh = static_cast<TriangleMesh*>(self);
+	LASS_ASSERT(mesh->numArrayViews_ > 0);
+	--mesh->numArrayViews_;
+}
+
+
 // --- free ----------------------------------------------------------------------------------------
 
 
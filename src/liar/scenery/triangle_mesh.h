@@ -30,12 +30,12 @@
 #define LIAR_GUARDIAN_OF_INCLUSION_SCENERY_TRIANGLE_MESH_H
 
 #include "scenery_common.h"
+#include "triangle_bvh.h"
 #include "../kernel/scene_object.h"
 #include "../kernel/texture.h"
 
-#include <lass/prim/triangle_mesh_3d.h>
-#include <lass/spat/qbvh_tree.h>
 #include <filesystem>
+#include <string>
 
 namespace liar
 {
@@ -50,25 +50,36 @@ class LIAR_SCENERY_DLL TriangleMesh: public SceneObject
 	PY_HEADER(SceneObject)
 public:
 
-	typedef prim::TriangleMesh3D<TScalar, spat::QbvhTree, spat::SAHSplitHeuristics> TMesh;
+	typedef TTriangleMesh3D TMesh;
 	typedef std::vector<TMesh::TPoint> TVertices;
 	typedef TMesh::TNormals TNormals;
 	typedef std::vector<TMesh::TUv> TUvs;
 	typedef std::vector<TMesh::TIndexTriangle> TIndexTriangles;
+	typedef std::vector< std::pair<std::string, TTriangleMeshPtr> > TObjGroups; /**< (material name, mesh) */
+	typedef std::vector<std::string> TObjMaterialLibraries;
+	typedef std::pair<TObjGroups, TObjMaterialLibraries> TObjContents;
 
 	TriangleMesh(TVertices vertices, TNormals normals, TUvs uvs, const TIndexTriangles& triangles);
+	static TTriangleMeshPtr fromArrays(const TPyObjectPtr& vertices, const TPyObjectPtr& normals,
+		const TPyObjectPtr& uvs, const TPyObjectPtr& triangles);
 
 	void smoothNormals();
 	void flatFaces();
 	void loopSubdivision(unsigned level);
 	void autoSew();
 	void autoCrease(unsigned level, TScalar maxAngleInRadians);
+	void updateVertices(const TVertices& vertices);
 
 	const TVertices& vertices() const;
 	const TNormals& normals() const;
 	const TUvs& uvs() const;
 	const TIndexTriangles triangles() const;
 
+	const TPyObjectPtr vertexArray() const;
+	const TPyObjectPtr normalArray() const;
+	const TPyObjectPtr uvArray() const;
+	const TPyObjectPtr triangleArray() const;
+
 	const TTexturePtr& alphaMask() const;
 	Texture::TValue alphaThreshold() const;
 	void setAlphaMask(const TTexturePtr& alphaMask);
@@ -77,13 +88,17 @@ public:
 #if LIAR_HAVE_HAPPLY
 	static TTriangleMeshPtr loadPly(std::filesystem::path path);
 #endif
+	static TObjContents loadObj(std::filesystem::path path);
 
 private:
 
 	LASS_UTIL_VISITOR_DO_ACCEPT
 
+	void doPreProcess(const TimePeriod& period) override;
 	void doIntersect(const Sample& sample, const BoundedRay& ray, Intersection& result) const override;
 	bool doIsIntersecting(const Sample& sample, const BoundedRay& ray) const override;
+	void doIntersectPacket(const Sample* samples, const BoundedRay* rays, Intersection* results, size_t count) const override;
+	void doAreIntersecting(const Sample& sample, const BoundedRay* rays, bool* results, size_t count) const override;
 	void doLocalContext(const Sample& sample, const BoundedRay& ray, const Intersection& intersection, IntersectionContext& result) const override;
 	bool doContains(const Sample& sample, const TPoint3D& point) const override;
 	const TAabb3D doBoundingBox() const override;
@@ -98,12 +113,19 @@ private:
 	void doSetState(const TPyObjectPtr& state) override;
 
 	bool triangleFilter(TMesh::TTriangleIterator triangle, TScalar t, const Sample& sample, const BoundedRay& ray) const;
+	void updateCdf();
+	const TPyObjectPtr arrayView(const TScalar* data, size_t count, size_t columns) const;
+	void enforceNoArrayViews(const char* method) const;
+	static void releaseArrayView(PyObject* self);
 
 	TMesh mesh_;
+	TriangleBvh bvh_;
 	std::vector<TScalar> cdf_;
 	TTexturePtr alphaMask_;
 	TScalar area_;
 	Texture::TValue alphaThreshold_;
+	mutable size_t numArrayViews_;
+	bool isBvhDirty_;
 };
 
 
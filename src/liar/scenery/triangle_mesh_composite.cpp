@@ -177,7 +177,11 @@ void TriangleMeshComposite::doPreProcess(const TimePeriod& period)
 
 	TMesh mesh(std::move(verts), std::move(normals), std::move(uvs), triangles);
 
+	TriangleBvh bvh;
+	bvh.reset(mesh);
+
 	mesh_.swap(mesh);
+	bvh_.swap(bvh);
 	backLinks_.swap(backLinks);
 }
 
@@ -194,7 +198,7 @@ void TriangleMeshComposite::doIntersect(const Sample& sample, const BoundedRay&
 	Intersection intersection;
 	TScalar t;
 	TMesh::TTriangleIterator triangle;
-	const prim::Result hit = mesh_.intersectFilter(ray.unboundedRay(), triangle, t, ray.nearLimit(), filter);
+	const prim::Result hit = bvh_.intersect(ray.unboundedRay(), triangle, t, ray.nearLimit(), filter);
 	if (hit == prim::rOne && ray.inRange(t))
 	{
 		const TScalar d = dot(ray.direction(), triangle->geometricNormal());
@@ -227,7 +231,7 @@ bool TriangleMeshComposite::doIsIntersecting(const Sample& sample, const Bounded
 		? [this, &sample, &ray](TMesh::TTriangleIterator triangle, TScalar t) { return this->triangleFilter(triangle, t, sample, ray); }
 		: TMesh::TFilter();
 
-	return mesh_.intersectsFilter(ray.unboundedRay(), ray.nearLimit(), ray.farLimit(), filter);
+	return bvh_.intersects(ray.unboundedRay(), ray.nearLimit(), ray.farLimit(), filter);
 }
 
 
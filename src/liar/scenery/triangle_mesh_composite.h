@@ -83,6 +83,7 @@ private:
 
 	TChildren children_;
 	TMesh mesh_;
+	TriangleBvh bvh_;
 	TBackLinks backLinks_;
 	bool hasAlphaMasks_ = false;
 };
@@ -0,0 +1,691 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "scenery_common.h"
+#include "wavefront_obj.h"
+#include "../kernel/mapped_file.h"
+#include <lass/util/thread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <future>
+#include <string_view>
+
+namespace liar
+{
+namespace scenery
+{
+namespace impl
+{
+namespace wavefront_obj
+{
+
+namespace
+{
+
+typedef TMesh::TPoint TPoint;
+typedef TMesh::TVector TVector;
+typedef TMesh::TUv TUv;
+typedef TMesh::TIndexTriangle TIndexTriangle;
+typedef TPoint::TValue TValue;
+
+const size_t minBytesPerChunk = 1 << 20;
+
+struct Corner
+{
+	size_t vertex;
+	size_t normal;
+	size_t uv;
+};
+
+/** a g or usemtl statement, in front of face number @a face of its chunk.
+ *  After triangulation, @a triangle is the number of triangles in front of it.
+ */
+struct Event
+{
+	size_t face;
+	size_t triangle;
+	std::string material;
+	bool isGroup;
+};
+
+struct Chunk
+{
+	const char* begin;
+	const char* end;
+	size_t numVertices = 0;
+	size_t numNormals = 0;
+	size_t numUvs = 0;
+	size_t firstVertex = 0;
+	size_t firstNormal = 0;
+	size_t firstUv = 0;
+	std::vector<Corner> corners;
+	std::vector<size_t> faceEnds;
+	std::vector<Event> events;
+	TMaterialLibraries materialLibraries;
+	TIndexTriangles triangles;
+};
+
+struct Range
+{
+	const Chunk* chunk;
+	size_t begin;
+	size_t end;
+};
+
+struct PendingGroup
+{
+	std::vector<Range> ranges;
+	std::string material;
+	size_t numTriangles = 0;
+};
+
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+const std::string_view nextToken(const char*& first, const char* last)
+{
+	while (first != last && isSpace(*first))
+	{
+		++first;
+	}
+	const char* begin = first;
+	while (first != last && !isSpace(*first))
+	{
+		++first;
+	}
+	return std::string_view(begin, static_cast<size_t>(first - begin));
+}
+
+const char* endOfLine(const char* first, const char* last)
+{
+	const void* eol = std::memchr(first, '\n', static_cast<size_t>(last - first));
+	return eol ? static_cast<const char*>(eol) : last;
+}
+
+const char* nextLine(const char* eol, const char* last)
+{
+	return eol == last ? last : eol + 1;
+}
+
+/** calls function(k) for each k in [0, count), on no more threads than there are processors.
+ *  The calling thread is one of them.
+ */
+template <typename Function>
+void parallelFor(size_t count, Function function)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&function, &next, count]()
+	{
+		for (size_t k = next++; k < count; k = next++)
+		{
+			function(k);
+		}
+	};
+	const size_t numThreads = std::min<size_t>(std::max<size_t>(util::numberOfAvailableProcessors(), 1), count);
+	std::vector< std::future<void> > futures;
+	futures.reserve(numThreads);
+	for (size_t k = 1; k < numThreads; ++k)
+	{
+		futures.push_back(std::async(std::launch::async, worker));
+	}
+	worker();
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+}
+
+/** calls function(chunk) for each chunk, in parallel.
+ */
+template <typename Function>
+void forEachChunk(std::vector<Chunk>& chunks, Function function)
+{
+	parallelFor(chunks.size(), [&function, &chunks](size_t k) { function(chunks[k]); });
+}
+
+
+
+class Reader
+{
+public:
+
+	Reader(const std::filesystem::path& path):
+		path_(path),
+		file_(path),
+		numVertices_(0),
+		numNormals_(0),
+		numUvs_(0)
+	{
+	}
+
+	void read(TGroups& groups, TMaterialLibraries& materialLibraries)
+	{
+		LASS_COUT << "loading Wavefront OBJ file " << path_.string() << " ..." << std::endl;
+
+		splitChunks();
+		forEachChunk(chunks_, [this](Chunk& chunk) { count(chunk); });
+		for (Chunk& chunk : chunks_)
+		{
+			chunk.firstVertex = numVertices_;
+			chunk.firstNormal = numNormals_;
+			chunk.firstUv = numUvs_;
+			numVertices_ += chunk.numVertices;
+			numNormals_ += chunk.numNormals;
+			numUvs_ += chunk.numUvs;
+		}
+		vertices_.resize(numVertices_);
+		normals_.resize(numNormals_);
+		uvs_.resize(numUvs_);
+		forEachChunk(chunks_, [this](Chunk& chunk) { parse(chunk); });
+		forEachChunk(chunks_, [this](Chunk& chunk) { triangulate(chunk); });
+
+		std::vector<PendingGroup> pending = cutGroups();
+		groups.clear();
+		groups.resize(pending.size());
+		parallelFor(pending.size(), [this, &pending, &groups](size_t k) { makeGroup(pending[k], groups[k]); });
+
+		size_t numTriangles = 0;
+		materialLibraries.clear();
+		for (const Chunk& chunk : chunks_)
+		{
+			numTriangles += chunk.triangles.size();
+			materialLibraries.insert(materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+		}
+		LASS_COUT << numVertices_ << " vertices, " << numNormals_ << " normals, " << numUvs_ << " uvs, "
+			<< numTriangles << " triangles in " << groups.size() << " groups" << std::endl;
+	}
+
+private:
+
+	/** cuts the file in chunks of whole lines, about one per thread.
+	 */
+	void splitChunks()
+	{
+		const char* data = file_.data();
+		const size_t size = file_.size();
+		const char* last = data + size;
+		const size_t numChunks = std::max<size_t>(std::min<size_t>(util::numberOfAvailableProcessors(), size / minBytesPerChunk), 1);
+		chunks_.resize(numChunks);
+		const char* begin = data;
+		for (size_t k = 0; k < numChunks; ++k)
+		{
+			const char* end = last;
+			if (k + 1 < numChunks)
+			{
+				end = std::max(begin, data + size * (k + 1) / numChunks);
+				end = nextLine(endOfLine(end, last), last);
+			}
+			chunks_[k].begin = begin;
+			chunks_[k].end = end;
+			begin = end;
+		}
+	}
+
+	static void count(Chunk& chunk)
+	{
+		for (const char* line = chunk.begin; line < chunk.end; )
+		{
+			const char* eol = endOfLine(line, chunk.end);
+			const std::string_view command = nextToken(line, eol);
+			if (command == "v")
+			{
+				++chunk.numVertices;
+			}
+			else if (command == "vn")
+			{
+				++chunk.numNormals;
+			}
+			else if (command == "vt")
+			{
+				++chunk.numUvs;
+			}
+			line = nextLine(eol, chunk.end);
+		}
+	}
+
+	void parse(Chunk& chunk)
+	{
+		size_t iVertex = chunk.firstVertex;
+		size_t iNormal = chunk.firstNormal;
+		size_t iUv = chunk.firstUv;
+		for (const char* line = chunk.begin; line < chunk.end; )
+		{
+			const char* eol = endOfLine(line, chunk.end);
+			const char* first = line;
+			const std::string_view command = nextToken(first, eol);
+			if (command == "v")
+			{
+				TValue x[7]; // x y z [w] or x y z r g b
+				parseValues(first, eol, x, 3, 7, line);
+				vertices_[iVertex++] = TPoint(x[0], x[1], x[2]);
+			}
+			else if (command == "vn")
+			{
+				TValue x[3];
+				parseValues(first, eol, x, 3, 3, line);
+				const TVector n(x[0], x[1], x[2]);
+				const TValue norm = n.norm();
+				normals_[iNormal++] = norm > 0 ? n / norm : n;
+			}
+			else if (command == "vt")
+			{
+				TValue x[3];
+				parseValues(first, eol, x, 2, 3, line);
+				uvs_[iUv++] = TUv(x[0], x[1]);
+			}
+			else if (command == "f")
+			{
+				const size_t begin = chunk.corners.size();
+				for (std::string_view field = nextToken(first, eol); !field.empty(); field = nextToken(first, eol))
+				{
+					chunk.corners.push_back(parseCorner(field, iVertex, iNormal, iUv, line));
+				}
+				enforce(chunk.corners.size() - begin >= 3, line);
+				chunk.faceEnds.push_back(chunk.corners.size());
+			}
+			else if (command == "g")
+			{
+				chunk.events.push_back(Event{ chunk.faceEnds.size(), 0, std::string(), true });
+			}
+			else if (command == "usemtl")
+			{
+				const std::string_view name = nextToken(first, eol);
+				enforce(nextToken(first, eol).empty(), line);
+				chunk.events.push_back(Event{ chunk.faceEnds.size(), 0, std::string(name), false });
+			}
+			else if (command == "mtllib")
+			{
+				const size_t n = chunk.materialLibraries.size();
+				for (std::string_view name = nextToken(first, eol); !name.empty(); name = nextToken(first, eol))
+				{
+					chunk.materialLibraries.emplace_back(name);
+				}
+				enforce(chunk.materialLibraries.size() > n, line);
+			}
+			line = nextLine(eol, chunk.end);
+		}
+	}
+
+	void parseValues(const char* first, const char* last, TValue* values, size_t minCount, size_t maxCount, const char* line) const
+	{
+		size_t n = 0;
+		for (std::string_view field = nextToken(first, last); !field.empty(); field = nextToken(first, last))
+		{
+			enforce(n < maxCount, line);
+			const char* end = field.data() + field.size();
+			const auto result = std::from_chars(field.data(), end, values[n++]);
+			enforce(result.ec == std::errc() && result.ptr == end, line);
+		}
+		enforce(n >= minCount, line);
+	}
+
+	/** parses v, v/vt, v//vn or v/vt/vn, and resolves the indices to zero based absolute ones.
+	 */
+	const Corner parseCorner(std::string_view field, size_t numVertices, size_t numNormals, size_t numUvs, const char* line) const
+	{
+		std::string_view fields[3];
+		size_t n = 0;
+		for (size_t slash = field.find('/'); ; slash = field.find('/'))
+		{
+			enforce(n < 3, line);
+			fields[n++] = field.substr(0, slash);
+			if (slash == std::string_view::npos)
+			{
+				break;
+			}
+			field.remove_prefix(slash + 1);
+		}
+		Corner corner;
+		corner.vertex = resolveIndex(fields[0], numVertices, numVertices_, line);
+		enforce(corner.vertex != TIndexTriangle::null(), line);
+		corner.uv = resolveIndex(fields[1], numUvs, numUvs_, line);
+		corner.normal = resolveIndex(fields[2], numNormals, numNormals_, line);
+		return corner;
+	}
+
+	size_t resolveIndex(std::string_view field, size_t countSoFar, size_t total, const char* line) const
+	{
+		if (field.empty())
+		{
+			return TIndexTriangle::null();
+		}
+		long long index = 0;
+		const char* end = field.data() + field.size();
+		const auto result = std::from_chars(field.data(), end, index);
+		enforce(result.ec == std::errc() && result.ptr == end && index != 0, line);
+		const long long resolved = index > 0 ? index - 1 : static_cast<long long>(countSoFar) + index;
+		enforce(resolved >= 0 && static_cast<size_t>(resolved) < total, line);
+		return static_cast<size_t>(resolved);
+	}
+
+	/** Zero normals are dropped, and so are normals or uvs that only some corners of a face have.
+	 *  Triangles are kept as is, other polygons are triangulated by ear clipping.
+	 */
+	void triangulate(Chunk& chunk)
+	{
+		const size_t numFaces = chunk.faceEnds.size();
+		auto event = chunk.events.begin();
+		std::vector<size_t> polygon;
+		std::vector<size_t> triangles;
+		size_t begin = 0;
+		for (size_t face = 0; face <= numFaces; ++face)
+		{
+			for (; event != chunk.events.end() && event->face == face; ++event)
+			{
+				event->triangle = chunk.triangles.size();
+			}
+			if (face == numFaces)
+			{
+				break;
+			}
+			const size_t end = chunk.faceEnds[face];
+			Corner* corners = &chunk.corners[begin];
+			const size_t size = end - begin;
+			begin = end;
+
+			size_t numNormals = 0;
+			size_t numUvs = 0;
+			for (size_t k = 0; k < size; ++k)
+			{
+				Corner& corner = corners[k];
+				if (corner.normal != TIndexTriangle::null() && normals_[corner.normal].isZero())
+				{
+					corner.normal = TIndexTriangle::null();
+				}
+				numNormals += corner.normal != TIndexTriangle::null();
+				numUvs += corner.uv != TIndexTriangle::null();
+			}
+			for (size_t k = 0; k < size; ++k)
+			{
+				if (numNormals < size)
+				{
+					corners[k].normal = TIndexTriangle::null();
+				}
+				if (numUvs < size)
+				{
+					corners[k].uv = TIndexTriangle::null();
+				}
+			}
+
+			triangles.clear();
+			if (size == 3)
+			{
+				triangles = { 0, 1, 2 };
+			}
+			else
+			{
+				earClip(corners, size, polygon, triangles);
+			}
+			for (size_t k = 0; k < triangles.size(); k += 3)
+			{
+				TIndexTriangle triangle;
+				for (size_t i = 0; i < 3; ++i)
+				{
+					const Corner& corner = corners[triangles[k + i]];
+					triangle.vertices[i] = corner.vertex;
+					triangle.normals[i] = corner.normal;
+					triangle.uvs[i] = corner.uv;
+				}
+				chunk.triangles.push_back(triangle);
+			}
+		}
+	}
+
+	/** naive O(n^3) ear clipper, as liar.tools.geometry.triangulate_3d.
+	 *  The polygon is projected along the major axis of its normal, and oriented counter clockwise.
+	 *  Each time, the ear with the largest area is clipped.
+	 */
+	void earClip(const Corner* corners, size_t size, std::vector<size_t>& polygon, std::vector<size_t>& triangles) const
+	{
+		const TPoint& origin = vertices_[corners[0].vertex];
+		TVector normal;
+		for (size_t k = 1; k + 1 < size; ++k)
+		{
+			normal += cross(vertices_[corners[k].vertex] - origin, vertices_[corners[k + 1].vertex] - origin);
+		}
+		const size_t axis = normal.majorAxis();
+		const size_t i = (axis + 1) % 3;
+		const size_t j = (axis + 2) % 3;
+		const bool flip = normal[axis] < 0;
+		auto point = [&](size_t k) -> const TPoint& { return vertices_[corners[k].vertex]; };
+		auto area = [&](size_t a, size_t b, size_t c)
+		{
+			const TPoint& pa = point(a);
+			const TPoint& pb = point(b);
+			const TPoint& pc = point(c);
+			const TValue result = (pb[i] - pa[i]) * (pc[j] - pa[j]) - (pc[i] - pa[i]) * (pb[j] - pa[j]);
+			return flip ? -result : result;
+		};
+		auto isInside = [&](size_t a, size_t b, size_t c, size_t d)
+		{
+			return area(a, b, d) >= 0 && area(b, c, d) >= 0 && area(c, a, d) >= 0;
+		};
+
+		polygon.resize(size);
+		for (size_t k = 0; k < size; ++k)
+		{
+			polygon[k] = k;
+		}
+		TValue polygonArea = 0;
+		for (size_t k = 1; k + 1 < size; ++k)
+		{
+			polygonArea += area(0, k, k + 1);
+		}
+		if (polygonArea == 0)
+		{
+			for (size_t k = 1; k + 1 < size; ++k)
+			{
+				triangles.insert(triangles.end(), { 0, k, k + 1 });
+			}
+			return;
+		}
+		while (polygon.size() > 3)
+		{
+			const size_t n = polygon.size();
+			size_t best = n;
+			TValue bestArea = 0;
+			for (size_t k = 0; k < n; ++k)
+			{
+				const size_t a = polygon[(k + n - 1) % n];
+				const size_t b = polygon[k];
+				const size_t c = polygon[(k + 1) % n];
+				const TValue earArea = area(a, b, c);
+				if (earArea <= bestArea)
+				{
+					continue;
+				}
+				bool isEar = true;
+				for (size_t d : polygon)
+				{
+					if (d != a && d != b && d != c && isInside(a, b, c, d))
+					{
+						isEar = false;
+						break;
+					}
+				}
+				if (isEar)
+				{
+					best = k;
+					bestArea = earArea;
+				}
+			}
+			if (best == n)
+			{
+				LASS_THROW("obj file " << path_.string() << ": failed to triangulate face with " << size << " vertices");
+			}
+			triangles.insert(triangles.end(), { polygon[(best + n - 1) % n], polygon[best], polygon[(best + 1) % n] });
+			polygon.erase(polygon.begin() + static_cast<std::ptrdiff_t>(best));
+		}
+		triangles.insert(triangles.end(), polygon.begin(), polygon.end());
+	}
+
+	/** A group is closed by a g statement or by the end of file, and gets the material that's in
+	 *  use by then.
+	 */
+	std::vector<PendingGroup> cutGroups() const
+	{
+		std::vector<PendingGroup> groups;
+		PendingGroup group;
+		std::string material;
+		auto add = [&group](const Chunk& chunk, size_t begin, size_t end)
+		{
+			if (end > begin)
+			{
+				group.ranges.push_back(Range{ &chunk, begin, end });
+				group.numTriangles += end - begin;
+			}
+		};
+		auto close = [&]()
+		{
+			if (group.numTriangles > 0)
+			{
+				group.material = material;
+				groups.push_back(std::move(group));
+				group = PendingGroup();
+			}
+		};
+		for (const Chunk& chunk : chunks_)
+		{
+			size_t begin = 0;
+			for (const Event& event : chunk.events)
+			{
+				add(chunk, begin, event.triangle);
+				begin = event.triangle;
+				if (event.isGroup)
+				{
+					close();
+				}
+				else
+				{
+					material = event.material;
+				}
+			}
+			add(chunk, begin, chunk.triangles.size());
+		}
+		close();
+		return groups;
+	}
+
+	void makeGroup(const PendingGroup& pending, Group& group) const
+	{
+		group.material = pending.material;
+		group.triangles.reserve(pending.numTriangles);
+		for (const Range& range : pending.ranges)
+		{
+			const auto first = range.chunk->triangles.begin();
+			group.triangles.insert(group.triangles.end(), first + static_cast<std::ptrdiff_t>(range.begin), first + static_cast<std::ptrdiff_t>(range.end));
+		}
+		compress(vertices_, group.triangles, &TIndexTriangle::vertices, group.vertices);
+		compress(normals_, group.triangles, &TIndexTriangle::normals, group.normals);
+		compress(uvs_, group.triangles, &TIndexTriangle::uvs, group.uvs);
+	}
+
+	/** copies the elements of @a all that are used by the triangles to @a used, and renumbers
+	 *  the indices of the triangles accordingly.
+	 */
+	template <typename T, typename Indices>
+	static void compress(const std::vector<T>& all, TIndexTriangles& triangles, Indices TIndexTriangle::*indices, std::vector<T>& used)
+	{
+		std::vector<size_t> usedIndices;
+		usedIndices.reserve(3 * triangles.size());
+		for (const TIndexTriangle& triangle : triangles)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				const size_t index = (triangle.*indices)[i];
+				if (index != TIndexTriangle::null())
+				{
+					usedIndices.push_back(index);
+				}
+			}
+		}
+		std::sort(usedIndices.begin(), usedIndices.end());
+		usedIndices.erase(std::unique(usedIndices.begin(), usedIndices.end()), usedIndices.end());
+
+		used.resize(usedIndices.size());
+		for (size_t k = 0; k < usedIndices.size(); ++k)
+		{
+			used[k] = all[usedIndices[k]];
+		}
+		if (usedIndices.size() == all.size())
+		{
+			return; // all are used, the indices stay the same.
+		}
+		for (TIndexTriangle& triangle : triangles)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				size_t& index = (triangle.*indices)[i];
+				if (index != TIndexTriangle::null())
+				{
+					index = static_cast<size_t>(std::lower_bound(usedIndices.begin(), usedIndices.end(), index) - usedIndices.begin());
+				}
+			}
+		}
+	}
+
+	void enforce(bool success, const char* line) const
+	{
+		if (!success)
+		{
+			const char* data = file_.data();
+			const size_t lineNumber = static_cast<size_t>(std::count(data, line, '\n')) + 1;
+			const std::string_view text(line, static_cast<size_t>(endOfLine(line, data + file_.size()) - line));
+			LASS_THROW("obj file " << path_.string() << " has syntax error on line " << lineNumber << ": " << text);
+		}
+	}
+
+	std::filesystem::path path_;
+	MappedFile file_;
+	std::vector<Chunk> chunks_;
+	TVertices vertices_;
+	TNormals normals_;
+	TUvs uvs_;
+	size_t numVertices_;
+	size_t numNormals_;
+	size_t numUvs_;
+};
+
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+void read(const std::filesystem::path& path, TGroups& groups, TMaterialLibraries& materialLibraries)
+{
+	Reader reader(path);
+	reader.read(groups, materialLibraries);
+}
+
+}
+}
+}
+}
+
+// EOF
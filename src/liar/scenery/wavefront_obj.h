@@ -0,0 +1,83 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @namespace liar::scenery::impl::wavefront_obj
+ *  @brief native reader of Wavefront OBJ files.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  The file is mapped in memory and cut in chunks of whole lines, that are parsed in parallel.
+ *  A first pass only counts the vertices, normals and uvs of each chunk, so that the second pass
+ *  knows where each chunk must write them, and can resolve negative (relative) indices of faces.
+ *  A third pass triangulates the faces, once all vertex positions are known.
+ *
+ *  The groups are cut the same way as liar.tools.wavefront_obj does: a new group starts at each
+ *  @c g statement, and gets the material that is in use when the group is closed.  Each group only
+ *  keeps the vertices, normals and uvs its triangles use.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_SCENERY_WAVEFRONT_OBJ_H
+#define LIAR_GUARDIAN_OF_INCLUSION_SCENERY_WAVEFRONT_OBJ_H
+
+#include "scenery_common.h"
+#include "triangle_bvh.h"
+
+#include <filesystem>
+#include <string>
+
+namespace liar
+{
+namespace scenery
+{
+namespace impl
+{
+namespace wavefront_obj
+{
+
+typedef TTriangleMesh3D TMesh;
+typedef std::vector<TMesh::TPoint> TVertices;
+typedef TMesh::TNormals TNormals;
+typedef std::vector<TMesh::TUv> TUvs;
+typedef std::vector<TMesh::TIndexTriangle> TIndexTriangles;
+
+struct Group
+{
+	std::string material; /**< name of material, or empty for default material */
+	TVertices vertices;
+	TNormals normals;
+	TUvs uvs;
+	TIndexTriangles triangles;
+};
+
+typedef std::vector<Group> TGroups;
+typedef std::vector<std::string> TMaterialLibraries;
+
+void read(const std::filesystem::path& path, TGroups& groups, TMaterialLibraries& materialLibraries);
+
+}
+}
+}
+}
+
+#endif
+
+// EOF
@@ -255,13 +255,29 @@ class PbrtScene(object):
                 f"Object {self.__cur_instance_name}"
             )
 
+        # build the shared child once, all instances will refer to it.
+        shapes = self.__cur_instance
+        if not shapes:
+            child = None
+        elif len(shapes) == 1:
+            child = shapes[0]
+        else:
+            child = liar.scenery.QbvhTree(shapes)
+        self.__instances[self.__cur_instance_name] = child
+
         self.__cur_instance = None
         self.__cur_instance_name = None
 
     def ObjectInstance(self, name):
         self.verify_world()
-        for shape in self.__instances[name]:
-            self.__add_shape(shape)
+        child = self.__instances[name]
+        if child is None:
+            return
+        instance = liar.scenery.Instance(child, self.__cur_transform)
+        if self.__cur_instance is not None:
+            self.__cur_instance.append(instance)
+        else:
+            self.__objects.append(instance)
 
     def __add_shape(self, shape):
         self.verify_world()
@@ -1052,7 +1068,7 @@ class PbrtScene(object):
         return tracer
 
     def _integrator_path(self, maxdepth=5):
-        tracer = liar.tracers.AdjointPhotonTracer()
+        tracer = liar.tracers.PathTracer()
         tracer.maxRayGeneration = maxdepth
         return tracer
 
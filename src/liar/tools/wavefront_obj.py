@@ -24,8 +24,127 @@ import liar.shaders
 import liar.textures
 
 
-def load(filename, *args, **kwargs):
-    return decode(open(filename), filename, *args, **kwargs)
+def load(
+    filename, material=liar.shaders.AshikhminShirley, initial_materials=None
+):
+    """
+    load(filename, material, initial_materials) -> groups, materials
+
+    Like decode, but the geometry is parsed by the native loader
+    liar.scenery.TriangleMesh.loadObj, which is a lot faster for big files.
+    """
+    meshes, libraries = liar.scenery.TriangleMesh.loadObj(filename)
+    materials = _initial_materials(initial_materials)
+    for mtl in libraries:
+        _load_materials(mtl, materials, material)
+    groups = []
+    for name, mesh in meshes:
+        if name not in materials:
+            print(
+                "obj file %s uses unknown material '%s', using default instead"
+                % (filename, name)
+            )
+            name = ""
+        mesh.shader = materials[name]
+        groups.append(mesh)
+    return groups, materials
+
+
+def _initial_materials(initial_materials):
+    materials = (initial_materials or {}).copy()
+    if not "" in materials:
+        materials[""] = liar.shaders.Lambert(liar.textures.Constant(liar.rgb(1, 1, 1)))
+    return materials
+
+
+def _load_materials(filename, materials, material):
+    currentMaterial = None
+    for line in open(filename):
+
+        def _enforceFields(iSuccess):
+            assert iSuccess, "material libary %s has syntax error: %s" % (
+                filename,
+                line,
+            )
+
+        def _setSpecularPower(material, texture):
+            try:
+                material.specularPower = texture
+            except AttributeError:
+                try:
+                    material.specularPowerU = texture
+                    material.specularPowerV = texture
+                except AttributeError:
+                    pass
+
+        fields = line.split()
+        if len(fields) > 0:
+            command, fields = fields[0], fields[1:]
+            if command == "newmtl":
+                _enforceFields(len(fields) < 2)
+                try:
+                    name = fields[0]
+                except:
+                    name = ""
+                if not name in materials:
+                    currentMaterial = material()
+                    materials[name] = currentMaterial
+                else:
+                    currentMaterial = (
+                        None  # respect the one that's already there ...
+                    )
+            elif command == "Kd":
+                _enforceFields(len(fields) == 3)
+                if currentMaterial:
+                    try:
+                        currentMaterial.diffuse = liar.textures.Constant(
+                            liar.rgb(_floatTuple(fields))
+                        )
+                    except AttributeError:
+                        pass
+            elif command == "Ks":
+                _enforceFields(len(fields) == 3)
+                if currentMaterial:
+                    try:
+                        currentMaterial.specular = liar.textures.Constant(
+                            liar.rgb(_floatTuple(fields))
+                        )
+                    except AttributeError:
+                        pass
+            elif command == "Ka":
+                _enforceFields(len(fields) == 3)
+                pass
+            elif command == "Ns":
+                _enforceFields(len(fields) == 1)
+                if currentMaterial:
+                    _setSpecularPower(
+                        currentMaterial, liar.textures.Constant(float(fields[0]))
+                    )
+            elif command == "map_Kd":
+                _enforceFields(len(fields) == 1)
+                if currentMaterial:
+                    try:
+                        currentMaterial.diffuse = liar.textures.Image(fields[0])
+                    except AttributeError:
+                        pass
+            elif command == "map_Ks":
+                _enforceFields(len(fields) == 1)
+                if currentMaterial:
+                    try:
+                        currentMaterial.specular = liar.textures.Image(fields[0])
+                    except AttributeError:
+                        pass
+            elif command == "map_Ka":
+                _enforceFields(len(fields) == 1)
+                pass
+            elif command == "map_Ns":
+                _enforceFields(len(fields) == 1)
+                if currentMaterial:
+                    _setSpecularPower(currentMaterial, liar.textures.Image(fields[0]))
+
+
+def _floatTuple(iFields):
+    return tuple([float(x) for x in iFields])
 
 
 def decode(
@@ -40,9 +159,7 @@ def decode(
     faces = []
     numFaces = 0
     groups = []
-    materials = (initial_materials or {}).copy()
-    if not "" in materials:
-        materials[""] = liar.shaders.Lambert(liar.textures.Constant(liar.rgb(1, 1, 1)))
+    materials = _initial_materials(initial_materials)
     currentMaterial = materials[""]
 
     def _int_or_none(x):
@@ -51,9 +168,6 @@ def decode(
         except:
             return None
 
-    def _floatTuple(iFields):
-        return tuple([float(x) for x in iFields])
-
     def _isZero(iTuple):
         return min([x == 0 for x in iTuple])
 
@@ -63,93 +177,6 @@ def decode(
             return n
         return tuple([x / norm for x in n])
 
-    def _loadMaterials(filename, materials):
-        currentMaterial = None
-        for line in open(filename):
-
-            def _enforceFields(iSuccess):
-                assert iSuccess, "material libary %s has syntax error: %s" % (
-                    filename,
-                    line,
-                )
-
-            def _setSpecularPower(material, texture):
-                try:
-                    material.specularPower = texture
-                except AttributeError:
-                    try:
-                        material.specularPowerU = texture
-                        material.specularPowerV = texture
-                    except AttributeError:
-                        pass
-
-            fields = line.split()
-            if len(fields) > 0:
-                command, fields = fields[0], fields[1:]
-                if command == "newmtl":
-                    _enforceFields(len(fields) < 2)
-                    try:
-                        name = fields[0]
-                    except:
-                        name = ""
-                    if not name in materials:
-                        currentMaterial = material()
-                        materials[name] = currentMaterial
-                    else:
-                        currentMaterial = (
-                            None  # respect the one that's already there ...
-                        )
-                elif command == "Kd":
-                    _enforceFields(len(fields) == 3)
-                    if currentMaterial:
-                        try:
-                            currentMaterial.diffuse = liar.textures.Constant(
-                                liar.rgb(_floatTuple(fields))
-                            )
-                        except AttributeError:
-                            pass
-                elif command == "Ks":
-                    _enforceFields(len(fields) == 3)
-                    if currentMaterial:
-                        try:
-                            currentMaterial.specular = liar.textures.Constant(
-                                liar.rgb(_floatTuple(fields))
-                            )
-                        except AttributeError:
-                            pass
-                elif command == "Ka":
-                    _enforceFields(len(fields) == 3)
-                    pass
-                elif command == "Ns":
-                    _enforceFields(len(fields) == 1)
-                    if currentMaterial:
-                        _setSpecularPower(
-                            currentMaterial, liar.textures.Constant(float(fields[0]))
-                        )
-                elif command == "map_Kd":
-                    _enforceFields(len(fields) == 1)
-                    if currentMaterial:
-                        try:
-                            currentMaterial.diffuse = liar.textures.Image(fields[0])
-                        except AttributeError:
-                            pass
-                elif command == "map_Ks":
-                    _enforceFields(len(fields) == 1)
-                    if currentMaterial:
-                        try:
-                            currentMaterial.specular = liar.textures.Image(fields[0])
-                        except AttributeError:
-                            pass
-                elif command == "map_Ka":
-                    _enforceFields(len(fields) == 1)
-                    pass
-                elif command == "map_Ns":
-                    _enforceFields(len(fields) == 1)
-                    if currentMaterial:
-                        _setSpecularPower(
-                            currentMaterial=liar.textures.Image(fields[0])
-                        )
-
     def _makeGroup(vertices, normals, uvs, faces, material):
         components = (vertices, normals, uvs)
 
@@ -209,7 +236,7 @@ def decode(
             if command == "mtllib":
                 _enforceFields(len(fields) > 0)
                 for mtl in fields:
-                    _loadMaterials(mtl, materials)
+                    _load_materials(mtl, materials, material)
 
             elif command == "usemtl":
                 _enforceFields(len(fields) < 2)
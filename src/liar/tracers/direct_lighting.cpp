@@ -23,6 +23,7 @@
 
 #include "tracers_common.h"
 #include "direct_lighting.h"
+#include "../kernel/ray_packet.h"
 #include <lass/num/floating_point_comparison.h>
 
 #define EVAL(x) LASS_COUT << LASS_STRINGIFY(x) << ": " << (x) << std::endl
@@ -122,37 +123,39 @@ const Spectral DirectLighting::doCastRay(
 {
 	Intersection intersection;
 	scene()->intersect(sample, primaryRay, intersection);
-	tIntersection = intersection ? intersection.t() : TNumTraits::infinity;
-	alpha = intersection ? 1 : 0;
+	return shadeIntersection(sample, primaryRay, intersection, tIntersection, alpha, generation, highQuality);
+}
 
-	const BoundedRay mediumRay = bound(primaryRay.centralRay(), primaryRay.centralRay().nearLimit(), tIntersection);
-	LASS_ENFORCE(!mediumRay.isEmpty());
-	Spectral transparency;
-	Spectral result = doShadeMedium(sample, mediumRay, transparency);
-	if (!transparency || !intersection)
-	{
-		return result;
-	}
 
-	Spectral surfaceResult;
-	IntersectionContext context(*scene(), sample, primaryRay, intersection, generation);
-	if (context.shader())
-	{
-		const TPoint3D point = primaryRay.point(intersection.t());
-		const TVector3D normal = context.worldNormal();
-		const TVector3D omega = context.worldToBsdf(-primaryRay.direction());
-		LASS_ASSERT(omega.z >= 0);
-		result += transparency * doShadeSurface(sample, primaryRay, context, point, normal, omega, highQuality);
-	}
-	else
+
+/** Intersects the central rays of the packet with the scene in one go, so that the scene can
+ *  cull the packet as a whole. Shading and all secondary rays are done ray by ray.
+ */
+void DirectLighting::doCastRays(
+		const kernel::Sample* samples, const kernel::DifferentialRay* primaryRays, Spectral* radiances,
+		TScalar* tIntersections, TScalar* alphas, size_t count, size_t generation, bool highQuality) const
+{
+	const size_t packetSize = RayPacket::capacity;
+	BoundedRay rays[packetSize];
+	Intersection intersections[packetSize];
+	for (size_t i = 0; i < count; i += packetSize)
 	{
-		// leaving or entering something
-		MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
-		const DifferentialRay continuedRay = bound(primaryRay, intersection.t() + liar::tolerance);
-		result += transparency * this->castRay(sample, continuedRay, tIntersection, alpha, highQuality);
+		const size_t n = std::min(count - i, packetSize);
+		for (size_t k = 0; k < n; ++k)
+		{
+			rays[k] = primaryRays[i + k].centralRay();
+		}
+		scene()->intersectPacket(samples + i, rays, intersections, n);
+		for (size_t k = 0; k < n; ++k)
+		{
+			const size_t j = i + k;
+			if (intersections[k].t() > primaryRays[j].farLimit())
+			{
+				intersections[k] = Intersection::empty();
+			}
+			radiances[j] = shadeIntersection(samples[j], primaryRays[j], intersections[k], tIntersections[j], alphas[j], generation, highQuality);
+		}
 	}
-
-	return result;
 }
 
 
@@ -215,6 +218,45 @@ const Spectral DirectLighting::doShadeSurface(
 
 
 
+const Spectral DirectLighting::shadeIntersection(
+		const kernel::Sample& sample, const kernel::DifferentialRay& primaryRay, const Intersection& intersection,
+		TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const
+{
+	tIntersection = intersection ? intersection.t() : TNumTraits::infinity;
+	alpha = intersection ? 1 : 0;
+
+	const BoundedRay mediumRay = bound(primaryRay.centralRay(), primaryRay.centralRay().nearLimit(), tIntersection);
+	LASS_ENFORCE(!mediumRay.isEmpty());
+	Spectral transparency;
+	Spectral result = doShadeMedium(sample, mediumRay, transparency);
+	if (!transparency || !intersection)
+	{
+		return result;
+	}
+
+	Spectral surfaceResult;
+	IntersectionContext context(*scene(), sample, primaryRay, intersection, generation);
+	if (context.shader())
+	{
+		const TPoint3D point = primaryRay.point(intersection.t());
+		const TVector3D normal = context.worldNormal();
+		const TVector3D omega = context.worldToBsdf(-primaryRay.direction());
+		LASS_ASSERT(omega.z >= 0);
+		result += transparency * doShadeSurface(sample, primaryRay, context, point, normal, omega, highQuality);
+	}
+	else
+	{
+		// leaving or entering something
+		MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
+		const DifferentialRay continuedRay = bound(primaryRay, intersection.t() + liar::tolerance);
+		result += transparency * this->castRay(sample, continuedRay, tIntersection, alpha, highQuality);
+	}
+
+	return result;
+}
+
+
+
 const Spectral DirectLighting::traceDirect(
 		const Sample& sample, const IntersectionContext&, const TBsdfPtr& bsdf,
 		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, bool highQuality) const
@@ -224,7 +266,6 @@ const Spectral DirectLighting::traceDirect(
 		return Spectral(0);
 	}
 
-	Spectral result;
 	if (highQuality)
 	{
 		const LightContexts::TIterator end = lights().end();
@@ -233,7 +274,7 @@ const Spectral DirectLighting::traceDirect(
 			Sample::TSubSequence2D lightSamples = sample.subSequence2D(light->idLightSamples());
 			Sample::TSubSequence2D bsdfSamples = sample.subSequence2D(light->idBsdfSamples());
 			Sample::TSubSequence1D compSamples = sample.subSequence1D(light->idBsdfComponentSamples());
-			result += estimateLightContribution(sample, bsdf, *light, lightSamples, bsdfSamples, compSamples, point, normal, omega);
+			gatherLightContribution(sample, bsdf, *light, lightSamples, bsdfSamples, compSamples, point, normal, omega);
 		}
 	}
 	else
@@ -256,18 +297,17 @@ const Spectral DirectLighting::traceDirect(
 			{
 				continue;
 			}
-			Spectral radiance = RayTracer::estimateLightContribution(
+			gatherLightContribution(
 				sample, bsdf, *light,
 				Sample::TSubSequence2D(lightSamples + k, lightSamples + k + 1),
 				Sample::TSubSequence2D(bsdfSamples + k, bsdfSamples + k + 1),
 				Sample::TSubSequence1D(componentSamples + k, componentSamples + k + 1),
-				point, normal, omega);
-			radiance /= static_cast<Spectral::TValue>(n) * static_cast<Spectral::TValue>(pdf);
-			result += radiance;
+				point, normal, omega, 1 / (static_cast<TScalar>(n) * pdf));
 		}
 	}
 
-	return result;
+	// all shadow rays of this shading point are tested for occlusion in one go.
+	return resolveLightContributions(sample);
 }
 
 
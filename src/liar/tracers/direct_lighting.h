@@ -58,6 +58,8 @@ protected:
 	void doRequestSamples(const TSamplerPtr& sampler) override;
 	void doPreProcess(const kernel::TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads) override;
 	const Spectral doCastRay(const Sample& sample, const DifferentialRay& primaryRay, TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const override;
+	void doCastRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, size_t generation, bool highQuality) const override;
 	const TRayTracerPtr doClone() const override;
 	void doSeed(num::Tuint32 seed) override;
 
@@ -68,6 +70,8 @@ protected:
 	virtual const Spectral doShadeSurface(const kernel::Sample& sample, const DifferentialRay& primaryRay, const IntersectionContext& context,
 		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, bool highQuality) const;
 
+	const Spectral shadeIntersection(const Sample& sample, const DifferentialRay& primaryRay, const Intersection& intersection,
+		TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const;
 	const Spectral traceDirect(const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
 		const TPoint3D& target, const TVector3D& targetNormal, const TVector3D& omegaIn, bool highQuality) const;
 	const Spectral traceSpecularAndGlossy(
@@ -0,0 +1,342 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "tracers_common.h"
+#include "irradiance_cache.h"
+
+#include <algorithm>
+
+namespace liar
+{
+namespace tracers
+{
+
+namespace temp
+{
+	/** records whose plane is more than this fraction of their radius behind the point are not used.
+	 */
+	const TScalar frontTolerance = 0.05_s;
+	const TScalar minError = 1e-6_s;
+
+	/** integral of tan(theta) over sin^2(theta), from 0 to @a sin2.
+	 */
+	TScalar integratedTangent(TScalar sin2)
+	{
+		const TScalar s = num::clamp(sin2, TNumTraits::zero, TNumTraits::one);
+		return num::asin(num::sqrt(s)) - num::sqrt(s * (1 - s));
+	}
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+IrradianceCache::IrradianceCache():
+	items_(nullptr),
+	size_(0),
+	center_(),
+	halfSize_(0),
+	accuracy_(0)
+{
+}
+
+
+
+IrradianceCache::~IrradianceCache()
+{
+	reset();
+}
+
+
+
+void IrradianceCache::reset()
+{
+	root_.reset();
+	Item* item = items_.exchange(nullptr);
+	while (item)
+	{
+		Item* next = item->next;
+		delete item;
+		item = next;
+	}
+	size_ = 0;
+	accuracy_ = 0;
+}
+
+
+
+/** Clears the cache, and prepares it for records within @a bounds.
+ *  An @a accuracy of zero disables the cache.
+ */
+void IrradianceCache::reset(const TAabb3D& bounds, TScalar accuracy)
+{
+	reset();
+	if (accuracy <= 0 || bounds.isEmpty())
+	{
+		return;
+	}
+	const TVector3D size = bounds.size();
+	center_ = bounds.center().affine();
+	halfSize_ = 0.51_s * std::max(size.x, std::max(size.y, size.z)) + liar::tolerance;
+	accuracy_ = accuracy;
+	root_.reset(new Node);
+}
+
+
+
+/** Interpolates the irradiance at @a point from the records around it.
+ *  @return false if there are no records close enough.
+ */
+bool IrradianceCache::interpolate(const TPoint3D& point, const TVector3D& normal, XYZ& irradiance) const
+{
+	const Node* node = root_.get();
+	TPoint3D center = center_;
+	TScalar halfSize = halfSize_;
+
+	const TScalar invAccuracy = num::inv(accuracy_);
+	XYZ sum;
+	TScalar sumWeights = 0;
+	while (node)
+	{
+		for (const Entry* entry = node->entries.load(std::memory_order_acquire); entry; entry = entry->next)
+		{
+			const Record& record = *entry->record;
+			const TVector3D offset = point - record.position;
+			const TScalar cosAngle = dot(normal, record.normal);
+			if (cosAngle <= 0)
+			{
+				continue;
+			}
+			const TScalar error = offset.norm() / record.radius + num::sqrt(std::max(TNumTraits::one - cosAngle, TNumTraits::zero));
+			if (error >= accuracy_)
+			{
+				continue;
+			}
+			if (dot(offset, normal + record.normal) < -2 * temp::frontTolerance * record.radius)
+			{
+				continue; // the record is in front of the point, and may see stuff this one can't.
+			}
+			const TScalar weight = num::inv(std::max(error, temp::minError)) - invAccuracy;
+			const TVector3D axis = cross(record.normal, normal);
+			const XYZ estimate(
+				record.irradiance.x + static_cast<XYZ::TValue>(dot(axis, record.rotationalGradient[0]) + dot(offset, record.translationalGradient[0])),
+				record.irradiance.y + static_cast<XYZ::TValue>(dot(axis, record.rotationalGradient[1]) + dot(offset, record.translationalGradient[1])),
+				record.irradiance.z + static_cast<XYZ::TValue>(dot(axis, record.rotationalGradient[2]) + dot(offset, record.translationalGradient[2])));
+			sum += estimate * static_cast<XYZ::TValue>(weight);
+			sumWeights += weight;
+		}
+
+		halfSize /= 2;
+		size_t index = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			if (point[k] >= center[k])
+			{
+				index |= size_t(1) << k;
+				center[k] += halfSize;
+			}
+			else
+			{
+				center[k] -= halfSize;
+			}
+		}
+		node = node->children[index].load(std::memory_order_acquire);
+	}
+
+	if (sumWeights <= 0)
+	{
+		return false;
+	}
+	irradiance = max(sum / static_cast<XYZ::TValue>(sumWeights), XYZ());
+	return true;
+}
+
+
+
+/** Adds a copy of @a record to the cache.  Can be called by many threads at the same time.
+ */
+void IrradianceCache::add(const Record& record)
+{
+	if (!root_)
+	{
+		return;
+	}
+	Item* item = new Item;
+	item->record = record;
+	push(items_, item);
+	size_.fetch_add(1, std::memory_order_relaxed);
+
+	add(*root_, center_, halfSize_, 0, item->record, accuracy_ * record.radius);
+}
+
+
+
+/** Integrates the irradiance of @a record and its rotational and translational gradients, from the
+ *  radiances and hit distances of a stratified hemisphere of @a numTheta x @a numPhi cells, numTheta
+ *  in sin^2(theta) and numPhi in phi, with cell (j, k) at j * numPhi + k.  The hemisphere is
+ *  around cross(@a tangent, @a bitangent), with phi measured from @a tangent.
+ *
+ *  The gradients follow Ward and Heckbert, except that the cell boundaries are integrated exactly for
+ *  this stratification, instead of being approximated at the cell centers.
+ *
+ *  @par ref: J. Krivanek, P. Gautron, S. Pattanaik, K. Bouatouch. Radiance Caching for Efficient
+ *      Global Illumination Computation (2005)
+ */
+void IrradianceCache::integrate(const XYZ* radiances, const TScalar* distances, size_t numTheta, size_t numPhi,
+		const TVector3D& tangent, const TVector3D& bitangent, Record& record)
+{
+	const TScalar invTheta = num::inv(static_cast<TScalar>(numTheta));
+	const TScalar dPhi = 2 * TNumTraits::pi / static_cast<TScalar>(numPhi);
+	const TScalar cellSolidAngle = TNumTraits::pi * invTheta / static_cast<TScalar>(numPhi);
+
+	XYZ irradiance;
+	for (size_t i = 0; i < numTheta * numPhi; ++i)
+	{
+		irradiance += radiances[i];
+	}
+	record.irradiance = irradiance * static_cast<XYZ::TValue>(cellSolidAngle);
+
+	auto accumulate = [](TVector3D* gradient, const TVector3D& direction, const XYZ& value)
+	{
+		gradient[0] += direction * static_cast<TScalar>(value.x);
+		gradient[1] += direction * static_cast<TScalar>(value.y);
+		gradient[2] += direction * static_cast<TScalar>(value.z);
+	};
+	TVector3D* rotational = record.rotationalGradient;
+	TVector3D* translational = record.translationalGradient;
+	std::fill(rotational, rotational + 3, TVector3D());
+	std::fill(translational, translational + 3, TVector3D());
+	for (size_t k = 0; k < numPhi; ++k)
+	{
+		const TScalar phi = (static_cast<TScalar>(k) + 0.5_s) * dPhi;
+		const TScalar phiMin = static_cast<TScalar>(k) * dPhi;
+		const TVector3D u = tangent * num::cos(phi) + bitangent * num::sin(phi);
+		const TVector3D v = bitangent * num::cos(phi) - tangent * num::sin(phi);
+		const TVector3D vMin = bitangent * num::cos(phiMin) - tangent * num::sin(phiMin);
+		const size_t kPrev = (k + numPhi - 1) % numPhi;
+		for (size_t j = 0; j < numTheta; ++j)
+		{
+			const size_t i = j * numPhi + k;
+			const XYZ& radiance = radiances[i];
+			const TScalar sin2Min = static_cast<TScalar>(j) * invTheta;
+			const TScalar sin2Max = static_cast<TScalar>(j + 1) * invTheta;
+
+			// rotation of the normal changes the cosine of the cells by tan(theta), averaged over the cell.
+			const TScalar tanTheta = (temp::integratedTangent(sin2Max) - temp::integratedTangent(sin2Min)) / invTheta;
+			accumulate(rotational, v * (tanTheta * cellSolidAngle), radiance);
+
+			// translation changes the solid angle of the cells by moving their boundaries.
+			if (j > 0)
+			{
+				const size_t iPrev = i - numPhi;
+				const TScalar r = std::max(std::min(distances[i], distances[iPrev]), liar::tolerance);
+				const TScalar weight = dPhi * num::sqrt(sin2Min) * (1 - sin2Min) / r;
+				accumulate(translational, u * weight, radiance - radiances[iPrev]);
+			}
+			if (numPhi > 1)
+			{
+				const size_t iPrev = j * numPhi + kPrev;
+				const TScalar r = std::max(std::min(distances[i], distances[iPrev]), liar::tolerance);
+				const TScalar weight = (num::sqrt(sin2Max) - num::sqrt(sin2Min)) / r;
+				accumulate(translational, vMin * weight, radiance - radiances[iPrev]);
+			}
+		}
+	}
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+IrradianceCache::Node::~Node()
+{
+	for (std::atomic<Node*>& child : children)
+	{
+		delete child.load();
+	}
+	Entry* entry = entries.load();
+	while (entry)
+	{
+		Entry* next = entry->next;
+		delete entry;
+		entry = next;
+	}
+}
+
+
+
+/** Stores the record in all nodes that overlap its range, at the depth where the nodes become
+ *  about as large as that range.  A lookup that visits all nodes from the root to the point
+ *  will then see each record that can affect that point exactly once.
+ */
+void IrradianceCache::add(Node& node, const TPoint3D& center, TScalar halfSize, size_t depth, const Record& record, TScalar range)
+{
+	if (depth == maxDepth || halfSize <= 2 * range)
+	{
+		Entry* entry = new Entry;
+		entry->record = &record;
+		push(node.entries, entry);
+		return;
+	}
+
+	const TScalar childHalfSize = halfSize / 2;
+	for (size_t index = 0; index < 8; ++index)
+	{
+		TPoint3D childCenter;
+		bool overlaps = true;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const bool isUpper = (index >> k) & 1;
+			childCenter[k] = center[k] + (isUpper ? childHalfSize : -childHalfSize);
+			overlaps &= num::abs(record.position[k] - childCenter[k]) <= childHalfSize + range;
+		}
+		if (overlaps)
+		{
+			add(child(node, index), childCenter, childHalfSize, depth + 1, record, range);
+		}
+	}
+}
+
+
+
+IrradianceCache::Node& IrradianceCache::child(Node& node, size_t index)
+{
+	Node* child = node.children[index].load(std::memory_order_acquire);
+	if (!child)
+	{
+		Node* fresh = new Node;
+		if (node.children[index].compare_exchange_strong(child, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			child = fresh;
+		}
+		else
+		{
+			delete fresh; // another thread was first.
+		}
+	}
+	return *child;
+}
+
+}
+
+}
+
+// EOF
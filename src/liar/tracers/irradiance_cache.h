@@ -0,0 +1,138 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::tracers::IrradianceCache
+ *  @brief octree of irradiance records with gradients, shared by all render threads.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  A record stores the irradiance at a point, together with its rotational and translational
+ *  gradient and the harmonic mean distance to the surrounding geometry.  It's used to estimate
+ *  the irradiance at nearby points where its weight is larger than 1 / accuracy:
+ *
+ *  @f[ w_i(p, n) = \frac{1}{\frac{|p - p_i|}{R_i} + \sqrt{1 - n \cdot n_i}} - \frac{1}{a} @f]
+ *
+ *  Records are added while rendering, by all threads at the same time.  Neither add() nor
+ *  interpolate() ever locks: octree nodes and records are pushed on atomic lists with
+ *  compare-and-swap, and are never removed or changed until reset().  reset() itself must not
+ *  be called while other threads are using the cache.
+ *
+ *  @par ref: G. J. Ward, F. M. Rubinstein, R. D. Clear. A Ray Tracing Solution for Diffuse
+ *      Interreflection (1988)
+ *  @par ref: G. J. Ward, P. S. Heckbert. Irradiance Gradients (1992)
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_TRACERS_IRRADIANCE_CACHE_H
+#define LIAR_GUARDIAN_OF_INCLUSION_TRACERS_IRRADIANCE_CACHE_H
+
+#include "tracers_common.h"
+#include "../kernel/xyz.h"
+
+#include <atomic>
+#include <memory>
+
+namespace liar
+{
+namespace tracers
+{
+
+class LIAR_TRACERS_DLL IrradianceCache: util::NonCopyable
+{
+public:
+
+	struct Record
+	{
+		TPoint3D position;
+		TVector3D normal;
+		XYZ irradiance;
+		TVector3D rotationalGradient[3]; /**< one per XYZ component */
+		TVector3D translationalGradient[3]; /**< one per XYZ component */
+		TScalar radius; /**< harmonic mean distance, clamped */
+	};
+
+	IrradianceCache();
+	~IrradianceCache();
+
+	void reset();
+	void reset(const TAabb3D& bounds, TScalar accuracy);
+
+	bool interpolate(const TPoint3D& point, const TVector3D& normal, XYZ& irradiance) const;
+	void add(const Record& record);
+
+	size_t size() const { return size_.load(std::memory_order_relaxed); }
+	TScalar accuracy() const { return accuracy_; }
+
+	static void integrate(const XYZ* radiances, const TScalar* distances, size_t numTheta, size_t numPhi,
+		const TVector3D& tangent, const TVector3D& bitangent, Record& record);
+
+private:
+
+	enum
+	{
+		maxDepth = 24,
+	};
+
+	struct Item
+	{
+		Record record;
+		Item* next;
+	};
+
+	struct Entry
+	{
+		const Record* record;
+		Entry* next;
+	};
+
+	struct Node
+	{
+		~Node();
+		std::atomic<Node*> children[8] = {};
+		std::atomic<Entry*> entries = nullptr;
+	};
+
+	void add(Node& node, const TPoint3D& center, TScalar halfSize, size_t depth, const Record& record, TScalar range);
+	static Node& child(Node& node, size_t index);
+
+	template <typename T> static void push(std::atomic<T*>& head, T* item)
+	{
+		item->next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	std::unique_ptr<Node> root_;
+	std::atomic<Item*> items_;
+	std::atomic<size_t> size_;
+	TPoint3D center_;
+	TScalar halfSize_;
+	TScalar accuracy_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
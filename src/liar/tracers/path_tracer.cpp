@@ -0,0 +1,326 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "tracers_common.h"
+#include "path_tracer.h"
+
+namespace liar
+{
+namespace tracers
+{
+
+PY_DECLARE_CLASS_DOC(PathTracer, "unidirectional path tracer with next event estimation and Russian roulette")
+PY_CLASS_CONSTRUCTOR_0(PathTracer)
+PY_CLASS_MEMBER_RW_DOC(PathTracer, rouletteDepth, setRouletteDepth, "ray generation from which on paths are terminated by Russian roulette")
+
+
+// --- public --------------------------------------------------------------------------------------
+
+PathTracer::PathTracer():
+	throughput_(1),
+	rouletteDepth_(3)
+{
+}
+
+
+
+size_t PathTracer::rouletteDepth() const
+{
+	return rouletteDepth_;
+}
+
+
+
+void PathTracer::setRouletteDepth(size_t depth)
+{
+	rouletteDepth_ = depth;
+}
+
+
+
+// --- protected -----------------------------------------------------------------------------------
+
+// --- private -------------------------------------------------------------------------------------
+
+void PathTracer::doRequestSamples(const kernel::TSamplerPtr& sampler)
+{
+	requestLightAndSceneSamples(sampler);
+
+	lightChoiceSample_.clear();
+	lightSample_.clear();
+	lightBsdfSample_.clear();
+	lightBsdfComponentSample_.clear();
+	bsdfSample_.clear();
+	bsdfComponentSample_.clear();
+
+	for (size_t k = 0; k < maxRayGeneration(); ++k)
+	{
+		lightChoiceSample_.push_back(sampler->requestSubSequence1D(1));
+		lightSample_.push_back(sampler->requestSubSequence2D(1));
+		lightBsdfSample_.push_back(sampler->requestSubSequence2D(1));
+		lightBsdfComponentSample_.push_back(sampler->requestSubSequence1D(1));
+		bsdfSample_.push_back(sampler->requestSubSequence2D(1));
+		bsdfComponentSample_.push_back(sampler->requestSubSequence1D(1));
+	}
+}
+
+
+
+void PathTracer::doPreProcess(const kernel::TSamplerPtr&, const TimePeriod&, size_t)
+{
+}
+
+
+
+const Spectral PathTracer::doCastRay(
+		const kernel::Sample& sample, const kernel::DifferentialRay& primaryRay,
+		TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const
+{
+	if (generation == 0)
+	{
+		throughput_ = Spectral(1);
+	}
+
+	Intersection intersection;
+	scene()->intersect(sample, primaryRay, intersection);
+	tIntersection = intersection ? intersection.t() : TNumTraits::infinity;
+	alpha = intersection ? 1 : 0;
+
+	const BoundedRay mediumRay = bound(primaryRay.centralRay(), primaryRay.centralRay().nearLimit(), tIntersection);
+	const Spectral transparency = mediumStack().transmittance(sample, mediumRay);
+	Spectral result = mediumStack().emission(sample, mediumRay);
+	if (!transparency || !intersection)
+	{
+		return result;
+	}
+
+	const IntersectionContext context(*scene(), sample, primaryRay, intersection, generation);
+	const Spectral oldThroughput = throughput_;
+	throughput_ *= transparency;
+	if (context.shader())
+	{
+		result += transparency * shadeSurface(sample, primaryRay, context, intersection.t(), generation, highQuality);
+	}
+	else
+	{
+		// leaving or entering something
+		const MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
+		const DifferentialRay continuedRay = bound(primaryRay, intersection.t() + liar::tolerance);
+		result += transparency * this->castRay(sample, continuedRay, tIntersection, alpha, highQuality);
+	}
+	throughput_ = oldThroughput;
+
+	return result;
+}
+
+
+
+const TRayTracerPtr PathTracer::doClone() const
+{
+	TRayTracerPtr::Rebind<PathTracer>::Type result(new PathTracer(*this));
+	result->random_.seed(random_());
+	return result;
+}
+
+
+
+void PathTracer::doSeed(num::Tuint32 seed)
+{
+	std::seed_seq seq { seed };
+	random_.seed(seq);
+}
+
+
+
+const TPyObjectPtr PathTracer::doGetState() const
+{
+	return python::makeTuple(rouletteDepth_);
+}
+
+
+
+void PathTracer::doSetState(const TPyObjectPtr& state)
+{
+	LASS_ENFORCE(python::decodeTuple(state, rouletteDepth_));
+}
+
+
+
+const Spectral PathTracer::shadeSurface(
+		const Sample& sample, const DifferentialRay& ray, const IntersectionContext& context,
+		TScalar t, size_t generation, bool highQuality) const
+{
+	const TPoint3D point = ray.point(t);
+	const TVector3D normal = context.worldNormal();
+	const TVector3D omega = context.worldToBsdf(-ray.direction());
+	LASS_ASSERT(omega.z >= 0);
+
+	Spectral result;
+	if (generation == 0 || !context.object().asLight())
+	{
+		// lights are picked up by estimateDirect, except when they're directly visible.
+		result += context.shader()->emission(sample, context, omega);
+	}
+
+	const TBsdfPtr& bsdf = context.bsdf();
+	if (!bsdf)
+	{
+		return result;
+	}
+
+	result += estimateDirect(sample, bsdf, point, normal, omega, generation, highQuality);
+	result += traceIndirect(sample, context, bsdf, point, normal, omega, generation, highQuality);
+	return result;
+}
+
+
+
+/** Estimates the direct lighting by sampling both lights and BSDF, weighted by MIS.
+ *  In high quality, all lights are sampled with their own sample sets, otherwise one light is picked.
+ */
+const Spectral PathTracer::estimateDirect(
+		const Sample& sample, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, size_t generation, bool highQuality) const
+{
+	Spectral result;
+	if (highQuality)
+	{
+		const LightContexts::TIterator end = lights().end();
+		for (LightContexts::TIterator light = lights().begin(); light != end; ++light)
+		{
+			const Sample::TSubSequence2D lightSamples = sample.subSequence2D(light->idLightSamples());
+			const Sample::TSubSequence2D bsdfSamples = sample.subSequence2D(light->idBsdfSamples());
+			const Sample::TSubSequence1D compSamples = sample.subSequence1D(light->idBsdfComponentSamples());
+			gatherLightContribution(sample, bsdf, *light, lightSamples, bsdfSamples, compSamples, point, normal, omega);
+		}
+		return resolveLightContributions(sample);
+	}
+
+	TScalar pdf;
+	const LightContext* light = lights().sample(sample1D(sample, lightChoiceSample_, generation), pdf);
+	if (!light || pdf <= 0)
+	{
+		return result;
+	}
+	TPoint2D lightSample = sample2D(sample, lightSample_, generation);
+	TPoint2D bsdfSample = sample2D(sample, lightBsdfSample_, generation);
+	TScalar componentSample = sample1D(sample, lightBsdfComponentSample_, generation);
+	result = estimateLightContribution(
+		sample, bsdf, *light,
+		Sample::TSubSequence2D(&lightSample, &lightSample + 1),
+		Sample::TSubSequence2D(&bsdfSample, &bsdfSample + 1),
+		Sample::TSubSequence1D(&componentSample, &componentSample + 1),
+		point, normal, omega);
+	return result / static_cast<Spectral::TValue>(pdf);
+}
+
+
+
+/** Continues the path in a direction sampled from the full BSDF.
+ *  Emission of lights it hits is ignored, since that's already accounted for by estimateDirect.
+ */
+const Spectral PathTracer::traceIndirect(
+		const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, size_t generation, bool highQuality) const
+{
+	if (generation + 1 > maxRayGeneration())
+	{
+		return Spectral();
+	}
+
+	const SampleBsdfOut out = bsdf->sample(omega, sample2D(sample, bsdfSample_, generation), sample1D(sample, bsdfComponentSample_, generation), BsdfCaps::all);
+	if (!out)
+	{
+		return Spectral();
+	}
+	Spectral weight = out.value * static_cast<Spectral::TValue>(num::abs(out.omegaOut.z) / out.pdf);
+
+	if (generation + 1 >= rouletteDepth_)
+	{
+		// play russian roulette to see if we continue.
+		const TScalar survivalPdf = std::min<TScalar>(static_cast<TScalar>((throughput_ * weight).maximum()), 1);
+		TUniformRealDistribution uniform;
+		if (!(uniform(random_) < survivalPdf))
+		{
+			return Spectral();
+		}
+		weight /= static_cast<Spectral::TValue>(survivalPdf);
+	}
+
+	const bool isReflection = out.omegaOut.z > 0;
+	const TPoint3D begin = point + (isReflection ? 10 : -10) * liar::tolerance * normal;
+	// a direction sampled from the full BSDF has no meaningful differentials, so the path continues without.
+	const DifferentialRay ray(BoundedRay(begin, context.bsdfToWorld(out.omegaOut), liar::tolerance));
+
+	const Spectral oldThroughput = throughput_;
+	throughput_ *= weight;
+	TScalar t;
+	TScalar a;
+	Spectral indirect;
+	if (isReflection)
+	{
+		indirect = castRay(sample, ray, t, a, highQuality && hasCaps(out.usedCaps, BsdfCaps::specular));
+	}
+	else
+	{
+		const MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
+		indirect = castRay(sample, ray, t, a, highQuality && hasCaps(out.usedCaps, BsdfCaps::specular));
+	}
+	throughput_ = oldThroughput;
+
+	return weight * indirect;
+}
+
+
+
+Sample::TSample1D PathTracer::sample1D(const Sample& sample, const TSampleIds& ids, size_t generation) const
+{
+	if (generation < ids.size())
+	{
+		return *sample.subSequence1D(ids[generation]);
+	}
+	TUniformRealDistribution uniform;
+	return uniform(random_);
+}
+
+
+
+Sample::TSample2D PathTracer::sample2D(const Sample& sample, const TSampleIds& ids, size_t generation) const
+{
+	if (generation < ids.size())
+	{
+		return *sample.subSequence2D(ids[generation]);
+	}
+	TUniformRealDistribution uniform;
+	return Sample::TSample2D(uniform(random_), uniform(random_));
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+}
+
+}
+
+// EOF
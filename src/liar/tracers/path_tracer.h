@@ -0,0 +1,102 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::tracers::PathTracer
+ *  @brief unidirectional path tracer with next event estimation.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  At every surface vertex, direct lighting is estimated by sampling the lights as well as the
+ *  BSDF, combined with multiple importance sampling, and the path is continued in one direction
+ *  sampled from the full BSDF.  Paths are cut at maxRayGeneration, and from rouletteDepth on,
+ *  Russian roulette terminates them with a probability based on their throughput.
+ *
+ *  Contrary to PhotonMapper, there's no preprocessing at all, so it's well suited for progressive
+ *  rendering.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PATH_TRACER_H
+#define LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PATH_TRACER_H
+
+#include "tracers_common.h"
+#include "../kernel/ray_tracer.h"
+
+namespace liar
+{
+namespace tracers
+{
+
+class LIAR_TRACERS_DLL PathTracer: public RayTracer
+{
+	PY_HEADER(RayTracer)
+public:
+
+	PathTracer();
+
+	size_t rouletteDepth() const;
+	void setRouletteDepth(size_t depth);
+
+private:
+
+	typedef std::conditional_t<sizeof(TScalar) >= 8, std::mt19937_64, std::mt19937> TRandom;
+	typedef UniformRealDistribution<TNumTraits::baseType> TUniformRealDistribution;
+	typedef Sampler::TSubSequenceId TSampleId;
+	typedef std::vector<TSampleId> TSampleIds;
+
+	void doRequestSamples(const TSamplerPtr& sampler) override;
+	void doPreProcess(const kernel::TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads) override;
+	const Spectral doCastRay(const Sample& sample, const DifferentialRay& primaryRay, TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const override;
+	const TRayTracerPtr doClone() const override;
+	void doSeed(num::Tuint32 seed) override;
+
+	const TPyObjectPtr doGetState() const override;
+	void doSetState(const TPyObjectPtr& state) override;
+
+	const Spectral shadeSurface(const Sample& sample, const DifferentialRay& ray, const IntersectionContext& context,
+		TScalar t, size_t generation, bool highQuality) const;
+	const Spectral estimateDirect(const Sample& sample, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, size_t generation, bool highQuality) const;
+	const Spectral traceIndirect(const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega, size_t generation, bool highQuality) const;
+
+	Sample::TSample1D sample1D(const Sample& sample, const TSampleIds& ids, size_t generation) const;
+	Sample::TSample2D sample2D(const Sample& sample, const TSampleIds& ids, size_t generation) const;
+
+	TSampleIds lightChoiceSample_;
+	TSampleIds lightSample_;
+	TSampleIds lightBsdfSample_;
+	TSampleIds lightBsdfComponentSample_;
+	TSampleIds bsdfSample_;
+	TSampleIds bsdfComponentSample_;
+
+	mutable TRandom random_;
+	mutable Spectral throughput_;
+	size_t rouletteDepth_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,152 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @file
+ *  @brief compact encodings of the incident direction and power of photons.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Directions are stored in 2x16 bit octahedral coordinates, powers as three 8-bit mantissas with a
+ *  shared 8-bit exponent, like Ward's RGBE.  Both fit in 32 bits.
+ *
+ *  @par ref: Z. H. Cigolle et al. A Survey of Efficient Representations for Independent Unit Vectors (2014)
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PHOTON_ENCODING_H
+#define LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PHOTON_ENCODING_H
+
+#include "tracers_common.h"
+#include "../kernel/xyz.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace liar
+{
+namespace tracers
+{
+namespace impl
+{
+
+const num::Tuint32 octahedralMax = 0xffff;
+
+inline num::Tuint32 quantizeOctahedral(TScalar x)
+{
+	const TScalar q = num::floor((x + 1) * static_cast<TScalar>(octahedralMax) / 2 + .5f);
+	return static_cast<num::Tuint32>(num::clamp<TScalar>(q, 0, static_cast<TScalar>(octahedralMax)));
+}
+
+inline TScalar dequantizeOctahedral(num::Tuint32 q)
+{
+	return static_cast<TScalar>(q) * 2 / static_cast<TScalar>(octahedralMax) - 1;
+}
+
+/** fold lower hemisphere of octahedron over upper one */
+inline void foldOctahedral(TScalar& u, TScalar& v)
+{
+	const TScalar uu = (1 - num::abs(v)) * (u < 0 ? -TNumTraits::one : TNumTraits::one);
+	v = (1 - num::abs(u)) * (v < 0 ? -TNumTraits::one : TNumTraits::one);
+	u = uu;
+}
+
+}
+
+
+
+inline num::Tuint32 encodePhotonDirection(const TVector3D& omega)
+{
+	const TScalar norm = num::abs(omega.x) + num::abs(omega.y) + num::abs(omega.z);
+	TScalar u = omega.x / norm;
+	TScalar v = omega.y / norm;
+	if (omega.z < 0)
+	{
+		impl::foldOctahedral(u, v);
+	}
+	return impl::quantizeOctahedral(u) | (impl::quantizeOctahedral(v) << 16);
+}
+
+
+
+inline const TVector3D decodePhotonDirection(num::Tuint32 direction)
+{
+	TScalar u = impl::dequantizeOctahedral(direction & impl::octahedralMax);
+	TScalar v = impl::dequantizeOctahedral(direction >> 16);
+	const TScalar w = 1 - num::abs(u) - num::abs(v);
+	if (w < 0)
+	{
+		impl::foldOctahedral(u, v);
+	}
+	return TVector3D(u, v, w).normal();
+}
+
+
+
+/** Mantissas are rounded rather than truncated, so that zero components decode to exactly zero.
+ *  Photon powers are never negative, so negative components are clamped to zero.
+ */
+inline num::Tuint32 encodePhotonPower(const XYZ& power)
+{
+	typedef XYZ::TValue TValue;
+	const TValue maximum = std::max(std::max(power.x, power.y), power.z);
+	if (!(maximum > 0))
+	{
+		return 0;
+	}
+	int exponent;
+	std::frexp(maximum, &exponent);
+	if (exponent <= -128)
+	{
+		return 0;
+	}
+	exponent = std::min(exponent, 127);
+	const TValue scale = std::ldexp(TValue(1), 8 - exponent);
+	auto mantissa = [scale](TValue x) -> num::Tuint32
+	{
+		return static_cast<num::Tuint32>(num::clamp<TValue>(num::floor(x * scale + .5f), 0, 255));
+	};
+	return mantissa(power.x) | (mantissa(power.y) << 8) | (mantissa(power.z) << 16) | (static_cast<num::Tuint32>(exponent + 128) << 24);
+}
+
+
+
+inline const XYZ decodePhotonPower(num::Tuint32 power)
+{
+	typedef XYZ::TValue TValue;
+	const int exponent = static_cast<int>(power >> 24);
+	if (exponent == 0)
+	{
+		return XYZ();
+	}
+	const TValue scale = std::ldexp(TValue(1), exponent - (128 + 8));
+	return XYZ(
+		static_cast<TValue>(power & 0xff) * scale,
+		static_cast<TValue>((power >> 8) & 0xff) * scale,
+		static_cast<TValue>((power >> 16) & 0xff) * scale);
+}
+
+}
+
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,184 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::tracers::BucketKdTree
+ *  @brief a k-nearest-neighbour search structure for photons, scanning its leaves with SIMD.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  spat::KdTree has one object per node, so a search hops through memory from node to node and
+ *  spends most of its time on cache misses and mispredicted branches.  BucketKdTree splits the
+ *  points only down to buckets of about bucketSize points instead, and stores the coordinates of
+ *  each bucket as contiguous x, y and z arrays.  A bucket is then scanned laneCount points at a
+ *  time, and only the points that are closer than the current search radius are inserted in the
+ *  bounded max-heap of the result.
+ *
+ *  The tree is balanced and implicit: all leaves are at the same depth, so the internal nodes are
+ *  an array in heap order and need nothing but a split value and axis.
+ *
+ *  BucketKdTree has the same template arguments and search interface as spat::KdTree, and
+ *  returns the same Neighbour type, so that PhotonMap can switch between both.
+ */
+
+/** @class liar::tracers::PhotonMap
+ *  @brief kNN search structure used by the PhotonMapper, being either a spat::KdTree or a
+ *      BucketKdTree depending on the PhotonMapLayout passed to reset().
+ *  @author Bram de Greve [Bramz]
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PHOTON_MAP_H
+#define LIAR_GUARDIAN_OF_INCLUSION_TRACERS_PHOTON_MAP_H
+
+#include "tracers_common.h"
+#include <lass/spat/kd_tree.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace liar
+{
+namespace tracers
+{
+
+enum PhotonMapLayout
+{
+	pmlKdTree = 0,
+	pmlBuckets,
+	numPhotonMapLayouts
+};
+
+
+
+template <typename ObjectType, typename ObjectTraits>
+class BucketKdTree
+{
+public:
+
+	typedef BucketKdTree<ObjectType, ObjectTraits> TSelf;
+	typedef ObjectType TObjectType;
+	typedef ObjectTraits TObjectTraits;
+
+	typedef typename TObjectTraits::TObjectIterator TObjectIterator;
+	typedef typename TObjectTraits::TPoint TPoint;
+	typedef typename TObjectTraits::TValue TValue;
+	typedef typename TObjectTraits::TParam TParam;
+
+	typedef typename spat::KdTree<ObjectType, ObjectTraits>::Neighbour Neighbour;
+
+	enum
+	{
+		dimension = TObjectTraits::dimension,
+#if LIAR_HAVE_AVX
+		laneCount = 8,
+#else
+		laneCount = 4,
+#endif
+		bucketSize = 4 * laneCount,
+		maxDepth = 32,
+	};
+
+	BucketKdTree();
+
+	void reset();
+	void reset(TObjectIterator first, TObjectIterator last, size_t numberOfThreads = 0);
+
+	template <typename RandomIterator>
+	RandomIterator rangeSearch(const TPoint& target, TParam maxRadius, size_t maxCount, RandomIterator first) const;
+	Neighbour nearestNeighbour(const TPoint& target, TParam maxRadius) const;
+
+	bool isEmpty() const { return size_ == 0; }
+	const TObjectIterator end() const { return end_; }
+
+	void swap(TSelf& other);
+
+private:
+
+	typedef std::uint32_t TIndex;
+	typedef std::vector<float> TCoordinates;
+	typedef std::vector<TIndex> TIndices;
+
+	struct Node
+	{
+		float split;
+		TIndex axis;
+	};
+	typedef std::vector<Node> TNodes;
+
+	class Builder;
+
+	size_t bucketBegin(size_t bucket) const { return (size_ * bucket) >> depth_; }
+
+	TCoordinates coordinates_[3];
+	TIndices indices_;
+	TNodes nodes_;
+	TObjectIterator begin_;
+	TObjectIterator end_;
+	size_t size_;
+	size_t depth_;
+};
+
+
+
+template <typename ObjectType, typename ObjectTraits>
+class PhotonMap
+{
+public:
+
+	typedef PhotonMap<ObjectType, ObjectTraits> TSelf;
+	typedef spat::KdTree<ObjectType, ObjectTraits> TKdTree;
+	typedef BucketKdTree<ObjectType, ObjectTraits> TBucketKdTree;
+
+	typedef typename TKdTree::TObjectIterator TObjectIterator;
+	typedef typename ObjectTraits::TPoint TPoint;
+	typedef typename ObjectTraits::TParam TParam;
+	typedef typename TKdTree::Neighbour Neighbour;
+	typedef std::vector<Neighbour> TNeighbourhood;
+
+	PhotonMap();
+
+	void reset();
+	void reset(TObjectIterator first, TObjectIterator last, PhotonMapLayout layout = pmlKdTree, size_t numberOfThreads = 0);
+
+	template <typename RandomIterator>
+	RandomIterator rangeSearch(const TPoint& target, TParam maxRadius, size_t maxCount, RandomIterator first) const;
+	Neighbour nearestNeighbour(const TPoint& target, TParam maxRadius) const;
+
+	bool isEmpty() const;
+	const TObjectIterator end() const;
+	PhotonMapLayout layout() const { return layout_; }
+
+private:
+
+	TKdTree kdTree_;
+	TBucketKdTree bucketTree_;
+	PhotonMapLayout layout_;
+};
+
+}
+
+}
+
+#include "photon_map.inl"
+
+#endif
+
+// EOF
@@ -0,0 +1,472 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <lass/util/thread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <future>
+#include <limits>
+
+#if LIAR_HAVE_AVX
+#	include <immintrin.h>
+#endif
+
+namespace liar
+{
+namespace tracers
+{
+
+// --- BucketKdTree::Builder -----------------------------------------------------------------------
+
+template <typename O, typename OT>
+class BucketKdTree<O, OT>::Builder
+{
+public:
+
+	enum
+	{
+		minObjectsPerTask = 16 * 1024,
+	};
+
+	Builder(TSelf& tree, size_t numThreads):
+		tree_(tree),
+		numIdleThreads_(static_cast<std::ptrdiff_t>(std::max<size_t>(numThreads, 1)) - 1)
+	{
+	}
+
+	void build(TObjectIterator first)
+	{
+		const size_t size = tree_.size_;
+		positions_.resize(dimension * size);
+		tree_.indices_.resize(size);
+		for (size_t i = 0; i < size; ++i)
+		{
+			const TPoint& p = TObjectTraits::position(first + static_cast<std::ptrdiff_t>(i));
+			for (size_t a = 0; a < dimension; ++a)
+			{
+				positions_[dimension * i + a] = static_cast<float>(p[a]);
+			}
+			tree_.indices_[i] = static_cast<TIndex>(i);
+		}
+
+		tree_.nodes_.resize((size_t(1) << tree_.depth_) - 1);
+		buildNode(0, 0, 0, size_t(1) << tree_.depth_);
+
+		// buckets are padded with laneCount points at infinity, so that the last one can be read in full.
+		const float infinity = std::numeric_limits<float>::infinity();
+		for (size_t a = 0; a < dimension; ++a)
+		{
+			TCoordinates& coordinates = tree_.coordinates_[a];
+			coordinates.resize(size + laneCount, infinity);
+			for (size_t i = 0; i < size; ++i)
+			{
+				coordinates[i] = positions_[dimension * tree_.indices_[i] + a];
+			}
+		}
+	}
+
+private:
+
+	void buildNode(size_t node, size_t level, size_t firstBucket, size_t lastBucket)
+	{
+		if (level == tree_.depth_)
+		{
+			return;
+		}
+
+		const size_t first = tree_.bucketBegin(firstBucket);
+		const size_t last = tree_.bucketBegin(lastBucket);
+		const size_t middleBucket = (firstBucket + lastBucket) / 2;
+		const size_t middle = tree_.bucketBegin(middleBucket);
+		TIndices& indices = tree_.indices_;
+
+		float min[dimension];
+		float max[dimension];
+		std::fill(min, min + dimension, std::numeric_limits<float>::infinity());
+		std::fill(max, max + dimension, -std::numeric_limits<float>::infinity());
+		for (size_t i = first; i < last; ++i)
+		{
+			const float* p = &positions_[dimension * indices[i]];
+			for (size_t a = 0; a < dimension; ++a)
+			{
+				min[a] = std::min(min[a], p[a]);
+				max[a] = std::max(max[a], p[a]);
+			}
+		}
+		size_t axis = 0;
+		for (size_t a = 1; a < dimension; ++a)
+		{
+			if (max[a] - min[a] > max[axis] - min[axis])
+			{
+				axis = a;
+			}
+		}
+
+		Node& n = tree_.nodes_[node];
+		n.axis = static_cast<TIndex>(axis);
+		if (middle < last)
+		{
+			const float* positions = positions_.data();
+			std::nth_element(indices.begin() + static_cast<std::ptrdiff_t>(first),
+				indices.begin() + static_cast<std::ptrdiff_t>(middle),
+				indices.begin() + static_cast<std::ptrdiff_t>(last),
+				[positions, axis](TIndex a, TIndex b) { return positions[dimension * a + axis] < positions[dimension * b + axis]; });
+			n.split = positions_[dimension * indices[middle] + axis];
+		}
+		else
+		{
+			n.split = std::numeric_limits<float>::infinity();
+		}
+
+		if (last - first >= minObjectsPerTask && acquireThread())
+		{
+			std::future<void> left = std::async(std::launch::async, [&]()
+			{
+				buildNode(2 * node + 1, level + 1, firstBucket, middleBucket);
+				releaseThread();
+			});
+			buildNode(2 * node + 2, level + 1, middleBucket, lastBucket);
+			left.get();
+		}
+		else
+		{
+			buildNode(2 * node + 1, level + 1, firstBucket, middleBucket);
+			buildNode(2 * node + 2, level + 1, middleBucket, lastBucket);
+		}
+	}
+
+	bool acquireThread()
+	{
+		if (numIdleThreads_.fetch_sub(1) > 0)
+		{
+			return true;
+		}
+		numIdleThreads_.fetch_add(1);
+		return false;
+	}
+
+	void releaseThread()
+	{
+		numIdleThreads_.fetch_add(1);
+	}
+
+	TSelf& tree_;
+	TCoordinates positions_;
+	std::atomic<std::ptrdiff_t> numIdleThreads_;
+};
+
+
+
+// --- BucketKdTree: public ------------------------------------------------------------------------
+
+template <typename O, typename OT>
+BucketKdTree<O, OT>::BucketKdTree():
+	begin_(),
+	end_(),
+	size_(0),
+	depth_(0)
+{
+	static_assert(dimension == 3, "BucketKdTree only supports three dimensional points");
+}
+
+
+
+template <typename O, typename OT>
+void BucketKdTree<O, OT>::reset()
+{
+	TSelf temp;
+	swap(temp);
+}
+
+
+
+template <typename O, typename OT>
+void BucketKdTree<O, OT>::reset(TObjectIterator first, TObjectIterator last, size_t numberOfThreads)
+{
+	TSelf temp;
+	temp.begin_ = first;
+	temp.end_ = last;
+	temp.size_ = static_cast<size_t>(last - first);
+	LASS_ENFORCE(temp.size_ <= std::numeric_limits<TIndex>::max());
+	while (temp.depth_ < maxDepth - 1 && ((temp.size_ + (size_t(1) << temp.depth_) - 1) >> temp.depth_) > bucketSize)
+	{
+		++temp.depth_;
+	}
+
+	if (numberOfThreads == 0)
+	{
+		numberOfThreads = util::numberOfAvailableProcessors();
+	}
+	Builder builder(temp, numberOfThreads);
+	builder.build(first);
+
+	swap(temp);
+}
+
+
+
+/** Finds up to maxCount objects within maxRadius of target, and stores them as a max-heap in
+ *  [first, last), like spat::KdTree::rangeSearch does.  The farthest one is at the front.
+ *
+ *  The output range needs room for maxCount + 1 neighbours, for compatibility with
+ *  spat::KdTree, though only maxCount are used.
+ */
+template <typename O, typename OT>
+template <typename RandomIterator>
+RandomIterator BucketKdTree<O, OT>::rangeSearch(const TPoint& target, TParam maxRadius, size_t maxCount, RandomIterator first) const
+{
+	if (isEmpty() || maxCount == 0)
+	{
+		return first;
+	}
+
+	const float t[dimension] = { static_cast<float>(target[0]), static_cast<float>(target[1]), static_cast<float>(target[2]) };
+	float maxSqr = std::min(num::sqr(static_cast<float>(maxRadius)), std::numeric_limits<float>::max());
+	size_t count = 0;
+
+	const float* xs = coordinates_[0].data();
+	const float* ys = coordinates_[1].data();
+	const float* zs = coordinates_[2].data();
+#if LIAR_HAVE_AVX
+	const __m256 tx = _mm256_set1_ps(t[0]);
+	const __m256 ty = _mm256_set1_ps(t[1]);
+	const __m256 tz = _mm256_set1_ps(t[2]);
+#endif
+
+	struct StackEntry
+	{
+		size_t node;
+		float squaredDistance;
+	};
+	StackEntry stack[maxDepth];
+	size_t stackSize = 0;
+
+	const size_t numInternalNodes = nodes_.size();
+	size_t node = 0;
+	float nodeSqr = 0;
+	while (true)
+	{
+		if (nodeSqr < maxSqr)
+		{
+			while (node < numInternalNodes)
+			{
+				const Node& n = nodes_[node];
+				const float d = t[n.axis] - n.split;
+				const size_t left = 2 * node + 1;
+				const float sqr = d * d;
+				if (sqr < maxSqr)
+				{
+					stack[stackSize].node = d < 0 ? left + 1 : left;
+					stack[stackSize].squaredDistance = sqr;
+					++stackSize;
+				}
+				node = d < 0 ? left : left + 1;
+			}
+
+			const size_t bucket = node - numInternalNodes;
+			const size_t begin = bucketBegin(bucket);
+			const size_t end = bucketBegin(bucket + 1);
+			for (size_t i = begin; i < end; i += laneCount)
+			{
+				alignas(32) float sqrs[laneCount];
+#if LIAR_HAVE_AVX
+				const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), tx);
+				const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), ty);
+				const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), tz);
+				const __m256 sqr = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				_mm256_store_ps(sqrs, sqr);
+				unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(sqr, _mm256_set1_ps(maxSqr), _CMP_LT_OQ)));
+#else
+				unsigned mask = 0;
+				for (size_t k = 0; k < laneCount; ++k)
+				{
+					const float dx = xs[i + k] - t[0];
+					const float dy = ys[i + k] - t[1];
+					const float dz = zs[i + k] - t[2];
+					sqrs[k] = dx * dx + dy * dy + dz * dz;
+					mask |= static_cast<unsigned>(sqrs[k] < maxSqr) << k;
+				}
+#endif
+				if (end - i < static_cast<size_t>(laneCount))
+				{
+					mask &= (1u << (end - i)) - 1;
+				}
+				while (mask)
+				{
+					const int lane = std::countr_zero(mask);
+					mask &= mask - 1;
+					const float sqr = sqrs[lane];
+					if (sqr >= maxSqr)
+					{
+						continue; // maxSqr has shrunk since the mask was made.
+					}
+					const Neighbour neighbour(begin_ + static_cast<std::ptrdiff_t>(indices_[i + static_cast<size_t>(lane)]), static_cast<TValue>(sqr));
+					if (count < maxCount)
+					{
+						first[static_cast<std::ptrdiff_t>(count++)] = neighbour;
+						std::push_heap(first, first + static_cast<std::ptrdiff_t>(count));
+					}
+					else
+					{
+						const RandomIterator last = first + static_cast<std::ptrdiff_t>(count);
+						std::pop_heap(first, last);
+						*(last - 1) = neighbour;
+						std::push_heap(first, last);
+					}
+					if (count == maxCount)
+					{
+						maxSqr = static_cast<float>(first->squaredDistance());
+					}
+				}
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			break;
+		}
+		--stackSize;
+		node = stack[stackSize].node;
+		nodeSqr = stack[stackSize].squaredDistance;
+	}
+
+	return first + static_cast<std::ptrdiff_t>(count);
+}
+
+
+
+template <typename O, typename OT>
+typename BucketKdTree<O, OT>::Neighbour
+BucketKdTree<O, OT>::nearestNeighbour(const TPoint& target, TParam maxRadius) const
+{
+	Neighbour result[2];
+	if (rangeSearch(target, maxRadius, 1, result) == result)
+	{
+		return Neighbour(end_, std::numeric_limits<TValue>::infinity());
+	}
+	return result[0];
+}
+
+
+
+template <typename O, typename OT>
+void BucketKdTree<O, OT>::swap(TSelf& other)
+{
+	for (size_t a = 0; a < dimension; ++a)
+	{
+		coordinates_[a].swap(other.coordinates_[a]);
+	}
+	indices_.swap(other.indices_);
+	nodes_.swap(other.nodes_);
+	std::swap(begin_, other.begin_);
+	std::swap(end_, other.end_);
+	std::swap(size_, other.size_);
+	std::swap(depth_, other.depth_);
+}
+
+
+
+// --- PhotonMap: public ---------------------------------------------------------------------------
+
+template <typename O, typename OT>
+PhotonMap<O, OT>::PhotonMap():
+	layout_(pmlKdTree)
+{
+}
+
+
+
+template <typename O, typename OT>
+void PhotonMap<O, OT>::reset()
+{
+	kdTree_.reset();
+	bucketTree_.reset();
+	layout_ = pmlKdTree;
+}
+
+
+
+template <typename O, typename OT>
+void PhotonMap<O, OT>::reset(TObjectIterator first, TObjectIterator last, PhotonMapLayout layout, size_t numberOfThreads)
+{
+	reset();
+	layout_ = layout;
+	switch (layout_)
+	{
+	case pmlKdTree:
+		kdTree_.reset(first, last);
+		break;
+	case pmlBuckets:
+		bucketTree_.reset(first, last, numberOfThreads);
+		break;
+	default:
+		LASS_THROW("invalid photon map layout: " << layout);
+	}
+}
+
+
+
+template <typename O, typename OT>
+template <typename RandomIterator>
+RandomIterator PhotonMap<O, OT>::rangeSearch(const TPoint& target, TParam maxRadius, size_t maxCount, RandomIterator first) const
+{
+	return layout_ == pmlBuckets
+		? bucketTree_.rangeSearch(target, maxRadius, maxCount, first)
+		: kdTree_.rangeSearch(target, maxRadius, maxCount, first);
+}
+
+
+
+template <typename O, typename OT>
+typename PhotonMap<O, OT>::Neighbour
+PhotonMap<O, OT>::nearestNeighbour(const TPoint& target, TParam maxRadius) const
+{
+	return layout_ == pmlBuckets
+		? bucketTree_.nearestNeighbour(target, maxRadius)
+		: kdTree_.nearestNeighbour(target, maxRadius);
+}
+
+
+
+template <typename O, typename OT>
+bool PhotonMap<O, OT>::isEmpty() const
+{
+	return layout_ == pmlBuckets ? bucketTree_.isEmpty() : kdTree_.isEmpty();
+}
+
+
+
+template <typename O, typename OT>
+const typename PhotonMap<O, OT>::TObjectIterator
+PhotonMap<O, OT>::end() const
+{
+	return layout_ == pmlBuckets ? bucketTree_.end() : kdTree_.end();
+}
+
+}
+
+}
+
+// EOF
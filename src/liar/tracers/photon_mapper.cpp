@@ -35,6 +35,8 @@
 #include <lass/util/callback_0.h>
 #include <lass/util/thread_fun.h>
 #include <lass/util/thread_pool.h>
+#include <atomic>
+#include <mutex>
 
 #define EVAL(x) LASS_COUT << LASS_STRINGIFY(x) << ": " << (x) << std::endl
 
@@ -91,9 +93,32 @@ PY_CLASS_MEMBER_RW_DOC(PhotonMapper, isRayTracingDirect, setRayTracingDirect,
 PY_CLASS_MEMBER_RW_DOC(PhotonMapper, isScatteringDirect, setScatteringDirect,
 	"if True and isRayTracingDirect, single scattering is performed in the direct lighting step.\n"
 	"Otherwise, all scattering is estimated using the volumetric photon map.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, photonsPerPass, setPhotonsPerPass,
+	"if > 0, photon mapping is done progressively: each render pass emits photonsPerPass photons "
+	"in fresh photon maps, and estimates with a smaller radius than the previous pass. "
+	"Memory use stays constant while the render converges, as long as it's rendered in passes "
+	"(by a progressive sampler).\n"
+	"if 0, the photon maps are filled once, using globalMapSize and maxNumberOfPhotons.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, radiusReduction, setRadiusReduction,
+	"Value between 0 and 1: the fraction of photons kept in the estimation area from one progressive pass to the next. "
+	"Smaller values shrink the estimation radius faster.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, photonMapLayout, setPhotonMapLayout,
+	"search structure of the photon maps: 'kdtree' (default) has one photon per node, "
+	"'buckets' stores the photons in small buckets that are scanned with SIMD, which is faster for large maps.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, irradianceCacheAccuracy, setIrradianceCacheAccuracy,
+	"if > 0, the final gather is done only at a sparse set of points, and the indirect diffuse lighting is "
+	"interpolated from those elsewhere.  Smaller values give more accurate results but more final gathers, "
+	"0.1 to 0.2 are typical values.\n"
+	"if 0, the final gather is done at every shading point.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, irradianceCacheMinSpacing, setIrradianceCacheMinSpacing,
+	"lower bound of the irradiance cache records radii, in scene units.  Prevents the records to pile up in corners.\n")
+PY_CLASS_MEMBER_RW_DOC(PhotonMapper, irradianceCacheMaxSpacing, setIrradianceCacheMaxSpacing,
+	"upper bound of the irradiance cache records radii, in scene units.\n")
 
 PhotonMapper::TMapTypeDictionary PhotonMapper::mapTypeDictionary_ =
 	PhotonMapper::generateMapTypeDictionary();
+PhotonMapper::TPhotonMapLayoutDictionary PhotonMapper::photonMapLayoutDictionary_ =
+	PhotonMapper::generatePhotonMapLayoutDictionary();
 
 
 // --- public --------------------------------------------------------------------------------------
@@ -116,6 +141,14 @@ PhotonMapper::PhotonMapper():
 	isRayTracingDirect_(true),
 	isScatteringDirect_(true),
 	idLightSelector_(-1),
+	photonsPerPass_(0),
+	radiusReduction_(2.f / 3),
+	passReduction_(1),
+	nextPass_(0),
+	photonMapLayout_(pmlKdTree),
+	irradianceCacheAccuracy_(0),
+	irradianceCacheMinSpacing_(0),
+	irradianceCacheMaxSpacing_(TNumTraits::infinity),
 	photonNeighbourhood_(1)
 {
 	for (int i = 0; i < numMapTypes; ++i)
@@ -348,6 +381,90 @@ void PhotonMapper::setPhotonSampler(const TSamplerProgressivePtr& photonSampler)
 }
 
 
+
+size_t PhotonMapper::photonsPerPass() const
+{
+	return photonsPerPass_;
+}
+
+
+
+void PhotonMapper::setPhotonsPerPass(size_t photonsPerPass)
+{
+	photonsPerPass_ = photonsPerPass;
+}
+
+
+
+TScalar PhotonMapper::radiusReduction() const
+{
+	return radiusReduction_;
+}
+
+
+
+void PhotonMapper::setRadiusReduction(TScalar alpha)
+{
+	radiusReduction_ = num::clamp(alpha, TNumTraits::zero, TNumTraits::one);
+}
+
+
+
+const std::string PhotonMapper::photonMapLayout() const
+{
+	return photonMapLayoutDictionary_.key(photonMapLayout_);
+}
+
+
+
+void PhotonMapper::setPhotonMapLayout(const std::string& layout)
+{
+	photonMapLayout_ = photonMapLayoutDictionary_[stde::tolower(layout)];
+}
+
+
+
+TScalar PhotonMapper::irradianceCacheAccuracy() const
+{
+	return irradianceCacheAccuracy_;
+}
+
+
+
+void PhotonMapper::setIrradianceCacheAccuracy(TScalar accuracy)
+{
+	irradianceCacheAccuracy_ = std::max(accuracy, TNumTraits::zero);
+}
+
+
+
+TScalar PhotonMapper::irradianceCacheMinSpacing() const
+{
+	return irradianceCacheMinSpacing_;
+}
+
+
+
+void PhotonMapper::setIrradianceCacheMinSpacing(TScalar spacing)
+{
+	irradianceCacheMinSpacing_ = std::max(spacing, TNumTraits::zero);
+}
+
+
+
+TScalar PhotonMapper::irradianceCacheMaxSpacing() const
+{
+	return irradianceCacheMaxSpacing_;
+}
+
+
+
+void PhotonMapper::setIrradianceCacheMaxSpacing(TScalar spacing)
+{
+	irradianceCacheMaxSpacing_ = std::max(spacing, TNumTraits::zero);
+}
+
+
 // --- protected -----------------------------------------------------------------------------------
 
 // --- private -------------------------------------------------------------------------------------
@@ -378,15 +495,68 @@ void PhotonMapper::doPreProcess(const kernel::TSamplerPtr& sampler, const TimePe
 	}
 
 	photonSampler_->seed(0);
+	nextPass_ = 0;
 
-	const size_t photonsShot = fillPhotonMaps(photonSampler_, period);
-	const TScalar powerScale = num::inv(static_cast<TScalar>(photonsShot));
-	buildPhotonMap(mtGlobal, shared_->globalBuffer_, shared_->globalMap_, powerScale);
-	buildIrradianceMap(numberOfThreads);
-	buildPhotonMap(mtCaustics, shared_->causticsBuffer_, shared_->causticsMap_, powerScale);
-	TPreliminaryVolumetricPhotonMap preliminaryVolumetricMap;
-	buildPhotonMap(mtVolume, shared_->volumetricBuffer_, preliminaryVolumetricMap, powerScale);
-	buildVolumetricPhotonMap(preliminaryVolumetricMap, numberOfThreads);
+	if (isProgressive())
+	{
+		// photon maps are built at the beginning of each pass.
+		return;
+	}
+
+	passReduction_ = 1;
+	buildPhotonMaps(period, numberOfThreads);
+}
+
+
+
+/** In progressive mode, each pass gets fresh photon maps and a smaller estimation radius than the previous one.
+ *  The photons of the previous pass are discarded, so memory use stays constant.
+ *
+ *  Instead of keeping flux and radius per pixel, each pass is an independent estimate with a global radius that
+ *  shrinks as @f$r_{i+1}^2 = r_i^2 (i + \alpha) / (i + 1)@f$.  Averaging the passes, as the render target does,
+ *  converges to the same result.
+ *
+ *  @par ref: C. Knaus, M. Zwicker. Progressive Photon Mapping: A Probabilistic Approach (2011)
+ */
+void PhotonMapper::doBeginPass(const kernel::TSamplerPtr&, const TimePeriod& period, size_t pass, size_t numberOfThreads)
+{
+	if (!isProgressive() || lights().size() == 0)
+	{
+		return;
+	}
+
+	if (pass > nextPass_)
+	{
+		// resuming from a checkpoint: skip the photons of the passes already rendered, so they're not used twice.
+		const size_t samplesPerTask = std::max<size_t>(photonSampler_->samplesPerTask(), 1);
+		const size_t tasksPerPass = (photonsPerPass_ + samplesPerTask - 1) / samplesPerTask;
+		for (size_t k = (pass - nextPass_) * tasksPerPass; k > 0; --k)
+		{
+			photonSampler_->getTask();
+		}
+	}
+	nextPass_ = pass + 1;
+
+	passReduction_ = 1;
+	for (size_t i = 1; i <= pass; ++i)
+	{
+		passReduction_ *= (static_cast<TScalar>(i) + radiusReduction_) / static_cast<TScalar>(i + 1);
+	}
+
+	shared_->globalBuffer_.clear();
+	shared_->irradianceBuffer_.clear();
+	shared_->causticsBuffer_.clear();
+	shared_->volumetricBuffer_.clear();
+
+	LASS_COUT << "photon pass " << pass << std::endl;
+	buildPhotonMaps(period, numberOfThreads);
+}
+
+
+
+bool PhotonMapper::doHasPasses() const
+{
+	return isProgressive();
 }
 
 
@@ -408,7 +578,8 @@ const TPyObjectPtr PhotonMapper::doGetState() const
 		maxNumberOfPhotons_, globalMapSize_, causticsQuality_,
 		numFinalGatherRays_, ratioPrecomputedIrradiance_, isVisualizingPhotonMap_,
 		isRayTracingDirect_, isScatteringDirect_, radius, tolerance, size,
-		photonSampler_);
+		photonSampler_, photonsPerPass_, radiusReduction_, photonMapLayout(),
+		irradianceCacheAccuracy_, irradianceCacheMinSpacing_, irradianceCacheMaxSpacing_);
 }
 
 
@@ -419,11 +590,15 @@ void PhotonMapper::doSetState(const TPyObjectPtr& state)
 	std::vector<TScalar> radius;
 	std::vector<TScalar> tolerance;
 	std::vector<size_t> size;
+	std::string layout;
 
 	python::decodeTuple(state, directLighting, maxNumberOfPhotons_, globalMapSize_, causticsQuality_,
 		numFinalGatherRays_, ratioPrecomputedIrradiance_, isVisualizingPhotonMap_,
 		isRayTracingDirect_, isScatteringDirect_, radius, tolerance, size,
-		photonSampler_);
+		photonSampler_, photonsPerPass_, radiusReduction_, layout,
+		irradianceCacheAccuracy_, irradianceCacheMinSpacing_, irradianceCacheMaxSpacing_);
+
+	setPhotonMapLayout(layout);
 
 	DirectLighting::doSetState(directLighting);
 
@@ -495,8 +670,16 @@ const Spectral PhotonMapper::doShadeSurface(
 			Sample::TSubSequence2D gatherSample = sample.subSequence2D(idFinalGatherSamples_);
 			Sample::TSubSequence1D componentSample = sample.subSequence1D(idFinalGatherComponentSamples_);
 			Sample::TSubSequence1D volumetricGatherSample = sample.subSequence1D(idFinalVolumetricGatherSamples_);
-			result += gatherIndirect(sample, context, bsdf, point + 10 * liar::tolerance * normal, omega,
-				gatherSample.begin(), gatherSample.end(), componentSample.begin(), volumetricGatherSample.begin());
+			if (hasIrradianceCache())
+			{
+				result += gatherCachedIndirect(sample, context, bsdf, point, normal, omega,
+					gatherSample.begin(), gatherSample.end(), volumetricGatherSample.begin());
+			}
+			else
+			{
+				result += gatherIndirect(sample, context, bsdf, point + 10 * liar::tolerance * normal, omega,
+					gatherSample.begin(), gatherSample.end(), componentSample.begin(), volumetricGatherSample.begin());
+			}
 		}
 		else
 		{
@@ -570,53 +753,189 @@ namespace experimental
 }
 
 
-size_t PhotonMapper::fillPhotonMaps(const TSamplerProgressivePtr& sampler, const TimePeriod& period)
+void PhotonMapper::buildPhotonMaps(const TimePeriod& period, size_t numberOfThreads)
 {
-	TRandomPrimary rng;
-	TPhotonBuffer& globalBuffer = shared_->globalBuffer_;
+	const size_t photonsShot = fillPhotonMaps(photonSampler_, period, numberOfThreads);
+	const TScalar powerScale = num::inv(static_cast<TScalar>(photonsShot));
+	buildPhotonMap(mtGlobal, shared_->globalBuffer_, shared_->globalMap_, powerScale, numberOfThreads);
+	buildIrradianceMap(numberOfThreads);
+	buildPhotonMap(mtCaustics, shared_->causticsBuffer_, shared_->causticsMap_, powerScale, numberOfThreads);
+	TPreliminaryVolumetricPhotonMap preliminaryVolumetricMap;
+	buildPhotonMap(mtVolume, shared_->volumetricBuffer_, preliminaryVolumetricMap, powerScale, numberOfThreads);
+	buildVolumetricPhotonMap(preliminaryVolumetricMap, numberOfThreads);
 
-	util::ProgressIndicator progress("filling photon map with " + util::stringCast<std::string>(globalMapSize_) + " photons");
+	// the cached irradiance depends on the photon maps, so it's thrown away with them.
+	shared_->irradianceCache_.reset(scene()->motionBoundingBox(period), hasFinalGather() ? irradianceCacheAccuracy_ : 0);
+}
 
-	Sampler::TTaskPtr task = sampler->getTask();
-	Sample sample;
 
-	size_t photonsShot = 0;
-	while (globalBuffer.size() < globalMapSize_)
+
+/** Emit photons until the global photon map is filled, or until maxNumberOfPhotons are emitted.
+ *  In progressive mode, exactly photonsPerPass photons are emitted instead.
+ *
+ *  Photons are traced by @a numberOfThreads workers, each on its own clone of the photon mapper
+ *  so that the medium stack and light contexts are not shared.  Each sampler task is traced as
+ *  a whole into its own buffers, with a random generator seeded by the task id.  Afterwards,
+ *  the tasks are merged in order of their id, up to the first one that fills the global map.
+ *  As tasks are drawn in order, this makes the photon maps independent of the number of threads.
+ */
+size_t PhotonMapper::fillPhotonMaps(const TSamplerProgressivePtr& sampler, const TimePeriod& period, size_t numberOfThreads)
+{
+	struct TaskPhotons
 	{
-		if (photonsShot >= maxNumberOfPhotons_)
-		{
-			LASS_CERR << "PhotonMapper: maximum number of " << maxNumberOfPhotons_
-				<< " photons emited before global photon map was sufficiently filled. "
-				<< "Only " << globalBuffer.size() << " of the requested "
-				<< globalMapSize_ << " photons have reached the global photon map. "
-				<< "Will continue with smaller map\n";
-			break;
-		}
+		size_t id;
+		size_t photonsShot;
+		PhotonBuffers buffers;
+	};
+	typedef std::vector<TaskPhotons> TTaskPhotons;
+
+	if (numberOfThreads == 0)
+	{
+		numberOfThreads = std::max<size_t>(util::numberOfAvailableProcessors(), 1);
+	}
+	const size_t samplesPerTask = std::max<size_t>(sampler->samplesPerTask(), 1);
+	const size_t globalMapSize = isProgressive() ? num::NumTraits<size_t>::max : globalMapSize_;
+	const size_t maxNumberOfPhotons = isProgressive() ? photonsPerPass_ : maxNumberOfPhotons_;
+
+	util::ProgressIndicator progress(isProgressive()
+		? "emitting " + util::stringCast<std::string>(maxNumberOfPhotons) + " photons"
+		: "filling photon map with " + util::stringCast<std::string>(globalMapSize) + " photons");
+
+	std::vector<TTaskPhotons> threadPhotons(numberOfThreads);
+	std::mutex samplerMutex;
+	size_t photonsDrawn = 0;
+	std::atomic<size_t> globalPhotons(0);
+	std::atomic<size_t> photonsTraced(0);
+	std::atomic<bool> isDone(false);
+	std::mutex errorMutex;
+	std::exception_ptr error;
+
+	// the calling thread can use this photon mapper, the others need their own clone.  Cloning copies
+	// reference counted members, so the clones are made and released by the calling thread only.
+	std::vector<TRayTracerPtr> clones(numberOfThreads);
+	for (size_t k = 1; k < numberOfThreads; ++k)
+	{
+		clones[k] = clone();
+	}
 
-		if (!task->drawSample(*sampler, period, sample))
+	auto work = [&](size_t k)
+	{
+		try
 		{
-			task = sampler->getTask();
-			if (!task)
+			PhotonMapper& tracer = k > 0 ? static_cast<PhotonMapper&>(*clones[k]) : *this;
+			TTaskPhotons& taskPhotons = threadPhotons[k];
+			Sample sample;
+
+			while (!isDone)
 			{
-				break;
+				Sampler::TTaskPtr task;
+				{
+					std::lock_guard<std::mutex> lock(samplerMutex);
+					if (isDone || photonsDrawn >= maxNumberOfPhotons)
+					{
+						break;
+					}
+					task = sampler->getTask();
+					photonsDrawn += samplesPerTask;
+				}
+				if (!task)
+				{
+					break;
+				}
+
+				taskPhotons.push_back(TaskPhotons{ task->id(), 0, PhotonBuffers() });
+				TaskPhotons& photons = taskPhotons.back();
+				TRandomPrimary rng(static_cast<TRandomPrimary::result_type>(task->id()));
+				while (task->drawSample(*sampler, period, sample))
+				{
+					TScalar pdf;
+					const LightContext* const light = tracer.lights().sample(*sample.subSequence1D(idLightSelector_), pdf);
+					if (light && pdf > 0)
+					{
+						const TRandomSecondary::result_type secondarySeed = rng();
+						tracer.emitPhoton(*light, pdf, sample, secondarySeed, photons.buffers);
+					}
+					++photons.photonsShot;
+				}
+
+				const size_t n = globalPhotons += photons.buffers.global.size();
+				const size_t m = photonsTraced += photons.photonsShot;
+				if (n >= globalMapSize)
+				{
+					isDone = true;
+				}
+				if (k == 0)
+				{
+					progress(std::min(1., std::max(
+						static_cast<double>(n) / static_cast<double>(globalMapSize),
+						static_cast<double>(m) / static_cast<double>(maxNumberOfPhotons))));
+				}
 			}
-			if (!task->drawSample(*sampler, period, sample))
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
 			{
-				break;
+				error = std::current_exception();
 			}
+			isDone = true;
 		}
+	};
 
-		TScalar pdf;
-		const LightContext* const light = lights().sample(*sample.subSequence1D(idLightSelector_), pdf);
-		if (light && pdf > 0)
+	// the calling thread is worker 0, so we only need to spawn the others.
+	std::vector<std::unique_ptr<util::Thread>> threads;
+	for (size_t k = 1; k < numberOfThreads; ++k)
+	{
+		threads.emplace_back(util::threadFun([&work, k]() { work(k); }, util::threadJoinable));
+		threads.back()->run();
+	}
+	work(0);
+	for (auto& thread : threads)
+	{
+		thread->join();
+	}
+	clones.clear();
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+
+	std::vector<TaskPhotons*> tasks;
+	for (TTaskPhotons& taskPhotons : threadPhotons)
+	{
+		for (TaskPhotons& photons : taskPhotons)
 		{
-			const TRandomSecondary::result_type secondarySeed = rng();
-			emitPhoton(*light, pdf, sample, secondarySeed);
+			tasks.push_back(&photons);
 		}
+	}
+	std::sort(tasks.begin(), tasks.end(), [](const TaskPhotons* a, const TaskPhotons* b) { return a->id < b->id; });
 
-		progress(std::min(1., static_cast<double>(globalBuffer.size()) / static_cast<double>(globalMapSize_)));
+	TPhotonBuffer& globalBuffer = shared_->globalBuffer_;
+	size_t photonsShot = 0;
+	for (TaskPhotons* photons : tasks)
+	{
+		if (globalBuffer.size() >= globalMapSize || photonsShot >= maxNumberOfPhotons)
+		{
+			break;
+		}
+		const PhotonBuffers& buffers = photons->buffers;
+		globalBuffer.insert(globalBuffer.end(), buffers.global.begin(), buffers.global.end());
+		shared_->irradianceBuffer_.insert(shared_->irradianceBuffer_.end(), buffers.irradiance.begin(), buffers.irradiance.end());
+		shared_->causticsBuffer_.insert(shared_->causticsBuffer_.end(), buffers.caustics.begin(), buffers.caustics.end());
+		shared_->volumetricBuffer_.insert(shared_->volumetricBuffer_.end(), buffers.volumetric.begin(), buffers.volumetric.end());
+		photonsShot += photons->photonsShot;
+	}
+	progress(1.);
 
-		++photonsShot;
+	if (!isProgressive() && globalBuffer.size() < globalMapSize_ && photonsShot >= maxNumberOfPhotons_)
+	{
+		LASS_CERR << "PhotonMapper: maximum number of " << maxNumberOfPhotons_
+			<< " photons emited before global photon map was sufficiently filled. "
+			<< "Only " << globalBuffer.size() << " of the requested "
+			<< globalMapSize_ << " photons have reached the global photon map. "
+			<< "Will continue with smaller map\n";
 	}
 
 	LASS_COUT << "  total number of emitted photons: " << photonsShot << std::endl;
@@ -627,7 +946,7 @@ size_t PhotonMapper::fillPhotonMaps(const TSamplerProgressivePtr& sampler, const
 
 void PhotonMapper::emitPhoton(
 		const LightContext& light, TScalar lightPdf, const Sample& sample,
-		TRandomSecondary::result_type secondarySeed)
+		TRandomSecondary::result_type secondarySeed, PhotonBuffers& buffers)
 {
 	TRandomPhoton rng(secondarySeed);
 
@@ -642,7 +961,7 @@ void PhotonMapper::emitPhoton(
 	if (pdf > 0 && spectrum)
 	{
 		spectrum /= static_cast<Spectral::TValue>(lightPdf * pdf);
-		tracePhoton(sample, spectrum, ray, 0, rng);
+		tracePhoton(sample, spectrum, ray, 0, rng, buffers);
 	}
 }
 
@@ -650,7 +969,7 @@ void PhotonMapper::emitPhoton(
 
 void PhotonMapper::tracePhoton(
 		const Sample& sample, const Spectral& power, const BoundedRay& ray,
-		size_t generation, TRandomPhoton& rng, bool isCaustic)
+		size_t generation, TRandomPhoton& rng, PhotonBuffers& buffers, bool isCaustic)
 {
 	if (!power)
 	{
@@ -680,10 +999,10 @@ void PhotonMapper::tracePhoton(
 		bool mayStore = !isDirect || !isScatteringDirect_ || numFinalGatherRays_ > 0;
 		if (mayStore)
 		{
-			VolumetricPhoton photon(Photon(scatterPoint, ray.direction(), transmittedPower, sample), isDirect);
-			if (russianRoulette(photon.power, storageProbability_[mtVolume], uniform(rng)))
+			XYZ photonPower = transmittedPower.xyz(sample);
+			if (russianRoulette(photonPower, storageProbability_[mtVolume], uniform(rng)))
 			{
-				shared_->volumetricBuffer_.push_back(photon);
+				buffers.volumetric.push_back(VolumetricPhoton(Photon(scatterPoint, ray.direction(), photonPower), isDirect));
 			}
 		}
 
@@ -706,7 +1025,7 @@ void PhotonMapper::tracePhoton(
 			return;
 		}
 		const BoundedRay scatteredRay(scatterPoint, ray.direction());
-		return tracePhoton(sample, scatteredPower, scatteredRay, generation + 1, rng, false);
+		return tracePhoton(sample, scatteredPower, scatteredRay, generation + 1, rng, buffers, false);
 	}
 
 	if (!intersection)
@@ -725,28 +1044,28 @@ void PhotonMapper::tracePhoton(
 		}
 		MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
 		const BoundedRay newRay = bound(ray, intersection.t() + liar::tolerance, ray.farLimit());
-		return tracePhoton(sample, transmittedPower, newRay, generation + 1, rng, isCaustic);
+		return tracePhoton(sample, transmittedPower, newRay, generation + 1, rng, buffers, isCaustic);
 	}
 	shader->shadeContext(sample, context);
 
 	if (shader->hasCaps(BsdfCaps::diffuse))
 	{
-		Photon photon(hitPoint, -ray.direction(), transmittedPower, sample);
+		XYZ photonPower = transmittedPower.xyz(sample);
 		if (isCaustic)
 		{
-			if (russianRoulette(photon.power, storageProbability_[mtCaustics], uniform(rng)))
+			if (russianRoulette(photonPower, storageProbability_[mtCaustics], uniform(rng)))
 			{
-				shared_->causticsBuffer_.push_back(photon);
+				buffers.caustics.push_back(Photon(hitPoint, -ray.direction(), photonPower));
 			}
 		}
 		const bool mayStorePhoton = (((generation > 0) || !isRayTracingDirect_) && !isCaustic) || hasFinalGather();
-		if (mayStorePhoton && russianRoulette(photon.power, storageProbability_[mtGlobal], uniform(rng)))
+		if (mayStorePhoton && russianRoulette(photonPower, storageProbability_[mtGlobal], uniform(rng)))
 		{
-			shared_->globalBuffer_.push_back(photon);
+			buffers.global.push_back(Photon(hitPoint, -ray.direction(), photonPower));
 			if (ratioPrecomputedIrradiance_ > 0 && uniform(rng) <= ratioPrecomputedIrradiance_)
 			{
 				const TVector3D worldNormal = context.bsdfToWorld(TVector3D(0, 0, 1));
-				shared_->irradianceBuffer_.push_back(Irradiance(hitPoint, worldNormal));
+				buffers.irradiance.push_back(Irradiance(hitPoint, worldNormal));
 			}
 		}
 	}
@@ -789,18 +1108,18 @@ void PhotonMapper::tracePhoton(
 	const bool newIsCaustic = isSpecular && (isCaustic || generation == 0);
 	MediumChanger mediumChanger(mediumStack(), context.interior(),
 		out.omegaOut.z < 0 ? context.solidEvent() : seNoEvent);
-	return tracePhoton(sample, newPower, newRay, generation + 1, rng, newIsCaustic);
+	return tracePhoton(sample, newPower, newRay, generation + 1, rng, buffers, newIsCaustic);
 }
 
 
 
-template <typename PhotonBuffer, typename PhotonMap>
-void PhotonMapper::buildPhotonMap(MapType type, PhotonBuffer& buffer, PhotonMap& map, TScalar powerScale)
+template <typename PhotonBuffer, typename SearchMap>
+void PhotonMapper::buildPhotonMap(MapType type, PhotonBuffer& buffer, SearchMap& map, TScalar powerScale, size_t numberOfThreads)
 {
 	LASS_COUT << mapTypeDictionary_.key(type) << " photon map:" << std::endl;
 	LASS_COUT << "  number of photons: " << buffer.size() << std::endl;
 
-	map.reset(buffer.begin(), buffer.end());
+	map.reset(buffer.begin(), buffer.end(), photonMapLayout_, numberOfThreads);
 
 	if (!buffer.empty())
 	{
@@ -809,8 +1128,10 @@ void PhotonMapper::buildPhotonMap(MapType type, PhotonBuffer& buffer, PhotonMap&
 		typename PhotonBuffer::iterator end = buffer.end();
 		for (typename PhotonBuffer::iterator i = buffer.begin(); i != end; ++i)
 		{
-			i->power *= static_cast<Spectral::TValue>(powerScale);
-			powers.push_back(i->power.absTotal());
+			XYZ power = i->power();
+			power *= static_cast<XYZ::TValue>(powerScale);
+			i->setPower(power);
+			powers.push_back(power.absTotal());
 		}
 		LASS_COUT << "  photon powers: " << temp::statistics(powers) << std::endl;
 
@@ -833,6 +1154,14 @@ void PhotonMapper::buildPhotonMap(MapType type, PhotonBuffer& buffer, PhotonMap&
 			LASS_COUT << "  automatic estimation radius: " << estimationRadius_[type] << std::endl;
 		}
 	}
+
+	// in 3D, the radius shrinks slower to reduce the volume by the same ratio.
+	const TScalar reduction = type == mtVolume ? num::pow(passReduction_, TNumTraits::one / 3) : num::sqrt(passReduction_);
+	shared_->searchRadius_[type] = reduction * estimationRadius_[type];
+	if (isProgressive())
+	{
+		LASS_COUT << "  estimation radius of pass: " << shared_->searchRadius_[type] << std::endl;
+	}
 }
 
 
@@ -997,7 +1326,7 @@ void PhotonMapper::buildIrradianceMap(size_t numberOfThreads)
 	LASS_COUT << "  eff. radii: " << temp::statistics(radii) << std::endl;
 	LASS_COUT << "  eff. counts: " << temp::statistics(counts) << std::endl;
 
-	shared_->irradianceMap_.reset(shared_->irradianceBuffer_.begin(), shared_->irradianceBuffer_.end());
+	shared_->irradianceMap_.reset(shared_->irradianceBuffer_.begin(), shared_->irradianceBuffer_.end(), photonMapLayout_, numberOfThreads);
 }
 
 
@@ -1027,11 +1356,11 @@ public:
 			const size_t i = *task++;
 			PhotonMapper::VolumetricPhoton& photon = buffer_[i];
 			//*
-			const TNeighbourhood::const_iterator last = map_.rangeSearch(photon.position, rMax_, mMax_, neighbourhood_.begin());
+			const TNeighbourhood::const_iterator last = map_.rangeSearch(photon.position, static_cast<PhotonMapper::TPhotonValue>(rMax_), mMax_, neighbourhood_.begin());
 			size_t m = static_cast<size_t>(last - neighbourhood_.begin());
 			LASS_ASSERT(m > 0);
 			const TScalar dist = num::sqrt(neighbourhood_.front().squaredDistance());
-			photon.radius = std::min(rMax_, mnScale_ * (m < mMax_ ? rMax_ : dist));
+			photon.radius = static_cast<PhotonMapper::TPhotonValue>(std::min(rMax_, mnScale_ * (m < mMax_ ? rMax_ : dist)));
 			/*/
 			photon.radius = rMax;
 			/**/
@@ -1059,10 +1388,11 @@ void PhotonMapper::buildVolumetricPhotonMap(const TPreliminaryVolumetricPhotonMa
 	const size_t size = shared_->volumetricBuffer_.size();
 	if (!size)
 	{
+		TVolumetricPhotonMap().swap(shared_->volumetricMap_);
 		return;
 	}
 	VolumetricWorker::TRadii radii(size);
-	VolumetricWorker worker(shared_->volumetricBuffer_, radii, preliminaryVolumetricMap, estimationRadius_[mtVolume], estimationSize_[mtVolume]);
+	VolumetricWorker worker(shared_->volumetricBuffer_, radii, preliminaryVolumetricMap, searchRadius(mtVolume), estimationSize_[mtVolume]);
 	experimental::runWorkers(worker, size, numberOfThreads, "  precomputing radii");
 	LASS_COUT << "  eff. radii: " << temp::statistics(radii) << std::endl;
 
@@ -1095,11 +1425,11 @@ const Spectral PhotonMapper::gatherIndirect(
 		//*
 		LASS_ASSERT(photonNeighbourhood_.size() > estimationSize_[mtGlobal]);
 		const TPhotonNeighbourhood::const_iterator last = shared_->globalMap_.rangeSearch(
-			target, estimationRadius_[mtGlobal], estimationSize_[mtGlobal], photonNeighbourhood_.begin());
+			photonPoint(target), static_cast<TPhotonValue>(searchRadius(mtGlobal)), estimationSize_[mtGlobal], photonNeighbourhood_.begin());
 		for (TPhotonNeighbourhood::const_iterator i = photonNeighbourhood_.begin(); i != last; ++i)
 		{
-			const TVector3D omega = context.worldToBsdf(i->object()->omegaIn);
-			const TScalar p = i->object()->power.absTotal();
+			const TVector3D omega = context.worldToBsdf(i->object()->omegaIn());
+			const TScalar p = i->object()->power().absTotal();
 			if (omega.z < 0)
 			{
 				continue;
@@ -1147,7 +1477,8 @@ const Spectral PhotonMapper::gatherIndirect(
 		const TVector3D direction = context.bsdfToWorld(out.omegaOut);
 		const BoundedRay ray(target, direction, liar::tolerance);
 		const bool gatherVolumetric = (volumetricGatherQuality_ > 0) && (*firstVolumetricSample <= volumetricGatherQuality_);
-		const Spectral radiance = traceGatherRay(sample, ray, gatherVolumetric, gatherStage, context.rayGeneration() + 1);
+		TScalar hitDistance;
+		const Spectral radiance = traceGatherRay(sample, ray, gatherVolumetric, gatherStage, context.rayGeneration() + 1, hitDistance);
 
 		result += radiance * out.value * static_cast<Spectral::TValue>(num::abs(out.omegaOut.z) / (static_cast<TScalar>(n) * out.pdf));
 	}
@@ -1156,10 +1487,11 @@ const Spectral PhotonMapper::gatherIndirect(
 
 
 
-const Spectral PhotonMapper::traceGatherRay(const Sample& sample, const BoundedRay& ray, bool gatherVolumetric, size_t gatherStage, size_t rayGeneration) const
+const Spectral PhotonMapper::traceGatherRay(const Sample& sample, const BoundedRay& ray, bool gatherVolumetric, size_t gatherStage, size_t rayGeneration, TScalar& hitDistance) const
 {
 	Intersection intersection;
 	scene()->intersect(sample, ray, intersection);
+	hitDistance = !intersection ? TNumTraits::infinity : intersection.t();
 
 	const Spectral inScatter = gatherVolumetric ?
 		estimateVolumetric(sample, bound(ray, ray.nearLimit(), intersection.t())) / static_cast<Spectral::TValue>(volumetricGatherQuality_) :
@@ -1191,7 +1523,7 @@ const Spectral PhotonMapper::traceGatherRay(const Sample& sample, const BoundedR
 		// leaving or entering something
 		MediumChanger mediumChanger(mediumStack(), context.interior(), context.solidEvent());
 		const BoundedRay continuedRay = bound(ray, intersection.t() + liar::tolerance);
-		radiance = traceGatherRay(sample, continuedRay, gatherVolumetric, gatherStage, rayGeneration + 1);
+		radiance = traceGatherRay(sample, continuedRay, gatherVolumetric, gatherStage, rayGeneration + 1, hitDistance);
 	}
 
 
@@ -1227,11 +1559,98 @@ const Spectral PhotonMapper::gatherSecondary(
 }
 
 
+/** Final gather through the irradiance cache: the irradiance is interpolated from nearby records if possible.
+ *  Otherwise, a new record is gathered and added to the cache.
+ *
+ *  The cache only knows irradiance, so the reflected radiance is approximated as if the diffuse component of the BSDF
+ *  was lambertian.
+ */
+const Spectral PhotonMapper::gatherCachedIndirect(
+		const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omegaIn,
+		const TPoint2D* firstSample, const TPoint2D* lastSample, const TScalar* firstVolumetricSample) const
+{
+	const TVector3D shadingNormal = context.bsdfToWorld(TVector3D(0, 0, 1)).normal();
+
+	XYZ irradiance;
+	if (!shared_->irradianceCache_.interpolate(point, shadingNormal, irradiance))
+	{
+		IrradianceCache::Record record;
+		gatherIrradianceRecord(sample, context, point + 10 * liar::tolerance * normal, firstSample, lastSample, firstVolumetricSample, record);
+		record.position = point;
+		record.normal = shadingNormal;
+		shared_->irradianceCache_.add(record);
+		irradiance = record.irradiance;
+	}
+
+	const BsdfOut diffuse = bsdf->evaluate(omegaIn, TVector3D(0, 0, 1), BsdfCaps::reflection | BsdfCaps::diffuse);
+	return Spectral::fromXYZ(irradiance, sample, SpectralType::Illuminant) * diffuse.value;
+}
+
+
+
+/** Gathers the irradiance at @a target over a stratified hemisphere of M x N cells, M in cos^2(theta) and N in phi,
+ *  and estimates its rotational and translational gradients from the differences between neighbouring cells.
+ *
+ *  The gather samples are used to jitter the rays within their cells.  Only the first M x N of them are used,
+ *  with N about pi times M.
+ *
+ *  The irradiance and its gradients are integrated by IrradianceCache::integrate.
+ */
+void PhotonMapper::gatherIrradianceRecord(
+		const Sample& sample, const IntersectionContext& context, const TPoint3D& target,
+		const TPoint2D* firstSample, const TPoint2D* lastSample, const TScalar* firstVolumetricSample,
+		IrradianceCache::Record& record) const
+{
+	const size_t n = static_cast<size_t>(lastSample - firstSample);
+	const size_t numTheta = std::max<size_t>(static_cast<size_t>(num::sqrt(static_cast<TScalar>(n) / TNumTraits::pi)), 1);
+	const size_t numPhi = std::max<size_t>(n / numTheta, 1);
+	const TScalar invTheta = num::inv(static_cast<TScalar>(numTheta));
+	const TScalar dPhi = 2 * TNumTraits::pi / static_cast<TScalar>(numPhi);
+
+	gatherRadiances_.resize(numTheta * numPhi);
+	gatherDistances_.resize(numTheta * numPhi);
+
+	TScalar sumInvDistances = 0;
+	for (size_t j = 0; j < numTheta; ++j)
+	{
+		for (size_t k = 0; k < numPhi; ++k)
+		{
+			const size_t i = j * numPhi + k;
+			const TPoint2D& s = firstSample[i];
+			const TScalar sinTheta = num::sqrt((static_cast<TScalar>(j) + s.x) * invTheta);
+			const TScalar cosTheta = num::sqrt(std::max(TNumTraits::one - num::sqr(sinTheta), TNumTraits::zero));
+			const TScalar phi = (static_cast<TScalar>(k) + s.y) * dPhi;
+			const TVector3D direction = context.bsdfToWorld(TVector3D(sinTheta * num::cos(phi), sinTheta * num::sin(phi), cosTheta));
+			const BoundedRay ray(target, direction.normal(), liar::tolerance);
+			const bool gatherVolumetric = (volumetricGatherQuality_ > 0) && (firstVolumetricSample[i] <= volumetricGatherQuality_);
+			TScalar distance;
+			gatherRadiances_[i] = traceGatherRay(sample, ray, gatherVolumetric, 0, context.rayGeneration() + 1, distance).xyz(sample);
+			gatherDistances_[i] = distance;
+			sumInvDistances += num::inv(distance);
+		}
+	}
+	const TVector3D tangent = context.bsdfToWorld(TVector3D(1, 0, 0));
+	const TVector3D bitangent = context.bsdfToWorld(TVector3D(0, 1, 0));
+	IrradianceCache::integrate(&gatherRadiances_[0], &gatherDistances_[0], numTheta, numPhi, tangent, bitangent, record);
+
+	// harmonic mean distance, limited by the translational gradient so that steep gradients aren't extrapolated too far.
+	TScalar radius = sumInvDistances > 0 ? static_cast<TScalar>(numTheta * numPhi) / sumInvDistances : TNumTraits::infinity;
+	const TScalar gradient = record.translationalGradient[1].norm();
+	if (gradient > 0 && record.irradiance.y > 0)
+	{
+		radius = std::min(radius, static_cast<TScalar>(record.irradiance.y) / gradient);
+	}
+	record.radius = std::max(std::min(std::max(radius, irradianceCacheMinSpacing_), irradianceCacheMaxSpacing_), liar::tolerance);
+}
+
+
+
 const XYZ PhotonMapper::estimateIrradiance(const TPoint3D& point, const TVector3D& normal, TScalar& sqrEstimationRadius, size_t& count) const
 {
 	if (!shared_->irradianceMap_.isEmpty())
 	{
-		TIrradianceMap::Neighbour nearest = shared_->irradianceMap_.nearestNeighbour(point, estimationRadius_[mtGlobal]);
+		TIrradianceMap::Neighbour nearest = shared_->irradianceMap_.nearestNeighbour(point, searchRadius(mtGlobal));
 		if (nearest.object() == shared_->irradianceMap_.end())
 		{
 			sqrEstimationRadius = 0;
@@ -1255,7 +1674,7 @@ const XYZ PhotonMapper::estimateIrradianceImpl(TPhotonNeighbourhood& neighbourho
 {
 	LASS_ASSERT(neighbourhood.size() > estimationSize_[mtGlobal]);
 	const TPhotonNeighbourhood::const_iterator last = shared_->globalMap_.rangeSearch(
-		point, estimationRadius_[mtGlobal], estimationSize_[mtGlobal], neighbourhood.begin());
+		photonPoint(point), static_cast<TPhotonValue>(searchRadius(mtGlobal)), estimationSize_[mtGlobal], neighbourhood.begin());
 
 	count = static_cast<size_t>(last - neighbourhood.begin());
 	if (count == 0)
@@ -1267,13 +1686,13 @@ const XYZ PhotonMapper::estimateIrradianceImpl(TPhotonNeighbourhood& neighbourho
 	XYZ result;
 	for (TPhotonNeighbourhood::const_iterator i = neighbourhood.begin(); i != last; ++i)
 	{
-		if (dot(i->object()->omegaIn, normal) > 0)
+		if (dot(i->object()->omegaIn(), normal) > 0)
 		{
-			result += i->object()->power;
+			result += i->object()->power();
 		}
 	}
 
-	sqrEstimationRadius = neighbourhood.front().squaredDistance();
+	sqrEstimationRadius = sqrDensityRadius(mtGlobal, count, neighbourhood.front().squaredDistance());
 	return sqrEstimationRadius > 0 ? result / static_cast<Spectral::TValue>(TNumTraits::pi * sqrEstimationRadius) : XYZ();
 }
 
@@ -1294,10 +1713,10 @@ const Spectral PhotonMapper::estimateRadiance(
 
 	if (!shared_->irradianceMap_.isEmpty())
 	{
-		TIrradianceMap::Neighbour nearest = shared_->irradianceMap_.nearestNeighbour(point, estimationRadius_[mtGlobal]);
+		TIrradianceMap::Neighbour nearest = shared_->irradianceMap_.nearestNeighbour(point, searchRadius(mtGlobal));
 		if (nearest.object() == shared_->irradianceMap_.end())
 		{
-			sqrEstimationRadius = estimationRadius_[mtGlobal];
+			sqrEstimationRadius = searchRadius(mtGlobal);
 			return Spectral();
 		}
 		//if (dot(normal, nearest->normal) > 0.9)
@@ -1310,19 +1729,19 @@ const Spectral PhotonMapper::estimateRadiance(
 
 	LASS_ASSERT(photonNeighbourhood_.size() > estimationSize_[mtGlobal]);
 	const TPhotonNeighbourhood::const_iterator last = shared_->globalMap_.rangeSearch(
-		point, estimationRadius_[mtGlobal], estimationSize_[mtGlobal], photonNeighbourhood_.begin());
+		photonPoint(point), static_cast<TPhotonValue>(searchRadius(mtGlobal)), estimationSize_[mtGlobal], photonNeighbourhood_.begin());
 
 	const TPhotonNeighbourhood::difference_type n = last - photonNeighbourhood_.begin();
 	if (n < 2)
 	{
-		sqrEstimationRadius = estimationRadius_[mtGlobal];
+		sqrEstimationRadius = searchRadius(mtGlobal);
 		return Spectral();
 	}
 
 	Spectral result;
 	for (TPhotonNeighbourhood::const_iterator i = photonNeighbourhood_.begin(); i != last; ++i)
 	{
-		const TVector3D omegaPhoton = context.worldToBsdf(i->object()->omegaIn);
+		const TVector3D omegaPhoton = context.worldToBsdf(i->object()->omegaIn());
 		const BsdfOut out = bsdf->evaluate(omegaOut, omegaPhoton, BsdfCaps::all & ~BsdfCaps::specular & ~BsdfCaps::glossy);
 		if (out.pdf > 0 && out.value)
 		{
@@ -1330,7 +1749,7 @@ const Spectral PhotonMapper::estimateRadiance(
 		}
 	}
 
-	sqrEstimationRadius = photonNeighbourhood_.front().squaredDistance();
+	sqrEstimationRadius = sqrDensityRadius(mtGlobal, static_cast<size_t>(n), photonNeighbourhood_.front().squaredDistance());
 	return result / static_cast<Spectral::TValue>(TNumTraits::pi * sqrEstimationRadius);
 }
 
@@ -1350,7 +1769,7 @@ const Spectral PhotonMapper::estimateCaustics(
 
 	LASS_ASSERT(photonNeighbourhood_.size() > estimationSize_[mtCaustics]);
 	const auto last = shared_->causticsMap_.rangeSearch(
-		point, estimationRadius_[mtCaustics], estimationSize_[mtCaustics], photonNeighbourhood_.begin());
+		photonPoint(point), static_cast<TPhotonValue>(searchRadius(mtCaustics)), estimationSize_[mtCaustics], photonNeighbourhood_.begin());
 	const auto n = std::distance(photonNeighbourhood_.begin(), last);
 	LASS_ASSERT(n >= 0);
 	if (n < 2)
@@ -1358,7 +1777,7 @@ const Spectral PhotonMapper::estimateCaustics(
 		return Spectral();
 	}
 
-	const TValue sqrSize = static_cast<TValue>(photonNeighbourhood_[0].squaredDistance());
+	const TValue sqrSize = static_cast<TValue>(sqrDensityRadius(mtCaustics, static_cast<size_t>(n), photonNeighbourhood_[0].squaredDistance()));
 	const TValue alpha = 0.918f;
 	const TValue beta = 1.953f;
 	const TValue b1 = -beta / (2 * sqrSize);
@@ -1367,7 +1786,7 @@ const Spectral PhotonMapper::estimateCaustics(
 	Spectral result;
 	for (auto i = photonNeighbourhood_.begin(); i != last; ++i)
 	{
-		const TVector3D omegaPhoton = context.worldToBsdf(i->object()->omegaIn);
+		const TVector3D omegaPhoton = context.worldToBsdf(i->object()->omegaIn());
 		const BsdfOut out = bsdf->evaluate(omegaIn, omegaPhoton, BsdfCaps::allDiffuse);
 		if (out)
 		{
@@ -1429,15 +1848,16 @@ const Spectral PhotonMapper::estimateVolumetric(const Sample& sample, const kern
 		{
 			continue;
 		}
-		const TScalar t = num::clamp(unboundedRay.t(photon.position), tNear, tFar);
+		const TPoint3D position = scenePoint(photon.position);
+		const TScalar t = num::clamp(unboundedRay.t(position), tNear, tFar);
 		const TPoint3D pos = unboundedRay.point(t);
-		const TScalar k = temp::kernelEpanechnikov2D(pos, photon.position, photon.radius);
+		const TScalar k = temp::kernelEpanechnikov2D(pos, position, photon.radius);
 		if (k <= 0)
 		{
 			continue;
 		}
 		const Spectral trans = medium->scatterOut(sample, bound(ray, tNear, t));
-		const Spectral phase = medium->phase(sample, pos, ray.direction(), -photon.omegaIn);
+		const Spectral phase = medium->phase(sample, pos, ray.direction(), -photon.omegaIn());
 		result += static_cast<Spectral::TValue>(k) * trans * phase * photon.spectralPower(sample);
 	}
 
@@ -1446,6 +1866,21 @@ const Spectral PhotonMapper::estimateVolumetric(const Sample& sample, const kern
 
 
 
+/** squared radius of the disc over which the @a count photons of a range search are spread.
+ *  That's normally up to the farthest one found.  A progressive estimate must use the fixed radius of the pass instead,
+ *  unless the search was cut short at estimationSize photons.
+ */
+TScalar PhotonMapper::sqrDensityRadius(MapType mapType, size_t count, TScalar sqrFarthest) const
+{
+	if (isProgressive() && count < estimationSize_[mapType])
+	{
+		return num::sqr(searchRadius(mapType));
+	}
+	return sqrFarthest;
+}
+
+
+
 void PhotonMapper::updateActualEstimationRadius(MapType mapType, TScalar radius) const
 {
 	maxActualEstimationRadius_[mapType] = std::max(maxActualEstimationRadius_[mapType], radius);
@@ -1474,6 +1909,17 @@ PhotonMapper::TMapTypeDictionary PhotonMapper::generateMapTypeDictionary()
 
 
 
+PhotonMapper::TPhotonMapLayoutDictionary PhotonMapper::generatePhotonMapLayoutDictionary()
+{
+	TPhotonMapLayoutDictionary dictionary;
+	dictionary.enableSuggestions(true);
+	dictionary.add("kdtree", pmlKdTree);
+	dictionary.add("buckets", pmlBuckets);
+	return dictionary;
+}
+
+
+
 // --- free ----------------------------------------------------------------------------------------
 
 }
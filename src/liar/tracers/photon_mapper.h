@@ -31,6 +31,9 @@
 
 #include "tracers_common.h"
 #include "direct_lighting.h"
+#include "photon_map.h"
+#include "photon_encoding.h"
+#include "irradiance_cache.h"
 #include "../kernel/sampler_progressive.h"
 #include <lass/prim/sphere_3d.h>
 #include <lass/spat/kd_tree.h>
@@ -101,22 +104,61 @@ public:
 	const TSamplerProgressivePtr& photonSampler() const;
 	void setPhotonSampler(const TSamplerProgressivePtr& photonSampler);
 
+	size_t photonsPerPass() const;
+	void setPhotonsPerPass(size_t photonsPerPass);
+
+	TScalar radiusReduction() const;
+	void setRadiusReduction(TScalar alpha);
+
+	const std::string photonMapLayout() const;
+	void setPhotonMapLayout(const std::string& layout);
+
+	TScalar irradianceCacheAccuracy() const;
+	void setIrradianceCacheAccuracy(TScalar accuracy);
+
+	TScalar irradianceCacheMinSpacing() const;
+	void setIrradianceCacheMinSpacing(TScalar spacing);
+
+	TScalar irradianceCacheMaxSpacing() const;
+	void setIrradianceCacheMaxSpacing(TScalar spacing);
+
 private:
 
 	typedef std::vector<Medium*> TMediumStack;
 
+	typedef float TPhotonValue;
+	typedef prim::Point3D<TPhotonValue> TPhotonPoint;
+
+	static const TPhotonPoint photonPoint(const TPoint3D& p)
+	{
+		return TPhotonPoint(static_cast<TPhotonValue>(p.x), static_cast<TPhotonValue>(p.y), static_cast<TPhotonValue>(p.z));
+	}
+	static const TPoint3D scenePoint(const TPhotonPoint& p)
+	{
+		return TPoint3D(p.x, p.y, p.z);
+	}
+
+	/** 20 byte photon record: a float position, the incident direction in 2x16 bit octahedral coordinates,
+	 *  and the power in XYZ with a shared exponent, like Ward's RGBE, see photon_encoding.h.  Direction and power are decoded on the fly.
+	 *  @par ref: H. W. Jensen. Realistic Image Synthesis Using Photon Mapping (2001), section 5.2
+	 *  @par ref: Z. H. Cigolle et al. A Survey of Efficient Representations for Independent Unit Vectors (2014)
+	 */
 	struct Photon
 	{
 	public:
-		Photon(const TPoint3D& position, const TVector3D& omegaIn, const Spectral& power, const Sample& sample) :
-			position(position), omegaIn(omegaIn), power(power.xyz(sample)) {}
-		TPoint3D position;
-		TVector3D omegaIn;
-		XYZ power;
+		Photon(const TPoint3D& position, const TVector3D& omegaIn, const XYZ& power) :
+			position(photonPoint(position)), direction_(encodePhotonDirection(omegaIn)), power_(encodePhotonPower(power)) {}
+		TPhotonPoint position;
+		const TVector3D omegaIn() const { return decodePhotonDirection(direction_); }
+		const XYZ power() const { return decodePhotonPower(power_); }
+		void setPower(const XYZ& power) { power_ = encodePhotonPower(power); }
 		const Spectral spectralPower(const Sample& sample) const
 		{
-			return Spectral::fromXYZ(power, sample, SpectralType::Illuminant);
+			return Spectral::fromXYZ(power(), sample, SpectralType::Illuminant);
 		}
+	private:
+		num::Tuint32 direction_;
+		num::Tuint32 power_;
 	};
 	typedef std::vector<Photon> TPhotonBuffer;
 
@@ -136,22 +178,22 @@ private:
 	typedef std::vector<Irradiance> TIrradianceBuffer;
 
 #if 1
-	template <typename Buffer>
+	template <typename Buffer, typename Point = TPoint3D>
 	struct KdTreeTraits
 	{
 		typedef typename Buffer::const_iterator TObjectIterator;
 		typedef typename Buffer::const_reference TObjectReference;
-		typedef TPoint3D TPoint;
-		typedef TPoint::TValue TValue;
-		typedef TPoint::TParam TParam;
-		typedef TPoint::TReference TReference;
-		typedef TPoint::TConstReference TConstReference;
+		typedef Point TPoint;
+		typedef typename TPoint::TValue TValue;
+		typedef typename TPoint::TParam TParam;
+		typedef typename TPoint::TReference TReference;
+		typedef typename TPoint::TConstReference TConstReference;
 		enum { dimension = TPoint::dimension };
 
 		static const TPoint& position(TObjectIterator object) { return object->position; }
 	};
-	typedef spat::KdTree<Photon, KdTreeTraits<TPhotonBuffer> > TPhotonMap;
-	typedef spat::KdTree<Irradiance, KdTreeTraits<TIrradianceBuffer> > TIrradianceMap;
+	typedef PhotonMap<Photon, KdTreeTraits<TPhotonBuffer, TPhotonPoint> > TPhotonMap;
+	typedef PhotonMap<Irradiance, KdTreeTraits<TIrradianceBuffer> > TIrradianceMap;
 #else
 	template <typename Buffer>
 	struct ObjectTraits: spat::DefaultObjectTraits<typename Buffer::value_type, TAabb3D, meta::NullType, typename Buffer::const_iterator>
@@ -174,7 +216,7 @@ private:
 	struct VolumetricPhoton: Photon
 	{
 		VolumetricPhoton(const Photon& photon, bool isDirect): Photon(photon), radius(0), isDirect(isDirect) {}
-		TScalar radius;
+		TPhotonValue radius;
 		bool isDirect;
 	};
 	typedef std::vector<VolumetricPhoton> TVolumetricPhotonBuffer;
@@ -183,7 +225,7 @@ private:
 	{
 		static const TAabb objectAabb(TObjectIterator it)
 		{
-			const TPoint3D center = it->position;
+			const TPoint3D center = scenePoint(it->position);
 			const TVector3D halfExtent = TVector3D(it->radius, it->radius, it->radius);
 			return TAabb(center - halfExtent, center + halfExtent);
 		}
@@ -191,11 +233,11 @@ private:
 		{
 			// ok, we're using a bit of a hack here. we're not intersecting the sphere surface, but it's volume.
 			/*
-			const TValue t = num::clamp(ray.t(it->position), tMin, tMax);
-			return prim::squaredDistance(it->position, ray.point(t)) < num::sqr(it->radius);
+			const TValue t = num::clamp(ray.t(scenePoint(it->position)), tMin, tMax);
+			return prim::squaredDistance(scenePoint(it->position), ray.point(t)) < num::sqr(it->radius);
 			/*/
 			const VolumetricPhoton& photon = *it;
-			TVector3D v = photon.position - ray.support();
+			TVector3D v = scenePoint(photon.position) - ray.support();
 			const TVector3D& d = ray.direction();
 			const TValue t = num::clamp(dot(v, d), tMin, tMax);
 			v.x -= t * d.x;
@@ -205,10 +247,20 @@ private:
 			/**/
 		}
 	};
-	typedef spat::KdTree< VolumetricPhoton, KdTreeTraits<TVolumetricPhotonBuffer> > TPreliminaryVolumetricPhotonMap;
+	typedef PhotonMap< VolumetricPhoton, KdTreeTraits<TVolumetricPhotonBuffer, TPhotonPoint> > TPreliminaryVolumetricPhotonMap;
 	typedef spat::AabpTree< VolumetricPhoton, VolumetricPhotonTraits, spat::DefaultSplitHeuristics > TVolumetricPhotonMap;
 	typedef TVolumetricPhotonMap::TObjectIterators TVolumetricNeighbourhood;
 
+	/** photons stored while tracing, before they're merged into the shared photon buffers.
+	 */
+	struct PhotonBuffers
+	{
+		TPhotonBuffer global;
+		TIrradianceBuffer irradiance;
+		TPhotonBuffer caustics;
+		TVolumetricPhotonBuffer volumetric;
+	};
+
 	enum MapType
 	{
 		mtNone = -1,
@@ -219,6 +271,7 @@ private:
 	};
 
 	typedef util::Dictionary<std::string, MapType> TMapTypeDictionary;
+	typedef util::Dictionary<std::string, PhotonMapLayout> TPhotonMapLayoutDictionary;
 
 	typedef std::vector<TScalar> TLightCdf;
 	typedef std::mt19937 TRandomPrimary;
@@ -240,6 +293,8 @@ private:
 	// RayTracer
 	void doRequestSamples(const TSamplerPtr& sampler) override;
 	void doPreProcess(const TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads) override;
+	void doBeginPass(const TSamplerPtr& sampler, const TimePeriod& period, size_t pass, size_t numberOfThreads) override;
+	bool doHasPasses() const override;
 	const TRayTracerPtr doClone() const override;
 	const TPyObjectPtr doGetState() const override;
 	void doSetState(const TPyObjectPtr& state) override;
@@ -251,11 +306,14 @@ private:
 
 	bool hasFinalGather() const { return isRayTracingDirect_ && (numFinalGatherRays_ > 0); }
 	bool hasSecondaryGather() const { return hasFinalGather() && (numSecondaryGatherRays_ > 0); }
-
-	size_t fillPhotonMaps(const TSamplerProgressivePtr& sampler, const TimePeriod& period);
-	void emitPhoton(const LightContext& light, TScalar lightPdf, const Sample& sample, TRandomSecondary::result_type secondarySeed);
-	void tracePhoton(const Sample& sample, const Spectral& power, const BoundedRay& ray, size_t geneneration, TRandomPhoton& rng, bool isCaustic = false);
-	template <typename PhotonBuffer, typename PhotonMap> void buildPhotonMap(MapType mapType, PhotonBuffer& buffer, PhotonMap& map, TScalar powerScale);
+	bool isProgressive() const { return photonsPerPass_ > 0; }
+	bool hasIrradianceCache() const { return shared_->irradianceCache_.accuracy() > 0; }
+
+	void buildPhotonMaps(const TimePeriod& period, size_t numberOfThreads);
+	size_t fillPhotonMaps(const TSamplerProgressivePtr& sampler, const TimePeriod& period, size_t numberOfThreads);
+	void emitPhoton(const LightContext& light, TScalar lightPdf, const Sample& sample, TRandomSecondary::result_type secondarySeed, PhotonBuffers& buffers);
+	void tracePhoton(const Sample& sample, const Spectral& power, const BoundedRay& ray, size_t geneneration, TRandomPhoton& rng, PhotonBuffers& buffers, bool isCaustic = false);
+	template <typename PhotonBuffer, typename SearchMap> void buildPhotonMap(MapType mapType, PhotonBuffer& buffer, SearchMap& map, TScalar powerScale, size_t numberOfThreads);
 	void buildIrradianceMap(size_t numberOfThreads);
 	void buildVolumetricPhotonMap(const TPreliminaryVolumetricPhotonMap& preliminaryVolumetricMap, size_t numberOfThreads);
 
@@ -264,7 +322,12 @@ private:
 		const TScalar* firstComponentSample, const TScalar* firstVolumetricSample, size_t gatherStage = 0) const;
 	const Spectral gatherSecondary(const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
 		const TPoint3D& target, const TVector3D& omegaOut) const;
-	const Spectral traceGatherRay(const Sample& sample, const BoundedRay& ray, bool gatherVolumetric, size_t gatherStage, size_t rayGeneration) const;
+	const Spectral traceGatherRay(const Sample& sample, const BoundedRay& ray, bool gatherVolumetric, size_t gatherStage, size_t rayGeneration, TScalar& hitDistance) const;
+	const Spectral gatherCachedIndirect(const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omegaOut,
+		const TPoint2D* firstSample, const TPoint2D* lastSample, const TScalar* firstVolumetricSample) const;
+	void gatherIrradianceRecord(const Sample& sample, const IntersectionContext& context, const TPoint3D& target,
+		const TPoint2D* firstSample, const TPoint2D* lastSample, const TScalar* firstVolumetricSample, IrradianceCache::Record& record) const;
 
 	const XYZ estimateIrradiance(const TPoint3D& point, const TVector3D& normal, TScalar& sqrEstimationRadius, size_t& estimationCount) const;
 	const XYZ estimateIrradiance(const TPoint3D& point, const TVector3D& normal) const
@@ -286,6 +349,8 @@ private:
 
 	const Spectral estimateCaustics(const Sample& sample, const IntersectionContext& context, const TBsdfPtr& bsdf,
 		const TPoint3D& point, const TVector3D& omegaOut) const;
+	TScalar searchRadius(MapType mapType) const { return shared_->searchRadius_[mapType]; }
+	TScalar sqrDensityRadius(MapType mapType, size_t count, TScalar sqrFarthest) const;
 	void updateActualEstimationRadius(MapType mapType, TScalar radius) const;
 	void updateStorageProbabilities();
 
@@ -301,6 +366,8 @@ private:
 		TIrradianceMap irradianceMap_;
 		TPhotonMap causticsMap_;
 		TVolumetricPhotonMap volumetricMap_;
+		TScalar searchRadius_[numMapTypes] = {}; /**< estimationRadius of the current pass */
+		IrradianceCache irradianceCache_;
 	};
 	util::SharedPtr<SharedData> shared_;
 
@@ -312,6 +379,9 @@ private:
 	mutable std::vector<TScalar> secondaryGatherComponentSamples_;
 	mutable std::vector<TScalar> secondaryGatherVolumetricSamples_;
 
+	mutable std::vector<XYZ> gatherRadiances_;
+	mutable std::vector<TScalar> gatherDistances_;
+
 	mutable std::vector<TScalar> grid_;
 	mutable num::InverseTransformSampling2D<TScalar> gatherDistribution_;
 
@@ -334,13 +404,26 @@ private:
 	TSamplerProgressivePtr photonSampler_;
 	int idLightSelector_;
 
+	size_t photonsPerPass_;
+	TScalar radiusReduction_;
+	TScalar passReduction_;
+	size_t nextPass_;
+
+	PhotonMapLayout photonMapLayout_;
+
+	TScalar irradianceCacheAccuracy_;
+	TScalar irradianceCacheMinSpacing_;
+	TScalar irradianceCacheMaxSpacing_;
+
 	// buffers
 	mutable TPhotonNeighbourhood photonNeighbourhood_;
 	mutable TVolumetricNeighbourhood volumetricNeighbourhood_;
 
 	static TMapTypeDictionary generateMapTypeDictionary();
+	static TPhotonMapLayoutDictionary generatePhotonMapLayoutDictionary();
 
 	static TMapTypeDictionary mapTypeDictionary_;
+	static TPhotonMapLayoutDictionary photonMapLayoutDictionary_;
 };
 
 }
@@ -27,7 +27,9 @@
 //
 #include "adjoint_photon_tracer.h"
 #include "direct_lighting.h"
+#include "path_tracer.h"
 #include "photon_mapper.h"
+#include "wavefront_tracer.h"
 
 #include <lass/io/proxy_man.h>
 
@@ -39,7 +41,9 @@ PY_DECLARE_MODULE_DOC(tracers, "LiAR ray- and path tracers")
 //
 PY_MODULE_CLASS(tracers, AdjointPhotonTracer)
 PY_MODULE_CLASS(tracers, DirectLighting)
+PY_MODULE_CLASS(tracers, PathTracer)
 PY_MODULE_CLASS(tracers, PhotonMapper)
+PY_MODULE_CLASS(tracers, WavefrontTracer)
 
 void tracersPostInject(PyObject*)
 {
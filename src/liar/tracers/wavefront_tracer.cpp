@@ -0,0 +1,494 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include "tracers_common.h"
+#include "wavefront_tracer.h"
+#include <numeric>
+
+namespace liar
+{
+namespace tracers
+{
+
+PY_DECLARE_CLASS_DOC(WavefrontTracer, "direct lighting with specular and glossy paths, traced breadth-first over batches of rays")
+PY_CLASS_CONSTRUCTOR_0(WavefrontTracer)
+PY_CLASS_MEMBER_RW_DOC(WavefrontTracer, batchSize, setBatchSize, "number of camera rays that are traced together")
+PY_CLASS_MEMBER_RW_DOC(WavefrontTracer, traceGlossy, setTraceGlossy, "Trace Glossy BSDF")
+
+namespace
+{
+
+/** MediumChanger only changes the stack for as long as it lives,
+ *  but a path needs to carry the change along to its next bounce.
+ */
+void changeMedium(MediumStack& stack, const Medium* medium, SolidEvent solidEvent)
+{
+	MediumStack changed;
+	{
+		const MediumChanger changer(stack, medium, solidEvent);
+		changed = stack;
+	}
+	stack = changed;
+}
+
+}
+
+// --- public --------------------------------------------------------------------------------------
+
+WavefrontTracer::WavefrontTracer():
+	batchSize_(256),
+	traceGlossy_(true)
+{
+}
+
+
+
+void WavefrontTracer::setBatchSize(size_t batchSize)
+{
+	batchSize_ = std::max<size_t>(batchSize, 1);
+}
+
+
+
+bool WavefrontTracer::traceGlossy() const
+{
+	return traceGlossy_;
+}
+
+
+
+void WavefrontTracer::setTraceGlossy(bool traceGlossy)
+{
+	traceGlossy_ = traceGlossy;
+}
+
+
+
+// --- private -------------------------------------------------------------------------------------
+
+void WavefrontTracer::doRequestSamples(const TSamplerPtr& sampler)
+{
+	requestLightAndSceneSamples(sampler);
+}
+
+
+
+void WavefrontTracer::doPreProcess(const kernel::TSamplerPtr&, const TimePeriod&, size_t)
+{
+}
+
+
+
+const Spectral WavefrontTracer::doCastRay(
+		const Sample& sample, const DifferentialRay& primaryRay, TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const
+{
+	Spectral radiance;
+	doCastRays(&sample, &primaryRay, &radiance, &tIntersection, &alpha, 1, generation, highQuality);
+	return radiance;
+}
+
+
+
+void WavefrontTracer::doCastRays(
+		const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, size_t generation, bool highQuality) const
+{
+	generate(primaryRays, radiances, tIntersections, alphas, count, highQuality);
+	for (size_t depth = 0; !active_.empty(); ++depth)
+	{
+		intersect(samples, depth == 0);
+		shade(samples, radiances, tIntersections, alphas, generation + depth);
+		shadow(samples, radiances);
+		active_.swap(next_);
+	}
+
+	// the contexts hold Bsdfs from the caller's arena, so they must not outlive this call.
+	contexts_.clear();
+	hits_.clear();
+}
+
+
+
+size_t WavefrontTracer::doBatchSize() const
+{
+	return batchSize_;
+}
+
+
+
+const TRayTracerPtr WavefrontTracer::doClone() const
+{
+	TRayTracerPtr::Rebind<WavefrontTracer>::Type result(new WavefrontTracer(*this));
+	result->random_.seed(random_());
+	return result;
+}
+
+
+
+void WavefrontTracer::doSeed(num::Tuint32 seed)
+{
+	std::seed_seq seq { seed };
+	random_.seed(seq);
+}
+
+
+
+const TPyObjectPtr WavefrontTracer::doGetState() const
+{
+	return python::makeTuple(batchSize_, traceGlossy_);
+}
+
+
+
+void WavefrontTracer::doSetState(const TPyObjectPtr& state)
+{
+	LASS_ENFORCE(python::decodeTuple(state, batchSize_, traceGlossy_));
+}
+
+
+
+/** Starts a path for every camera ray.
+ */
+void WavefrontTracer::generate(
+		const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas, size_t count, bool highQuality) const
+{
+	rays_.assign(primaryRays, primaryRays + count);
+	throughputs_.assign(count, Spectral(1));
+	media_.assign(count, 0);
+	changedMedia_.clear();
+	intersections_.resize(count);
+	flags_.assign(count, static_cast<num::Tuint8>(pfCamera | (highQuality ? pfHighQuality : 0)));
+	active_.resize(count);
+	std::iota(active_.begin(), active_.end(), 0);
+	next_.clear();
+
+	for (size_t k = 0; k < count; ++k)
+	{
+		radiances[k] = Spectral();
+		tIntersections[k] = TNumTraits::infinity;
+		alphas[k] = 0;
+	}
+}
+
+
+
+/** Intersects the rays of all active paths with the scene.
+ */
+void WavefrontTracer::intersect(const Sample* samples, bool isPrimary) const
+{
+	if (isPrimary)
+	{
+		// all paths are still active, in the same order as the samples, so we can intersect them as packets.
+		const size_t n = active_.size();
+		centralRays_.resize(n);
+		for (size_t k = 0; k < n; ++k)
+		{
+			centralRays_[k] = rays_[k].centralRay();
+		}
+		scene()->intersectPacket(samples, &centralRays_[0], &intersections_[0], n);
+		for (size_t k = 0; k < n; ++k)
+		{
+			if (intersections_[k].t() > rays_[k].farLimit())
+			{
+				intersections_[k] = Intersection::empty();
+			}
+		}
+		return;
+	}
+
+	for (TIndices::const_iterator i = active_.begin(); i != active_.end(); ++i)
+	{
+		scene()->intersect(samples[*i], rays_[*i], intersections_[*i]);
+	}
+}
+
+
+
+/** Accounts for the medium along the rays of all active paths, and shades their hits.
+ *  Hits are sorted by shader first, so that all texture lookups and BSDF evaluations of the same
+ *  shader are done together.  Paths that continue are queued in next_.
+ */
+void WavefrontTracer::shade(const Sample* samples, Spectral* radiances, TScalar* tIntersections, TScalar* alphas, size_t generation) const
+{
+	next_.clear();
+	hits_.clear();
+	contexts_.clear();
+	for (TIndices::const_iterator i = active_.begin(); i != active_.end(); ++i)
+	{
+		const size_t path = *i;
+		const Sample& sample = samples[path];
+		const DifferentialRay& ray = rays_[path];
+		const Intersection& intersection = intersections_[path];
+		const TScalar t = intersection ? intersection.t() : TNumTraits::infinity;
+		if (flags_[path] & pfCamera)
+		{
+			tIntersections[path] = t;
+			alphas[path] = intersection ? 1 : 0;
+		}
+
+		const BoundedRay mediumRay = bound(ray.centralRay(), ray.centralRay().nearLimit(), t);
+		const MediumStack& medium = pathMedium(path);
+		radiances[path] += throughputs_[path] * medium.emission(sample, mediumRay);
+		throughputs_[path] *= medium.transmittance(sample, mediumRay);
+		if (!intersection || !throughputs_[path])
+		{
+			continue;
+		}
+
+		contexts_.emplace_back(*scene(), sample, ray, intersection, generation);
+		hits_.push_back(path);
+	}
+
+	order_.resize(hits_.size());
+	std::iota(order_.begin(), order_.end(), 0);
+	std::sort(order_.begin(), order_.end(), [this](size_t a, size_t b)
+	{
+		return std::less<const Shader*>()(contexts_[a].shader(), contexts_[b].shader());
+	});
+
+	for (TIndices::const_iterator i = order_.begin(); i != order_.end(); ++i)
+	{
+		const size_t path = hits_[*i];
+		shadeSurface(samples[path], path, contexts_[*i], radiances[path], generation);
+	}
+}
+
+
+
+void WavefrontTracer::shadeSurface(const Sample& sample, size_t path, const IntersectionContext& context, Spectral& radiance, size_t generation) const
+{
+	const bool mayContinue = generation < maxRayGeneration();
+	const DifferentialRay& ray = rays_[path];
+	const TScalar t = intersections_[path].t();
+
+	const Shader* const shader = context.shader();
+	if (!shader)
+	{
+		// leaving or entering something
+		if (mayContinue)
+		{
+			changePathMedium(path, context);
+			rays_[path] = bound(ray, t + liar::tolerance);
+			next_.push_back(path);
+		}
+		return;
+	}
+
+	const TPoint3D point = ray.point(t);
+	const TVector3D normal = context.worldNormal();
+	const TVector3D omega = context.worldToBsdf(-ray.direction());
+	LASS_ASSERT(omega.z >= 0);
+
+	if (context.rayGeneration() == 0 || !context.object().asLight())
+	{
+		// see DirectLighting::doShadeSurface
+		radiance += throughputs_[path] * shader->emission(sample, context, omega);
+	}
+
+	const TBsdfPtr& bsdf = context.bsdf();
+	if (!bsdf)
+	{
+		return;
+	}
+
+	gatherDirect(sample, path, context, bsdf, point, normal, omega);
+
+	const BsdfCaps caps = BsdfCaps::allSpecular | (traceGlossy_ ? BsdfCaps::allGlossy : BsdfCaps::none);
+	if (!mayContinue || !shader->compatibleCaps(caps))
+	{
+		return;
+	}
+	const TPoint2D bsdfSample(uniform(), uniform());
+	const SampleBsdfOut out = bsdf->sample(omega, bsdfSample, uniform(), caps);
+	if (!out)
+	{
+		return;
+	}
+
+	// the differentials follow the ideal reflection, like in DirectLighting::traceSpecularAndGlossy.
+	// Through transmission, only the offsets of their supports are carried along.
+	const auto localToWorld = context.localToWorld();
+	const TVector3D dPoint_dI = localToWorld.transform(context.dPoint_dI());
+	const TVector3D dPoint_dJ = localToWorld.transform(context.dPoint_dJ());
+	const TVector3D direction = context.bsdfToWorld(out.omegaOut);
+	const bool isReflection = out.omegaOut.z > 0;
+	const TPoint3D begin = point + (isReflection ? 10 : -10) * liar::tolerance * normal;
+	TVector3D directionI = direction;
+	TVector3D directionJ = direction;
+	if (isReflection)
+	{
+		const TVector3D dNormal_dI = localToWorld.normalTransform(context.dNormal_dI());
+		const TVector3D dNormal_dJ = localToWorld.normalTransform(context.dNormal_dJ());
+		const TVector3D incident = ray.centralRay().direction();
+		const TScalar cosTheta = -dot(incident, normal);
+
+		const TVector3D dIncident_dI = ray.differentialI().direction() - incident;
+		const TScalar dCosTheta_dI = -dot(dIncident_dI, normal) - dot(incident, dNormal_dI);
+		directionI += dIncident_dI + 2 * (dCosTheta_dI * normal + cosTheta * dNormal_dI);
+
+		const TVector3D dIncident_dJ = ray.differentialJ().direction() - incident;
+		const TScalar dCosTheta_dJ = -dot(dIncident_dJ, normal) - dot(incident, dNormal_dJ);
+		directionJ += dIncident_dJ + 2 * (dCosTheta_dJ * normal + cosTheta * dNormal_dJ);
+	}
+	else
+	{
+		changePathMedium(path, context);
+	}
+	rays_[path] = DifferentialRay(
+		BoundedRay(begin, direction, liar::tolerance),
+		TRay3D(begin + dPoint_dI, directionI),
+		TRay3D(begin + dPoint_dJ, directionJ));
+	throughputs_[path] *= out.value * static_cast<Spectral::TValue>(num::abs(out.omegaOut.z) / out.pdf);
+	const bool isHighQuality = (flags_[path] & pfHighQuality) && hasCaps(out.usedCaps, BsdfCaps::specular);
+	flags_[path] = static_cast<num::Tuint8>(isHighQuality ? pfHighQuality : 0);
+	next_.push_back(path);
+}
+
+
+
+/** Queues the shadow rays to estimate the direct lighting of a hit.
+ *  Their contribution is already weighted by the path throughput and the transmittance of the
+ *  medium, so that only the occlusion test remains to be done.
+ */
+void WavefrontTracer::gatherDirect(
+		const Sample& sample, size_t path, const IntersectionContext&, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega) const
+{
+	const size_t first = shadowRayQueue_.size();
+
+	if (flags_[path] & pfHighQuality)
+	{
+		const LightContexts::TIterator end = lights().end();
+		for (LightContexts::TIterator light = lights().begin(); light != end; ++light)
+		{
+			const Sample::TSubSequence2D lightSamples = sample.subSequence2D(light->idLightSamples());
+			const Sample::TSubSequence2D bsdfSamples = sample.subSequence2D(light->idBsdfSamples());
+			const Sample::TSubSequence1D compSamples = sample.subSequence1D(light->idBsdfComponentSamples());
+			gatherLightContribution(sample, bsdf, *light, lightSamples, bsdfSamples, compSamples, point, normal, omega,
+				shadowRayQueue_, shadowContributionQueue_);
+		}
+	}
+	else
+	{
+		TScalar pdf;
+		const LightContext* light = lights().sample(uniform(), pdf);
+		if (light && pdf > 0)
+		{
+			TPoint2D lightSample(uniform(), uniform());
+			TPoint2D bsdfSample(uniform(), uniform());
+			TScalar componentSample = uniform();
+			gatherLightContribution(
+				sample, bsdf, *light,
+				Sample::TSubSequence2D(&lightSample, &lightSample + 1),
+				Sample::TSubSequence2D(&bsdfSample, &bsdfSample + 1),
+				Sample::TSubSequence1D(&componentSample, &componentSample + 1),
+				point, normal, omega, shadowRayQueue_, shadowContributionQueue_, 1 / pdf);
+		}
+	}
+
+	const Spectral& throughput = throughputs_[path];
+	for (size_t k = first; k < shadowRayQueue_.size(); ++k)
+	{
+		shadowContributionQueue_[k].value *= throughput * pathMedium(path).transmittance(sample, shadowRayQueue_[k]);
+		shadowOwnerQueue_.push_back(path);
+	}
+}
+
+
+
+/** Tests all shadow rays queued during shading for occlusion, and accumulates the contributions
+ *  of the ones that get through.  Shadow rays of the same hit share their sample, so they're
+ *  tested together.
+ */
+void WavefrontTracer::shadow(const Sample* samples, Spectral* radiances) const
+{
+	LASS_ASSERT(shadowRayQueue_.size() == shadowContributionQueue_.size() && shadowRayQueue_.size() == shadowOwnerQueue_.size());
+	const size_t maxRun = 64;
+	bool isOccluded[maxRun];
+
+	const size_t n = shadowRayQueue_.size();
+	for (size_t i = 0; i < n; )
+	{
+		const size_t path = shadowOwnerQueue_[i];
+		size_t m = 1;
+		while (m < maxRun && i + m < n && shadowOwnerQueue_[i + m] == path)
+		{
+			++m;
+		}
+		scene()->areIntersecting(samples[path], &shadowRayQueue_[i], isOccluded, m);
+		for (size_t k = 0; k < m; ++k)
+		{
+			const ShadowContribution& contribution = shadowContributionQueue_[i + k];
+			if (isOccluded[k] == contribution.isShadowOnly)
+			{
+				radiances[path] += contribution.value;
+			}
+		}
+		i += m;
+	}
+
+	shadowRayQueue_.clear();
+	shadowContributionQueue_.clear();
+	shadowOwnerQueue_.clear();
+}
+
+
+
+/** Paths share mediumStack() until they pass through a surface that changes it.  Only then they
+ *  get a copy of their own, so that a batch doesn't need to copy a stack for each path.
+ */
+const MediumStack& WavefrontTracer::pathMedium(size_t path) const
+{
+	const size_t index = media_[path];
+	return index == 0 ? mediumStack() : changedMedia_[index - 1];
+}
+
+
+
+void WavefrontTracer::changePathMedium(size_t path, const IntersectionContext& context) const
+{
+	if (media_[path] == 0)
+	{
+		changedMedia_.push_back(mediumStack());
+		media_[path] = changedMedia_.size();
+	}
+	changeMedium(changedMedia_[media_[path] - 1], context.interior(), context.solidEvent());
+}
+
+
+
+TScalar WavefrontTracer::uniform() const
+{
+	TUniformRealDistribution distribution;
+	return distribution(random_);
+}
+
+
+
+// --- free ----------------------------------------------------------------------------------------
+
+}
+
+}
+
+// EOF
@@ -0,0 +1,135 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+/** @class liar::tracers::WavefrontTracer
+ *  @brief direct lighting with specular and glossy paths, traced breadth-first over batches of rays.
+ *  @author Bram de Greve [Bramz]
+ *
+ *  Instead of recursing depth-first for every camera ray like DirectLighting does, WavefrontTracer
+ *  keeps the state of a whole batch of paths in structure-of-arrays queues and runs one stage at
+ *  a time over the whole queue: generate, intersect, shade and shadow.  Hits are sorted by shader
+ *  before the BSDFs are evaluated, and all shadow rays of a bounce are tested after all shading is
+ *  done, so that each stage runs over warm caches.
+ *
+ *  At each hit, the direct lighting is estimated and the path continues along one sampled specular
+ *  or glossy direction.  Single scattering in participating media is not supported.
+ */
+
+#ifndef LIAR_GUARDIAN_OF_INCLUSION_TRACERS_WAVEFRONT_TRACER_H
+#define LIAR_GUARDIAN_OF_INCLUSION_TRACERS_WAVEFRONT_TRACER_H
+
+#include "tracers_common.h"
+#include "../kernel/ray_tracer.h"
+
+namespace liar
+{
+namespace tracers
+{
+
+class LIAR_TRACERS_DLL WavefrontTracer: public RayTracer
+{
+	PY_HEADER(RayTracer)
+public:
+
+	WavefrontTracer();
+
+	void setBatchSize(size_t batchSize);
+
+	bool traceGlossy() const;
+	void setTraceGlossy(bool traceGlossy);
+
+private:
+
+	typedef std::conditional_t<sizeof(TScalar) >= 8, std::mt19937_64, std::mt19937> TRandom;
+	typedef UniformRealDistribution<TNumTraits::baseType> TUniformRealDistribution;
+
+	typedef std::vector<size_t> TIndices;
+	typedef std::vector<DifferentialRay> TRays;
+	typedef std::vector<Spectral> TSpectra;
+	typedef std::vector<MediumStack> TMediumStacks;
+	typedef std::vector<Intersection> TIntersections;
+	typedef std::vector<IntersectionContext> TContexts;
+
+	enum PathFlags
+	{
+		pfCamera = 0x01, // path hasn't scattered yet, so it still determines depth and alpha
+		pfHighQuality = 0x02,
+	};
+
+	void doRequestSamples(const TSamplerPtr& sampler) override;
+	void doPreProcess(const kernel::TSamplerPtr& sampler, const TimePeriod& period, size_t numberOfThreads) override;
+	const Spectral doCastRay(const Sample& sample, const DifferentialRay& primaryRay, TScalar& tIntersection, TScalar& alpha, size_t generation, bool highQuality) const override;
+	void doCastRays(const Sample* samples, const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas,
+		size_t count, size_t generation, bool highQuality) const override;
+	size_t doBatchSize() const override;
+	const TRayTracerPtr doClone() const override;
+	void doSeed(num::Tuint32 seed) override;
+
+	const TPyObjectPtr doGetState() const override;
+	void doSetState(const TPyObjectPtr& state) override;
+
+	void generate(const DifferentialRay* primaryRays, Spectral* radiances, TScalar* tIntersections, TScalar* alphas, size_t count, bool highQuality) const;
+	void intersect(const Sample* samples, bool isPrimary) const;
+	void shade(const Sample* samples, Spectral* radiances, TScalar* tIntersections, TScalar* alphas, size_t generation) const;
+	void shadeSurface(const Sample& sample, size_t path, const IntersectionContext& context, Spectral& radiance, size_t generation) const;
+	void gatherDirect(const Sample& sample, size_t path, const IntersectionContext& context, const TBsdfPtr& bsdf,
+		const TPoint3D& point, const TVector3D& normal, const TVector3D& omega) const;
+	void shadow(const Sample* samples, Spectral* radiances) const;
+	const MediumStack& pathMedium(size_t path) const;
+	void changePathMedium(size_t path, const IntersectionContext& context) const;
+
+	TScalar uniform() const;
+
+	// path state, one entry per ray of the batch
+	mutable TRays rays_;
+	mutable TSpectra throughputs_;
+	mutable TIndices media_; // 0 if the path is still in mediumStack(), otherwise 1 + its index in changedMedia_
+	mutable TMediumStacks changedMedia_;
+	mutable TIntersections intersections_;
+	mutable std::vector<num::Tuint8> flags_;
+
+	// work queues, by path index
+	mutable TIndices active_;
+	mutable TIndices next_;
+	mutable TIndices hits_;
+	mutable TContexts contexts_;
+	mutable TIndices order_;
+	mutable std::vector<BoundedRay> centralRays_;
+
+	// shadow rays of all hits of the current bounce
+	mutable TShadowRays shadowRayQueue_;
+	mutable TShadowContributions shadowContributionQueue_;
+	mutable TIndices shadowOwnerQueue_;
+
+	mutable TRandom random_;
+	size_t batchSize_;
+	bool traceGlossy_;
+};
+
+}
+
+}
+
+#endif
+
+// EOF
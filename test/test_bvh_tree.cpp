@@ -0,0 +1,293 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <liar/kernel/bvh_tree.h>
+#include <lass/spat/default_object_traits.h>
+#include <lass/spat/qbvh_tree.h>
+#include <lass/spat/split_heuristics.h>
+
+#include <random>
+#include <vector>
+
+using namespace liar;
+using namespace liar::kernel;
+
+namespace
+{
+
+struct Triangle
+{
+	TPoint3D vertices[3];
+};
+
+typedef std::vector<Triangle> TTriangles;
+
+/** Both trees use the same intersection test, so they must find exactly the same hits.
+ */
+struct TriangleTraits: lass::spat::DefaultObjectTraits<Triangle, TAabb3D, TRay3D, TTriangles::const_iterator>
+{
+	static const TAabb objectAabb(TObjectIterator triangle)
+	{
+		TAabb3D result;
+		for (const TPoint3D& vertex : triangle->vertices)
+		{
+			result += vertex;
+		}
+		return result;
+	}
+
+	static bool objectIntersect(TObjectIterator triangle, const TRay& ray, TReference t, TParam tMin, const TInfo*)
+	{
+		const TVector3D edge1 = triangle->vertices[1] - triangle->vertices[0];
+		const TVector3D edge2 = triangle->vertices[2] - triangle->vertices[0];
+		const TVector3D p = cross(ray.direction(), edge2);
+		const TScalar det = dot(edge1, p);
+		if (det == 0)
+		{
+			return false;
+		}
+		const TVector3D s = ray.support() - triangle->vertices[0];
+		const TScalar u = dot(s, p) / det;
+		const TVector3D q = cross(s, edge1);
+		const TScalar v = dot(ray.direction(), q) / det;
+		const TScalar tCandidate = dot(edge2, q) / det;
+		if (u < 0 || v < 0 || u + v > 1 || !(tCandidate > tMin))
+		{
+			return false;
+		}
+		t = tCandidate;
+		return true;
+	}
+
+	static bool objectIntersects(TObjectIterator triangle, const TRay& ray, TParam tMin, TParam tMax, const TInfo* info)
+	{
+		TScalar t;
+		return objectIntersect(triangle, ray, t, tMin, info) && t < tMax;
+	}
+};
+
+typedef BvhTree<Triangle, TriangleTraits, lass::spat::SAHSplitHeuristics> TBvhTree;
+typedef lass::spat::QbvhTree<Triangle, TriangleTraits, lass::spat::SAHSplitHeuristics> TQbvhTree;
+
+typedef std::mt19937 TRandom;
+
+/** small triangles scattered in a box of 100 units.
+ */
+TTriangles randomTriangles(size_t count, TRandom& random)
+{
+	std::uniform_real_distribution<TScalar> position(0, 100);
+	std::uniform_real_distribution<TScalar> offset(-2, 2);
+	TTriangles triangles(count);
+	for (Triangle& triangle : triangles)
+	{
+		const TPoint3D center(position(random), position(random), position(random));
+		for (TPoint3D& vertex : triangle.vertices)
+		{
+			vertex = center + TVector3D(offset(random), offset(random), offset(random));
+		}
+	}
+	return triangles;
+}
+
+TRay3D randomRay(TRandom& random, const TPoint3D& origin, TScalar spread)
+{
+	std::uniform_real_distribution<TScalar> position(-spread, spread);
+	std::uniform_real_distribution<TScalar> direction(-1, 1);
+	return TRay3D(
+		origin + TVector3D(position(random), position(random), position(random)),
+		TVector3D(direction(random), direction(random), direction(random)));
+}
+
+/** builds the tree with a given number of threads, and restores the number of threads afterwards.
+ */
+class BuildThreads
+{
+public:
+	explicit BuildThreads(size_t number): old_(BvhTreeBase::numberOfBuildThreads())
+	{
+		BvhTreeBase::setNumberOfBuildThreads(number);
+	}
+	~BuildThreads()
+	{
+		BvhTreeBase::setNumberOfBuildThreads(old_);
+	}
+private:
+	size_t old_;
+};
+
+}
+
+
+
+TEST(BvhTree, IntersectLikeQbvhTree)
+{
+	TRandom random(42);
+	const TTriangles triangles = randomTriangles(50000, random);
+
+	const BuildThreads threads(4); // enough objects to build in parallel chunks and tasks.
+	const TBvhTree bvh(triangles.begin(), triangles.end());
+	const TQbvhTree qbvh(triangles.begin(), triangles.end());
+
+	std::uniform_real_distribution<TScalar> limit(0, 50);
+	size_t numHits = 0;
+	for (size_t k = 0; k < 2000; ++k)
+	{
+		const TRay3D ray = randomRay(random, TPoint3D(50, 50, 50), 60);
+		const TScalar tMin = limit(random);
+
+		TScalar tBvh = 0;
+		TScalar tQbvh = 0;
+		const bool isBvhHit = bvh.intersect(ray, tBvh, tMin) != bvh.end();
+		const bool isQbvhHit = qbvh.intersect(ray, tQbvh, tMin) != qbvh.end();
+		ASSERT_EQ(isBvhHit, isQbvhHit);
+		if (isBvhHit)
+		{
+			EXPECT_EQ(tBvh, tQbvh);
+			++numHits;
+		}
+
+		const TScalar tMax = tMin + limit(random);
+		EXPECT_EQ(bvh.intersects(ray, tMin, tMax), qbvh.intersects(ray, tMin, tMax));
+	}
+	EXPECT_GT(numHits, 100u);
+}
+
+
+
+TEST(BvhTree, IntersectPacketLikeSingleRays)
+{
+	TRandom random(7);
+	const TTriangles triangles = randomTriangles(10000, random);
+	const TBvhTree bvh(triangles.begin(), triangles.end());
+
+	const size_t packetSize = TBvhTree::packetSize;
+	std::uniform_real_distribution<TScalar> position(0, 100);
+	for (size_t k = 0; k < 500; ++k)
+	{
+		// coherent packets with a common origin region, of all sizes up to packetSize.
+		const size_t count = k % packetSize + 1;
+		const TPoint3D origin(position(random), position(random), position(random));
+		TRay3D rays[packetSize];
+		TScalar tMin[packetSize];
+		TScalar tNearest[packetSize];
+		for (size_t i = 0; i < count; ++i)
+		{
+			rays[i] = randomRay(random, origin, 1);
+			tMin[i] = 0;
+			tNearest[i] = TNumTraits::infinity;
+		}
+
+		const TBvhTree::TMask hits = bvh.intersectPacketLeaves(rays, count, tMin, tNearest,
+			[&](size_t first, size_t numObjects, TBvhTree::TMask mask, TScalar* tLeaf)
+		{
+			TBvhTree::TMask found = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!((mask >> i) & 1))
+				{
+					continue;
+				}
+				for (size_t j = first; j < first + numObjects; ++j)
+				{
+					TScalar t;
+					if (TriangleTraits::objectIntersect(bvh.object(j), rays[i], t, tMin[i], nullptr) && t < tLeaf[i])
+					{
+						tLeaf[i] = t;
+						found |= TBvhTree::TMask(1) << i;
+					}
+				}
+			}
+			return found;
+		});
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			TScalar t = 0;
+			const bool isHit = bvh.intersect(rays[i], t, tMin[i]) != bvh.end();
+			ASSERT_EQ(isHit, ((hits >> i) & 1) != 0);
+			if (isHit)
+			{
+				EXPECT_EQ(t, tNearest[i]);
+			}
+		}
+	}
+}
+
+
+
+TEST(BvhTree, IntersectsPacketLikeSingleRays)
+{
+	TRandom random(11);
+	const TTriangles triangles = randomTriangles(10000, random);
+	const TBvhTree bvh(triangles.begin(), triangles.end());
+
+	const size_t packetSize = TBvhTree::packetSize;
+	std::uniform_real_distribution<TScalar> position(0, 100);
+	std::uniform_real_distribution<TScalar> limit(0, 50);
+	for (size_t k = 0; k < 500; ++k)
+	{
+		const size_t count = k % packetSize + 1;
+		const TPoint3D origin(position(random), position(random), position(random));
+		TRay3D rays[packetSize];
+		TScalar tMin[packetSize];
+		TScalar tMax[packetSize];
+		for (size_t i = 0; i < count; ++i)
+		{
+			rays[i] = randomRay(random, origin, 1);
+			tMin[i] = 0;
+			tMax[i] = limit(random);
+		}
+
+		const TBvhTree::TMask hits = bvh.intersectsPacketLeaves(rays, count, tMin, tMax,
+			[&](size_t first, size_t numObjects, TBvhTree::TMask mask)
+		{
+			TBvhTree::TMask found = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!((mask >> i) & 1))
+				{
+					continue;
+				}
+				for (size_t j = first; j < first + numObjects; ++j)
+				{
+					if (TriangleTraits::objectIntersects(bvh.object(j), rays[i], tMin[i], tMax[i], nullptr))
+					{
+						found |= TBvhTree::TMask(1) << i;
+						break;
+					}
+				}
+			}
+			return found;
+		});
+
+		EXPECT_EQ(hits >> count, 0u);
+		for (size_t i = 0; i < count; ++i)
+		{
+			EXPECT_EQ(bvh.intersects(rays[i], tMin[i], tMax[i]), ((hits >> i) & 1) != 0);
+		}
+	}
+}
+
+// EOF
@@ -0,0 +1,159 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <liar/tracers/irradiance_cache.h>
+
+#include <functional>
+#include <vector>
+
+using namespace liar;
+using namespace liar::tracers;
+
+namespace
+{
+
+/** radiance seen from a point in a direction, and the distance to where it's seen.
+ */
+typedef std::function<XYZ (const TPoint3D&, const TVector3D&, TScalar&)> TScene;
+
+/** an emitter plane at z = 1 with smoothly varying radiance, seen from below.
+ */
+XYZ emitterPlane(const TPoint3D& point, const TVector3D& direction, TScalar& distance)
+{
+	if (direction.z <= 0)
+	{
+		distance = TNumTraits::infinity;
+		return XYZ();
+	}
+	distance = (1 - point.z) / direction.z;
+	const TPoint3D hit = point + distance * direction;
+	return XYZ(
+		static_cast<XYZ::TValue>(1 + 0.5 * num::sin(hit.x)),
+		static_cast<XYZ::TValue>(1 + 0.3 * num::cos(2 * hit.y)),
+		static_cast<XYZ::TValue>(1 + 0.2 * num::sin(hit.x + hit.y)));
+}
+
+/** an environment at infinity with smoothly varying radiance.
+ */
+XYZ environment(const TPoint3D&, const TVector3D& direction, TScalar& distance)
+{
+	distance = TNumTraits::infinity;
+	return XYZ(
+		static_cast<XYZ::TValue>(1 + 0.5 * direction.x),
+		static_cast<XYZ::TValue>(1 + 0.5 * direction.y + 0.3 * direction.z),
+		static_cast<XYZ::TValue>(1 + 0.5 * direction.x * direction.y));
+}
+
+/** gathers a record at the centers of the cells, like PhotonMapper does with jittered rays.
+ */
+IrradianceCache::Record gather(const TScene& scene, const TPoint3D& point, const TVector3D& tangent, const TVector3D& bitangent,
+	size_t numTheta, size_t numPhi)
+{
+	const TVector3D normal = cross(tangent, bitangent);
+	std::vector<XYZ> radiances(numTheta * numPhi);
+	std::vector<TScalar> distances(numTheta * numPhi);
+	for (size_t j = 0; j < numTheta; ++j)
+	{
+		for (size_t k = 0; k < numPhi; ++k)
+		{
+			const TScalar sinTheta = num::sqrt((static_cast<TScalar>(j) + 0.5_s) / static_cast<TScalar>(numTheta));
+			const TScalar cosTheta = num::sqrt(1 - num::sqr(sinTheta));
+			const TScalar phi = (static_cast<TScalar>(k) + 0.5_s) * 2 * TNumTraits::pi / static_cast<TScalar>(numPhi);
+			const TVector3D direction = tangent * (sinTheta * num::cos(phi)) + bitangent * (sinTheta * num::sin(phi)) + normal * cosTheta;
+			const size_t i = j * numPhi + k;
+			radiances[i] = scene(point, direction, distances[i]);
+		}
+	}
+	IrradianceCache::Record record;
+	IrradianceCache::integrate(&radiances[0], &distances[0], numTheta, numPhi, tangent, bitangent, record);
+	return record;
+}
+
+const XYZ irradiance(const TScene& scene, const TPoint3D& point, const TVector3D& tangent, const TVector3D& bitangent)
+{
+	return gather(scene, point, tangent, bitangent, 200, 628).irradiance;
+}
+
+TScalar component(const XYZ& xyz, size_t k)
+{
+	return static_cast<TScalar>(k == 0 ? xyz.x : (k == 1 ? xyz.y : xyz.z));
+}
+
+/** rotates @a v by @a angle around the unit vector @a axis.
+ */
+const TVector3D rotate(const TVector3D& v, const TVector3D& axis, TScalar angle)
+{
+	return v * num::cos(angle) + cross(axis, v) * num::sin(angle) + axis * (dot(axis, v) * (1 - num::cos(angle)));
+}
+
+}
+
+
+
+TEST(IrradianceCache, TranslationalGradientLikeFiniteDifferences)
+{
+	const TPoint3D point(0.3_s, -0.2_s, 0);
+	const TVector3D tangent(1, 0, 0);
+	const TVector3D bitangent(0, 1, 0);
+	const IrradianceCache::Record record = gather(emitterPlane, point, tangent, bitangent, 30, 94);
+
+	const TScalar h = 0.02_s;
+	for (const TVector3D& offset : { tangent, bitangent, (tangent + bitangent).normal() })
+	{
+		const XYZ finiteDifference = (irradiance(emitterPlane, point + h * offset, tangent, bitangent)
+			- irradiance(emitterPlane, point - h * offset, tangent, bitangent)) / static_cast<XYZ::TValue>(2 * h);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const TScalar expected = component(finiteDifference, k);
+			EXPECT_NEAR(dot(offset, record.translationalGradient[k]), expected, 0.05 * num::abs(expected) + 0.01) << offset << " " << k;
+		}
+	}
+}
+
+
+
+TEST(IrradianceCache, RotationalGradientLikeFiniteDifferences)
+{
+	const TPoint3D point(0, 0, 0);
+	const TVector3D tangent = TVector3D(1, 1, 0).normal();
+	const TVector3D bitangent = TVector3D(-1, 1, 1).normal();
+	const TVector3D normal = cross(tangent, bitangent);
+	const IrradianceCache::Record record = gather(environment, point, tangent, bitangent, 30, 94);
+
+	// rotating the normal by an angle around an axis in the tangent plane.
+	const TScalar angle = 0.02_s;
+	for (const TVector3D& axis : { tangent, bitangent, (tangent - bitangent).normal() })
+	{
+		const XYZ finiteDifference = (
+			irradiance(environment, point, rotate(tangent, axis, angle), rotate(bitangent, axis, angle)) -
+			irradiance(environment, point, rotate(tangent, axis, -angle), rotate(bitangent, axis, -angle))) / static_cast<XYZ::TValue>(2 * angle);
+		ASSERT_NEAR(dot(axis, normal), 0, 1e-6);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const TScalar expected = component(finiteDifference, k);
+			EXPECT_NEAR(dot(axis, record.rotationalGradient[k]), expected, 0.05 * num::abs(expected) + 0.01) << axis << " " << k;
+		}
+	}
+}
@@ -0,0 +1,104 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <liar/tracers/photon_encoding.h>
+
+#include <random>
+
+using namespace liar;
+using namespace liar::tracers;
+
+namespace
+{
+
+typedef std::mt19937 TRandom;
+
+TScalar angle(const TVector3D& a, const TVector3D& b)
+{
+	return num::atan2(cross(a, b).norm(), dot(a, b));
+}
+
+void testDirection(const TVector3D& omega)
+{
+	const TVector3D decoded = decodePhotonDirection(encodePhotonDirection(omega));
+	EXPECT_NEAR(decoded.norm(), 1, 1e-6);
+	EXPECT_LE(angle(decoded, omega), 7e-5) << omega;
+}
+
+}
+
+
+
+TEST(PhotonEncoding, DirectionRoundTrip)
+{
+	// the poles, the equator and the seams of the folded octahedron.
+	for (TScalar x : { -1, 0, 1 })
+	{
+		for (TScalar y : { -1, 0, 1 })
+		{
+			for (TScalar z : { -1, 0, 1 })
+			{
+				if (x != 0 || y != 0 || z != 0)
+				{
+					testDirection(TVector3D(x, y, z).normal());
+				}
+			}
+		}
+	}
+
+	TRandom random(42);
+	std::normal_distribution<TScalar> normal;
+	for (size_t k = 0; k < 100000; ++k)
+	{
+		testDirection(TVector3D(normal(random), normal(random), normal(random)).normal());
+	}
+}
+
+
+
+TEST(PhotonEncoding, PowerRoundTrip)
+{
+	EXPECT_EQ(decodePhotonPower(encodePhotonPower(XYZ(0, 0, 0))), XYZ(0, 0, 0));
+	EXPECT_EQ(decodePhotonPower(encodePhotonPower(XYZ(-1, 0, 0))), XYZ(0, 0, 0));
+
+	// each component is within 0.4% of the largest one, rounded to 8 bits of mantissa.
+	TRandom random(42);
+	std::uniform_real_distribution<XYZ::TValue> unit(0, 1);
+	std::uniform_int_distribution<int> exponent(-60, 60);
+	for (size_t k = 0; k < 100000; ++k)
+	{
+		const XYZ::TValue scale = std::ldexp(XYZ::TValue(1), exponent(random));
+		const XYZ power(unit(random) * scale, unit(random) * scale, (k % 10 == 0 ? 0 : unit(random)) * scale);
+		const XYZ decoded = decodePhotonPower(encodePhotonPower(power));
+		const XYZ::TValue maximum = std::max(std::max(power.x, power.y), power.z);
+		EXPECT_NEAR(decoded.x, power.x, 4e-3 * maximum);
+		EXPECT_NEAR(decoded.y, power.y, 4e-3 * maximum);
+		EXPECT_NEAR(decoded.z, power.z, 4e-3 * maximum);
+		if (power.z == 0)
+		{
+			EXPECT_EQ(decoded.z, 0);
+		}
+	}
+}
@@ -0,0 +1,185 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <liar/tracers/photon_map.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace liar;
+using namespace liar::tracers;
+
+namespace
+{
+
+typedef lass::prim::Point3D<float> TPointF;
+typedef std::vector<TPointF> TPoints;
+
+struct PointTraits
+{
+	typedef TPoints::const_iterator TObjectIterator;
+	typedef TPoints::const_reference TObjectReference;
+	typedef TPointF TPoint;
+	typedef TPoint::TValue TValue;
+	typedef TPoint::TParam TParam;
+	typedef TPoint::TReference TReference;
+	typedef TPoint::TConstReference TConstReference;
+	enum { dimension = TPoint::dimension };
+
+	static const TPoint& position(TObjectIterator object) { return *object; }
+};
+
+typedef lass::spat::KdTree<TPointF, PointTraits> TKdTree;
+typedef BucketKdTree<TPointF, PointTraits> TBucketKdTree;
+typedef TKdTree::Neighbour TNeighbour;
+typedef std::vector<TNeighbour> TNeighbourhood;
+
+typedef std::mt19937 TRandom;
+
+/** points clustered around a few centers, like photons on surfaces, plus uniform ones.
+ */
+TPoints randomPoints(size_t count, TRandom& random)
+{
+	std::uniform_real_distribution<float> uniform(0, 100);
+	std::normal_distribution<float> normal(0, 2);
+	TPoints centers(10);
+	for (TPointF& center : centers)
+	{
+		center = TPointF(uniform(random), uniform(random), uniform(random));
+	}
+	TPoints points(count);
+	for (size_t k = 0; k < count; ++k)
+	{
+		if (k % 2)
+		{
+			points[k] = TPointF(uniform(random), uniform(random), uniform(random));
+		}
+		else
+		{
+			const TPointF& center = centers[k % centers.size()];
+			points[k] = TPointF(center.x + normal(random), center.y + normal(random), center.z + normal(random));
+		}
+	}
+	return points;
+}
+
+/** the neighbours, nearest first.
+ */
+TNeighbourhood sorted(TNeighbourhood::iterator first, TNeighbourhood::iterator last)
+{
+	TNeighbourhood result(first, last);
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+void testLikeKdTree(size_t numPoints, size_t numThreads)
+{
+	TRandom random(static_cast<TRandom::result_type>(numPoints));
+	const TPoints points = randomPoints(numPoints, random);
+	TKdTree kdTree(points.begin(), points.end());
+	TBucketKdTree bucketTree;
+	bucketTree.reset(points.begin(), points.end(), numThreads);
+	ASSERT_EQ(bucketTree.end(), points.end());
+
+	std::uniform_real_distribution<float> position(-10, 110);
+	std::uniform_real_distribution<float> radius(0, 10);
+	std::uniform_int_distribution<size_t> count(1, 200);
+	TNeighbourhood expected(201);
+	TNeighbourhood result(201);
+	for (size_t k = 0; k < 1000; ++k)
+	{
+		const TPointF target(position(random), position(random), position(random));
+		const float maxRadius = radius(random);
+		const size_t maxCount = count(random);
+
+		const TNeighbourhood::iterator lastExpected = kdTree.rangeSearch(target, maxRadius, maxCount, expected.begin());
+		const TNeighbourhood::iterator last = bucketTree.rangeSearch(target, maxRadius, maxCount, result.begin());
+		ASSERT_EQ(last - result.begin(), lastExpected - expected.begin());
+		if (last != result.begin())
+		{
+			// like spat::KdTree, the farthest neighbour is in front.
+			EXPECT_EQ(result.front().squaredDistance(), std::max_element(result.begin(), last)->squaredDistance());
+		}
+		const TNeighbourhood sortedExpected = sorted(expected.begin(), lastExpected);
+		const TNeighbourhood sortedResult = sorted(result.begin(), last);
+		for (size_t i = 0; i < sortedResult.size(); ++i)
+		{
+			EXPECT_EQ(sortedResult[i].object(), sortedExpected[i].object());
+			EXPECT_FLOAT_EQ(sortedResult[i].squaredDistance(), sortedExpected[i].squaredDistance());
+		}
+
+		const TNeighbour nearestExpected = kdTree.nearestNeighbour(target, maxRadius);
+		const TNeighbour nearest = bucketTree.nearestNeighbour(target, maxRadius);
+		if (nearestExpected.object() == points.end())
+		{
+			EXPECT_EQ(nearest.object(), points.end());
+		}
+		else
+		{
+			EXPECT_EQ(nearest.object(), nearestExpected.object());
+			EXPECT_FLOAT_EQ(nearest.squaredDistance(), nearestExpected.squaredDistance());
+		}
+	}
+}
+
+}
+
+
+
+TEST(BucketKdTree, RangeSearchLikeKdTree)
+{
+	testLikeKdTree(10000, 1);
+}
+
+
+
+TEST(BucketKdTree, RangeSearchLikeKdTreeUnevenBuckets)
+{
+	// too few points to fill the last lanes of all buckets.
+	testLikeKdTree(1001, 1);
+	testLikeKdTree(TBucketKdTree::bucketSize - 1, 1);
+}
+
+
+
+TEST(BucketKdTree, RangeSearchLikeKdTreeBuiltInParallel)
+{
+	// enough points to build in parallel tasks.
+	testLikeKdTree(200000, 4);
+}
+
+
+
+TEST(BucketKdTree, Empty)
+{
+	const TPoints points;
+	TBucketKdTree bucketTree;
+	bucketTree.reset(points.begin(), points.end());
+	EXPECT_TRUE(bucketTree.isEmpty());
+	TNeighbourhood result(2);
+	EXPECT_EQ(bucketTree.rangeSearch(TPointF(0, 0, 0), 1, 1, result.begin()), result.begin());
+	EXPECT_EQ(bucketTree.nearestNeighbour(TPointF(0, 0, 0), 1).object(), points.end());
+}
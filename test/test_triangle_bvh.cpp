@@ -0,0 +1,135 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <liar/scenery/triangle_bvh.h>
+
+#include <random>
+#include <vector>
+
+using namespace liar;
+using namespace liar::scenery;
+
+namespace
+{
+
+typedef TriangleBvh::TMesh TMesh;
+typedef std::mt19937 TRandom;
+
+/** small triangles scattered in a box of 100 units, far from the origin, so that the conversion
+ *  to single precision is a lot coarser than the triangles themselves.
+ */
+TMesh randomMesh(size_t count, const TPoint3D& corner, TRandom& random)
+{
+	std::uniform_real_distribution<TScalar> position(0, 100);
+	std::uniform_real_distribution<TScalar> offset(-2, 2);
+	std::vector<TMesh::TPoint> vertices;
+	std::vector<TMesh::TIndexTriangle> triangles(count);
+	for (TMesh::TIndexTriangle& triangle : triangles)
+	{
+		const TVector3D center(position(random), position(random), position(random));
+		for (size_t k = 0; k < 3; ++k)
+		{
+			triangle.vertices[k] = vertices.size();
+			triangle.normals[k] = TMesh::TIndexTriangle::null();
+			triangle.uvs[k] = TMesh::TIndexTriangle::null();
+			vertices.push_back(corner + center + TVector3D(offset(random), offset(random), offset(random)));
+		}
+	}
+	return TMesh(vertices, TMesh::TNormals(), std::vector<TMesh::TUv>(), triangles);
+}
+
+/** A ray from somewhere in the box, aimed at a point of a random triangle.  Half of them are aimed
+ *  at an edge, where the single precision test is most likely to disagree with the full one.
+ */
+TRay3D randomRay(const TMesh& mesh, const TPoint3D& corner, TRandom& random)
+{
+	std::uniform_real_distribution<TScalar> position(0, 100);
+	std::uniform_real_distribution<TScalar> unit(0, 1);
+	std::uniform_int_distribution<size_t> index(0, mesh.triangles().size() - 1);
+	const TMesh::TTriangle& triangle = mesh.triangles()[index(random)];
+
+	TScalar u = unit(random);
+	TScalar v = unit(random) * (1 - u);
+	if (random() % 2)
+	{
+		v = 0;
+	}
+	const TPoint3D& a = *triangle.vertices[0];
+	const TPoint3D target = a + u * (*triangle.vertices[1] - a) + v * (*triangle.vertices[2] - a);
+	const TPoint3D origin = corner + TVector3D(position(random), position(random), position(random));
+	return TRay3D(origin, target - origin);
+}
+
+/** the nearest hit of the full precision test, over all triangles.
+ */
+bool bruteForce(const TMesh& mesh, const TRay3D& ray, TScalar& t, TScalar tMin)
+{
+	bool hit = false;
+	for (const TMesh::TTriangle& triangle : mesh.triangles())
+	{
+		TScalar tCandidate;
+		if (triangle.intersect(ray, tCandidate, tMin, nullptr) == prim::rOne && (!hit || tCandidate < t))
+		{
+			t = tCandidate;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+}
+
+
+
+TEST(TriangleBvh, IntersectFarFromOriginLikeFullPrecision)
+{
+	TRandom random(42);
+	const TPoint3D corner(30000, -50000, 70000);
+	const TMesh mesh = randomMesh(2000, corner, random);
+	TriangleBvh bvh;
+	bvh.reset(mesh);
+
+	const TMesh::TFilter noFilter;
+	size_t numHits = 0;
+	for (size_t k = 0; k < 5000; ++k)
+	{
+		const TRay3D ray = randomRay(mesh, corner, random);
+
+		TScalar tExpected = 0;
+		const bool isExpectedHit = bruteForce(mesh, ray, tExpected, 0);
+
+		TMesh::TTriangleIterator triangle;
+		TScalar t = 0;
+		const bool isHit = bvh.intersect(ray, triangle, t, 0, noFilter) == prim::rOne;
+		ASSERT_EQ(isHit, isExpectedHit);
+		if (isHit)
+		{
+			EXPECT_EQ(t, tExpected);
+			EXPECT_TRUE(bvh.intersects(ray, 0, tExpected * 2, noFilter));
+			++numHits;
+		}
+	}
+	EXPECT_GT(numHits, 2500u);
+}
@@ -0,0 +1,98 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <lass/python/python_api.h>
+
+namespace
+{
+
+int execute(const char* script)
+{
+	lass::python::LockGIL LASS_UNUSED(lock);
+	return PyRun_SimpleString(script);
+}
+
+bool hasLoadPly()
+{
+	lass::python::LockGIL LASS_UNUSED(lock);
+	const lass::python::TPyObjPtr result = lass::python::evaluate("hasattr(liar.scenery.TriangleMesh, 'loadPly')");
+	return PyObject_IsTrue(result.get()) == 1;
+}
+
+}
+
+
+
+TEST(TriangleMesh, LoadPlyKeepsAllTrianglesOfPolygons)
+{
+	if (!hasLoadPly())
+	{
+		GTEST_SKIP() << "liar is built without happly";
+	}
+	const char* script =
+		"import os, tempfile\n"
+		"import liar\n"
+		"with tempfile.TemporaryDirectory() as tmp:\n"
+		"    path = os.path.join(tmp, 'polygons.ply')\n"
+		"    with open(path, 'w') as f:\n"
+		"        f.write('ply\\nformat ascii 1.0\\n'\n"
+		"            'element vertex 5\\nproperty float x\\nproperty float y\\nproperty float z\\n'\n"
+		"            'element face 2\\nproperty list uchar int vertex_indices\\nend_header\\n'\n"
+		"            '0 0 0\\n1 0 0\\n1 1 0\\n0 1 0\\n2 0 0\\n'\n"
+		"            '4 0 1 2 3\\n3 1 4 2\\n')\n"
+		"    mesh = liar.scenery.TriangleMesh.loadPly(path)\n"
+		"    assert len(mesh.triangles()) == 3, mesh.triangles()\n"
+		;
+	EXPECT_EQ(execute(script), 0);
+}
+
+
+
+TEST(TriangleMesh, LoadPlyRejectsDegenerateFaces)
+{
+	if (!hasLoadPly())
+	{
+		GTEST_SKIP() << "liar is built without happly";
+	}
+	const char* script =
+		"import os, tempfile\n"
+		"import liar\n"
+		"with tempfile.TemporaryDirectory() as tmp:\n"
+		"    path = os.path.join(tmp, 'edge.ply')\n"
+		"    with open(path, 'w') as f:\n"
+		"        f.write('ply\\nformat ascii 1.0\\n'\n"
+		"            'element vertex 3\\nproperty float x\\nproperty float y\\nproperty float z\\n'\n"
+		"            'element face 1\\nproperty list uchar int vertex_indices\\nend_header\\n'\n"
+		"            '0 0 0\\n1 0 0\\n1 1 0\\n'\n"
+		"            '2 0 1\\n')\n"
+		"    try:\n"
+		"        liar.scenery.TriangleMesh.loadPly(path)\n"
+		"    except Exception:\n"
+		"        pass\n"
+		"    else:\n"
+		"        raise AssertionError('a face with two vertices must be rejected')\n"
+		;
+	EXPECT_EQ(execute(script), 0);
+}
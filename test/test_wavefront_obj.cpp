@@ -0,0 +1,61 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <lass/python/python_api.h>
+
+namespace
+{
+
+int execute(const char* script)
+{
+	lass::python::LockGIL LASS_UNUSED(lock);
+	return PyRun_SimpleString(script);
+}
+
+}
+
+
+
+TEST(WavefrontObj, SpecularPowerMap)
+{
+	const char* script =
+		"import os, tempfile\n"
+		"import liar\n"
+		"from liar.tools import wavefront_obj\n"
+		"texture = os.path.join(\"" LASS_STRINGIFY(TEST_SOURCE_DIR) "\", 'colors-srgb.png')\n"
+		"with tempfile.TemporaryDirectory() as tmp:\n"
+		"    mtl = os.path.join(tmp, 'power.mtl')\n"
+		"    with open(mtl, 'w') as f:\n"
+		"        f.write('newmtl shiny\\nNs 10\\nmap_Ns %s\\n' % texture)\n"
+		"    obj = os.path.join(tmp, 'power.obj')\n"
+		"    with open(obj, 'w') as f:\n"
+		"        f.write('mtllib %s\\nv 0 0 0\\nv 1 0 0\\nv 0 1 0\\nusemtl shiny\\nf 1 2 3\\ng\\n' % mtl)\n"
+		"    groups, materials = wavefront_obj.load(obj)\n"
+		"    shiny = materials['shiny']\n"
+		"    assert isinstance(shiny.specularPowerU, liar.textures.Image), shiny.specularPowerU\n"
+		"    assert isinstance(shiny.specularPowerV, liar.textures.Image), shiny.specularPowerV\n"
+		;
+	EXPECT_EQ(execute(script), 0);
+}
@@ -0,0 +1,71 @@
+/** @file
+ *  @author Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  LiAR isn't a raytracer
+ *  Copyright (C) 2026  Bram de Greve (bramz@users.sourceforge.net)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  http://liar.bramz.net/
+ */
+
+#include <gtest/gtest.h>
+
+#include <lass/python/python_api.h>
+
+namespace
+{
+
+int execute(const char* script)
+{
+	lass::python::LockGIL LASS_UNUSED(lock);
+	return PyRun_SimpleString(script);
+}
+
+}
+
+
+
+/** The contexts of the last bounce hold Bsdfs from the arena of the render thread.  They must be
+ *  gone before the next batch resets that arena, and before the engine destroys it.
+ */
+TEST(WavefrontTracer, ConsecutiveBatchesAndTeardown)
+{
+	const char* script =
+		"import os, tempfile\n"
+		"import liar\n"
+		"from liar import cameras, output, samplers, scenery, shaders, textures, tracers\n"
+		"sphere = scenery.Sphere((0, 0, 0), 1)\n"
+		"sphere.shader = shaders.Lambert(textures.Constant(0.5))\n"
+		"sky = scenery.LightSky(textures.Constant(1))\n"
+		"camera = cameras.PerspectiveCamera()\n"
+		"camera.position = (0, -5, 0)\n"
+		"camera.lookAt((0, 0, 0))\n"
+		"tracer = tracers.WavefrontTracer()\n"
+		"tracer.batchSize = 16\n"
+		"with tempfile.TemporaryDirectory() as tmp:\n"
+		"    engine = liar.RenderEngine()\n"
+		"    engine.numberOfThreads = 2\n"
+		"    engine.tracer = tracer\n"
+		"    engine.sampler = samplers.Stratifier((16, 16), 1)\n"
+		"    engine.camera = camera\n"
+		"    engine.scene = scenery.List([sphere, sky])\n"
+		"    engine.target = output.Image(os.path.join(tmp, 'wavefront.hdr'), (16, 16))\n"
+		"    engine.render()\n"
+		"    engine.render()\n"
+		"    del engine\n"
+		;
+	EXPECT_EQ(execute(script), 0);
+}